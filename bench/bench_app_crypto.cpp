@@ -0,0 +1,120 @@
+// App-layer payload encryption throughput: AES-256-GCM vs ChaCha20-Poly1305.
+//
+//   urpc_bench_app_crypto [min_seconds_per_case]
+//
+// Prints one row per (cipher, payload size) with seal and open throughput.
+// Run it on the target machine: AES-GCM wins by a wide margin with AES-NI /
+// ARMv8 crypto extensions and loses to ChaCha20 without them.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <openssl/rand.h>
+
+#include <urpc/crypto/AppCrypto.h>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Result
+    {
+        double seal_mib_s{0};
+        double open_mib_s{0};
+        bool ok{true};
+    };
+
+    template <typename F>
+    double run_for(double min_seconds, std::size_t bytes_per_op, F&& op)
+    {
+        std::size_t iters = 0;
+        const auto start = Clock::now();
+        double elapsed = 0;
+        do
+        {
+            for (int i = 0; i < 16; ++i)
+                op();
+            iters += 16;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        while (elapsed < min_seconds);
+
+        return (static_cast<double>(iters) * bytes_per_op) /
+            (1024.0 * 1024.0) / elapsed;
+    }
+
+    Result bench_one(urpc::AppCipherSuite suite,
+                     std::size_t size,
+                     double min_seconds)
+    {
+        urpc::AppCipherContext ctx;
+        ctx.suite = suite;
+        ctx.valid = true;
+        RAND_bytes(ctx.key.data(), static_cast<int>(ctx.key.size()));
+
+        std::vector<uint8_t> plain(size);
+        if (size)
+            RAND_bytes(plain.data(), static_cast<int>(size));
+
+        std::vector<uint8_t> sealed;
+        std::vector<uint8_t> opened;
+
+        Result r;
+        if (!urpc::app_encrypt(ctx, plain, sealed) ||
+            !urpc::app_decrypt(ctx, sealed, opened) ||
+            opened != plain)
+        {
+            r.ok = false;
+            return r;
+        }
+
+        r.seal_mib_s = run_for(min_seconds, size, [&]
+        {
+            urpc::app_encrypt(ctx, plain, sealed);
+        });
+        r.open_mib_s = run_for(min_seconds, size, [&]
+        {
+            urpc::app_decrypt(ctx, sealed, opened);
+        });
+        return r;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const double min_seconds = argc > 1 ? std::atof(argv[1]) : 0.5;
+
+    const std::size_t sizes[] = {
+        64, 512, 4 * 1024, 16 * 1024, 64 * 1024,
+        256 * 1024, 1024 * 1024, 16 * 1024 * 1024,
+    };
+    const urpc::AppCipherSuite suites[] = {
+        urpc::AppCipherSuite::Aes256Gcm,
+        urpc::AppCipherSuite::ChaCha20Poly1305,
+    };
+
+    std::printf("%-18s %10s %14s %14s\n",
+                "cipher", "bytes", "seal MiB/s", "open MiB/s");
+
+    int rc = 0;
+    for (auto suite : suites)
+    {
+        for (std::size_t size : sizes)
+        {
+            const Result r = bench_one(suite, size, min_seconds);
+            if (!r.ok)
+            {
+                std::printf("%-18s %10zu   round-trip FAILED\n",
+                            urpc::app_cipher_name(suite), size);
+                rc = 1;
+                continue;
+            }
+            std::printf("%-18s %10zu %14.1f %14.1f\n",
+                        urpc::app_cipher_name(suite), size,
+                        r.seal_mib_s, r.open_mib_s);
+        }
+    }
+    return rc;
+}
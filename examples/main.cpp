@@ -160,9 +160,7 @@ int main() {
 
     ulog::info("SERVER: System.Shutdown handler registered");
 
-    uvent.for_each_thread([&](int threadIndex, thread::ThreadLocalStorage *) {
-        system::co_spawn_static(server.run_async(), threadIndex);
-    });
+    server.attach(uvent);
     ulog::info("SERVER: accept_loop spawned on {} threads, calling uvent.run()",
                kThreads);
 
@@ -0,0 +1,27 @@
+#ifndef URPC_IRPCRESPONSESINK_H
+#define URPC_IRPCRESPONSESINK_H
+
+#include <cstdint>
+#include <span>
+
+#include <uvent/tasks/Awaitable.h>
+
+namespace urpc
+{
+    // Destination for a response body consumed while it arrives
+    // (RpcClient::try_call_into). write() runs on the client's reader, so
+    // it should hand data on (file, socket) rather than do heavy work; a
+    // slow sink stalls every other call on the connection.
+    struct IRpcResponseSink
+    {
+        // Called with consecutive pieces of the body, in order. The span is
+        // only valid during the call. Returning false aborts the call; the
+        // rest of the body is read and dropped.
+        virtual usub::uvent::task::Awaitable<bool> write(
+            std::span<const uint8_t> chunk) = 0;
+
+        virtual ~IRpcResponseSink() = default;
+    };
+}
+
+#endif // URPC_IRPCRESPONSESINK_H
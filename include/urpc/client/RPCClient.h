@@ -6,7 +6,9 @@
 #define RPCCLIENT_H
 
 #include <atomic>
+#include <chrono>
 #include <memory>
+#include <optional>
 #include <span>
 #include <string>
 #include <string_view>
@@ -22,34 +24,19 @@
 
 #include <ulog/ulog.h>
 
+#include <urpc/client/RPCClientStats.h>
 #include <urpc/config/Config.h>
 #include <urpc/datatypes/Frame.h>
+#include <urpc/datatypes/LoadReport.h>
+#include <urpc/datatypes/PendingCall.h>
+#include <urpc/registry/RPCMethodRegistry.h>
+#include <urpc/registry/RPCTopicRegistry.h>
 #include <urpc/transport/IRPCStream.h>
 #include <urpc/transport/IOOps.h>
 #include <urpc/utils/Hash.h>
 
 namespace urpc
 {
-    struct PendingCall
-    {
-        std::shared_ptr<usub::uvent::sync::AsyncEvent> event;
-        std::vector<uint8_t> response;
-        bool error{false};
-        uint32_t error_code{0};
-        std::string error_message;
-
-        std::atomic<bool> timed_out{false};
-    };
-
-    struct RpcCallResult
-    {
-        bool                 ok{false};
-        bool                 timed_out{false};
-        uint32_t             error_code{0};
-        std::string          error_message;
-        std::vector<uint8_t> response;
-    };
-
     class RpcClient : public std::enable_shared_from_this<RpcClient>
     {
     public:
@@ -120,6 +107,56 @@ namespace urpc
             co_return co_await this->try_call(mid, request_body, timeout_ms);
         }
 
+        // Like try_call, but the response body goes to sink as it arrives
+        // instead of into RpcCallResult::response, so a large download is
+        // never held in memory as a whole. ok means the whole body was
+        // written. Error responses are reported in the result as usual.
+        usub::uvent::task::Awaitable<RpcCallResult> try_call_into(
+            uint64_t method_id,
+            std::span<const uint8_t> request_body,
+            std::shared_ptr<IRpcResponseSink> sink,
+            uint32_t timeout_ms = 0);
+
+        template <size_t N>
+        usub::uvent::task::Awaitable<RpcCallResult> try_call_into(
+            const char (&name)[N],
+            std::span<const uint8_t> request_body,
+            std::shared_ptr<IRpcResponseSink> sink,
+            uint32_t timeout_ms = 0)
+        {
+            uint64_t mid = fnv1a64_rt(std::string_view{name, N - 1});
+            co_return co_await this->try_call_into(
+                mid, request_body, std::move(sink), timeout_ms);
+        }
+
+        // Like try_call, but the request carries key (FLAG_IDEMPOTENCY_KEY).
+        // Pass the same key again when retrying after a timeout or a lost
+        // connection: a server with an idempotency table runs the handler
+        // at most once per key and answers retries with the first response.
+        // key must not be 0; see new_idempotency_key(). The key is agreed
+        // per connection first (one Ping round trip); against a server
+        // that predates keys the call fails without being sent.
+        usub::uvent::task::Awaitable<RpcCallResult> try_call_idempotent(
+            uint64_t method_id,
+            uint64_t key,
+            std::span<const uint8_t> request_body,
+            uint32_t timeout_ms = 0);
+
+        template <size_t N>
+        usub::uvent::task::Awaitable<RpcCallResult> try_call_idempotent(
+            const char (&name)[N],
+            uint64_t key,
+            std::span<const uint8_t> request_body,
+            uint32_t timeout_ms = 0)
+        {
+            uint64_t mid = fnv1a64_rt(std::string_view{name, N - 1});
+            co_return co_await this->try_call_idempotent(
+                mid, key, request_body, timeout_ms);
+        }
+
+        // Random non-zero key for try_call_idempotent.
+        static uint64_t new_idempotency_key();
+
         template <uint64_t MethodId>
         usub::uvent::task::Awaitable<RpcCallResult> try_call_ct(
             std::span<const uint8_t> request_body,
@@ -160,6 +197,84 @@ namespace urpc
             co_return co_await this->async_call(MethodId, request_body);
         }
 
+        // Sends the request and returns at once. The call completes in the
+        // background; collect it with await_call, when_all or when_any. A
+        // failed send still yields a handle whose result carries the error.
+        usub::uvent::task::Awaitable<RpcCallHandle> start_call(
+            uint64_t method_id,
+            std::span<const uint8_t> request_body,
+            uint32_t timeout_ms = 0);
+
+        template <size_t N>
+        usub::uvent::task::Awaitable<RpcCallHandle> start_call(
+            const char (&name)[N],
+            std::span<const uint8_t> request_body,
+            uint32_t timeout_ms = 0)
+        {
+            uint64_t mid = fnv1a64_rt(std::string_view{name, N - 1});
+            co_return co_await this->start_call(mid, request_body, timeout_ms);
+        }
+
+        // A handle's result can be collected once, by await_call or
+        // when_all (copies of the handle included). Later collections
+        // return an error "call result already consumed".
+        usub::uvent::task::Awaitable<RpcCallResult> await_call(
+            const RpcCallHandle& h);
+
+        // Waits for every handle; results are in handle order.
+        usub::uvent::task::Awaitable<std::vector<RpcCallResult>> when_all(
+            std::span<const RpcCallHandle> handles);
+
+        // Waits for the first handle to complete and returns its index.
+        // The others keep running; await or cancel_call them. Null handles
+        // never complete and are skipped; returns handles.size() if there
+        // is no valid handle (including an empty span).
+        usub::uvent::task::Awaitable<std::size_t> when_any(
+            std::span<const RpcCallHandle> handles);
+
+        // Drops a running call and sends a Cancel frame. Its result becomes
+        // error 499 "Cancelled". No-op if the call already completed.
+        usub::uvent::task::Awaitable<void> cancel_call(
+            const RpcCallHandle& h);
+
+        // Raw forwarding used by RpcProxy. The payload is sent as-is (only
+        // app-encrypted when this connection requires it) and the response
+        // payload is handed back in call->raw_payload without decoding.
+        // Only pass-through flags (e.g. FLAG_ONEWAY) are taken from
+        // flags; security flags are recomputed for this connection.
+        usub::uvent::task::Awaitable<RpcCallHandle> start_forward(
+            uint64_t method_id,
+            uint16_t flags,
+            std::span<const uint8_t> payload,
+            uint32_t timeout_ms);
+
+        usub::uvent::task::Awaitable<void> wait_forward(
+            const RpcCallHandle& h);
+
+        // One-way call (FLAG_ONEWAY): the request is written and the
+        // coroutine returns; no PendingCall is registered and the server
+        // sends no Response, not even on error. Returns false only if the
+        // frame could not be written.
+        usub::uvent::task::Awaitable<bool> notify(
+            uint64_t method_id,
+            std::span<const uint8_t> request_body);
+
+        template <size_t N>
+        usub::uvent::task::Awaitable<bool> notify(
+            const char (&name)[N],
+            std::span<const uint8_t> request_body)
+        {
+            uint64_t mid = fnv1a64_rt(std::string_view{name, N - 1});
+            co_return co_await this->notify(mid, request_body);
+        }
+
+        template <uint64_t MethodId>
+        usub::uvent::task::Awaitable<bool> notify_ct(
+            std::span<const uint8_t> request_body)
+        {
+            co_return co_await this->notify(MethodId, request_body);
+        }
+
         usub::uvent::task::Awaitable<bool> async_ping();
 
         static usub::uvent::task::Awaitable<void> run_ping_detached(
@@ -168,29 +283,201 @@ namespace urpc
 
         void close();
 
+        [[nodiscard]] const RpcClientConfig& config() const noexcept
+        {
+            return this->config_;
+        }
+
+        // Call counters; shared with other clients when config.stats is set.
+        [[nodiscard]] const RpcClientStats& stats() const noexcept
+        {
+            return *this->stats_;
+        }
+
+        // Last load report the server attached to a Response
+        // (FLAG_LOAD_REPORT), if one arrived within max_age.
+        [[nodiscard]] std::optional<RpcLoadReport> load_report(
+            std::chrono::milliseconds max_age = std::chrono::milliseconds{1000}) const;
+
+        // Handlers for server-initiated Requests (push calls made via
+        // RpcConnection::call on the server side).
+        template <uint64_t MethodId, typename F>
+        void register_method_ct(F&& f)
+        {
+#if URPC_LOGS
+            usub::ulog::info(
+                "RpcClient::register_method_ct: MethodId={}", MethodId);
+#endif
+            this->registry_.register_method_ct<MethodId>(std::forward<F>(f));
+        }
+
+        void register_method(uint64_t method_id, RpcHandlerPtr fn);
+        void register_method(std::string_view name, RpcHandlerPtr fn);
+
+        // Stateful callable; the registry keeps a copy per registration.
+        template <typename F>
+            requires (!std::is_convertible_v<F, RpcHandlerPtr>)
+        void register_method(uint64_t method_id, F&& f)
+        {
+            this->registry_.register_method(method_id, std::forward<F>(f));
+        }
+
+        template <typename F>
+            requires (!std::is_convertible_v<F, RpcHandlerPtr>)
+        void register_method(std::string_view name, F&& f)
+        {
+            this->registry_.register_method(name, std::forward<F>(f));
+        }
+
+        // Member function on an object that outlives the client.
+        template <auto Member, class Obj>
+        void register_member(uint64_t method_id, Obj* obj)
+        {
+            this->registry_.register_member<Member>(method_id, obj);
+        }
+
+        RpcMethodRegistry& registry() { return this->registry_; }
+
+        // Registers handler for messages published on topic and subscribes
+        // this connection on the server. Topic messages are one-way: the
+        // handler's return value is discarded. Topic handlers are kept apart
+        // from method handlers, so a topic never shadows a method. They
+        // live as long as the connection's subscription; after a
+        // reconnect, subscribe again. unsubscribe() drops the handler.
+        usub::uvent::task::Awaitable<bool> subscribe(
+            std::string_view topic,
+            RpcHandlerPtr handler,
+            uint32_t timeout_ms = 0);
+
+        usub::uvent::task::Awaitable<bool> unsubscribe(
+            std::string_view topic,
+            uint32_t timeout_ms = 0);
+
     private:
         RpcClientConfig config_;
 
         std::shared_ptr<IRpcStream> stream_;
 
+        RpcMethodRegistry registry_;
+
         std::atomic<uint32_t> next_stream_id_{1};
         std::atomic<bool> running_{false};
 
+        // Server policy fetched after connect; null until it arrives.
+        std::atomic<std::shared_ptr<const RpcCryptoPolicy>> crypto_policy_;
+
+        // Packed RpcLoadReport and its arrival time (steady clock, ns).
+        std::atomic<uint32_t> load_report_{0};
+        std::atomic<int64_t> load_report_at_ns_{0};
+
+        // Shared with in-flight calls, which count their own completion.
+        std::shared_ptr<RpcClientStats> stats_;
+
         usub::uvent::sync::AsyncMutex write_mutex_;
         usub::uvent::sync::AsyncMutex connect_mutex_;
         usub::uvent::sync::AsyncMutex pending_mutex_;
         usub::uvent::sync::AsyncMutex ping_mutex_;
 
         std::unordered_map<uint32_t, std::shared_ptr<PendingCall>> pending_calls_;
+
+        // Push requests being handled, by stream id; a Cancel from the
+        // server (e.g. its call timed out) cancels the handler's token.
+        // The reader registers each push before spawning its handler, so a
+        // Cancel it reads later always finds it. One-way pushes share a
+        // stream id and are kept by a local sequence number instead; both
+        // kinds are cancelled when the connection closes.
+        usub::uvent::sync::AsyncMutex push_cancel_mutex_;
+        std::unordered_map<uint32_t,
+                           std::shared_ptr<usub::uvent::sync::CancellationSource>> push_cancels_;
+        std::unordered_map<uint64_t,
+                           std::shared_ptr<usub::uvent::sync::CancellationSource>> oneway_push_cancels_;
+        uint64_t oneway_push_seq_{0};
         std::unordered_map<uint32_t,
                            std::shared_ptr<usub::uvent::sync::AsyncEvent>> ping_waiters_;
 
+        // Subscribed topics by fnv1a64(topic name).
+        usub::uvent::sync::AsyncMutex topic_mutex_;
+        std::unordered_map<uint64_t, RpcHandlerPtr> topic_handlers_;
+
         usub::uvent::task::Awaitable<bool> ensure_connected();
         usub::uvent::task::Awaitable<void> reader_loop();
 
         static usub::uvent::task::Awaitable<void> run_reader_detached(
             std::shared_ptr<RpcClient> self);
 
+        static usub::uvent::task::Awaitable<void> fetch_crypto_policy_detached(
+            std::shared_ptr<RpcClient> self);
+
+        // Takes a slot from config_.limiter for call (no-op without one).
+        // Waits for a limiter slot for at most timeout_ms (0: no bound)
+        // and takes the wait off timeout_ms, so the call's deadline runs
+        // from before it queued.
+        usub::uvent::task::Awaitable<bool> acquire_slot(
+            const std::shared_ptr<PendingCall>& call,
+            uint32_t& timeout_ms);
+
+        static usub::uvent::task::Awaitable<void> offer_link_options_detached(
+            std::shared_ptr<RpcClient> self);
+
+        // Ping carrying extra_flags; true once the Pong arrived. With
+        // timeout_ms > 0 gives up (false) after that long.
+        usub::uvent::task::Awaitable<bool> ping_with_flags(uint16_t extra_flags,
+                                                           uint32_t timeout_ms);
+
+        static usub::uvent::task::Awaitable<void> ping_timeout_detached(
+            std::shared_ptr<RpcClient> self,
+            uint32_t sid,
+            uint32_t timeout_ms);
+
+        // Offers FLAG_IDEMPOTENCY_KEY on the current link unless it was
+        // agreed already; false if the server does not take keys.
+        usub::uvent::task::Awaitable<bool> agree_idempotency_keys(
+            uint32_t timeout_ms);
+
+        usub::uvent::task::Awaitable<RpcCallResult> call_impl(
+            uint64_t method_id,
+            std::span<const uint8_t> request_body,
+            uint32_t timeout_ms,
+            std::shared_ptr<IRpcResponseSink> sink,
+            uint64_t idempotency_key = 0);
+
+        // Reads a plaintext Response body for a call with a sink, writing it
+        // through chunk by chunk. false when the link failed.
+        usub::uvent::task::Awaitable<bool> stream_response_body(
+            IRpcStream& stream,
+            const RpcFrameHeader& hdr,
+            const uint8_t* head,
+            const std::shared_ptr<PendingCall>& call,
+            bool& crc_seen);
+
+        void note_load_report(const RpcFrameHeader& hdr);
+
+        // Counts a call about to be registered and hooks it up so its
+        // completion is counted too.
+        void track_call(PendingCall& call, std::size_t request_bytes);
+
+        // Completes call from a (decrypted) Response body.
+        void deliver_response(const std::shared_ptr<PendingCall>& call,
+                              RpcFrame& frame,
+                              std::span<const uint8_t> payload_view,
+                              bool encrypted);
+
+        // stream is the link the frame arrived on: its key, not that of a
+        // link reconnected meanwhile, opens the body.
+        static usub::uvent::task::Awaitable<void> deliver_offloaded_detached(
+            std::shared_ptr<RpcClient> self,
+            std::shared_ptr<IRpcStream> stream,
+            std::shared_ptr<PendingCall> call,
+            RpcFrame frame);
+
+        // Outgoing bodies: encrypt unless the negotiated policy says not to.
+        bool should_encrypt(uint64_t method_id, std::size_t size) const;
+        // Incoming bodies: plaintext is rejected only under a negotiated
+        // policy that requires encryption.
+        bool requires_encryption(uint64_t method_id, std::size_t size) const;
+        // Body large enough to seal/open on config_.crypto_pool.
+        bool offload_crypto(std::size_t size) const;
+
         bool parse_error_payload(
             const usub::uvent::utils::DynamicBuffer& payload,
             uint32_t& out_code,
@@ -199,6 +486,45 @@ namespace urpc
         usub::uvent::task::Awaitable<bool> send_cancel_frame(
             uint32_t stream_id, uint64_t method_id);
 
+        usub::uvent::task::Awaitable<bool> start_request(
+            const std::shared_ptr<PendingCall>& call,
+            uint32_t& out_sid,
+            uint64_t method_id,
+            uint16_t flags,
+            std::span<const uint8_t> payload,
+            uint32_t timeout_ms);
+
+        static RpcCallResult take_result(const RpcCallHandle& h);
+
+        // oneway_key: the push's key in oneway_push_cancels_, 0 for a
+        // two-way push (kept in push_cancels_ by stream id).
+        static usub::uvent::task::Awaitable<void> handle_push_detached(
+            std::shared_ptr<RpcClient> self,
+            std::shared_ptr<IRpcStream> stream,
+            RpcFrame frame,
+            std::shared_ptr<usub::uvent::sync::CancellationSource> src,
+            uint64_t oneway_key);
+
+        usub::uvent::task::Awaitable<void> handle_push(
+            std::shared_ptr<IRpcStream> stream,
+            RpcFrame frame,
+            std::shared_ptr<usub::uvent::sync::CancellationSource> src,
+            uint64_t oneway_key);
+
+        usub::uvent::task::Awaitable<void> untrack_push(
+            uint32_t stream_id,
+            const std::shared_ptr<usub::uvent::sync::CancellationSource>& src,
+            uint64_t oneway_key);
+
+        usub::uvent::task::Awaitable<void> handle_push_cancel(uint32_t stream_id);
+
+        usub::uvent::task::Awaitable<void> send_push_reply(
+            const std::shared_ptr<IRpcStream>& stream,
+            uint32_t stream_id,
+            uint64_t method_id,
+            bool is_error,
+            std::span<const uint8_t> body);
+
         static usub::uvent::task::Awaitable<void> timeout_watchdog(
             std::shared_ptr<RpcClient> self,
             std::shared_ptr<PendingCall> call,
@@ -12,11 +12,21 @@
 #include <uvent/utils/datastructures/array/ConcurrentVector.h>
 
 #include <urpc/client/RPCClient.h>
+#include <urpc/client/RPCConcurrencyLimiter.h>
 #include <urpc/config/Config.h>
 #include <urpc/transport/IRPCStream.h>
 
 namespace urpc
 {
+    enum class RpcPoolBalance : uint8_t
+    {
+        RoundRobin,
+        // Two random clients, keep the one whose server reported less load
+        // (FLAG_LOAD_REPORT). Clients without a fresh report count as idle,
+        // so they get probed.
+        PowerOfTwo,
+    };
+
     struct RpcClientPoolConfig
     {
         std::string host;
@@ -28,6 +38,15 @@ namespace urpc
         int ping_interval_ms{0};
 
         std::size_t max_clients{std::numeric_limits<std::size_t>::max()};
+
+        // Shared by every client of the pool, so the in-flight limit applies
+        // to the endpoint as a whole.
+        std::shared_ptr<RpcConcurrencyLimiter> limiter{};
+
+        RpcPoolBalance balance{RpcPoolBalance::RoundRobin};
+
+        // Reports older than this are ignored by PowerOfTwo.
+        uint32_t load_report_max_age_ms{1000};
     };
 
     struct RpcClientLease
@@ -64,13 +83,23 @@ namespace urpc
             return cfg_;
         }
 
+        // Counters of all clients of the pool together.
+        [[nodiscard]] const RpcClientStats& stats() const noexcept
+        {
+            return *stats_;
+        }
+
     private:
         std::optional<std::size_t> try_create_one();
 
+        // Lower is better; derived from the client's last load report.
+        double load_cost(const RpcClient& client) const;
+
     private:
         RpcClientPoolConfig cfg_;
         std::atomic<std::size_t> size_{0};
         std::atomic<std::size_t> rr_{0};
+        std::shared_ptr<RpcClientStats> stats_{std::make_shared<RpcClientStats>()};
 
         usub::array::concurrent::LockFreeVector<std::shared_ptr<RpcClient>> clients_;
     };
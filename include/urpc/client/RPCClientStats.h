@@ -0,0 +1,26 @@
+#ifndef URPC_RPCCLIENTSTATS_H
+#define URPC_RPCCLIENTSTATS_H
+
+#include <urpc/utils/ShardedCounter.h>
+
+namespace urpc
+{
+    // Counters kept by every RpcClient (RpcClient::stats()). A call is
+    // counted when it is registered and again when it completes.
+    struct RpcClientStats
+    {
+        ShardedCounter calls;
+        ShardedCounter succeeded;
+        ShardedCounter failed;    // error response, cancel, lost connection
+        ShardedCounter timed_out;
+
+        ShardedCounter request_bytes;
+        ShardedCounter response_bytes;
+
+        // Registration to completion of calls that did not time out,
+        // microseconds.
+        ShardedHistogram latency_us = make_latency_histogram();
+    };
+}
+
+#endif // URPC_RPCCLIENTSTATS_H
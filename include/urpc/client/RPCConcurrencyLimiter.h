@@ -0,0 +1,127 @@
+#ifndef URPC_RPCCONCURRENCYLIMITER_H
+#define URPC_RPCCONCURRENCYLIMITER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include <uvent/tasks/Awaitable.h>
+#include <uvent/sync/AsyncEvent.h>
+
+namespace urpc
+{
+    struct RpcConcurrencyLimiterConfig
+    {
+        uint32_t initial_limit{20};
+        uint32_t min_limit{1};
+        uint32_t max_limit{1000};
+
+        // The limit shrinks once an RTT sample exceeds the no-load baseline
+        // by more than this factor.
+        double rtt_tolerance{1.5};
+
+        // Weight of each new estimate in the limit (0..1].
+        double smoothing{0.2};
+
+        // Multiplier applied on a timeout or an overload error (429/503).
+        double backoff_ratio{0.9};
+
+        // Calls over the limit wait here; when the queue is full they fail
+        // at once. 0 makes every call over the limit fail fast.
+        std::size_t max_queue{128};
+
+        // How long a queued call may wait for a slot. A call with a timeout
+        // never waits longer than its timeout either. 0: no bound of its
+        // own.
+        uint32_t queue_timeout_ms{10 * 1000};
+    };
+
+    enum class RpcLimitOutcome : uint8_t
+    {
+        Success, // RTT sample counts towards the estimate
+        Dropped, // timeout or overload; the limit backs off
+        Ignored, // cancelled, connection lost, never sent
+    };
+
+    // Adaptive in-flight limit for the calls of one RpcClient, or of every
+    // client talking to one endpoint when shared (RpcClientConfig::limiter).
+    //
+    // Gradient estimator, updated once per window of ~limit completions.
+    // With base = the no-load RTT (lowest RTT seen, re-taken from windows
+    // where the limit was not the bottleneck) and rtt = the window's
+    // average RTT,
+    //   gradient  = clamp(rtt_tolerance * base / rtt, 0.5, 1.0)
+    //   new_limit = limit * gradient + sqrt(limit)
+    // blended into the limit with `smoothing`. The sqrt(limit) headroom
+    // lets the limit probe upwards while latency stays flat; a rising RTT
+    // (queueing at the server) pulls it down before throughput collapses.
+    // Windows in which less than half the limit was in use do not grow it,
+    // so an idle client does not inflate its limit.
+    class RpcConcurrencyLimiter
+        : public std::enable_shared_from_this<RpcConcurrencyLimiter>
+    {
+    public:
+        explicit RpcConcurrencyLimiter(RpcConcurrencyLimiterConfig cfg = {});
+
+        RpcConcurrencyLimiter(const RpcConcurrencyLimiter&) = delete;
+        RpcConcurrencyLimiter& operator=(const RpcConcurrencyLimiter&) = delete;
+
+        // Takes a slot, waiting in the queue if needed, for at most
+        // max_wait_ms (0: no bound) and queue_timeout_ms. false when the
+        // queue is full or the wait timed out; the caller must not send.
+        usub::uvent::task::Awaitable<bool> acquire(uint32_t max_wait_ms = 0);
+
+        // Non-waiting variant.
+        bool try_acquire();
+
+        // Gives a slot back. rtt is only used for Success.
+        void release(RpcLimitOutcome outcome, std::chrono::nanoseconds rtt);
+
+        [[nodiscard]] uint32_t limit() const;
+        [[nodiscard]] uint32_t in_flight() const;
+        [[nodiscard]] std::size_t queued() const;
+
+        [[nodiscard]] const RpcConcurrencyLimiterConfig& config() const noexcept
+        {
+            return this->cfg_;
+        }
+
+    private:
+        struct Waiter
+        {
+            std::shared_ptr<usub::uvent::sync::AsyncEvent> event;
+            bool granted{false};
+            bool abandoned{false};
+        };
+
+        static usub::uvent::task::Awaitable<void> expire_waiter(
+            std::shared_ptr<RpcConcurrencyLimiter> self,
+            std::shared_ptr<Waiter> waiter,
+            uint32_t timeout_ms);
+
+        void update_limit(RpcLimitOutcome outcome, double rtt_us);
+        uint32_t current_limit() const;
+
+    private:
+        RpcConcurrencyLimiterConfig cfg_;
+
+        mutable std::mutex mutex_;
+        double limit_;
+        double min_rtt_us_{0.0};
+
+        // Current update window.
+        uint32_t win_samples_{0};
+        uint32_t win_rtt_count_{0};
+        double win_rtt_sum_us_{0.0};
+        double win_min_rtt_us_{0.0};
+        uint32_t win_max_in_flight_{0};
+        bool win_dropped_{false};
+        uint32_t in_flight_{0};
+        std::deque<std::shared_ptr<Waiter>> waiters_;
+    };
+}
+
+#endif // URPC_RPCCONCURRENCYLIMITER_H
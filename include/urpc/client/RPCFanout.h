@@ -0,0 +1,73 @@
+//
+// Created by root on 12/15/25.
+//
+
+#ifndef URPC_RPCFANOUT_H
+#define URPC_RPCFANOUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <uvent/tasks/Awaitable.h>
+
+#include <urpc/client/RPCClient.h>
+#include <urpc/datatypes/PendingCall.h>
+
+namespace urpc
+{
+    enum class RpcFanoutMode : uint8_t
+    {
+        All = 0, // wait for every target
+        FirstK = 1, // done after k successful responses
+        Quorum = 2, // done after n/2 + 1 successful responses
+    };
+
+    struct RpcFanoutTarget
+    {
+        RpcClient* client{nullptr};
+        uint64_t method_id{0};
+        std::span<const uint8_t> body;
+    };
+
+    struct RpcFanoutOptions
+    {
+        RpcFanoutMode mode{RpcFanoutMode::All};
+        std::size_t k{1}; // FirstK only
+
+        // One deadline for the whole group; 0 = none.
+        uint32_t deadline_ms{0};
+    };
+
+    struct RpcFanoutResult
+    {
+        // true when the completion condition was met (for All: every call
+        // succeeded).
+        bool ok{false};
+        std::size_t succeeded{0};
+
+        // One entry per target, in target order. Calls that were still
+        // running when the group completed are cancelled and report 499.
+        std::vector<RpcCallResult> results;
+    };
+
+    // Starts every target at once, each in its own coroutine (connecting
+    // if needed), and completes on All / FirstK / Quorum. The deadline runs
+    // from the call, so a target still connecting when it passes reports
+    // 408. Remaining calls are cancelled with Cancel frames as soon as the
+    // outcome is decided, either way. Clients must be owned by a
+    // shared_ptr; the request body is copied per target.
+    usub::uvent::task::Awaitable<RpcFanoutResult> rpc_fanout(
+        std::span<const RpcFanoutTarget> targets,
+        RpcFanoutOptions opts);
+
+    // Same request to several clients (typically one per endpoint pool).
+    usub::uvent::task::Awaitable<RpcFanoutResult> rpc_fanout(
+        std::span<RpcClient* const> clients,
+        uint64_t method_id,
+        std::span<const uint8_t> body,
+        RpcFanoutOptions opts);
+}
+
+#endif // URPC_RPCFANOUT_H
@@ -0,0 +1,150 @@
+//
+// Created by root on 12/15/25.
+//
+
+#ifndef URPC_RPCSYNCCLIENT_H
+#define URPC_RPCSYNCCLIENT_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <uvent/Uvent.h>
+#include <uvent/tasks/Awaitable.h>
+#include <uvent/sync/AsyncEvent.h>
+
+#include <urpc/client/RPCClient.h>
+#include <urpc/config/Config.h>
+#include <urpc/datatypes/PendingCall.h>
+#include <urpc/utils/ForeignSignal.h>
+#include <urpc/utils/Hash.h>
+#include <urpc/utils/MpscQueue.h>
+
+namespace urpc
+{
+    using RpcSyncCallback = std::function<void(RpcCallResult)>;
+
+    // Thread-safe blocking facade over RpcClient for code that does not run
+    // on uvent. Calls are handed to a background Uvent through a lock-free
+    // MPSC queue; only the producer that finds the loop parked wakes it, so
+    // bursts from many threads are submitted as one batch. The wake-up is
+    // an RpcForeignSignal: a loop parked for a while notices it within
+    // about a millisecond.
+    class RpcSyncClient
+    {
+    public:
+        explicit RpcSyncClient(RpcClientConfig cfg, int threads = 1);
+
+        // Uses a caller-owned runtime instead of starting one. Construct
+        // before uvent.run(); the caller keeps running and stopping it.
+        RpcSyncClient(RpcClientConfig cfg, usub::Uvent& uvent);
+        ~RpcSyncClient();
+
+        RpcSyncClient(const RpcSyncClient&) = delete;
+        RpcSyncClient& operator=(const RpcSyncClient&) = delete;
+
+        // Blocks the calling thread until the call completes.
+        RpcCallResult call(uint64_t method_id,
+                           std::span<const uint8_t> body,
+                           uint32_t timeout_ms = 0);
+
+        template <size_t N>
+        RpcCallResult call(const char (&name)[N],
+                           std::span<const uint8_t> body,
+                           uint32_t timeout_ms = 0)
+        {
+            return this->call(fnv1a64_rt(std::string_view{name, N - 1}),
+                              body, timeout_ms);
+        }
+
+        std::future<RpcCallResult> call_async(uint64_t method_id,
+                                              std::span<const uint8_t> body,
+                                              uint32_t timeout_ms = 0);
+
+        // cb runs on a uvent thread; keep it short and non-blocking.
+        void call_async(uint64_t method_id,
+                        std::span<const uint8_t> body,
+                        uint32_t timeout_ms,
+                        RpcSyncCallback cb);
+
+        // Stops the background runtime. The connection is closed first, on
+        // the client's uvent thread, so that running calls fail and
+        // complete; calls still running after a short grace period, and
+        // queued calls, complete with an error (on the stopping thread).
+        // Called by the destructor.
+        void stop();
+
+    private:
+        struct Job : MpscNode
+        {
+            uint64_t method_id{0};
+            std::vector<uint8_t> body;
+            uint32_t timeout_ms{0};
+            std::promise<RpcCallResult> promise;
+            RpcSyncCallback callback;
+        };
+
+        // Everything the drain loop and running jobs touch. They hold it by
+        // shared_ptr, so on a caller-owned runtime they may outlive the
+        // RpcSyncClient without touching freed memory.
+        struct State
+        {
+            std::shared_ptr<RpcClient> client;
+
+            MpscQueue queue;
+            // Raised by producers and stop(), which are not uvent threads.
+            RpcForeignSignal wake;
+            std::atomic<bool> parked{false};
+            std::atomic<bool> stopping{false};
+
+            // Set by the last running job once stopping (or by the grace
+            // timer); the drain loop waits on it before failing the rest.
+            std::shared_ptr<usub::uvent::sync::AsyncEvent> idle;
+
+            // Fulfilled by the drain loop once it has closed the client on
+            // its own thread (RpcClient is not safe to close from a foreign
+            // one) and completed every running job.
+            std::promise<void> stopped;
+
+            std::mutex mutex;
+            std::unordered_set<Job*> running;
+            // The queue has no consumer any more; leftovers are failed by
+            // whoever finds them, under mutex.
+            bool drained{false};
+
+            // Consumer only (or under mutex once drained).
+            void fail_queued();
+
+            // Completes every job still running with an error. A job
+            // completes exactly once: whoever removes it from running
+            // completes it.
+            void fail_running();
+        };
+
+        void submit(Job* job);
+        static void complete(Job* job, RpcCallResult result);
+
+        static usub::uvent::task::Awaitable<void> drain_loop(
+            std::shared_ptr<State> st);
+        static usub::uvent::task::Awaitable<void> expire_grace(
+            std::shared_ptr<usub::uvent::sync::AsyncEvent> idle);
+        static usub::uvent::task::Awaitable<void> run_job(
+            std::shared_ptr<State> st, Job* job);
+
+    private:
+        std::shared_ptr<State> state_;
+        std::unique_ptr<usub::Uvent> owned_uvent_;
+        usub::Uvent* uvent_{nullptr};
+        std::thread thread_;
+    };
+}
+
+#endif // URPC_RPCSYNCCLIENT_H
@@ -14,6 +14,17 @@
 namespace urpc
 {
     struct IRpcStreamFactory;
+    class RpcMirror;
+    class RpcCryptoPolicy;
+    class RpcCryptoPool;
+    class RpcConcurrencyLimiter;
+    class RpcLoadTracker;
+    class RpcMemoryBudget;
+    class RpcResponseCache;
+    class RpcIdempotencyTable;
+    class RpcMethodStats;
+    struct RpcServerStats;
+    struct RpcClientStats;
 
     enum class RpcCancelStage : uint8_t
     {
@@ -38,6 +49,61 @@ namespace urpc
         std::shared_ptr<IRpcStreamFactory> stream_factory;
         uint32_t ping_interval_ms{0};
         int socket_timeout_ms{-1};
+
+        // Fetch the server's per-method app-encryption policy after each
+        // connect (TLS with app_encryption only). Until it arrives, and if
+        // the server does not serve one, every body is encrypted.
+        bool negotiate_crypto_policy{false};
+
+        // Optional worker pool for app-layer crypto on large bodies (see
+        // RpcCryptoPool). Responses above its threshold are decrypted off
+        // the reader loop.
+        std::shared_ptr<RpcCryptoPool> crypto_pool;
+
+        // Offer CRC32C frame trailers on plain TCP connections. Enabled
+        // once the server acknowledges; TLS links never use them.
+        bool frame_crc32c{false};
+
+        // Offer connection-level deflate (FLAG_COMPRESSED) on plain TCP
+        // links: one compression stream per direction, shared by every
+        // frame. Needs a build with URPC_WITH_ZLIB; TLS links never use it.
+        bool compression{false};
+        int compression_level{1};
+
+        // Optional adaptive in-flight limit (see RpcConcurrencyLimiter).
+        // Share one instance between clients of the same endpoint to limit
+        // them together.
+        std::shared_ptr<RpcConcurrencyLimiter> limiter;
+
+        // Counters to update instead of the client's own (see
+        // RpcClient::stats()); RpcClientPool shares one between its clients.
+        std::shared_ptr<RpcClientStats> stats;
+    };
+
+    // Per-connection buffering bounds on the server. A peer that stops
+    // reading would otherwise park every response for it in memory behind
+    // the connection's write lock.
+    struct RpcConnectionLimits
+    {
+        // Bytes a connection may have queued for writing (waiting for the
+        // write lock or being written). A send that would exceed it fails;
+        // a response is replaced by error 503. 0 = unlimited.
+        std::size_t max_outbound_bytes{0};
+
+        // A write that makes no progress for this long evicts the
+        // connection. 0 = never.
+        uint32_t write_stall_timeout_ms{0};
+
+        // Bytes of a streamed request body (register_streaming) buffered
+        // ahead of its handler before the reader stops reading the socket.
+        std::size_t stream_body_window{256 * 1024};
+
+        // Longest the reader waits for a streaming handler to make room in
+        // that window. After that the body is failed (the handler sees
+        // failed(), the client gets 408) and the rest of it is read and
+        // dropped, so other frames on the connection are not held up
+        // behind a stalled handler. 0 = wait forever.
+        uint32_t stream_body_stall_ms{5000};
     };
 
     struct RpcServerConfig
@@ -49,6 +115,55 @@ namespace urpc
         int timeout_ms{-1};
 
         RpcCancelCallback on_request_cancelled;
+
+        // Optional shadow-traffic mirror (see RpcMirror).
+        std::shared_ptr<RpcMirror> mirror;
+
+        // Per-method app-encryption policy (see RpcCryptoPolicy). Null keeps
+        // the default of encrypting every body when the stream has a cipher.
+        std::shared_ptr<const RpcCryptoPolicy> crypto_policy;
+
+        // Optional worker pool for app-layer crypto on large bodies.
+        std::shared_ptr<RpcCryptoPool> crypto_pool;
+
+        // When set, requests are counted here and every Response carries a
+        // load report (FLAG_LOAD_REPORT) for client-side balancing.
+        std::shared_ptr<RpcLoadTracker> load_tracker;
+
+        RpcConnectionLimits limits{};
+
+        // Optional process-wide budget for buffered request/response bytes
+        // (see RpcMemoryBudget). Share one instance between servers.
+        std::shared_ptr<RpcMemoryBudget> memory_budget;
+
+        // Optional memoization of responses for opted-in methods, with an
+        // optional persistent tier (see RpcResponseCache).
+        std::shared_ptr<RpcResponseCache> response_cache;
+
+        // Deduplicates retried calls that carry an idempotency key
+        // (FLAG_IDEMPOTENCY_KEY). Without it the key is ignored.
+        std::shared_ptr<RpcIdempotencyTable> idempotency;
+
+        // Per-method handler CPU time, wall time and allocated bytes (see
+        // RpcMethodStats). Costs two thread-CPU clock reads per call.
+        std::shared_ptr<RpcMethodStats> method_stats;
+    };
+
+    struct RpcProxyConfig
+    {
+        std::string host;
+        uint16_t port{0};
+        int threads{1};
+        std::shared_ptr<IRpcStreamFactory> stream_factory;
+        int timeout_ms{-1};
+
+        // 0 = wait for the upstream until it answers or disconnects.
+        uint32_t upstream_timeout_ms{0};
+
+        // App-encryption policy for the downstream hop, served to clients
+        // that negotiate it and applied to responses. Null encrypts every
+        // non-empty body on app-encrypted links.
+        std::shared_ptr<const RpcCryptoPolicy> crypto_policy;
     };
 }
 
@@ -5,9 +5,13 @@
 #ifndef RPCCONNECTION_H
 #define RPCCONNECTION_H
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 #include <span>
+#include <string_view>
 
 #include <uvent/tasks/Awaitable.h>
 #include <uvent/sync/AsyncMutex.h>
@@ -18,8 +22,11 @@
 #include <ulog/ulog.h>
 
 #include <urpc/datatypes/Frame.h>
+#include <urpc/datatypes/PendingCall.h>
 #include <urpc/context/RPCContext.h>
 #include <urpc/registry/RPCMethodRegistry.h>
+#include <urpc/registry/RPCTopicRegistry.h>
+#include <urpc/server/RPCMemoryBudget.h>
 #include <urpc/transport/IRPCStream.h>
 #include <urpc/transport/IOOps.h>
 #include <urpc/utils/Endianness.h>
@@ -36,17 +43,86 @@ namespace urpc
 
         RpcConnection(std::shared_ptr<IRpcStream> stream,
                       RpcMethodRegistry& registry,
-                      RpcCancelCallback on_cancel);
+                      RpcCancelCallback on_cancel,
+                      RpcTopicRegistry* topics = nullptr,
+                      RpcMirror* mirror = nullptr,
+                      const RpcCryptoPolicy* crypto_policy = nullptr,
+                      RpcCryptoPool* crypto_pool = nullptr,
+                      RpcLoadTracker* load = nullptr,
+                      RpcConnectionLimits limits = {},
+                      RpcMemoryBudget* budget = nullptr,
+                      RpcResponseCache* cache = nullptr,
+                      RpcIdempotencyTable* idempotency = nullptr,
+                      RpcMethodStats* stats = nullptr,
+                      RpcServerStats* server_stats = nullptr);
 
         static usub::uvent::task::Awaitable<void> run_detached(
             std::shared_ptr<RpcConnection> self);
 
+        // Server -> client call over this connection. The client must have
+        // a handler registered for method_id (RpcClient::register_method*).
+        // timeout_ms == 0 waits until the response or connection close.
+        usub::uvent::task::Awaitable<RpcCallResult> call(
+            uint64_t method_id,
+            std::span<const uint8_t> body,
+            uint32_t timeout_ms = 0);
+
+        template <size_t N>
+        usub::uvent::task::Awaitable<RpcCallResult> call(
+            const char (&name)[N],
+            std::span<const uint8_t> body,
+            uint32_t timeout_ms = 0)
+        {
+            const uint64_t mid = fnv1a64_rt(std::string_view{name, N - 1});
+            co_return co_await this->call(mid, body, timeout_ms);
+        }
+
+        // Server -> client one-way Request (FLAG_ONEWAY): no stream is
+        // registered and the client sends nothing back. Returns false if the
+        // frame could not be written. extra_flags: FLAG_TOPIC for published
+        // topic messages.
+        usub::uvent::task::Awaitable<bool> notify(
+            uint64_t method_id,
+            std::span<const uint8_t> body,
+            uint16_t extra_flags = 0);
+
+        template <size_t N>
+        usub::uvent::task::Awaitable<bool> notify(
+            const char (&name)[N],
+            std::span<const uint8_t> body)
+        {
+            const uint64_t mid = fnv1a64_rt(std::string_view{name, N - 1});
+            co_return co_await this->notify(mid, body);
+        }
+
+        [[nodiscard]] bool is_open() const noexcept
+        {
+            return this->open_.load(std::memory_order_acquire);
+        }
+
+        [[nodiscard]] RpcTopicRegistry* topics() const noexcept
+        {
+            return this->topics_;
+        }
+
+        // Sends a one-way Request (FLAG_ONEWAY) carrying a shared body. The
+        // body is only copied when this connection needs app-layer
+        // encryption; otherwise the same buffer is written to every peer.
+        static usub::uvent::task::Awaitable<void> send_oneway_detached(
+            std::shared_ptr<RpcConnection> self,
+            uint64_t method_id,
+            std::shared_ptr<const std::vector<uint8_t>> body);
+
     private:
         usub::uvent::task::Awaitable<void> loop();
 
-        usub::uvent::task::Awaitable<void> locked_send(
+        // false if the frame was not sent. over_cap (optional) tells a
+        // send refused by limits.max_outbound_bytes, which leaves the
+        // connection up, from a dead or evicted link.
+        usub::uvent::task::Awaitable<bool> locked_send(
             const RpcFrameHeader& hdr,
-            std::span<const uint8_t> body);
+            std::span<const uint8_t> body,
+            bool* over_cap = nullptr);
 
         usub::uvent::task::Awaitable<void> send_response(
             RpcContext& ctx,
@@ -61,21 +137,108 @@ namespace urpc
         usub::uvent::task::Awaitable<void> handle_request(RpcFrame frame);
         usub::uvent::task::Awaitable<void> handle_cancel(RpcFrame frame);
         usub::uvent::task::Awaitable<void> handle_ping(RpcFrame frame);
+        usub::uvent::task::Awaitable<void> handle_response(RpcFrame frame);
+        usub::uvent::task::Awaitable<void> fail_pending_calls();
 
         static usub::uvent::task::Awaitable<void>
         handle_request_detached(std::shared_ptr<RpcConnection> self,
-                                RpcFrame frame);
+                                RpcFrame frame,
+                                std::chrono::steady_clock::time_point read_at,
+                                RpcMemoryCharge charge);
+
+        // Reads a Request body for a streaming handler chunk by chunk,
+        // feeding the handler as it goes. Only used for frames without a
+        // CRC32C trailer. false when the link failed.
+        usub::uvent::task::Awaitable<bool> stream_request_body(
+            const RpcFrameHeader& hdr,
+            RpcStreamHandlerEntry fn);
+
+        static usub::uvent::task::Awaitable<void>
+        handle_stream_request_detached(std::shared_ptr<RpcConnection> self,
+                                       RpcFrameHeader hdr,
+                                       RpcStreamHandlerEntry fn,
+                                       std::shared_ptr<RpcBodyReader> body,
+                                       std::chrono::steady_clock::time_point read_at);
+
+        usub::uvent::task::Awaitable<void> handle_stream_request(
+            const RpcFrameHeader& hdr,
+            RpcStreamHandlerEntry fn,
+            RpcBodyReader& body);
+
+        // Sends resp for ctx unless the request was cancelled meanwhile;
+        // reports AfterHandler cancellations.
+        usub::uvent::task::Awaitable<void> finish_request(
+            RpcContext& ctx,
+            std::vector<uint8_t> resp);
+
+        // 503 for a request whose body was dropped under the memory budget.
+        static usub::uvent::task::Awaitable<void>
+        reject_request_detached(std::shared_ptr<RpcConnection> self,
+                                RpcFrameHeader hdr);
+
+        // Charge against budget_ for this connection; empty without one.
+        RpcMemoryCharge charge_memory(std::size_t bytes);
+
+        // True while a write has been in progress without moving any bytes
+        // for longer than limits_.write_stall_timeout_ms.
+        bool write_stalled(int64_t now_ns) const;
+
+        // Shuts the stream down; pending sends fail and running handlers
+        // see their cancel token fire. Safe to call more than once.
+        void evict(const char* reason);
+
+        static usub::uvent::task::Awaitable<void> cancel_handlers_detached(
+            std::shared_ptr<RpcConnection> self);
+
+        static usub::uvent::task::Awaitable<void> stall_watchdog(
+            std::shared_ptr<RpcConnection> self);
+
+        // Adds FLAG_LOAD_REPORT and the packed report to a Response header.
+        void stamp_load_report(RpcFrameHeader& hdr) const;
+
+        // App-encryption decision for a body of method_id. Without a policy
+        // every non-empty body is encrypted when the stream has a cipher.
+        bool should_encrypt(uint64_t method_id, std::size_t size) const;
+
+        static usub::uvent::task::Awaitable<void> call_timeout_watchdog(
+            std::shared_ptr<RpcConnection> self,
+            std::shared_ptr<PendingCall> call,
+            uint32_t stream_id,
+            uint64_t method_id,
+            uint32_t timeout_ms);
 
     private:
         std::shared_ptr<IRpcStream> stream_;
         RpcMethodRegistry& registry_;
         RpcCancelCallback on_cancel_;
+        RpcTopicRegistry* topics_{nullptr};
+        RpcMirror* mirror_{nullptr};
+        const RpcCryptoPolicy* crypto_policy_{nullptr};
+        RpcCryptoPool* crypto_pool_{nullptr};
+        RpcLoadTracker* load_{nullptr};
+        RpcConnectionLimits limits_{};
+        RpcMemoryBudget* budget_{nullptr};
+        RpcResponseCache* cache_{nullptr};
+        RpcIdempotencyTable* idempotency_{nullptr};
+        RpcMethodStats* stats_{nullptr};
+        RpcServerStats* server_stats_{nullptr};
+
+        // Header + body bytes of sends waiting for or holding write_mutex_.
+        std::atomic<std::size_t> out_bytes_{0};
+        // steady_now_ns() when the current write started; 0 when idle.
+        std::atomic<int64_t> write_since_ns_{0};
+        std::atomic<bool> evicted_{false};
 
         usub::uvent::sync::AsyncMutex write_mutex_;
         usub::uvent::sync::AsyncMutex cancel_map_mutex_;
         std::unordered_map<
             uint64_t,
             std::shared_ptr<usub::uvent::sync::CancellationSource>> cancel_map_;
+
+        std::atomic<bool> open_{true};
+        std::atomic<uint32_t> next_stream_id_{1};
+        usub::uvent::sync::AsyncMutex pending_mutex_;
+        std::unordered_map<uint32_t, std::shared_ptr<PendingCall>> pending_calls_;
     };
 }
 
@@ -0,0 +1,110 @@
+#ifndef URPC_RPCWIREHELPERS_H
+#define URPC_RPCWIREHELPERS_H
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <uvent/tasks/Awaitable.h>
+#include <uvent/utils/buffer/DynamicBuffer.h>
+
+#include <urpc/crypto/AppCrypto.h>
+#include <urpc/datatypes/Frame.h>
+#include <urpc/transport/IRPCStream.h>
+#include <urpc/transport/TlsRpcStream.h>
+#include <urpc/utils/Endianness.h>
+
+// Helpers shared by the server-side frame loops (RpcConnection and
+// RpcProxyConnection). Include from translation units only.
+namespace urpc
+{
+    inline const AppCipherContext* get_cipher_for_stream(IRpcStream* s)
+    {
+        auto* tls = dynamic_cast<TlsRpcStream*>(s);
+        if (!tls)
+            return nullptr;
+        return tls->app_cipher();
+    }
+
+    inline bool stream_is_tls(IRpcStream* s)
+    {
+        return dynamic_cast<TlsRpcStream*>(s) != nullptr;
+    }
+
+    inline uint16_t build_security_flags(IRpcStream* stream,
+                                         const RpcPeerIdentity* peer)
+    {
+        uint16_t flags = 0;
+        if (stream_is_tls(stream))
+            flags |= FLAG_TLS;
+        if (peer && peer->authenticated)
+            flags |= FLAG_MTLS;
+        return flags;
+    }
+
+    // Error response body: u32 code, u32 message length, message, then
+    // optional details (all big-endian).
+    inline std::vector<uint8_t> build_error_body(
+        uint32_t code,
+        std::string_view message,
+        std::span<const uint8_t> details = {})
+    {
+        const uint32_t code_be = host_to_be<uint32_t>(code);
+        const uint32_t len_be =
+            host_to_be<uint32_t>(static_cast<uint32_t>(message.size()));
+
+        std::vector<uint8_t> buf(8 + message.size() + details.size());
+        std::memcpy(buf.data(), &code_be, 4);
+        std::memcpy(buf.data() + 4, &len_be, 4);
+        if (!message.empty())
+            std::memcpy(buf.data() + 8, message.data(), message.size());
+        if (!details.empty())
+            std::memcpy(buf.data() + 8 + message.size(),
+                        details.data(), details.size());
+        return buf;
+    }
+
+    inline bool parse_error_body(std::span<const uint8_t> body,
+                                 uint32_t& out_code,
+                                 std::string& out_msg)
+    {
+        if (body.size() < 8)
+            return false;
+
+        uint32_t code_be = 0;
+        uint32_t len_be = 0;
+        std::memcpy(&code_be, body.data(), 4);
+        std::memcpy(&len_be, body.data() + 4, 4);
+
+        const uint32_t len = be_to_host(len_be);
+        if (len > body.size() - 8u)
+            return false;
+
+        out_code = be_to_host(code_be);
+        out_msg.assign(reinterpret_cast<const char*>(body.data() + 8), len);
+        return true;
+    }
+
+    inline usub::uvent::task::Awaitable<bool> read_exact(
+        IRpcStream& stream,
+        usub::uvent::utils::DynamicBuffer& buf,
+        std::size_t expected)
+    {
+        buf.clear();
+        buf.reserve(expected);
+
+        while (buf.size() < expected)
+        {
+            const std::size_t want = expected - buf.size();
+            const ssize_t r = co_await stream.async_read(buf, want);
+            if (r <= 0)
+                co_return false;
+        }
+        co_return true;
+    }
+}
+
+#endif // URPC_RPCWIREHELPERS_H
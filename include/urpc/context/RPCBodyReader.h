@@ -0,0 +1,83 @@
+#ifndef URPC_RPCBODYREADER_H
+#define URPC_RPCBODYREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include <uvent/tasks/Awaitable.h>
+#include <uvent/sync/AsyncEvent.h>
+#include <uvent/utils/buffer/DynamicBuffer.h>
+
+namespace urpc
+{
+    // Request body handed to a streaming handler
+    // (RpcMethodRegistry::register_streaming) while it is still being read
+    // off the socket. The connection's reader stops reading once `window`
+    // bytes are buffered and not yet consumed, so a slow handler pushes back
+    // on the client instead of growing memory.
+    class RpcBodyReader
+    {
+    public:
+        RpcBodyReader(std::size_t length, std::size_t window);
+
+        RpcBodyReader(const RpcBodyReader&) = delete;
+        RpcBodyReader& operator=(const RpcBodyReader&) = delete;
+
+        // Next chunk of the body, in order; valid until the next call.
+        // false once the body is complete, or when it failed (failed()):
+        // the connection was lost mid-body or the handler stalled the
+        // reader for longer than stream_body_stall_ms (stalled()). Check
+        // failed() before committing side effects.
+        usub::uvent::task::Awaitable<bool> next(std::span<const uint8_t>& chunk);
+
+        // Collects the rest of the body. Empty and failed() on error.
+        usub::uvent::task::Awaitable<std::vector<uint8_t>> read_all();
+
+        // Total body length from the frame header.
+        [[nodiscard]] std::size_t length() const noexcept { return this->length_; }
+
+        [[nodiscard]] std::size_t consumed() const;
+        [[nodiscard]] bool failed() const;
+        [[nodiscard]] bool stalled() const;
+
+        // Reader side. push() waits while the window is full, at most
+        // stall_ms at a time (0 = no limit). When that runs out the body
+        // is failed and abandoned, later pushes are dropped, and push()
+        // returns false.
+        usub::uvent::task::Awaitable<bool> push(usub::uvent::utils::DynamicBuffer chunk,
+                                                uint32_t stall_ms = 0);
+        // Whole body already in memory (app-encrypted requests are
+        // decrypted first); the caller keeps it alive until the handler
+        // returns.
+        void set_buffered(std::span<const uint8_t> body);
+        void finish();
+        void fail();
+        // The handler returned; drops buffered chunks and unblocks push().
+        void abandon();
+
+    private:
+        const std::size_t length_;
+        const std::size_t window_;
+
+        mutable std::mutex mutex_;
+        std::deque<usub::uvent::utils::DynamicBuffer> queue_;
+        usub::uvent::utils::DynamicBuffer current_;
+        std::span<const uint8_t> buffered_body_{};
+        std::size_t queued_bytes_{0};
+        std::size_t consumed_{0};
+        bool done_{false};
+        bool failed_{false};
+        bool abandoned_{false};
+        bool stalled_{false};
+
+        std::shared_ptr<usub::uvent::sync::AsyncEvent> data_ev_;
+        std::shared_ptr<usub::uvent::sync::AsyncEvent> room_ev_;
+    };
+}
+
+#endif // URPC_RPCBODYREADER_H
@@ -22,6 +22,8 @@
 
 namespace urpc
 {
+    class RpcConnection;
+
     template <class T>
     concept ByteRange =
         requires(const T& t)
@@ -61,6 +63,9 @@ namespace urpc
         uint16_t flags;
         usub::uvent::sync::CancellationToken cancel_token;
         const RpcPeerIdentity* peer{nullptr};
+        // Server side only: the connection the request arrived on. Use
+        // connection->shared_from_this() to keep it for later push calls.
+        RpcConnection* connection{nullptr};
     };
 
     using RpcHandlerAwaitable = usub::uvent::task::Awaitable<void>;
@@ -71,4 +76,6 @@ namespace urpc
     using RpcHandlerPtr = RpcHandlerFn*;
 }
 
+#include <urpc/context/RPCHandlerCoroutine.h>
+
 #endif // RPCCONTEXT_H
@@ -0,0 +1,140 @@
+#ifndef URPC_RPCHANDLERCOROUTINE_H
+#define URPC_RPCHANDLERCOROUTINE_H
+
+#include <coroutine>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#include <uvent/tasks/Awaitable.h>
+
+#include <urpc/server/RPCMethodStats.h>
+
+namespace urpc
+{
+    struct RpcContext;
+    class RpcBodyReader;
+
+    namespace detail
+    {
+        template <class A>
+        decltype(auto) get_awaiter(A&& a)
+        {
+            if constexpr (requires { std::forward<A>(a).operator co_await(); })
+                return std::forward<A>(a).operator co_await();
+            else if constexpr (requires { operator co_await(std::forward<A>(a)); })
+                return operator co_await(std::forward<A>(a));
+            else
+                return std::forward<A>(a);
+        }
+
+        // Wraps one co_await of a handler: the thread is detached from the
+        // handler's method right before it suspends and re-attributed on
+        // whichever thread it resumes (see RpcMethodStats).
+        template <class Aw>
+        struct AttributedAwaiter
+        {
+            Aw aw; // the awaiter itself, or a reference to an lvalue one
+            RpcMethodStats::Attribution saved{};
+            bool detached{false};
+
+            bool await_ready()
+            {
+                return this->aw.await_ready();
+            }
+
+            template <class P>
+            auto await_suspend(std::coroutine_handle<P> h)
+            {
+                this->saved = RpcMethodStats::suspend();
+                this->detached = true;
+                if constexpr (requires { this->aw.await_suspend(h); })
+                    return this->aw.await_suspend(h);
+                else
+                    return this->aw.await_suspend(
+                        std::coroutine_handle<typename P::base_promise>::from_address(
+                            h.address()));
+            }
+
+            decltype(auto) await_resume()
+            {
+                if (this->detached)
+                    RpcMethodStats::resume(this->saved);
+                return this->aw.await_resume();
+            }
+        };
+
+        template <class A>
+        auto attributed(A&& a)
+        {
+            using Got = decltype(get_awaiter(std::forward<A>(a)));
+            using Aw = std::conditional_t<std::is_lvalue_reference_v<Got>,
+                                          Got,
+                                          std::remove_cvref_t<Got>>;
+            return AttributedAwaiter<Aw>{get_awaiter(std::forward<A>(a))};
+        }
+
+        // Promise of coroutines shaped like a registered handler. It is
+        // uvent's own promise plus an await_transform, so every co_await in
+        // the handler body detaches the CPU attribution while it is
+        // suspended; the handler does not have to wrap anything.
+        template <class T>
+        struct RpcHandlerPromise : usub::uvent::task::Awaitable<T>::promise_type
+        {
+            using base_promise = typename usub::uvent::task::Awaitable<T>::promise_type;
+            using base_promise::base_promise;
+
+            template <class A>
+            auto await_transform(A&& a)
+            {
+                if constexpr (requires(base_promise& b) {
+                    b.await_transform(std::forward<A>(a));
+                })
+                    return attributed(
+                        base_promise::await_transform(std::forward<A>(a)));
+                else
+                    return attributed(std::forward<A>(a));
+            }
+        };
+    }
+}
+
+// Handler signatures: free functions, and lambdas / member functions (whose
+// object comes first). Coroutines with other signatures keep uvent's
+// promise unchanged.
+template <class T>
+struct std::coroutine_traits<usub::uvent::task::Awaitable<T>,
+                             urpc::RpcContext&,
+                             std::span<const std::uint8_t>>
+{
+    using promise_type = urpc::detail::RpcHandlerPromise<T>;
+};
+
+template <class T, class Self>
+struct std::coroutine_traits<usub::uvent::task::Awaitable<T>,
+                             Self,
+                             urpc::RpcContext&,
+                             std::span<const std::uint8_t>>
+{
+    using promise_type = urpc::detail::RpcHandlerPromise<T>;
+};
+
+template <class T>
+struct std::coroutine_traits<usub::uvent::task::Awaitable<T>,
+                             urpc::RpcContext&,
+                             urpc::RpcBodyReader&>
+{
+    using promise_type = urpc::detail::RpcHandlerPromise<T>;
+};
+
+template <class T, class Self>
+struct std::coroutine_traits<usub::uvent::task::Awaitable<T>,
+                             Self,
+                             urpc::RpcContext&,
+                             urpc::RpcBodyReader&>
+{
+    using promise_type = urpc::detail::RpcHandlerPromise<T>;
+};
+
+#endif // URPC_RPCHANDLERCOROUTINE_H
@@ -2,6 +2,7 @@
 #define URPC_APPCRYPTO_H
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
 #include <span>
 #include <vector>
@@ -10,35 +11,73 @@
 #include <openssl/rand.h>
 #include <ulog/ulog.h>
 
+#include <urpc/transport/TlsConfig.h>
+
 namespace urpc
 {
     struct AppCipherContext
     {
         std::array<uint8_t, 32> key{};
+        // Resolved suite, never Auto once valid.
+        AppCipherSuite suite{AppCipherSuite::Aes256Gcm};
         bool valid{false};
     };
 
-    inline bool app_encrypt_gcm(
+    inline const char* app_cipher_name(AppCipherSuite suite)
+    {
+        switch (suite)
+        {
+        case AppCipherSuite::ChaCha20Poly1305:
+            return "chacha20-poly1305";
+        case AppCipherSuite::Aes256Gcm:
+            return "aes-256-gcm";
+        case AppCipherSuite::Auto:
+        default:
+            return "auto";
+        }
+    }
+
+    inline const EVP_CIPHER* app_evp_cipher(AppCipherSuite suite)
+    {
+        switch (suite)
+        {
+        case AppCipherSuite::ChaCha20Poly1305:
+            return EVP_chacha20_poly1305();
+        case AppCipherSuite::Aes256Gcm:
+            return EVP_aes_256_gcm();
+        case AppCipherSuite::Auto:
+        default:
+            return nullptr;
+        }
+    }
+
+    inline constexpr std::size_t kAppIvSize = 12;
+    inline constexpr std::size_t kAppTagSize = 16;
+    inline constexpr std::size_t kAppSealOverhead = kAppIvSize + kAppTagSize;
+
+    // Seals plaintext into out[0 .. size + kAppSealOverhead) as
+    // IV(12) | CT | TAG(16). aad is authenticated but not transmitted.
+    // Both suites use a 12-byte nonce and a 16-byte tag, so the layout is
+    // the same for AES-256-GCM and ChaCha20-Poly1305.
+    inline bool app_seal_into(
         const AppCipherContext& ctx,
         std::span<const uint8_t> plaintext,
-        std::vector<uint8_t>& out)
+        uint8_t* out,
+        std::span<const uint8_t> aad = {})
     {
         if (!ctx.valid)
             return false;
 
-        EVP_CIPHER_CTX* c = EVP_CIPHER_CTX_new();
-        if (!c)
+        const EVP_CIPHER* cipher = app_evp_cipher(ctx.suite);
+        if (!cipher)
             return false;
 
-        const EVP_CIPHER* cipher = EVP_aes_256_gcm();
-        if (!cipher)
-        {
-            EVP_CIPHER_CTX_free(c);
+        EVP_CIPHER_CTX* c = EVP_CIPHER_CTX_new();
+        if (!c)
             return false;
-        }
 
-        uint8_t iv[12];
-        if (RAND_bytes(iv, sizeof(iv)) != 1)
+        uint8_t* iv = out;
+        if (RAND_bytes(iv, static_cast<int>(kAppIvSize)) != 1)
         {
             EVP_CIPHER_CTX_free(c);
             return false;
@@ -51,8 +90,8 @@ namespace urpc
         }
 
         if (EVP_CIPHER_CTX_ctrl(
-            c, EVP_CTRL_GCM_SET_IVLEN,
-            static_cast<int>(sizeof(iv)), nullptr) != 1)
+            c, EVP_CTRL_AEAD_SET_IVLEN,
+            static_cast<int>(kAppIvSize), nullptr) != 1)
         {
             EVP_CIPHER_CTX_free(c);
             return false;
@@ -66,22 +105,24 @@ namespace urpc
             return false;
         }
 
-        out.clear();
-        out.reserve(12 + plaintext.size() + 16);
-
-        out.insert(out.end(), iv, iv + sizeof(iv));
-
-        std::vector<uint8_t> ct;
-        ct.resize(plaintext.size() + 16);
-
         int len = 0;
         int total = 0;
 
+        if (!aad.empty() &&
+            EVP_EncryptUpdate(c, nullptr, &len, aad.data(),
+                              static_cast<int>(aad.size())) != 1)
+        {
+            EVP_CIPHER_CTX_free(c);
+            return false;
+        }
+
+        uint8_t* ct = out + kAppIvSize;
+
         if (!plaintext.empty())
         {
             if (EVP_EncryptUpdate(
                 c,
-                ct.data(),
+                ct,
                 &len,
                 plaintext.data(),
                 static_cast<int>(plaintext.size())) != 1)
@@ -92,58 +133,52 @@ namespace urpc
             total = len;
         }
 
-        if (EVP_EncryptFinal_ex(c, ct.data() + total, &len) != 1)
+        if (EVP_EncryptFinal_ex(c, ct + total, &len) != 1)
         {
             EVP_CIPHER_CTX_free(c);
             return false;
         }
         total += len;
-        ct.resize(total);
 
-        out.insert(out.end(), ct.begin(), ct.end());
-
-        uint8_t tag[16];
         if (EVP_CIPHER_CTX_ctrl(
-            c, EVP_CTRL_GCM_GET_TAG,
-            static_cast<int>(sizeof(tag)),
-            tag) != 1)
+            c, EVP_CTRL_AEAD_GET_TAG,
+            static_cast<int>(kAppTagSize),
+            ct + total) != 1)
         {
             EVP_CIPHER_CTX_free(c);
             return false;
         }
-        out.insert(out.end(), tag, tag + sizeof(tag));
 
         EVP_CIPHER_CTX_free(c);
         return true;
     }
 
-    inline bool app_decrypt_gcm(
+    // Opens IV | CT | TAG into out[0 .. enc.size() - kAppSealOverhead).
+    inline bool app_open_into(
         const AppCipherContext& ctx,
         std::span<const uint8_t> enc,
-        std::vector<uint8_t>& out)
+        uint8_t* out,
+        std::span<const uint8_t> aad = {})
     {
         if (!ctx.valid)
             return false;
 
-        if (enc.size() < 12 + 16)
+        if (enc.size() < kAppSealOverhead)
+            return false;
+
+        const EVP_CIPHER* cipher = app_evp_cipher(ctx.suite);
+        if (!cipher)
             return false;
 
         const uint8_t* iv = enc.data();
-        const uint8_t* tag = enc.data() + enc.size() - 16;
-        const uint8_t* ct = enc.data() + 12;
-        const std::size_t ct_len = enc.size() - 12 - 16;
+        const uint8_t* tag = enc.data() + enc.size() - kAppTagSize;
+        const uint8_t* ct = enc.data() + kAppIvSize;
+        const std::size_t ct_len = enc.size() - kAppSealOverhead;
 
         EVP_CIPHER_CTX* c = EVP_CIPHER_CTX_new();
         if (!c)
             return false;
 
-        const EVP_CIPHER* cipher = EVP_aes_256_gcm();
-        if (!cipher)
-        {
-            EVP_CIPHER_CTX_free(c);
-            return false;
-        }
-
         if (EVP_DecryptInit_ex(c, cipher, nullptr, nullptr, nullptr) != 1)
         {
             EVP_CIPHER_CTX_free(c);
@@ -151,8 +186,8 @@ namespace urpc
         }
 
         if (EVP_CIPHER_CTX_ctrl(
-            c, EVP_CTRL_GCM_SET_IVLEN,
-            12, nullptr) != 1)
+            c, EVP_CTRL_AEAD_SET_IVLEN,
+            static_cast<int>(kAppIvSize), nullptr) != 1)
         {
             EVP_CIPHER_CTX_free(c);
             return false;
@@ -166,17 +201,22 @@ namespace urpc
             return false;
         }
 
-        out.clear();
-        out.resize(ct_len);
-
         int len = 0;
         int total = 0;
 
+        if (!aad.empty() &&
+            EVP_DecryptUpdate(c, nullptr, &len, aad.data(),
+                              static_cast<int>(aad.size())) != 1)
+        {
+            EVP_CIPHER_CTX_free(c);
+            return false;
+        }
+
         if (ct_len > 0)
         {
             if (EVP_DecryptUpdate(
                 c,
-                out.data(),
+                out,
                 &len,
                 ct,
                 static_cast<int>(ct_len)) != 1)
@@ -188,24 +228,42 @@ namespace urpc
         }
 
         if (EVP_CIPHER_CTX_ctrl(
-            c, EVP_CTRL_GCM_SET_TAG,
-            16, const_cast<uint8_t*>(tag)) != 1)
+            c, EVP_CTRL_AEAD_SET_TAG,
+            static_cast<int>(kAppTagSize), const_cast<uint8_t*>(tag)) != 1)
         {
             EVP_CIPHER_CTX_free(c);
             return false;
         }
 
-        if (EVP_DecryptFinal_ex(c, out.data() + total, &len) != 1)
+        if (EVP_DecryptFinal_ex(c, out + total, &len) != 1)
         {
             EVP_CIPHER_CTX_free(c);
             return false;
         }
-        total += len;
-        out.resize(total);
 
         EVP_CIPHER_CTX_free(c);
         return true;
     }
+
+    inline bool app_encrypt(
+        const AppCipherContext& ctx,
+        std::span<const uint8_t> plaintext,
+        std::vector<uint8_t>& out)
+    {
+        out.resize(plaintext.size() + kAppSealOverhead);
+        return app_seal_into(ctx, plaintext, out.data());
+    }
+
+    inline bool app_decrypt(
+        const AppCipherContext& ctx,
+        std::span<const uint8_t> enc,
+        std::vector<uint8_t>& out)
+    {
+        if (enc.size() < kAppSealOverhead)
+            return false;
+        out.resize(enc.size() - kAppSealOverhead);
+        return app_open_into(ctx, enc, out.data());
+    }
 }
 
 #endif // URPC_APPCRYPTO_H
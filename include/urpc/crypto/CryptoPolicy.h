@@ -0,0 +1,60 @@
+#ifndef URPC_CRYPTOPOLICY_H
+#define URPC_CRYPTOPOLICY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace urpc
+{
+    // Built-in method serving the server's policy table. Empty request body;
+    // the reply is RpcCryptoPolicy::serialize().
+    inline constexpr const char* kCryptoPolicyMethod = "urpc.CryptoPolicy";
+
+    // When a body is app-encrypted (AES-GCM over TLS). Sizes are plaintext
+    // body sizes in bytes; empty bodies are never encrypted.
+    enum class RpcCryptoMode : uint8_t
+    {
+        Always    = 0,
+        Never     = 1,
+        AboveSize = 2, // encrypt when size >  threshold
+        BelowSize = 3, // encrypt when size <= threshold
+    };
+
+    struct RpcCryptoRule
+    {
+        RpcCryptoMode mode{RpcCryptoMode::Always};
+        uint32_t threshold{0};
+    };
+
+    // Per-method app-encryption policy. The server's table is authoritative:
+    // it rejects plaintext bodies the table says must be encrypted, and
+    // clients that fetched the table (RpcClientConfig::negotiate_crypto_policy)
+    // apply the same rules to what they send and accept.
+    class RpcCryptoPolicy
+    {
+    public:
+        void set_default(RpcCryptoRule rule) { this->default_ = rule; }
+        void set(uint64_t method_id, RpcCryptoRule rule);
+        void set(std::string_view method_name, RpcCryptoRule rule);
+
+        [[nodiscard]] RpcCryptoRule rule_for(uint64_t method_id) const;
+
+        [[nodiscard]] bool should_encrypt(uint64_t method_id,
+                                          std::size_t body_size) const;
+
+        // [u8 default mode][u32 default threshold][u32 count]
+        // count x [u64 method_id][u8 mode][u32 threshold], big-endian.
+        [[nodiscard]] std::vector<uint8_t> serialize() const;
+        static bool parse(std::span<const uint8_t> in, RpcCryptoPolicy& out);
+
+    private:
+        RpcCryptoRule default_{};
+        std::unordered_map<uint64_t, RpcCryptoRule> rules_;
+    };
+}
+
+#endif // URPC_CRYPTOPOLICY_H
@@ -0,0 +1,127 @@
+#ifndef URPC_CRYPTOPOOL_H
+#define URPC_CRYPTOPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <uvent/tasks/Awaitable.h>
+
+#include <urpc/crypto/AppCrypto.h>
+#include <urpc/utils/ForeignSignal.h>
+
+namespace urpc
+{
+    struct RpcCryptoPoolConfig
+    {
+        int threads{2};
+
+        // Bodies at least this large are sealed/opened on the pool instead
+        // of the I/O thread.
+        std::size_t offload_threshold{256 * 1024};
+
+        // When non-zero, offloaded bodies larger than chunk_size are sealed
+        // as independent chunks (FLAG_CHUNKED) and processed in parallel.
+        // Raised to RpcCryptoPool::kMinChunkSize if smaller. Both peers must
+        // understand FLAG_CHUNKED; receiving it works with or without a
+        // pool.
+        std::size_t chunk_size{0};
+    };
+
+    // Worker threads for app-layer AEAD on large bodies. Shared by any
+    // number of servers and clients (RpcServerConfig / RpcClientConfig
+    // ::crypto_pool). Workers only flag completion; the awaiting coroutine
+    // notices it on its own uvent thread (RpcForeignSignal).
+    //
+    // Chunked body (FLAG_ENCRYPTED | FLAG_CHUNKED):
+    //   [u32 chunk_size BE] chunk_0 .. chunk_{n-1}
+    // chunk_i = IV | CT | TAG over plaintext[i * chunk_size, ...), sealed with
+    // AAD = [u32 i BE][u32 n BE] so chunks cannot be reordered, dropped or
+    // spliced between bodies of different length. Bodies announcing a
+    // chunk_size below kMinChunkSize are rejected before any work is
+    // scheduled: tiny chunks would turn one body into a flood of tasks.
+    class RpcCryptoPool
+    {
+    public:
+        static constexpr std::size_t kMinChunkSize = 16 * 1024;
+
+        explicit RpcCryptoPool(RpcCryptoPoolConfig cfg = {});
+        ~RpcCryptoPool();
+
+        RpcCryptoPool(const RpcCryptoPool&) = delete;
+        RpcCryptoPool& operator=(const RpcCryptoPool&) = delete;
+
+        [[nodiscard]] const RpcCryptoPoolConfig& config() const noexcept
+        {
+            return this->cfg_;
+        }
+
+        [[nodiscard]] bool should_offload(std::size_t size) const noexcept
+        {
+            return size >= this->cfg_.offload_threshold;
+        }
+
+        // Seals in into out; adds FLAG_CHUNKED to flags when chunked.
+        usub::uvent::task::Awaitable<bool> seal(
+            const AppCipherContext& cipher,
+            std::span<const uint8_t> in,
+            std::vector<uint8_t>& out,
+            uint16_t& flags);
+
+        usub::uvent::task::Awaitable<bool> open(
+            const AppCipherContext& cipher,
+            std::span<const uint8_t> in,
+            uint16_t flags,
+            std::vector<uint8_t>& out);
+
+        // Synchronous open on the calling thread; handles FLAG_CHUNKED.
+        static bool open_inline(const AppCipherContext& cipher,
+                                std::span<const uint8_t> in,
+                                uint16_t flags,
+                                std::vector<uint8_t>& out);
+
+    private:
+        struct Batch
+        {
+            AppCipherContext cipher;
+            std::atomic<std::size_t> remaining{0};
+            std::atomic<bool> failed{false};
+            RpcForeignSignal done;
+        };
+
+        struct Task
+        {
+            std::shared_ptr<Batch> batch;
+            bool seal{true};
+            std::span<const uint8_t> in;
+            uint8_t* out{nullptr};
+            uint32_t index{0};
+            uint32_t count{0}; // 0: whole body, no AAD
+        };
+
+        usub::uvent::task::Awaitable<bool> run(
+            const std::shared_ptr<Batch>& batch,
+            std::vector<Task> tasks);
+
+        void worker_loop();
+        static void execute(Task& t);
+
+    private:
+        RpcCryptoPoolConfig cfg_;
+
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<Task> tasks_;
+        bool stopping_{false};
+        std::vector<std::thread> workers_;
+    };
+}
+
+#endif // URPC_CRYPTOPOOL_H
@@ -24,7 +24,7 @@ namespace urpc {
         Pong = 5,
     };
 
-    enum FrameFlags : uint8_t {
+    enum FrameFlags : uint16_t {
         FLAG_END_STREAM = 0x01,
         FLAG_ERROR = 0x02,
         FLAG_COMPRESSED = 0x04,
@@ -32,6 +32,12 @@ namespace urpc {
         FLAG_TLS = 0x08, // transport is TLS
         FLAG_MTLS = 0x10, // mutual TLS (client cert)
         FLAG_ENCRYPTED = 0x20, // body is app-encrypted
+        FLAG_ONEWAY = 0x40, // request expects no response
+        FLAG_CHUNKED = 0x80, // encrypted body is sealed in independent chunks
+        FLAG_CRC32C = 0x100, // 4-byte CRC32C trailer follows the payload
+        FLAG_LOAD_REPORT = 0x200, // reserved carries a server load report
+        FLAG_IDEMPOTENCY_KEY = 0x400, // body starts with an 8-byte retry key
+        FLAG_TOPIC = 0x800, // one-way Request is a published topic message
     };
 
     struct RpcFrameHeader {
@@ -57,6 +63,14 @@ namespace urpc {
 
     constexpr std::size_t kMaxFrameBodyLength = 16u * 1024u * 1024u;
 
+    // Big-endian key in front of the (decrypted, inflated) request body of
+    // a FLAG_IDEMPOTENCY_KEY request.
+    constexpr std::size_t kIdempotencyKeySize = sizeof(uint64_t);
+
+    // Streams opened by the server (push calls) carry this bit so that they
+    // never collide with the client-allocated ids on the same connection.
+    constexpr uint32_t kServerStreamIdBit = 0x80000000u;
+
     URPC_ALWAYS_INLINE void serialize_header(const RpcFrameHeader &src, uint8_t *out) {
         auto put_be = [](uint8_t *&p, auto v) {
             using T = decltype(v);
@@ -0,0 +1,43 @@
+#ifndef URPC_LOADREPORT_H
+#define URPC_LOADREPORT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace urpc
+{
+    // Server load piggybacked on Response frames (FLAG_LOAD_REPORT). It
+    // travels in RpcFrameHeader::reserved, so it costs no extra bytes:
+    //   bits 31..16  in_flight      requests being handled, saturating
+    //   bits 15..8   queue_delay    v = round(8 * log2(1 + us)), ~9% steps
+    //   bits  7..0   cpu_percent    process CPU over all cores, 0..100
+    struct RpcLoadReport
+    {
+        uint32_t in_flight{0};
+        uint32_t queue_delay_us{0};
+        uint8_t cpu_percent{0};
+    };
+
+    inline uint32_t encode_load_report(const RpcLoadReport& r)
+    {
+        const uint32_t inflight = std::min<uint32_t>(r.in_flight, 0xFFFFu);
+        const double q = std::round(8.0 * std::log2(1.0 + r.queue_delay_us));
+        const uint32_t delay = static_cast<uint32_t>(std::clamp(q, 0.0, 255.0));
+        const uint32_t cpu = std::min<uint32_t>(r.cpu_percent, 100u);
+        return (inflight << 16) | (delay << 8) | cpu;
+    }
+
+    inline RpcLoadReport decode_load_report(uint32_t v)
+    {
+        RpcLoadReport r;
+        r.in_flight = v >> 16;
+        const double us = std::exp2(static_cast<double>((v >> 8) & 0xFFu) / 8.0) - 1.0;
+        r.queue_delay_us = static_cast<uint32_t>(
+            std::min(us, static_cast<double>(UINT32_MAX)));
+        r.cpu_percent = static_cast<uint8_t>(std::min<uint32_t>(v & 0xFFu, 100u));
+        return r;
+    }
+}
+
+#endif // URPC_LOADREPORT_H
@@ -0,0 +1,127 @@
+//
+// Created by root on 11/29/25.
+//
+
+#ifndef URPC_PENDINGCALL_H
+#define URPC_PENDINGCALL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <uvent/sync/AsyncEvent.h>
+#include <uvent/utils/buffer/DynamicBuffer.h>
+
+namespace urpc
+{
+    struct IRpcResponseSink;
+    class RpcConcurrencyLimiter;
+    struct RpcClientStats;
+    enum class RpcLimitOutcome : uint8_t;
+
+    struct PendingCall
+    {
+        std::shared_ptr<usub::uvent::sync::AsyncEvent> event;
+        std::vector<uint8_t> response;
+        bool error{false};
+        uint32_t error_code{0};
+        std::string error_message;
+
+        std::atomic<bool> timed_out{false};
+        std::atomic<bool> done{false};
+
+        // Extra events woken on completion, one per group wait (when_any,
+        // rpc_fanout), so several waits can watch the same call without a
+        // coroutine per call.
+        std::mutex waiters_mutex;
+        std::vector<std::shared_ptr<usub::uvent::sync::AsyncEvent>> waiters;
+
+        void add_waiter(const std::shared_ptr<usub::uvent::sync::AsyncEvent>& ev)
+        {
+            std::lock_guard lk(this->waiters_mutex);
+            this->waiters.push_back(ev);
+        }
+
+        void remove_waiter(const std::shared_ptr<usub::uvent::sync::AsyncEvent>& ev)
+        {
+            std::lock_guard lk(this->waiters_mutex);
+            std::erase(this->waiters, ev);
+        }
+
+        // Marks the call complete and wakes its waiter(s). Every completion
+        // path (response, error, timeout, connection loss) goes through here.
+        void signal();
+
+        // Slot taken from RpcClientConfig::limiter for this call; handed
+        // back on completion, or on destruction if the call never
+        // completed (e.g. the send failed).
+        std::shared_ptr<RpcConcurrencyLimiter> limiter;
+        std::chrono::steady_clock::time_point started{};
+        std::atomic<bool> slot_released{false};
+
+        void release_slot(RpcLimitOutcome outcome);
+        RpcLimitOutcome limit_outcome() const;
+
+        // Set by RpcClient::track_call when the call is registered.
+        std::shared_ptr<RpcClientStats> stats;
+        std::chrono::steady_clock::time_point registered_at{};
+        std::atomic<bool> counted{false};
+
+        void count_completion();
+
+        ~PendingCall();
+
+        // try_call_into: plaintext bodies are written here by the reader as
+        // they arrive and never land in `response`; bodies that must be
+        // decrypted first are buffered and written by the caller.
+        std::shared_ptr<IRpcResponseSink> sink;
+        bool sink_aborted{false};
+
+        // Forwarded calls (RpcProxy) keep the response frame as received:
+        // the payload buffer is moved out of the reader, not decoded.
+        bool raw{false};
+        uint16_t raw_flags{0};
+        usub::uvent::utils::DynamicBuffer raw_payload;
+    };
+
+    // Shared by every copy of an RpcCallHandle. The result is moved out of
+    // the PendingCall when it is collected, so only the first collection
+    // (await_call / when_all) may take it.
+    struct RpcCallResultState
+    {
+        std::atomic<bool> consumed{false};
+
+        // true exactly once.
+        bool try_consume() noexcept
+        {
+            return !this->consumed.exchange(true, std::memory_order_acq_rel);
+        }
+    };
+
+    // Returned by RpcClient::start_call / start_forward.
+    struct RpcCallHandle
+    {
+        uint32_t stream_id{0};
+        uint64_t method_id{0};
+        std::shared_ptr<PendingCall> call;
+        std::shared_ptr<RpcCallResultState> result_state;
+
+        explicit operator bool() const noexcept { return call != nullptr; }
+    };
+
+    struct RpcCallResult
+    {
+        bool                 ok{false};
+        bool                 timed_out{false};
+        uint32_t             error_code{0};
+        std::string          error_message;
+        std::vector<uint8_t> response;
+    };
+}
+
+#endif // URPC_PENDINGCALL_H
@@ -6,35 +6,249 @@
 #define RPCMETHODREGISTRY_H
 
 #include <cstdint>
+#include <memory>
 #include <string_view>
 #include <unordered_map>
 #include <utility>
+#include <type_traits>
+#include <span>
+#include <vector>
 
+#include <urpc/context/RPCBodyReader.h>
 #include <urpc/context/RPCContext.h>
 #include <urpc/utils/Hash.h>
 
 namespace urpc
 {
+    namespace detail
+    {
+        template <class T>
+        struct awaitable_value;
+
+        template <class T>
+        struct awaitable_value<usub::uvent::task::Awaitable<T>>
+        {
+            using type = T;
+        };
+
+        template <class T>
+        using awaitable_value_t = typename awaitable_value<T>::type;
+
+        template <class Result, class Call>
+        usub::uvent::task::Awaitable<std::vector<std::uint8_t>>
+        adapt_result(Call call)
+        {
+            if constexpr (ByteRange<Result>)
+            {
+                Result r = co_await call();
+                co_return to_byte_vector(std::move(r));
+            }
+            else
+            {
+                static_assert(
+                    std::is_same_v<Result, void>,
+                    "RpcMethodRegistry: unsupported handler result type");
+                co_await call();
+                co_return std::vector<std::uint8_t>{};
+            }
+        }
+    }
+
+    using RpcHandlerThunk =
+        usub::uvent::task::Awaitable<std::vector<uint8_t>> (*)(
+            void* state, RpcContext&, std::span<const uint8_t>);
+
+    // One dispatch table slot. Plain handlers are stored as themselves and
+    // called directly; functors and members go through a thunk that gets
+    // the state they were registered with. Either way calling it is a
+    // single indirect call.
+    struct RpcHandlerEntry
+    {
+        RpcHandlerPtr fn{nullptr};
+        RpcHandlerThunk thunk{nullptr};
+        void* state{nullptr};
+
+        explicit operator bool() const noexcept
+        {
+            return fn != nullptr || thunk != nullptr;
+        }
+
+        usub::uvent::task::Awaitable<std::vector<uint8_t>>
+        operator()(RpcContext& ctx, std::span<const uint8_t> body) const
+        {
+            if (fn)
+                return fn(ctx, body);
+            return thunk(state, ctx, body);
+        }
+    };
+
+    using RpcStreamHandlerThunk =
+        usub::uvent::task::Awaitable<std::vector<uint8_t>> (*)(
+            void* state, RpcContext&, RpcBodyReader&);
+
+    struct RpcStreamHandlerEntry
+    {
+        RpcStreamHandlerThunk thunk{nullptr};
+        void* state{nullptr};
+
+        explicit operator bool() const noexcept { return thunk != nullptr; }
+
+        usub::uvent::task::Awaitable<std::vector<uint8_t>>
+        operator()(RpcContext& ctx, RpcBodyReader& body) const
+        {
+            return thunk(state, ctx, body);
+        }
+    };
+
     class RpcMethodRegistry
     {
     public:
         template <uint64_t MethodId, typename F>
         void register_method_ct(F&& f)
         {
-            this->register_method(
-                MethodId,
-                static_cast<RpcHandlerPtr>(+std::forward<F>(f))
-            );
+            this->register_method(MethodId, std::forward<F>(f));
         }
 
         void register_method(uint64_t method_id, RpcHandlerPtr fn);
         void register_method(std::string_view name, RpcHandlerPtr fn);
 
-        RpcHandlerPtr find(uint64_t method_id) const;
+        // Stateful callables: each registration owns its own copy, so two
+        // registrations of the same type never share state. Registering
+        // the method id again frees that copy, so do not re-register a
+        // method while calls to it may still be running.
+        template <typename F>
+            requires (!std::is_convertible_v<F, RpcHandlerPtr>)
+        void register_method(uint64_t method_id, F&& f)
+        {
+            using Functor = std::decay_t<F>;
+
+            auto* obj = new Functor(std::forward<F>(f));
+            this->stream_handlers_.erase(method_id);
+            this->handlers_[method_id] =
+                RpcHandlerEntry{.thunk = &functor_thunk<Functor>, .state = obj};
+            this->own(method_id, obj);
+        }
+
+        template <typename F>
+            requires (!std::is_convertible_v<F, RpcHandlerPtr>)
+        void register_method(std::string_view name, F&& f)
+        {
+            this->register_method(fnv1a64_rt(name), std::forward<F>(f));
+        }
+
+        // Member function handler on a caller-owned object:
+        //   registry.register_member<&Backend::get>(id, &backend);
+        template <auto Member, class Obj>
+        void register_member(uint64_t method_id, Obj* obj)
+        {
+            this->stream_handlers_.erase(method_id);
+            this->handlers_[method_id] =
+                RpcHandlerEntry{.thunk = &member_thunk<Obj, Member>, .state = obj};
+            this->states_.erase(method_id);
+        }
+
+        // Handler that reads the request body while it arrives:
+        //   Awaitable<R>(RpcContext&, RpcBodyReader&)
+        // with R a byte range or void, as for register_method. A method id
+        // has either a regular or a streaming handler; the later
+        // registration wins.
+        template <typename F>
+        void register_streaming(uint64_t method_id, F&& f)
+        {
+            using Functor = std::decay_t<F>;
+
+            auto* obj = new Functor(std::forward<F>(f));
+            this->handlers_.erase(method_id);
+            this->stream_handlers_[method_id] =
+                RpcStreamHandlerEntry{&stream_thunk<Functor>, obj};
+            this->own(method_id, obj);
+        }
+
+        template <typename F>
+        void register_streaming(std::string_view name, F&& f)
+        {
+            this->register_streaming(fnv1a64_rt(name), std::forward<F>(f));
+        }
+
+        RpcHandlerEntry find(uint64_t method_id) const;
+        RpcStreamHandlerEntry find_streaming(uint64_t method_id) const;
+
+    private:
+        // Makes obj the state owned for method_id, freeing the one a
+        // previous registration of that id owned.
+        template <class Functor>
+        void own(uint64_t method_id, Functor* obj)
+        {
+            this->states_.insert_or_assign(
+                method_id,
+                std::unique_ptr<void, void (*)(void*)>(
+                    obj, [](void* p) { delete static_cast<Functor*>(p); }));
+        }
+
+        template <class Functor>
+        static usub::uvent::task::Awaitable<std::vector<uint8_t>>
+        functor_thunk(void* state, RpcContext& ctx, std::span<const uint8_t> body)
+        {
+            auto& func = *static_cast<Functor*>(state);
+
+            using RawRet = std::invoke_result_t<
+                Functor&,
+                RpcContext&,
+                std::span<const std::uint8_t>>;
+            using Result = detail::awaitable_value_t<RawRet>;
+
+            if constexpr (std::is_same_v<Result, std::vector<std::uint8_t>>)
+                return func(ctx, body);
+            else
+                return detail::adapt_result<Result>(
+                    [&func, &ctx, body] { return func(ctx, body); });
+        }
+
+        template <class Functor>
+        static usub::uvent::task::Awaitable<std::vector<uint8_t>>
+        stream_thunk(void* state, RpcContext& ctx, RpcBodyReader& body)
+        {
+            auto& func = *static_cast<Functor*>(state);
+
+            using RawRet = std::invoke_result_t<
+                Functor&,
+                RpcContext&,
+                RpcBodyReader&>;
+            using Result = detail::awaitable_value_t<RawRet>;
+
+            if constexpr (std::is_same_v<Result, std::vector<std::uint8_t>>)
+                return func(ctx, body);
+            else
+                return detail::adapt_result<Result>(
+                    [&func, &ctx, &body] { return func(ctx, body); });
+        }
+
+        template <class Obj, auto Member>
+        static usub::uvent::task::Awaitable<std::vector<uint8_t>>
+        member_thunk(void* state, RpcContext& ctx, std::span<const uint8_t> body)
+        {
+            auto* obj = static_cast<Obj*>(state);
+
+            using RawRet = std::invoke_result_t<
+                decltype(Member),
+                Obj*,
+                RpcContext&,
+                std::span<const std::uint8_t>>;
+            using Result = detail::awaitable_value_t<RawRet>;
+
+            if constexpr (std::is_same_v<Result, std::vector<std::uint8_t>>)
+                return (obj->*Member)(ctx, body);
+            else
+                return detail::adapt_result<Result>(
+                    [obj, &ctx, body] { return (obj->*Member)(ctx, body); });
+        }
 
     private:
-        std::unordered_map<uint64_t, RpcHandlerPtr> handlers_;
+        std::unordered_map<uint64_t, RpcHandlerEntry> handlers_;
+        std::unordered_map<uint64_t, RpcStreamHandlerEntry> stream_handlers_;
+        // Functor state per method id, owned by its current registration.
+        std::unordered_map<uint64_t, std::unique_ptr<void, void (*)(void*)>> states_;
     };
 }
 
-#endif // RPCMETHODREGISTRY_H
\ No newline at end of file
+#endif // RPCMETHODREGISTRY_H
@@ -0,0 +1,58 @@
+//
+// Created by root on 12/14/25.
+//
+
+#ifndef RPCTOPICREGISTRY_H
+#define RPCTOPICREGISTRY_H
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <uvent/tasks/Awaitable.h>
+#include <uvent/sync/AsyncMutex.h>
+
+#include <urpc/context/RPCContext.h>
+
+namespace urpc
+{
+    class RpcConnection;
+
+    // Built-in method names. The request body is the topic name; topic
+    // messages are delivered as one-way Requests with
+    // method_id == fnv1a64(topic).
+    inline constexpr const char* kSubscribeMethod = "urpc.Subscribe";
+    inline constexpr const char* kUnsubscribeMethod = "urpc.Unsubscribe";
+
+    class RpcTopicRegistry
+    {
+    public:
+        usub::uvent::task::Awaitable<void> subscribe(
+            uint64_t topic_id,
+            const std::shared_ptr<RpcConnection>& conn);
+
+        usub::uvent::task::Awaitable<void> unsubscribe(
+            uint64_t topic_id,
+            const RpcConnection* conn);
+
+        // Live subscribers of topic_id. Closed / destroyed connections are
+        // pruned from the table as a side effect.
+        usub::uvent::task::Awaitable<std::vector<std::shared_ptr<RpcConnection>>>
+        subscribers(uint64_t topic_id);
+
+        static usub::uvent::task::Awaitable<std::vector<uint8_t>>
+        handle_subscribe(RpcContext& ctx, std::span<const uint8_t> body);
+
+        static usub::uvent::task::Awaitable<std::vector<uint8_t>>
+        handle_unsubscribe(RpcContext& ctx, std::span<const uint8_t> body);
+
+    private:
+        usub::uvent::sync::AsyncMutex mutex_;
+        std::unordered_map<uint64_t,
+                           std::vector<std::weak_ptr<RpcConnection>>> topics_;
+    };
+}
+
+#endif // RPCTOPICREGISTRY_H
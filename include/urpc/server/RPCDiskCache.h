@@ -0,0 +1,106 @@
+#ifndef URPC_RPCDISKCACHE_H
+#define URPC_RPCDISKCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <span>
+#include <string>
+
+namespace urpc
+{
+    struct RpcDiskCacheConfig
+    {
+        // Files <path>.dat (entries) and <path>.idx (index) are created or,
+        // when they exist with the same geometry, reused as they are. Both
+        // are locked (flock) while open, so a second process or cache
+        // opening the same path fails instead of corrupting them.
+        std::string path;
+
+        std::size_t capacity_bytes{1ull << 30};
+
+        // Index slots; 0 picks one per 16 KiB of capacity.
+        uint32_t index_slots{0};
+    };
+
+    // A response served straight from a cache tier. pin keeps the bytes
+    // valid (and, for the disk tier, the region from being overwritten)
+    // until it is released.
+    struct RpcCachedResponse
+    {
+        std::span<const uint8_t> body;
+        std::shared_ptr<const void> pin;
+        uint64_t expires_ms{0}; // wall clock; 0: never
+
+        explicit operator bool() const noexcept { return pin != nullptr; }
+    };
+
+    // Persistent response store in a memory-mapped file. Entries are
+    // appended to a ring (<path>.dat); the oldest are overwritten when it
+    // wraps. An open-addressing table in a second mapped file (<path>.idx)
+    // maps keys to log positions, so a restarted process finds everything
+    // that was written before, without a scan. Each entry carries a CRC32C,
+    // checked on lookup, so torn writes from a crash read as misses.
+    class RpcDiskCache : public std::enable_shared_from_this<RpcDiskCache>
+    {
+    public:
+        // Returns nullptr when the files cannot be created or mapped.
+        static std::shared_ptr<RpcDiskCache> open(RpcDiskCacheConfig cfg);
+
+        ~RpcDiskCache();
+
+        RpcDiskCache(const RpcDiskCache&) = delete;
+        RpcDiskCache& operator=(const RpcDiskCache&) = delete;
+
+        // key: hash of (method_id, request). request is compared in full.
+        // now_ms: wall clock (ms since epoch) for expiry.
+        RpcCachedResponse get(uint64_t key,
+                              uint64_t method_id,
+                              std::span<const uint8_t> request,
+                              uint64_t now_ms);
+
+        // false when the entry was not stored (too large, or the space it
+        // needs is still being served from).
+        bool put(uint64_t key,
+                 uint64_t method_id,
+                 std::span<const uint8_t> request,
+                 std::span<const uint8_t> response,
+                 uint64_t expires_ms);
+
+        // Schedules write-back of dirty pages (msync MS_ASYNC).
+        void flush();
+
+        [[nodiscard]] std::size_t capacity() const noexcept { return this->capacity_; }
+
+    private:
+        RpcDiskCache() = default;
+
+        struct EntryHeader;
+        struct IndexHeader;
+        struct Slot;
+
+        bool map_files(const RpcDiskCacheConfig& cfg);
+        const EntryHeader* entry_at(uint64_t pos, std::size_t& len) const;
+        bool live(uint64_t pos, std::size_t len) const;
+        Slot* slot_for(uint64_t key, bool for_insert);
+        void unpin(uint64_t pos);
+
+    private:
+        std::mutex mutex_;
+
+        int data_fd_{-1};
+        int index_fd_{-1};
+        uint8_t* data_{nullptr};
+        uint8_t* index_{nullptr};
+        std::size_t capacity_{0};
+        std::size_t index_bytes_{0};
+        uint32_t slot_count_{0};
+
+        // Log positions of entries currently being served.
+        std::multiset<uint64_t> pins_;
+    };
+}
+
+#endif // URPC_RPCDISKCACHE_H
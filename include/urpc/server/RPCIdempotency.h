@@ -0,0 +1,193 @@
+#ifndef URPC_RPCIDEMPOTENCY_H
+#define URPC_RPCIDEMPOTENCY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <uvent/tasks/Awaitable.h>
+#include <uvent/sync/AsyncEvent.h>
+
+namespace urpc
+{
+    struct IRpcStream;
+
+    struct RpcIdempotencyConfig
+    {
+        // Completed calls remembered at most. Calls still running are never
+        // dropped; beyond max_entries of them, new keys run untracked.
+        std::size_t max_entries{10000};
+        std::size_t max_bytes{64ull << 20};
+
+        // How long a completed call is replayed to retries.
+        uint32_t ttl_ms{10 * 60 * 1000};
+
+        // How long a retry waits for a first attempt that is still running
+        // before it is answered 409 (InProgress). 0: do not wait.
+        uint32_t wait_timeout_ms{30 * 1000};
+    };
+
+    // What a key is remembered under. scope tells callers apart (see
+    // RpcConnection: authenticated identity, else remote address), so one
+    // caller can neither collide with nor replay another's result.
+    struct RpcIdempotencyKey
+    {
+        uint64_t scope{0};
+        uint64_t method_id{0};
+        uint64_t key{0};
+
+        auto operator<=>(const RpcIdempotencyKey&) const = default;
+    };
+
+    // Scope of keys arriving on stream: the authenticated identity, else
+    // the remote address (which a retry after a reconnect keeps), else the
+    // connection itself.
+    uint64_t idempotency_scope(const IRpcStream& stream, const void* connection);
+
+    // Folds a downstream caller's scope into its key. A proxy forwards
+    // this instead of the original, since upstream sees every caller as
+    // the proxy. Never 0.
+    uint64_t scoped_idempotency_key(uint64_t scope, uint64_t key) noexcept;
+
+    enum class RpcIdempotencyOutcome : uint8_t
+    {
+        Run,        // first attempt (or untracked): run the handler
+        Replay,     // answer with the stored response
+        Conflict,   // key reused for a different request body
+        InProgress, // first attempt still running after wait_timeout_ms
+    };
+
+    struct RpcIdempotencyClaim
+    {
+        RpcIdempotencyOutcome outcome{RpcIdempotencyOutcome::Run};
+
+        // Replay: the response of the first attempt.
+        std::shared_ptr<const std::vector<uint8_t>> response;
+
+        // Run: the caller owns the entry and must complete() or abandon()
+        // it (RpcIdempotencyRun does both). false when the table was full
+        // of in-progress calls.
+        bool tracked{false};
+    };
+
+    class RpcIdempotencyTable;
+
+    // Owns a tracked Run claim: complete() stores the response, and
+    // destruction without it abandons the entry, so a handler that throws
+    // or a request that bails out early never leaves retries waiting.
+    class RpcIdempotencyRun
+    {
+    public:
+        RpcIdempotencyRun() = default;
+        RpcIdempotencyRun(RpcIdempotencyTable* table,
+                          RpcIdempotencyKey key) noexcept
+            : table_(table), key_(key)
+        {
+        }
+        RpcIdempotencyRun(RpcIdempotencyRun&& o) noexcept;
+        RpcIdempotencyRun& operator=(RpcIdempotencyRun&& o) noexcept;
+        RpcIdempotencyRun(const RpcIdempotencyRun&) = delete;
+        RpcIdempotencyRun& operator=(const RpcIdempotencyRun&) = delete;
+        ~RpcIdempotencyRun();
+
+        void complete(std::span<const uint8_t> response);
+
+        explicit operator bool() const noexcept
+        {
+            return this->table_ != nullptr;
+        }
+
+    private:
+        RpcIdempotencyTable* table_{nullptr};
+        RpcIdempotencyKey key_;
+    };
+
+    // Server-wide table of recent idempotency keys (FLAG_IDEMPOTENCY_KEY),
+    // scoped by caller and method id. The first request with a key runs
+    // the handler; a retry that arrives while it runs waits for it (at most
+    // wait_timeout_ms), and one that arrives later gets the stored response
+    // without running the handler again.
+    // Set as RpcServerConfig::idempotency; share one instance between the
+    // servers of a process so a retry on another listener is caught too.
+    class RpcIdempotencyTable
+    {
+    public:
+        explicit RpcIdempotencyTable(RpcIdempotencyConfig cfg = {});
+
+        RpcIdempotencyTable(const RpcIdempotencyTable&) = delete;
+        RpcIdempotencyTable& operator=(const RpcIdempotencyTable&) = delete;
+
+        usub::uvent::task::Awaitable<RpcIdempotencyClaim> claim(
+            const RpcIdempotencyKey& key,
+            std::span<const uint8_t> body);
+
+        // Stores the response of a tracked Run and wakes waiting retries.
+        void complete(const RpcIdempotencyKey& key,
+                      std::span<const uint8_t> response);
+
+        // Forgets a tracked Run that produced no response; a waiting retry
+        // then runs the handler itself.
+        void abandon(const RpcIdempotencyKey& key);
+
+        [[nodiscard]] std::size_t size() const;
+
+        [[nodiscard]] uint64_t replays() const noexcept
+        {
+            return this->replays_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t conflicts() const noexcept
+        {
+            return this->conflicts_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] const RpcIdempotencyConfig& config() const noexcept
+        {
+            return this->cfg_;
+        }
+
+    private:
+        using Key = RpcIdempotencyKey;
+
+        struct Entry
+        {
+            uint64_t fingerprint{0};
+            bool done{false};
+            int64_t expires_ns{0};
+            std::shared_ptr<const std::vector<uint8_t>> response;
+            // One event per waiting retry, so each can time out alone.
+            std::vector<std::shared_ptr<usub::uvent::sync::AsyncEvent>> waiters;
+            std::list<Key>::iterator order; // valid once done
+        };
+
+        static uint64_t fingerprint(std::span<const uint8_t> body) noexcept;
+
+        // Drops expired completed entries, then the oldest ones while over
+        // the bounds.
+        void evict_locked(int64_t now_ns);
+        void erase_locked(std::map<Key, Entry>::iterator it);
+        static void wake(
+            std::vector<std::shared_ptr<usub::uvent::sync::AsyncEvent>> waiters);
+
+    private:
+        RpcIdempotencyConfig cfg_;
+
+        mutable std::mutex mutex_;
+        std::map<Key, Entry> entries_;
+        std::list<Key> order_; // completed entries, oldest first
+        std::size_t done_count_{0};
+        std::size_t done_bytes_{0};
+
+        std::atomic<uint64_t> replays_{0};
+        std::atomic<uint64_t> conflicts_{0};
+    };
+}
+
+#endif // URPC_RPCIDEMPOTENCY_H
@@ -0,0 +1,59 @@
+#ifndef URPC_RPCLOADTRACKER_H
+#define URPC_RPCLOADTRACKER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include <urpc/datatypes/LoadReport.h>
+
+namespace urpc
+{
+    // Server-side load figures reported to clients on every Response when
+    // set as RpcServerConfig::load_tracker. One tracker may be shared by
+    // several servers of a process; the CPU figure is process-wide anyway.
+    class RpcLoadTracker
+    {
+    public:
+        RpcLoadTracker();
+
+        RpcLoadTracker(const RpcLoadTracker&) = delete;
+        RpcLoadTracker& operator=(const RpcLoadTracker&) = delete;
+
+        // queue_delay: time from the request frame being read to its handler
+        // starting (scheduler backlog).
+        void on_request_start(std::chrono::nanoseconds queue_delay);
+        void on_request_end();
+
+        // Current figures; refreshes the CPU sample at most every 100 ms.
+        RpcLoadReport snapshot();
+
+        [[nodiscard]] uint32_t in_flight() const noexcept
+        {
+            return this->in_flight_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint32_t queue_delay_us() const noexcept
+        {
+            return this->queue_delay_us_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        void sample_cpu();
+
+    private:
+        std::atomic<uint32_t> in_flight_{0};
+        // EWMA, weight 1/8 per request.
+        std::atomic<uint32_t> queue_delay_us_{0};
+        std::atomic<uint8_t> cpu_percent_{0};
+        std::atomic<int64_t> next_cpu_sample_ns_{0};
+
+        std::mutex cpu_mutex_;
+        int64_t last_wall_ns_{0};
+        int64_t last_cpu_ns_{0};
+        unsigned cores_{1};
+    };
+}
+
+#endif // URPC_RPCLOADTRACKER_H
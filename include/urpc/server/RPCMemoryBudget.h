@@ -0,0 +1,141 @@
+#ifndef URPC_RPCMEMORYBUDGET_H
+#define URPC_RPCMEMORYBUDGET_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include <uvent/tasks/Awaitable.h>
+
+namespace urpc
+{
+    class RpcMemoryBudget;
+
+    struct RpcMemoryBudgetConfig
+    {
+        // Above this many held bytes the heaviest connections stop reading
+        // new frames until usage falls again. 0 = never pause.
+        std::size_t soft_limit_bytes{0};
+
+        // Above this, requests of at least large_request_bytes are rejected
+        // with 503 and their bodies discarded unread. 0 = never reject.
+        std::size_t hard_limit_bytes{0};
+
+        std::size_t large_request_bytes{64 * 1024};
+
+        // How often a paused reader re-checks the budget.
+        uint32_t pause_poll_ms{5};
+    };
+
+    // Bytes held on behalf of one owner (a connection). Released on
+    // destruction; move-only.
+    class RpcMemoryCharge
+    {
+    public:
+        RpcMemoryCharge() = default;
+        RpcMemoryCharge(RpcMemoryCharge&& o) noexcept;
+        RpcMemoryCharge& operator=(RpcMemoryCharge&& o) noexcept;
+        RpcMemoryCharge(const RpcMemoryCharge&) = delete;
+        RpcMemoryCharge& operator=(const RpcMemoryCharge&) = delete;
+        ~RpcMemoryCharge();
+
+        void reset();
+
+        // Takes over o's bytes (same budget and owner), leaving o empty.
+        void merge(RpcMemoryCharge&& o) noexcept;
+
+        [[nodiscard]] std::size_t bytes() const noexcept { return this->bytes_; }
+
+    private:
+        friend class RpcMemoryBudget;
+        RpcMemoryCharge(RpcMemoryBudget* budget, const void* owner,
+                        std::size_t bytes) noexcept
+            : budget_(budget), owner_(owner), bytes_(bytes)
+        {
+        }
+
+        RpcMemoryBudget* budget_{nullptr};
+        const void* owner_{nullptr};
+        std::size_t bytes_{0};
+    };
+
+    // Process-wide account of request/response bytes buffered by server
+    // connections: frame payloads, decrypted copies and responses waiting
+    // to be written. Set as RpcServerConfig::memory_budget; one instance
+    // may be shared by every server of the process.
+    class RpcMemoryBudget
+    {
+    public:
+        explicit RpcMemoryBudget(RpcMemoryBudgetConfig cfg = {});
+
+        RpcMemoryBudget(const RpcMemoryBudget&) = delete;
+        RpcMemoryBudget& operator=(const RpcMemoryBudget&) = delete;
+
+        // Accounts bytes for owner. Never fails; see admit().
+        RpcMemoryCharge charge(const void* owner, std::size_t bytes);
+
+        // false when a request body of this size must be rejected under the
+        // hard limit.
+        [[nodiscard]] bool admit(std::size_t bytes) const noexcept;
+
+        // True when reading `incoming` more bytes for owner would take
+        // usage over the soft limit and owner holds at least its fair share
+        // (held bytes / owners) of it. Owners are never paused when nothing
+        // held elsewhere or by their own handlers could free memory.
+        [[nodiscard]] bool should_pause(const void* owner,
+                                        std::size_t incoming) const;
+
+        // Waits while should_pause() holds.
+        usub::uvent::task::Awaitable<void> wait_for_room(const void* owner,
+                                                         std::size_t incoming);
+
+        void count_rejected() noexcept
+        {
+            this->rejected_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] std::size_t used() const noexcept
+        {
+            return this->used_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] std::size_t peak() const noexcept
+        {
+            return this->peak_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t rejected() const noexcept
+        {
+            return this->rejected_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t pauses() const noexcept
+        {
+            return this->pauses_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] const RpcMemoryBudgetConfig& config() const noexcept
+        {
+            return this->cfg_;
+        }
+
+    private:
+        friend class RpcMemoryCharge;
+        void release(const void* owner, std::size_t bytes) noexcept;
+
+    private:
+        RpcMemoryBudgetConfig cfg_;
+
+        std::atomic<std::size_t> used_{0};
+        std::atomic<std::size_t> peak_{0};
+        std::atomic<uint64_t> rejected_{0};
+        std::atomic<uint64_t> pauses_{0};
+
+        mutable std::mutex mutex_;
+        std::unordered_map<const void*, std::size_t> by_owner_;
+    };
+}
+
+#endif // URPC_RPCMEMORYBUDGET_H
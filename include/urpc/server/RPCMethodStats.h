@@ -0,0 +1,142 @@
+#ifndef URPC_RPCMETHODSTATS_H
+#define URPC_RPCMETHODSTATS_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <uvent/tasks/Awaitable.h>
+
+namespace urpc
+{
+    struct RpcMethodStatsEntry
+    {
+        uint64_t method_id{0}; // 0: methods beyond the table's capacity
+        uint64_t calls{0};
+        uint64_t wall_ns{0};   // handler start to return
+        uint64_t cpu_ns{0};    // thread CPU time attributed to the handler
+        uint64_t alloc_bytes{0};
+    };
+
+    struct RpcMethodStatsSnapshot
+    {
+        // Sorted by cpu_ns, highest first.
+        std::vector<RpcMethodStatsEntry> methods;
+    };
+
+    // Per-method handler cost, set as RpcServerConfig::method_stats.
+    //
+    // CPU time is read from CLOCK_THREAD_CPUTIME_ID each time a thread
+    // switches to or away from a handler, and the delta is charged to
+    // whatever the thread was attributed to, so time is never counted
+    // twice. The connection switches around the handler call, and every
+    // co_await in a handler body detaches the thread while the handler is
+    // suspended and re-attributes the thread it resumes on (see
+    // RPCHandlerCoroutine.h). Coroutines the handler awaits are not
+    // handlers: the CPU they use is charged to no method.
+    //
+    // alloc_bytes counts request and response buffers urpc allocates for
+    // the call, plus whatever note_alloc() reports while the handler is
+    // attributed (e.g. from an application allocator).
+    //
+    // Counters live in per-thread shards written only by their thread;
+    // snapshot() reads them without locking out writers.
+    class RpcMethodStats
+    {
+    public:
+        RpcMethodStats();
+        ~RpcMethodStats();
+
+        RpcMethodStats(const RpcMethodStats&) = delete;
+        RpcMethodStats& operator=(const RpcMethodStats&) = delete;
+
+        // What the calling thread is attributed to; restore with resume().
+        struct Attribution
+        {
+            RpcMethodStats* stats{nullptr};
+            uint64_t method_id{0};
+            uint64_t call{0}; // identifies the enter() that started it
+        };
+
+        // Attributes this thread to method_id (called before the handler).
+        // The result is handed back to leave().
+        Attribution enter(uint64_t method_id, std::size_t request_bytes);
+
+        // Counts the call. If the thread is still attributed to it, charges
+        // the CPU time and detaches the thread; a handler that returned on
+        // another thread, or after another call took this one over, leaves
+        // that attribution alone (called when the handler returned).
+        void leave(const Attribution& call,
+                   uint64_t wall_ns,
+                   std::size_t response_bytes);
+
+        RpcMethodStatsSnapshot snapshot() const;
+
+        // Charges the running attribution and detaches the thread; returns
+        // what it was. Called right before a handler suspends.
+        static Attribution suspend() noexcept;
+
+        // Re-attributes the thread after a resumption.
+        static void resume(Attribution a) noexcept;
+
+        // Adds bytes to the method the calling thread is attributed to, if
+        // any. Cheap enough for an allocator hook.
+        static void note_alloc(std::size_t bytes) noexcept;
+
+    private:
+        static constexpr std::size_t kSlots = 512;
+
+        struct Slot
+        {
+            std::atomic<uint64_t> method_id{0};
+            std::atomic<uint64_t> calls{0};
+            std::atomic<uint64_t> wall_ns{0};
+            std::atomic<uint64_t> cpu_ns{0};
+            std::atomic<uint64_t> alloc_bytes{0};
+        };
+
+        struct Shard
+        {
+            std::array<Slot, kSlots> slots;
+            Slot overflow;
+        };
+
+        Shard& local_shard();
+        Slot& slot(uint64_t method_id);
+
+        static void switch_to(const Attribution& to) noexcept;
+
+    private:
+        const uint64_t id_;
+
+        mutable std::mutex shards_mutex_;
+        std::vector<std::unique_ptr<Shard>> shards_;
+    };
+
+    // Detaches the thread around one await. A handler's own awaits already
+    // do this; kept for handlers written against earlier releases.
+    template <class T>
+    usub::uvent::task::Awaitable<T> cpu_attributed(usub::uvent::task::Awaitable<T> aw)
+    {
+        const RpcMethodStats::Attribution a = RpcMethodStats::suspend();
+        if constexpr (std::is_void_v<T>)
+        {
+            co_await std::move(aw);
+            RpcMethodStats::resume(a);
+        }
+        else
+        {
+            T v = co_await std::move(aw);
+            RpcMethodStats::resume(a);
+            co_return v;
+        }
+    }
+}
+
+#endif // URPC_RPCMETHODSTATS_H
@@ -0,0 +1,99 @@
+#ifndef URPC_RPCMETRICSEXPORTER_H
+#define URPC_RPCMETRICSEXPORTER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <uvent/Uvent.h>
+#include <uvent/tasks/Awaitable.h>
+#include <uvent/net/Socket.h>
+
+namespace urpc
+{
+    class RpcServer;
+    class RpcClient;
+    class RpcClientPool;
+
+    struct RpcMetricsExporterConfig
+    {
+        // Built-in HTTP listener serving GET /metrics. 0 = no listener.
+        std::string http_host{"0.0.0.0"};
+        uint16_t http_port{0};
+
+        // File rewritten (temp file + rename) every file_interval_ms by a
+        // dedicated writer thread, off the event loop. Empty = no file.
+        std::string file_path;
+        uint32_t file_interval_ms{10000};
+    };
+
+    // Renders the statistics of registered servers, clients and pools as
+    // OpenMetrics text (Prometheus text format compatible). Every value is
+    // read from per-thread shards or atomics while the owners keep
+    // running, so a scrape never blocks request processing; counters that
+    // move during a scrape may be off by the calls in flight.
+    //
+    // Registered objects are referenced, not owned: they, and the
+    // exporter, must outlive the runtime it is attached to. The file
+    // writer thread is stopped and joined by the destructor.
+    class RpcMetricsExporter
+    {
+    public:
+        explicit RpcMetricsExporter(RpcMetricsExporterConfig cfg = {});
+        ~RpcMetricsExporter();
+
+        RpcMetricsExporter(const RpcMetricsExporter&) = delete;
+        RpcMetricsExporter& operator=(const RpcMetricsExporter&) = delete;
+
+        // name becomes the server= / client= / pool= label.
+        void add_server(std::string name, const RpcServer& server);
+        void add_client(std::string name, const RpcClient& client);
+        void add_pool(std::string name, const RpcClientPool& pool);
+
+        [[nodiscard]] std::string render() const;
+
+        // Writes render() to config.file_path atomically. false on I/O
+        // errors or without a path. Blocks on disk I/O; the exporter only
+        // calls it from its writer thread.
+        bool write_file() const;
+
+        // Starts the file writer thread and/or runs the HTTP listener, as
+        // configured.
+        usub::uvent::task::Awaitable<void> run_async();
+
+        // Spawns run_async() on the first thread of a caller-owned runtime.
+        void attach(usub::Uvent& uvent);
+
+    private:
+        void start_file_writer();
+        void file_writer_loop();
+        usub::uvent::task::Awaitable<void> http_loop();
+        usub::uvent::task::Awaitable<void> serve(
+            usub::uvent::net::TCPClientSocket socket);
+
+        template <class T>
+        struct Source
+        {
+            std::string name;
+            const T* object;
+        };
+
+        RpcMetricsExporterConfig cfg_;
+
+        std::once_flag writer_once_;
+        std::thread writer_;
+        std::mutex writer_mutex_;
+        std::condition_variable writer_cv_;
+        bool writer_stop_{false};
+
+        mutable std::mutex mutex_;
+        std::vector<Source<RpcServer>> servers_;
+        std::vector<Source<RpcClient>> clients_;
+        std::vector<Source<RpcClientPool>> pools_;
+    };
+}
+
+#endif // URPC_RPCMETRICSEXPORTER_H
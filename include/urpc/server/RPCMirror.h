@@ -0,0 +1,98 @@
+//
+// Created by root on 12/14/25.
+//
+
+#ifndef RPCMIRROR_H
+#define RPCMIRROR_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_set>
+
+#include <uvent/tasks/Awaitable.h>
+#include <uvent/sync/AsyncEvent.h>
+
+#include <urpc/client/RPCClient.h>
+#include <urpc/config/Config.h>
+#include <urpc/utils/BoundedQueue.h>
+
+namespace urpc
+{
+    struct RpcMirrorConfig
+    {
+        std::string host;
+        uint16_t port{0};
+        std::shared_ptr<IRpcStreamFactory> stream_factory;
+
+        // Empty = every method.
+        std::unordered_set<uint64_t> methods;
+
+        // 0..100, share of matching requests that are mirrored.
+        uint32_t sample_percent{100};
+
+        std::size_t queue_capacity{1024};
+        std::size_t max_inflight{256};
+        uint32_t timeout_ms{1000};
+    };
+
+    // Fire-and-forget copy of sampled requests to a secondary endpoint.
+    // offer() is wait-free from the caller's point of view: a full queue or
+    // too many outstanding mirror calls drop the request. Responses from the
+    // mirror target are discarded.
+    class RpcMirror : public std::enable_shared_from_this<RpcMirror>
+    {
+    public:
+        explicit RpcMirror(RpcMirrorConfig cfg);
+
+        // Method filter + sampling. Cheap; call before preparing the body.
+        [[nodiscard]] bool should_mirror(uint64_t method_id) const noexcept;
+
+        // owner keeps body alive until the mirror call has been sent.
+        bool offer(uint64_t method_id,
+                   std::shared_ptr<const void> owner,
+                   std::span<const uint8_t> body);
+
+        [[nodiscard]] uint64_t mirrored() const noexcept
+        {
+            return this->mirrored_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t dropped() const noexcept
+        {
+            return this->dropped_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct Item
+        {
+            uint64_t method_id{0};
+            std::shared_ptr<const void> owner;
+            std::span<const uint8_t> body;
+        };
+
+        static usub::uvent::task::Awaitable<void> drain_loop(
+            std::shared_ptr<RpcMirror> self);
+
+        static usub::uvent::task::Awaitable<void> send_one(
+            std::shared_ptr<RpcMirror> self,
+            Item item);
+
+    private:
+        RpcMirrorConfig cfg_;
+        std::shared_ptr<RpcClient> client_;
+        BoundedQueue<Item> queue_;
+
+        std::shared_ptr<usub::uvent::sync::AsyncEvent> wake_;
+        std::atomic<bool> started_{false};
+        std::atomic<bool> parked_{false};
+        std::atomic<std::size_t> inflight_{0};
+
+        std::atomic<uint64_t> mirrored_{0};
+        std::atomic<uint64_t> dropped_{0};
+    };
+}
+
+#endif // RPCMIRROR_H
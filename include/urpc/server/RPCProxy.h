@@ -0,0 +1,134 @@
+//
+// Created by root on 12/14/25.
+//
+
+#ifndef RPCPROXY_H
+#define RPCPROXY_H
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <uvent/Uvent.h>
+#include <uvent/tasks/Awaitable.h>
+#include <uvent/sync/AsyncMutex.h>
+#include <uvent/system/SystemContext.h>
+#include <uvent/net/Socket.h>
+
+#include <ulog/ulog.h>
+
+#include <urpc/client/RPCClientPool.h>
+#include <urpc/config/Config.h>
+#include <urpc/datatypes/Frame.h>
+#include <urpc/datatypes/PendingCall.h>
+#include <urpc/transport/IRPCStream.h>
+#include <urpc/transport/IRPCStreamFactory.h>
+
+namespace urpc
+{
+    // Routing table: exact method ids first, then inclusive [lo, hi] ranges
+    // in insertion order, then the default pool.
+    class RpcRouteTable
+    {
+    public:
+        void add(uint64_t method_id, RpcClientPool* pool);
+        void add_range(uint64_t lo, uint64_t hi, RpcClientPool* pool);
+        void set_default(RpcClientPool* pool);
+
+        [[nodiscard]] RpcClientPool* find(uint64_t method_id) const;
+
+    private:
+        struct Range
+        {
+            uint64_t lo;
+            uint64_t hi;
+            RpcClientPool* pool;
+        };
+
+        std::unordered_map<uint64_t, RpcClientPool*> exact_;
+        std::vector<Range> ranges_;
+        RpcClientPool* default_{nullptr};
+    };
+
+    class RpcProxyConnection
+        : public std::enable_shared_from_this<RpcProxyConnection>
+    {
+    public:
+        RpcProxyConnection(std::shared_ptr<IRpcStream> stream,
+                           const RpcRouteTable& routes,
+                           uint32_t upstream_timeout_ms,
+                           std::shared_ptr<const RpcCryptoPolicy> crypto_policy = nullptr);
+
+        static usub::uvent::task::Awaitable<void> run_detached(
+            std::shared_ptr<RpcProxyConnection> self);
+
+    private:
+        struct InFlight
+        {
+            RpcClient* client{nullptr};
+            RpcCallHandle handle;
+        };
+
+        usub::uvent::task::Awaitable<void> loop();
+
+        static usub::uvent::task::Awaitable<void> forward_detached(
+            std::shared_ptr<RpcProxyConnection> self,
+            RpcFrame frame);
+
+        usub::uvent::task::Awaitable<void> forward(RpcFrame frame);
+        usub::uvent::task::Awaitable<void> relay_cancel(const RpcFrame& frame);
+        usub::uvent::task::Awaitable<void> reply_pong(const RpcFrame& frame);
+
+        bool should_encrypt(uint64_t method_id, std::size_t size) const;
+
+        usub::uvent::task::Awaitable<void> send_downstream(
+            RpcFrameHeader hdr,
+            std::span<const uint8_t> body);
+
+        // No-op for FLAG_ONEWAY requests.
+        usub::uvent::task::Awaitable<void> send_error(
+            const RpcFrameHeader& request,
+            uint32_t code,
+            std::string_view message);
+
+    private:
+        std::shared_ptr<IRpcStream> stream_;
+        const RpcRouteTable& routes_;
+        uint32_t upstream_timeout_ms_;
+        std::shared_ptr<const RpcCryptoPolicy> crypto_policy_;
+
+        usub::uvent::sync::AsyncMutex write_mutex_;
+        usub::uvent::sync::AsyncMutex inflight_mutex_;
+        std::unordered_map<uint32_t, InFlight> inflight_;
+    };
+
+    // Frame-level router: requests are forwarded by method_id to upstream
+    // RpcClientPools without running any handler. Only stream ids are
+    // rewritten; Cancel frames are relayed to the upstream call.
+    class RpcProxy
+    {
+    public:
+        explicit RpcProxy(RpcProxyConfig cfg);
+
+        void route(uint64_t method_id, RpcClientPool* pool);
+        void route(std::string_view name, RpcClientPool* pool);
+        void route_range(uint64_t lo, uint64_t hi, RpcClientPool* pool);
+        void set_default_route(RpcClientPool* pool);
+
+        usub::uvent::task::Awaitable<void> run_async();
+        void attach(usub::Uvent& uvent);
+        void run();
+
+    private:
+        usub::uvent::task::Awaitable<void> accept_loop();
+
+    private:
+        RpcProxyConfig config_;
+        RpcRouteTable routes_;
+    };
+}
+
+#endif // RPCPROXY_H
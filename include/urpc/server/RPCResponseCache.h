@@ -0,0 +1,130 @@
+#ifndef URPC_RPCRESPONSECACHE_H
+#define URPC_RPCRESPONSECACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <urpc/server/RPCDiskCache.h>
+
+namespace urpc
+{
+    struct RpcResponseCacheConfig
+    {
+        // In-memory LRU tier. 0 disables it.
+        std::size_t memory_bytes{64ull << 20};
+
+        // Responses above this stay out of memory (disk tier only).
+        std::size_t memory_max_entry_bytes{1ull << 20};
+
+        // Optional persistent tier; disk.path empty disables it.
+        RpcDiskCacheConfig disk{};
+    };
+
+    // Memoizes handler responses by (method, request body) for methods that
+    // opt in with cache_method(). Lookups go to an in-memory LRU first, then
+    // to the mapped-file tier (RpcDiskCache), whose hits are sent straight
+    // from the mapping and promoted to memory when small enough. Stores go
+    // to both tiers. Set as RpcServerConfig::response_cache.
+    //
+    // Only deterministic methods should be cached: a hit skips the handler,
+    // including any side effect it has.
+    class RpcResponseCache
+    {
+    public:
+        explicit RpcResponseCache(RpcResponseCacheConfig cfg = {});
+
+        RpcResponseCache(const RpcResponseCache&) = delete;
+        RpcResponseCache& operator=(const RpcResponseCache&) = delete;
+
+        // Call before the server starts. ttl_ms 0: entries never expire
+        // (they still age out of both tiers).
+        void cache_method(uint64_t method_id, uint32_t ttl_ms = 0);
+
+        [[nodiscard]] bool caches(uint64_t method_id) const noexcept;
+
+        RpcCachedResponse lookup(uint64_t method_id,
+                                 std::span<const uint8_t> request);
+
+        void store(uint64_t method_id,
+                   std::span<const uint8_t> request,
+                   std::span<const uint8_t> response);
+
+        // Drops the memory tier; disk entries stay until overwritten.
+        void clear_memory();
+
+        // Forwards to the disk tier, if any.
+        void flush();
+
+        [[nodiscard]] bool has_disk() const noexcept { return this->disk_ != nullptr; }
+
+        [[nodiscard]] uint64_t memory_hits() const noexcept
+        {
+            return this->memory_hits_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t disk_hits() const noexcept
+        {
+            return this->disk_hits_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t misses() const noexcept
+        {
+            return this->misses_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t stores() const noexcept
+        {
+            return this->stores_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] std::size_t memory_used() const;
+
+    private:
+        struct Entry
+        {
+            uint64_t key;
+            uint64_t method_id;
+            uint64_t expires_ms;
+            std::vector<uint8_t> request;
+            std::vector<uint8_t> response;
+        };
+
+        using Lru = std::list<std::shared_ptr<const Entry>>;
+
+        static uint64_t make_key(uint64_t method_id,
+                                 std::span<const uint8_t> request) noexcept;
+        static uint64_t now_ms() noexcept;
+
+        uint64_t expiry_for(uint64_t method_id, uint64_t now) const;
+
+        RpcCachedResponse memory_get(uint64_t key,
+                                     uint64_t method_id,
+                                     std::span<const uint8_t> request,
+                                     uint64_t now);
+        void memory_put(std::shared_ptr<const Entry> e);
+
+    private:
+        RpcResponseCacheConfig cfg_;
+        std::unordered_map<uint64_t, uint32_t> methods_; // mid -> ttl_ms
+        std::shared_ptr<RpcDiskCache> disk_;
+
+        mutable std::mutex mutex_;
+        Lru lru_; // front = most recent
+        std::unordered_map<uint64_t, Lru::iterator> index_;
+        std::size_t memory_used_{0};
+
+        std::atomic<uint64_t> memory_hits_{0};
+        std::atomic<uint64_t> disk_hits_{0};
+        std::atomic<uint64_t> misses_{0};
+        std::atomic<uint64_t> stores_{0};
+    };
+}
+
+#endif // URPC_RPCRESPONSECACHE_H
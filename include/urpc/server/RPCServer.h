@@ -12,6 +12,7 @@
 #include <utility>
 #include <type_traits>
 #include <span>
+#include <vector>
 
 #include <uvent/Uvent.h>
 #include <uvent/system/SystemContext.h>
@@ -21,27 +22,14 @@
 
 #include <urpc/config/Config.h>
 #include <urpc/registry/RPCMethodRegistry.h>
+#include <urpc/registry/RPCTopicRegistry.h>
+#include <urpc/server/RPCServerStats.h>
 #include <urpc/connection/RPCConnection.h>
 #include <urpc/transport/IRPCStreamFactory.h>
 #include <urpc/context/RPCContext.h>
 
 namespace urpc
 {
-    namespace detail
-    {
-        template <class T>
-        struct awaitable_value;
-
-        template <class T>
-        struct awaitable_value<usub::uvent::task::Awaitable<T>>
-        {
-            using type = T;
-        };
-
-        template <class T>
-        using awaitable_value_t = typename awaitable_value<T>::type;
-    }
-
     class RpcServer
     {
     public:
@@ -61,54 +49,76 @@ namespace urpc
                 "RpcServer: register_method_ct MethodId={}",
                 MethodId);
 #endif
-            using Functor = std::decay_t<F>;
-            static Functor func = std::forward<F>(f);
-
-            using RawRet = std::invoke_result_t<
-                Functor&,
-                RpcContext&,
-                std::span<const std::uint8_t>>;
-
-            using Result = detail::awaitable_value_t<RawRet>;
-
-            auto wrapper =
-                [](urpc::RpcContext& ctx,
-                   std::span<const std::uint8_t> body)
-                -> usub::uvent::task::Awaitable<std::vector<std::uint8_t>>
-            {
-                if constexpr (std::is_same_v<Result, std::vector<std::uint8_t>>)
-                {
-                    co_return co_await func(ctx, body);
-                }
-                else if constexpr (ByteRange<Result>)
-                {
-                    Result r = co_await func(ctx, body);
-                    co_return to_byte_vector(std::move(r));
-                }
-                else
-                {
-                    static_assert(
-                        std::is_same_v<Result, void>,
-                        "RpcServer::register_method_ct: unsupported handler result type");
-                    co_return std::vector<std::uint8_t>{};
-                }
-            };
-
-            this->register_method(MethodId, wrapper);
+            this->registry_.register_method_ct<MethodId>(
+                std::forward<F>(f));
         }
 
         void register_method(uint64_t method_id, RpcHandlerPtr fn);
         void register_method(std::string_view name, RpcHandlerPtr fn);
 
+        // Stateful callable; the registry keeps a copy per registration.
+        template <typename F>
+            requires (!std::is_convertible_v<F, RpcHandlerPtr>)
+        void register_method(uint64_t method_id, F&& f)
+        {
+            this->registry_.register_method(method_id, std::forward<F>(f));
+        }
+
+        template <typename F>
+            requires (!std::is_convertible_v<F, RpcHandlerPtr>)
+        void register_method(std::string_view name, F&& f)
+        {
+            this->registry_.register_method(name, std::forward<F>(f));
+        }
+
+        // Member function on an object that outlives the server.
+        template <auto Member, class Obj>
+        void register_member(uint64_t method_id, Obj* obj)
+        {
+            this->registry_.register_member<Member>(method_id, obj);
+        }
+
+        // Broadcasts body to every connection subscribed to topic (see
+        // RpcClient::subscribe). The body is shared by all connections and
+        // only copied for those that use app-layer encryption. Returns the
+        // number of connections the message was queued for.
+        usub::uvent::task::Awaitable<std::size_t> publish(
+            std::string_view topic,
+            std::span<const uint8_t> body);
+
+        usub::uvent::task::Awaitable<std::size_t> publish(
+            std::string_view topic,
+            std::shared_ptr<const std::vector<uint8_t>> body);
+
         usub::uvent::task::Awaitable<void> run_async();
+
+        // Spawns this server's accept loop on every thread of a caller-owned
+        // runtime. Call before uvent.run(); several servers (own ports and
+        // registries), proxies and clients can share one Uvent this way.
+        void attach(usub::Uvent& uvent);
+
+        // Owns a Uvent with config.threads threads and blocks in it.
         void run();
 
+        [[nodiscard]] const RpcServerStats& stats() const noexcept
+        {
+            return *this->stats_;
+        }
+
+        [[nodiscard]] const RpcServerConfig& config() const noexcept
+        {
+            return this->config_;
+        }
+
     private:
         usub::uvent::task::Awaitable<void> accept_loop();
 
     private:
         RpcMethodRegistry registry_;
+        RpcTopicRegistry topics_;
         RpcServerConfig config_;
+        // Held by pointer: the counters can be neither copied nor moved.
+        std::shared_ptr<RpcServerStats> stats_{std::make_shared<RpcServerStats>()};
     };
 }
 
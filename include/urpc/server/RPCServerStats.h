@@ -0,0 +1,27 @@
+#ifndef URPC_RPCSERVERSTATS_H
+#define URPC_RPCSERVERSTATS_H
+
+#include <urpc/utils/ShardedCounter.h>
+
+namespace urpc
+{
+    // Counters kept by every RpcServer (RpcServer::stats()) and updated by
+    // its connections.
+    struct RpcServerStats
+    {
+        ShardedCounter connections_accepted;
+        ShardedCounter connections_active; // gauge
+        ShardedCounter connections_evicted;
+
+        ShardedCounter requests;
+        ShardedCounter request_bytes;
+        ShardedCounter responses;      // including error responses
+        ShardedCounter response_bytes;
+        ShardedCounter errors;         // error responses
+
+        // Frame read to handler done (response queued), microseconds.
+        ShardedHistogram request_latency_us = make_latency_histogram();
+    };
+}
+
+#endif // URPC_RPCSERVERSTATS_H
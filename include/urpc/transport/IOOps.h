@@ -1,13 +1,37 @@
 #ifndef IOOPS_H
 #define IOOPS_H
 
+#include <algorithm>
+#include <chrono>
 #include <span>
+#include <vector>
 #include <urpc/datatypes/Frame.h>
 #include <urpc/transport/IRPCStream.h>
+#include <urpc/utils/Crc32c.h>
 
 namespace urpc {
     using namespace usub::uvent;
 
+    inline int64_t steady_now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    inline constexpr std::size_t kFrameCrcSize = 4;
+
+    // Payloads up to this size are copied next to the header while the CRC
+    // is computed and go out in a single write; larger ones are checksummed
+    // in place and written as header / payload / trailer.
+    inline constexpr std::size_t kFrameCrcCoalesceLimit = 64 * 1024;
+
+    // On Ping/Pong FLAG_CRC32C is the negotiation offer/ack and no trailer
+    // is sent; every other frame type carries one when the flag is set.
+    URPC_ALWAYS_INLINE bool frame_has_crc(const RpcFrameHeader &hdr) {
+        const auto t = static_cast<FrameType>(hdr.type);
+        return (hdr.flags & FLAG_CRC32C) != 0 &&
+               t != FrameType::Ping && t != FrameType::Pong;
+    }
+
     inline task::Awaitable<bool> write_all(
         IRpcStream &stream,
         const uint8_t *data,
@@ -21,6 +45,7 @@ namespace urpc {
             if (r <= 0) co_return false;
 
             off += static_cast<size_t>(r);
+            stream.note_write_progress(steady_now_ns());
         }
         co_return true;
     }
@@ -29,15 +54,192 @@ namespace urpc {
         IRpcStream &stream,
         const RpcFrameHeader &hdr,
         std::span<const uint8_t> payload) {
+        RpcFrameHeader h = hdr;
+        std::vector<uint8_t> zbuf;
+        const auto t = static_cast<FrameType>(h.type);
+        if (t != FrameType::Ping && t != FrameType::Pong)
+        {
+            if (stream.frame_crc())
+                h.flags |= FLAG_CRC32C;
+            else
+                h.flags &= static_cast<uint16_t>(~FLAG_CRC32C);
+
+            // Ciphertext does not compress; app-encrypted bodies go as is.
+            h.flags &= static_cast<uint16_t>(~FLAG_COMPRESSED);
+            DeflateStream *z = stream.deflater();
+            if (z && !payload.empty() && (h.flags & FLAG_ENCRYPTED) == 0)
+            {
+                if (!z->compress(payload, zbuf)) co_return false;
+                h.flags |= FLAG_COMPRESSED;
+                h.length = static_cast<uint32_t>(zbuf.size());
+                payload = std::span<const uint8_t>{zbuf.data(), zbuf.size()};
+            }
+        }
+
+        if (!frame_has_crc(h)) {
+            std::array<uint8_t, RpcFrameHeaderSize> header_buf{};
+            serialize_header(h, header_buf.data());
+
+            if (!(co_await write_all(stream, header_buf.data(), header_buf.size()))) co_return false;
+            if (!payload.empty())
+                if (!(co_await write_all(stream, payload.data(), payload.size()))) co_return false;
+
+            co_return true;
+        }
+
+        if (payload.size() <= kFrameCrcCoalesceLimit) {
+            std::vector<uint8_t> buf(RpcFrameHeaderSize + payload.size() + kFrameCrcSize);
+            serialize_header(h, buf.data());
+
+            uint32_t crc = crc32c_update(kCrc32cInit, buf.data(), RpcFrameHeaderSize);
+            crc = crc32c_copy(crc, buf.data() + RpcFrameHeaderSize,
+                              payload.data(), payload.size());
+
+            const uint32_t be = host_to_be<uint32_t>(crc32c_finish(crc));
+            std::memcpy(buf.data() + RpcFrameHeaderSize + payload.size(), &be, kFrameCrcSize);
+
+            co_return co_await write_all(stream, buf.data(), buf.size());
+        }
+
         std::array<uint8_t, RpcFrameHeaderSize> header_buf{};
-        serialize_header(hdr, header_buf.data());
+        serialize_header(h, header_buf.data());
+
+        uint32_t crc = crc32c_update(kCrc32cInit, header_buf.data(), header_buf.size());
+        crc = crc32c_update(crc, payload.data(), payload.size());
+
+        std::array<uint8_t, kFrameCrcSize> trailer{};
+        const uint32_t be = host_to_be<uint32_t>(crc32c_finish(crc));
+        std::memcpy(trailer.data(), &be, kFrameCrcSize);
 
         if (!(co_await write_all(stream, header_buf.data(), header_buf.size()))) co_return false;
-        if (!payload.empty())
-            if (!(co_await write_all(stream, payload.data(), payload.size()))) co_return false;
+        if (!(co_await write_all(stream, payload.data(), payload.size()))) co_return false;
+        co_return co_await write_all(stream, trailer.data(), trailer.size());
+    }
+
+    inline task::Awaitable<bool> read_crc_trailer(IRpcStream &stream,
+                                                  uint32_t &crc) {
+        utils::DynamicBuffer trailer;
+        trailer.reserve(kFrameCrcSize);
+        while (trailer.size() < kFrameCrcSize) {
+            const ssize_t r = co_await stream.async_read(
+                trailer, kFrameCrcSize - trailer.size());
+            if (r <= 0) co_return false;
+        }
 
+        uint32_t be = 0;
+        std::memcpy(&be, trailer.data(), kFrameCrcSize);
+        crc = be_to_host<uint32_t>(be);
         co_return true;
     }
+
+    // Called by frame readers after the payload has been read. head is the
+    // raw 28-byte header as received. Once a CRC'd data frame has been seen
+    // on the link (crc_seen), a data frame without the flag is treated as
+    // corruption, since a flipped flag bit would otherwise disable the check.
+    inline task::Awaitable<bool> read_frame_crc(
+        IRpcStream &stream,
+        const RpcFrameHeader &hdr,
+        const uint8_t *head,
+        std::span<const uint8_t> payload,
+        bool &crc_seen) {
+        const auto t = static_cast<FrameType>(hdr.type);
+        if (t == FrameType::Ping || t == FrameType::Pong)
+            co_return true;
+
+        if (!frame_has_crc(hdr))
+            co_return !crc_seen;
+        crc_seen = true;
+
+        uint32_t wire = 0;
+        if (!co_await read_crc_trailer(stream, wire))
+            co_return false;
+
+        uint32_t crc = crc32c_update(kCrc32cInit, head, RpcFrameHeaderSize);
+        crc = crc32c_update(crc, payload.data(), payload.size());
+        co_return wire == crc32c_finish(crc);
+    }
+
+    // Reads a frame body of hdr.length bytes, and its CRC trailer, through
+    // a small scratch buffer and drops it. Used to skip a rejected request
+    // without buffering it; the CRC is still checked so a corrupted length
+    // cannot desynchronise the link unnoticed.
+    inline task::Awaitable<bool> discard_frame_body(
+        IRpcStream &stream,
+        const RpcFrameHeader &hdr,
+        const uint8_t *head,
+        bool &crc_seen) {
+        constexpr std::size_t kChunk = 64 * 1024;
+
+        const bool has_crc = frame_has_crc(hdr);
+        uint32_t crc = has_crc
+                           ? crc32c_update(kCrc32cInit, head, RpcFrameHeaderSize)
+                           : 0;
+
+        // A compressed body still has to go through the link's inflate
+        // stream, or every later compressed frame would fail to decode.
+        InflateStream *z = nullptr;
+        if (hdr.flags & FLAG_COMPRESSED) {
+            z = stream.inflater();
+            if (!z) co_return false;
+            z->set_max_message(kMaxFrameBodyLength);
+        }
+        const InflateStream::Sink drop = [](std::span<const uint8_t>) {};
+
+        utils::DynamicBuffer scratch;
+        std::size_t left = hdr.length;
+        while (left > 0) {
+            scratch.clear();
+            const std::size_t want = std::min(left, kChunk);
+            const ssize_t r = co_await stream.async_read(scratch, want);
+            if (r <= 0) co_return false;
+            if (has_crc)
+                crc = crc32c_update(crc, scratch.data(), scratch.size());
+            if (z && !z->write({scratch.data(), scratch.size()}, drop))
+                co_return false;
+            left -= std::min(left, scratch.size());
+        }
+        if (z && !z->end_message(drop))
+            co_return false;
+
+        if (!has_crc)
+            co_return !crc_seen;
+        crc_seen = true;
+
+        uint32_t wire = 0;
+        if (!co_await read_crc_trailer(stream, wire))
+            co_return false;
+        co_return wire == crc32c_finish(crc);
+    }
+
+    // Replaces a FLAG_COMPRESSED payload (read and CRC-checked) by its
+    // decoded form and clears the flag. false for a compressed frame on a
+    // link that never agreed to compression, or for corrupt data.
+    inline bool inflate_frame(IRpcStream &stream,
+                              RpcFrameHeader &hdr,
+                              utils::DynamicBuffer &payload) {
+        const auto t = static_cast<FrameType>(hdr.type);
+        if ((hdr.flags & FLAG_COMPRESSED) == 0 ||
+            t == FrameType::Ping || t == FrameType::Pong)
+            return true;
+
+        InflateStream *z = stream.inflater();
+        if (!z)
+            return false;
+        z->set_max_message(kMaxFrameBodyLength);
+
+        utils::DynamicBuffer out;
+        const InflateStream::Sink sink = [&out](std::span<const uint8_t> b) {
+            out.append(b.data(), b.size());
+        };
+        if (!z->write({payload.data(), payload.size()}, sink) ||
+            !z->end_message(sink))
+            return false;
+
+        payload = std::move(out);
+        hdr.length = static_cast<uint32_t>(payload.size());
+        hdr.flags &= static_cast<uint16_t>(~FLAG_COMPRESSED);
+        return true;
+    }
 }
 
 #endif // IOOPS_H
@@ -6,11 +6,19 @@
 #define IRPCSTREAM_H
 
 #include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
 
 #include <uvent/utils/buffer/DynamicBuffer.h>
 #include <uvent/tasks/Awaitable.h>
 
 #include <urpc/transport/TlsPeer.h>
+#include <urpc/utils/StreamCompression.h>
 
 namespace urpc
 {
@@ -29,6 +37,122 @@ namespace urpc
 
         virtual void shutdown() = 0;
         virtual ~IRpcStream() = default;
+
+        // Remote IP address (no port), empty when unknown. Stays the same
+        // across a client's reconnects, unlike the connection itself.
+        [[nodiscard]] virtual std::string peer_address() const
+        {
+            return {};
+        }
+
+        // Set once both ends agreed on CRC32C frame trailers (plain links
+        // only, see send_frame()).
+        void enable_frame_crc(bool on) noexcept
+        {
+            this->frame_crc_.store(on, std::memory_order_release);
+        }
+
+        [[nodiscard]] bool frame_crc() const noexcept
+        {
+            return this->frame_crc_.load(std::memory_order_acquire);
+        }
+
+        // Set once both ends agreed that requests may carry an idempotency
+        // key (FLAG_IDEMPOTENCY_KEY); a peer that never agreed would take
+        // the key for part of the body.
+        void enable_idempotency_keys(bool on) noexcept
+        {
+            this->idempotency_keys_.store(on, std::memory_order_release);
+        }
+
+        [[nodiscard]] bool idempotency_keys() const noexcept
+        {
+            return this->idempotency_keys_.load(std::memory_order_acquire);
+        }
+
+        // Steady-clock time (ns) of the last async_write that moved bytes;
+        // updated by write_all(). Used to tell a slow peer from a stuck one.
+        void note_write_progress(int64_t now_ns) noexcept
+        {
+            this->write_progress_ns_.store(now_ns, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] int64_t last_write_progress_ns() const noexcept
+        {
+            return this->write_progress_ns_.load(std::memory_order_relaxed);
+        }
+
+        // Connection-level compression (FLAG_COMPRESSED, plain links only).
+        // The receive side is set up before the offer / ack goes out, so
+        // compressed frames may follow it at once; the send side is
+        // switched on when the peer has agreed. Both last as long as the
+        // stream. Returns false when built without zlib.
+        bool prepare_inflate()
+        {
+            if (!DeflateStream::available())
+                return false;
+            if (!this->inflate_.load(std::memory_order_acquire))
+            {
+                this->inflate_owner_ = std::make_unique<InflateStream>();
+                this->inflate_.store(this->inflate_owner_.get(),
+                                     std::memory_order_release);
+            }
+            return true;
+        }
+
+        bool enable_deflate(int level)
+        {
+            if (!DeflateStream::available())
+                return false;
+            if (!this->deflate_.load(std::memory_order_acquire))
+            {
+                this->deflate_owner_ = std::make_unique<DeflateStream>(level);
+                this->deflate_.store(this->deflate_owner_.get(),
+                                     std::memory_order_release);
+            }
+            return true;
+        }
+
+        // Used by send_frame() under the connection's write lock.
+        [[nodiscard]] DeflateStream* deflater() const noexcept
+        {
+            return this->deflate_.load(std::memory_order_acquire);
+        }
+
+        // Used by the connection's (single) frame reader.
+        [[nodiscard]] InflateStream* inflater() const noexcept
+        {
+            return this->inflate_.load(std::memory_order_acquire);
+        }
+
+    protected:
+        static std::string socket_peer_ip(int fd)
+        {
+            sockaddr_storage ss{};
+            socklen_t len = sizeof(ss);
+            if (fd < 0 ||
+                ::getpeername(fd, reinterpret_cast<sockaddr*>(&ss), &len) != 0)
+                return {};
+
+            char buf[INET6_ADDRSTRLEN]{};
+            const void* addr = nullptr;
+            if (ss.ss_family == AF_INET)
+                addr = &reinterpret_cast<const sockaddr_in*>(&ss)->sin_addr;
+            else if (ss.ss_family == AF_INET6)
+                addr = &reinterpret_cast<const sockaddr_in6*>(&ss)->sin6_addr;
+            if (!addr || !::inet_ntop(ss.ss_family, addr, buf, sizeof(buf)))
+                return {};
+            return buf;
+        }
+
+    private:
+        std::atomic<bool> frame_crc_{false};
+        std::atomic<bool> idempotency_keys_{false};
+        std::unique_ptr<DeflateStream> deflate_owner_;
+        std::unique_ptr<InflateStream> inflate_owner_;
+        std::atomic<DeflateStream*> deflate_{nullptr};
+        std::atomic<InflateStream*> inflate_{nullptr};
+        std::atomic<int64_t> write_progress_ns_{0};
     };
 }
 
@@ -37,6 +37,8 @@ namespace urpc
 
         [[nodiscard]] const RpcPeerIdentity* peer_identity() const noexcept override;
 
+        [[nodiscard]] std::string peer_address() const override;
+
         [[nodiscard]] bool get_app_secret_key(
             std::array<uint8_t, 32>& out_key) const noexcept override
         {
@@ -3,16 +3,33 @@
 #ifndef TLSCONFIG_H
 #define TLSCONFIG_H
 
+#include <cstdint>
 #include <string>
 
 namespace urpc
 {
+    // AEAD used for app-layer payload encryption. The client offers the
+    // suites it accepts through ALPN during the TLS handshake and the server
+    // picks one; a server whose explicit suite the client does not offer
+    // fails the handshake. Auto accepts either and, on the server, follows
+    // the cipher the TLS handshake settled on (ChaCha20 TLS suite ->
+    // ChaCha20-Poly1305, otherwise AES-256-GCM).
+    enum class AppCipherSuite : uint8_t
+    {
+        Auto = 0,
+        Aes256Gcm = 1,
+        ChaCha20Poly1305 = 2,
+    };
+
     struct TlsClientConfig
     {
         bool enabled{false};
         bool verify_peer{true};
 
         bool app_encryption{true};
+        // ChaCha20Poly1305 also moves the TLS 1.3 ChaCha20 suite to the front
+        // of the offer, so Auto servers pick it too.
+        AppCipherSuite app_cipher{AppCipherSuite::Aes256Gcm};
 
         std::string ca_cert_file;
         std::string client_cert_file;
@@ -28,6 +45,8 @@ namespace urpc
         bool require_client_cert{false};
 
         bool app_encryption{true};
+        // Auto also lets a client that prefers ChaCha20 choose it for TLS.
+        AppCipherSuite app_cipher{AppCipherSuite::Aes256Gcm};
 
         std::string ca_cert_file;
         std::string server_cert_file;
@@ -58,6 +58,10 @@ namespace urpc {
             return this->peer_.authenticated ? &this->peer_ : nullptr;
         }
 
+        [[nodiscard]] std::string peer_address() const override {
+            return socket_peer_ip(this->socket_.get_raw_header()->fd);
+        }
+
         [[nodiscard]] bool get_app_secret_key(
             std::array<uint8_t, 32> &out_key) const noexcept override {
             return false;
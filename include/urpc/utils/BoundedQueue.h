@@ -0,0 +1,128 @@
+//
+// Created by root on 12/14/25.
+//
+
+#ifndef URPC_BOUNDEDQUEUE_H
+#define URPC_BOUNDEDQUEUE_H
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <optional>
+#include <utility>
+
+namespace urpc
+{
+    // Bounded lock-free MPMC ring (D. Vyukov). try_push/try_pop never block;
+    // try_push fails when the ring is full. Capacity is rounded up to a
+    // power of two.
+    template <class T>
+    class BoundedQueue
+    {
+    public:
+        explicit BoundedQueue(std::size_t capacity)
+            : mask_(std::bit_ceil(capacity < 2 ? std::size_t{2} : capacity) - 1)
+              , cells_(std::make_unique<Cell[]>(mask_ + 1))
+        {
+            for (std::size_t i = 0; i <= this->mask_; ++i)
+                this->cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        bool try_push(T&& value)
+        {
+            std::size_t pos = this->tail_.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Cell& cell = this->cells_[pos & this->mask_];
+                const std::size_t seq = cell.seq.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::ptrdiff_t>(seq) -
+                    static_cast<std::ptrdiff_t>(pos);
+
+                if (diff == 0)
+                {
+                    if (this->tail_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        cell.value.emplace(std::move(value));
+                        cell.seq.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = this->tail_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool try_pop(T& out)
+        {
+            std::size_t pos = this->head_.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Cell& cell = this->cells_[pos & this->mask_];
+                const std::size_t seq = cell.seq.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::ptrdiff_t>(seq) -
+                    static_cast<std::ptrdiff_t>(pos + 1);
+
+                if (diff == 0)
+                {
+                    if (this->head_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        out = std::move(*cell.value);
+                        cell.value.reset();
+                        cell.seq.store(pos + this->mask_ + 1,
+                                       std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = this->head_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        [[nodiscard]] bool empty_approx() const noexcept
+        {
+            return this->head_.load(std::memory_order_acquire) ==
+                this->tail_.load(std::memory_order_acquire);
+        }
+
+        [[nodiscard]] std::size_t capacity() const noexcept
+        {
+            return this->mask_ + 1;
+        }
+
+    private:
+        struct Cell
+        {
+            std::atomic<std::size_t> seq{0};
+            std::optional<T> value;
+        };
+
+        static constexpr std::size_t kCacheLine = 64;
+
+        const std::size_t mask_;
+        std::unique_ptr<Cell[]> cells_;
+
+        alignas(kCacheLine) std::atomic<std::size_t> head_{0};
+        alignas(kCacheLine) std::atomic<std::size_t> tail_{0};
+    };
+}
+
+#endif // URPC_BOUNDEDQUEUE_H
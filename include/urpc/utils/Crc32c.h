@@ -0,0 +1,41 @@
+#ifndef URPC_CRC32C_H
+#define URPC_CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace urpc
+{
+    // CRC-32C (Castagnoli). Uses SSE4.2 / ARMv8 CRC instructions when the
+    // CPU has them (checked once at runtime), slicing-by-8 otherwise.
+    //
+    // crc32c_update() works on the raw register: start with kCrc32cInit,
+    // feed any number of pieces, finish with crc32c_finish().
+    inline constexpr uint32_t kCrc32cInit = 0xFFFFFFFFu;
+
+    constexpr uint32_t crc32c_finish(uint32_t state) noexcept
+    {
+        return ~state;
+    }
+
+    uint32_t crc32c_update(uint32_t state,
+                           const uint8_t* data,
+                           std::size_t n) noexcept;
+
+    // Copies n bytes from src to dst and folds them into the CRC in the
+    // same pass, so the data is read from memory once.
+    uint32_t crc32c_copy(uint32_t state,
+                         uint8_t* dst,
+                         const uint8_t* src,
+                         std::size_t n) noexcept;
+
+    inline uint32_t crc32c(const uint8_t* data, std::size_t n) noexcept
+    {
+        return crc32c_finish(crc32c_update(kCrc32cInit, data, n));
+    }
+
+    // True when a hardware implementation is in use.
+    bool crc32c_hw() noexcept;
+}
+
+#endif // URPC_CRC32C_H
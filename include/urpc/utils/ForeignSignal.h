@@ -0,0 +1,51 @@
+#ifndef URPC_FOREIGNSIGNAL_H
+#define URPC_FOREIGNSIGNAL_H
+
+#include <atomic>
+#include <chrono>
+
+#include <uvent/system/SystemContext.h>
+#include <uvent/tasks/Awaitable.h>
+
+namespace urpc
+{
+    // One-shot completion raised by a plain std::thread (worker pool,
+    // caller of a blocking facade) and awaited on a uvent thread. uvent
+    // objects such as AsyncEvent may only be touched from the runtime's
+    // own threads, so set() only flips an atomic and the waiter polls it:
+    // a few immediate re-checks for short jobs, then a 1 ms timer.
+    class RpcForeignSignal
+    {
+    public:
+        void set() noexcept
+        {
+            this->set_.store(true, std::memory_order_release);
+        }
+
+        void reset() noexcept
+        {
+            this->set_.store(false, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] bool is_set() const noexcept
+        {
+            return this->set_.load(std::memory_order_acquire);
+        }
+
+        usub::uvent::task::Awaitable<void> wait()
+        {
+            using namespace std::chrono_literals;
+            for (int spins = 0; !this->is_set(); ++spins)
+                co_await usub::uvent::system::this_coroutine::sleep_for(
+                    spins < kYieldPolls ? 0ms : 1ms);
+            co_return;
+        }
+
+    private:
+        static constexpr int kYieldPolls = 16;
+
+        std::atomic<bool> set_{false};
+    };
+}
+
+#endif // URPC_FOREIGNSIGNAL_H
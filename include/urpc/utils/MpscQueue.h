@@ -0,0 +1,92 @@
+//
+// Created by root on 12/15/25.
+//
+
+#ifndef URPC_MPSCQUEUE_H
+#define URPC_MPSCQUEUE_H
+
+#include <atomic>
+
+namespace urpc
+{
+    struct MpscNode
+    {
+        std::atomic<MpscNode*> next{nullptr};
+    };
+
+    // Intrusive unbounded MPSC queue (D. Vyukov). Elements derive from
+    // MpscNode. push() is wait-free and may be called from any thread;
+    // pop() and empty() belong to the single consumer. pop() may briefly
+    // return nullptr while a concurrent push is linking its node; empty()
+    // is false in that window.
+    class MpscQueue
+    {
+        using Node = MpscNode;
+
+    public:
+        MpscQueue()
+            : head_(&stub_)
+              , tail_(&stub_)
+        {
+            this->stub_.next.store(nullptr, std::memory_order_relaxed);
+        }
+
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+
+        void push(Node* n) noexcept
+        {
+            n->next.store(nullptr, std::memory_order_relaxed);
+            Node* prev = this->head_.exchange(n, std::memory_order_acq_rel);
+            prev->next.store(n, std::memory_order_release);
+        }
+
+        Node* pop() noexcept
+        {
+            Node* tail = this->tail_;
+            Node* next = tail->next.load(std::memory_order_acquire);
+
+            if (tail == &this->stub_)
+            {
+                if (!next)
+                    return nullptr;
+                this->tail_ = next;
+                tail = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+
+            if (next)
+            {
+                this->tail_ = next;
+                return tail;
+            }
+
+            if (tail != this->head_.load(std::memory_order_acquire))
+                return nullptr;
+
+            this->push(&this->stub_);
+
+            next = tail->next.load(std::memory_order_acquire);
+            if (next)
+            {
+                this->tail_ = next;
+                return tail;
+            }
+            return nullptr;
+        }
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            const Node* head = this->head_.load(std::memory_order_acquire);
+            return head == this->tail_ &&
+                this->tail_->next.load(std::memory_order_acquire) == nullptr;
+        }
+
+    private:
+        std::atomic<Node*> head_;
+        Node* tail_;
+        Node stub_;
+    };
+}
+
+#endif // URPC_MPSCQUEUE_H
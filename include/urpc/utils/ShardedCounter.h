@@ -0,0 +1,142 @@
+#ifndef URPC_SHARDEDCOUNTER_H
+#define URPC_SHARDEDCOUNTER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+namespace urpc
+{
+    inline constexpr std::size_t kCounterShards = 64;
+
+    // Shard of the calling thread. Threads are dealt out round-robin, so up
+    // to kCounterShards threads never touch the same cache line.
+    inline std::size_t counter_shard() noexcept
+    {
+        static std::atomic<std::size_t> next{0};
+        thread_local const std::size_t idx =
+            next.fetch_add(1, std::memory_order_relaxed) % kCounterShards;
+        return idx;
+    }
+
+    // Counter (or gauge, via add(-n)) split into per-thread cells. Writers
+    // only touch their own cell; value() sums the cells without stopping
+    // them, so a read is a consistent-enough snapshot, never a stall.
+    class ShardedCounter
+    {
+    public:
+        void add(int64_t v = 1) noexcept
+        {
+            this->cells_[counter_shard()].v.fetch_add(v, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] int64_t value() const noexcept
+        {
+            int64_t sum = 0;
+            for (const Cell& c : this->cells_)
+                sum += c.v.load(std::memory_order_relaxed);
+            return sum;
+        }
+
+    private:
+        struct alignas(64) Cell
+        {
+            std::atomic<int64_t> v{0};
+        };
+
+        std::array<Cell, kCounterShards> cells_{};
+    };
+
+    struct HistogramSnapshot
+    {
+        std::vector<uint64_t> bounds; // inclusive upper bounds
+        std::vector<uint64_t> counts; // per bucket; one more for +Inf
+        uint64_t count{0};
+        uint64_t sum{0};
+
+        void merge(const HistogramSnapshot& o)
+        {
+            if (this->counts.empty())
+            {
+                *this = o;
+                return;
+            }
+            if (o.bounds != this->bounds)
+                return;
+            for (std::size_t i = 0; i < this->counts.size(); ++i)
+                this->counts[i] += o.counts[i];
+            this->count += o.count;
+            this->sum += o.sum;
+        }
+    };
+
+    // Fixed-bucket histogram with the same per-thread layout as
+    // ShardedCounter.
+    class ShardedHistogram
+    {
+    public:
+        static constexpr std::size_t kMaxBuckets = 20;
+
+        ShardedHistogram(std::initializer_list<uint64_t> bounds)
+            : bounds_(bounds)
+        {
+            if (this->bounds_.size() > kMaxBuckets)
+                this->bounds_.resize(kMaxBuckets);
+            std::sort(this->bounds_.begin(), this->bounds_.end());
+        }
+
+        void observe(uint64_t v) noexcept
+        {
+            const std::size_t b = static_cast<std::size_t>(
+                std::lower_bound(this->bounds_.begin(), this->bounds_.end(), v) -
+                this->bounds_.begin());
+            Shard& s = this->shards_[counter_shard()];
+            s.counts[b].fetch_add(1, std::memory_order_relaxed);
+            s.sum.fetch_add(v, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] HistogramSnapshot snapshot() const
+        {
+            HistogramSnapshot snap;
+            snap.bounds = this->bounds_;
+            snap.counts.assign(this->bounds_.size() + 1, 0);
+            for (const Shard& s : this->shards_)
+            {
+                for (std::size_t i = 0; i < snap.counts.size(); ++i)
+                    snap.counts[i] += s.counts[i].load(std::memory_order_relaxed);
+                snap.sum += s.sum.load(std::memory_order_relaxed);
+            }
+            for (uint64_t c : snap.counts)
+                snap.count += c;
+            return snap;
+        }
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::array<std::atomic<uint64_t>, kMaxBuckets + 1> counts{};
+            std::atomic<uint64_t> sum{0};
+        };
+
+        std::vector<uint64_t> bounds_;
+        std::array<Shard, kCounterShards> shards_{};
+    };
+
+    // Latency buckets in microseconds, 100 us .. 10 s.
+    inline ShardedHistogram make_latency_histogram()
+    {
+        return ShardedHistogram{
+            100, 250, 500,
+            1'000, 2'500, 5'000,
+            10'000, 25'000, 50'000,
+            100'000, 250'000, 500'000,
+            1'000'000, 2'500'000, 5'000'000, 10'000'000,
+        };
+    }
+}
+
+#endif // URPC_SHARDEDCOUNTER_H
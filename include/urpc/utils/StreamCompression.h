@@ -0,0 +1,77 @@
+#ifndef URPC_STREAMCOMPRESSION_H
+#define URPC_STREAMCOMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace urpc
+{
+    // Connection-level raw deflate (FLAG_COMPRESSED). Each direction of a
+    // link keeps one compression stream for its lifetime, so later messages
+    // can back-reference earlier ones: a run of small, similar messages
+    // compresses even when each one alone would not. Every message ends
+    // with a sync flush, so it can be decoded as soon as it arrives. The
+    // 00 00 FF FF flush marker is stripped from the wire (as in RFC 7692)
+    // and added back by the receiver.
+    //
+    // Needs zlib (CMake option URPC_WITH_ZLIB). Without it available()
+    // is false and the feature is never negotiated.
+    class DeflateStream
+    {
+    public:
+        explicit DeflateStream(int level = 1, int window_bits = 15);
+        ~DeflateStream();
+
+        DeflateStream(const DeflateStream&) = delete;
+        DeflateStream& operator=(const DeflateStream&) = delete;
+
+        static bool available() noexcept;
+
+        // Compresses one message into out (replaced). Calls must be made in
+        // the order the frames go out on the wire. false leaves the stream
+        // unusable.
+        bool compress(std::span<const uint8_t> in, std::vector<uint8_t>& out);
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl_;
+    };
+
+    class InflateStream
+    {
+    public:
+        using Sink = std::function<void(std::span<const uint8_t>)>;
+
+        explicit InflateStream(int window_bits = 15);
+        ~InflateStream();
+
+        InflateStream(const InflateStream&) = delete;
+        InflateStream& operator=(const InflateStream&) = delete;
+
+        // Feeds part of a compressed message; decoded bytes go to out as
+        // they are produced. A message may be fed in any number of pieces
+        // and must then be closed with end_message(). false on corrupt
+        // input or when the message decodes to more than max_message bytes.
+        bool write(std::span<const uint8_t> in, const Sink& out);
+        bool end_message(const Sink& out);
+
+        // Whole message in one call.
+        bool decompress(std::span<const uint8_t> in, std::vector<uint8_t>& out);
+
+        void set_max_message(std::size_t n) noexcept { this->max_message_ = n; }
+
+    private:
+        bool feed(const uint8_t* data, std::size_t n, const Sink& out);
+
+        struct Impl;
+        std::unique_ptr<Impl> impl_;
+        std::size_t max_message_{static_cast<std::size_t>(-1)};
+        std::size_t message_bytes_{0};
+    };
+}
+
+#endif // URPC_STREAMCOMPRESSION_H
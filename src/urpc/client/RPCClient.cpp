@@ -12,9 +12,13 @@
 #include <uvent/utils/buffer/DynamicBuffer.h>
 
 #include <urpc/client/RPCClient.h>
+#include <urpc/client/IRPCResponseSink.h>
+#include <urpc/client/RPCConcurrencyLimiter.h>
 #include <urpc/utils/Endianness.h>
 #include <urpc/transport/TCPStreamFactory.h>
 #include <urpc/crypto/AppCrypto.h>
+#include <urpc/crypto/CryptoPolicy.h>
+#include <urpc/crypto/CryptoPool.h>
 #include <urpc/transport/TlsRpcStream.h>
 
 namespace urpc {
@@ -28,6 +32,16 @@ namespace urpc {
         return tls->app_cipher();
     }
 
+    // Completes a registered call that never reached the wire, so the
+    // statistics and the limiter see it as failed. Only the path that
+    // removed it from pending_calls_ may do this.
+    static void fail_unsent(PendingCall &call, const char *why) {
+        call.error = true;
+        call.error_code = 0;
+        call.error_message = why;
+        call.signal();
+    }
+
     static uint16_t build_security_flags_client(
         const std::shared_ptr<IRpcStream> &stream) {
         uint16_t flags = 0;
@@ -120,6 +134,9 @@ namespace urpc {
                     std::make_shared<TcpRpcStreamFactory>(
                         this->config_.socket_timeout_ms);
         }
+        this->stats_ = this->config_.stats
+                           ? this->config_.stats
+                           : std::make_shared<RpcClientStats>();
     }
 
     usub::uvent::task::Awaitable<std::vector<uint8_t> >
@@ -154,6 +171,18 @@ namespace urpc {
         call->event = std::make_shared<sync::AsyncEvent>(
             sync::Reset::Manual, false);
 
+        uint32_t no_timeout = 0;
+        if (!co_await this->acquire_slot(call, no_timeout)) {
+#if URPC_LOGS
+            usub::ulog::warn(
+                "RpcClient::async_call: concurrency limit reached, "
+                "mid={} rejected",
+                method_id);
+#endif
+            co_return empty;
+        }
+
+        this->track_call(*call, request_body.size());
         {
             auto guard = co_await this->pending_mutex_.lock();
             this->pending_calls_[sid] = call;
@@ -190,7 +219,8 @@ namespace urpc {
                     sid);
 #endif
                 auto g2 = co_await this->pending_mutex_.lock();
-                this->pending_calls_.erase(sid);
+                if (this->pending_calls_.erase(sid) != 0)
+                    fail_unsent(*call, "stream is null before send");
                 co_return empty;
             }
 
@@ -199,11 +229,12 @@ namespace urpc {
 
             std::span<const uint8_t> to_send = request_body;
 
-            if (cipher && !request_body.empty()) {
-                bool enc_ok = app_encrypt_gcm(
-                    *cipher,
-                    request_body,
-                    enc_buf);
+            if (cipher && this->should_encrypt(method_id, request_body.size())) {
+                bool enc_ok =
+                        this->offload_crypto(request_body.size())
+                            ? co_await this->config_.crypto_pool->seal(
+                                *cipher, request_body, enc_buf, hdr.flags)
+                            : app_encrypt(*cipher, request_body, enc_buf);
                 if (enc_ok) {
                     hdr.flags |= FLAG_ENCRYPTED;
                     hdr.length =
@@ -223,12 +254,13 @@ namespace urpc {
                 } else {
 #if URPC_LOGS
                     usub::ulog::error(
-                        "RpcClient::async_call: app_encrypt_gcm failed for "
+                        "RpcClient::async_call: app_encrypt failed for "
                         "sid={} -- failing closed (no plaintext fallback)",
                         sid);
 #endif
                     auto g2 = co_await this->pending_mutex_.lock();
-                    this->pending_calls_.erase(sid);
+                    if (this->pending_calls_.erase(sid) != 0)
+                        fail_unsent(*call, "app_encrypt failed (failing closed)");
                     co_return empty;
                 }
             }
@@ -248,7 +280,8 @@ namespace urpc {
                     sid);
 #endif
                 auto g2 = co_await this->pending_mutex_.lock();
-                this->pending_calls_.erase(sid);
+                if (this->pending_calls_.erase(sid) != 0)
+                    fail_unsent(*call, "send_frame failed");
                 co_return empty;
             }
         }
@@ -306,6 +339,53 @@ namespace urpc {
         co_return resp;
     }
 
+    void RpcClient::track_call(PendingCall &call, std::size_t request_bytes) {
+        call.stats = this->stats_;
+        call.registered_at = std::chrono::steady_clock::now();
+        this->stats_->calls.add();
+        this->stats_->request_bytes.add(static_cast<int64_t>(request_bytes));
+    }
+
+    std::optional<RpcLoadReport> RpcClient::load_report(
+        std::chrono::milliseconds max_age) const {
+        const int64_t at =
+                this->load_report_at_ns_.load(std::memory_order_acquire);
+        if (at == 0)
+            return std::nullopt;
+
+        const int64_t now =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (now - at > std::chrono::duration_cast<std::chrono::nanoseconds>(
+                max_age).count())
+            return std::nullopt;
+
+        return decode_load_report(
+            this->load_report_.load(std::memory_order_relaxed));
+    }
+
+    usub::uvent::task::Awaitable<bool>
+    RpcClient::acquire_slot(const std::shared_ptr<PendingCall> &call,
+                            uint32_t &timeout_ms) {
+        const auto &limiter = this->config_.limiter;
+        if (!limiter)
+            co_return true;
+        const auto queued_at = std::chrono::steady_clock::now();
+        if (!co_await limiter->acquire(timeout_ms))
+            co_return false;
+        call->limiter = limiter;
+        call->started = std::chrono::steady_clock::now();
+        if (timeout_ms > 0) {
+            const auto waited = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    call->started - queued_at).count());
+            timeout_ms = waited < timeout_ms
+                             ? timeout_ms - static_cast<uint32_t>(waited)
+                             : 1;
+        }
+        co_return true;
+    }
+
     usub::uvent::task::Awaitable<bool>
     RpcClient::send_cancel_frame(uint32_t stream_id, uint64_t method_id) {
         auto stream = this->stream_;
@@ -392,7 +472,7 @@ namespace urpc {
         call->error_message = "RPC call timed out";
 
         if (call->event)
-            call->event->set();
+            call->signal();
 
         co_await self->send_cancel_frame(stream_id, method_id);
 
@@ -437,6 +517,17 @@ namespace urpc {
             usub::uvent::sync::AsyncEvent>(
             usub::uvent::sync::Reset::Manual, false);
 
+        if (!co_await this->acquire_slot(call, timeout_ms)) {
+#if URPC_LOGS
+            usub::ulog::warn(
+                "RpcClient::async_call_with_timeout: concurrency limit "
+                "reached, mid={} rejected",
+                method_id);
+#endif
+            co_return empty;
+        }
+
+        this->track_call(*call, request_body.size());
         {
             auto guard = co_await this->pending_mutex_.lock();
             this->pending_calls_[sid] = call;
@@ -466,7 +557,8 @@ namespace urpc {
                     sid);
 #endif
                 auto g2 = co_await this->pending_mutex_.lock();
-                this->pending_calls_.erase(sid);
+                if (this->pending_calls_.erase(sid) != 0)
+                    fail_unsent(*call, "stream is null before send");
                 co_return empty;
             }
 
@@ -475,9 +567,12 @@ namespace urpc {
 
             std::span<const uint8_t> to_send = request_body;
 
-            if (cipher && !request_body.empty()) {
-                bool enc_ok = app_encrypt_gcm(
-                    *cipher, request_body, enc_buf);
+            if (cipher && this->should_encrypt(method_id, request_body.size())) {
+                bool enc_ok =
+                        this->offload_crypto(request_body.size())
+                            ? co_await this->config_.crypto_pool->seal(
+                                *cipher, request_body, enc_buf, hdr.flags)
+                            : app_encrypt(*cipher, request_body, enc_buf);
                 if (enc_ok) {
                     hdr.flags |= FLAG_ENCRYPTED;
                     hdr.length =
@@ -490,12 +585,13 @@ namespace urpc {
 #if URPC_LOGS
                     usub::ulog::error(
                         "RpcClient::async_call_with_timeout: "
-                        "app_encrypt_gcm failed for sid={} -- failing "
+                        "app_encrypt failed for sid={} -- failing "
                         "closed",
                         sid);
 #endif
                     auto g2 = co_await this->pending_mutex_.lock();
-                    this->pending_calls_.erase(sid);
+                    if (this->pending_calls_.erase(sid) != 0)
+                        fail_unsent(*call, "app_encrypt failed (failing closed)");
                     co_return empty;
                 }
             }
@@ -509,7 +605,8 @@ namespace urpc {
                     sid);
 #endif
                 auto g2 = co_await this->pending_mutex_.lock();
-                this->pending_calls_.erase(sid);
+                if (this->pending_calls_.erase(sid) != 0)
+                    fail_unsent(*call, "send_frame failed");
                 co_return empty;
             }
         }
@@ -559,6 +656,56 @@ namespace urpc {
     RpcClient::try_call(uint64_t method_id,
                         std::span<const uint8_t> request_body,
                         uint32_t timeout_ms) {
+        co_return co_await this->call_impl(
+            method_id, request_body, timeout_ms, nullptr);
+    }
+
+    usub::uvent::task::Awaitable<RpcCallResult>
+    RpcClient::try_call_into(uint64_t method_id,
+                             std::span<const uint8_t> request_body,
+                             std::shared_ptr<IRpcResponseSink> sink,
+                             uint32_t timeout_ms) {
+        if (!sink) {
+            RpcCallResult result;
+            result.error_message = "try_call_into: sink is null";
+            co_return result;
+        }
+        co_return co_await this->call_impl(
+            method_id, request_body, timeout_ms, std::move(sink));
+    }
+
+    usub::uvent::task::Awaitable<RpcCallResult>
+    RpcClient::try_call_idempotent(uint64_t method_id,
+                                   uint64_t key,
+                                   std::span<const uint8_t> request_body,
+                                   uint32_t timeout_ms) {
+        if (key == 0) {
+            RpcCallResult result;
+            result.error_message = "try_call_idempotent: key is 0";
+            co_return result;
+        }
+        co_return co_await this->call_impl(
+            method_id, request_body, timeout_ms, nullptr, key);
+    }
+
+    uint64_t RpcClient::new_idempotency_key() {
+        uint64_t key = 0;
+        while (key == 0) {
+            if (RAND_bytes(reinterpret_cast<unsigned char *>(&key),
+                           sizeof(key)) != 1)
+                key = static_cast<uint64_t>(
+                          std::chrono::steady_clock::now()
+                          .time_since_epoch().count()) ^ 0x9E3779B97F4A7C15ull;
+        }
+        return key;
+    }
+
+    usub::uvent::task::Awaitable<RpcCallResult>
+    RpcClient::call_impl(uint64_t method_id,
+                         std::span<const uint8_t> request_body,
+                         uint32_t timeout_ms,
+                         std::shared_ptr<IRpcResponseSink> sink,
+                         uint64_t idempotency_key) {
         RpcCallResult result;
 
 #if URPC_LOGS
@@ -579,6 +726,20 @@ namespace urpc {
             co_return result;
         }
 
+        if (idempotency_key != 0 &&
+            !co_await this->agree_idempotency_keys(timeout_ms)) {
+            result.ok = false;
+            result.error_code = 0;
+            result.error_message = "server does not accept idempotency keys";
+#if URPC_LOGS
+            usub::ulog::warn(
+                "RpcClient::try_call: idempotency keys not agreed, mid={} "
+                "not sent",
+                method_id);
+#endif
+            co_return result;
+        }
+
         uint32_t sid =
                 this->next_stream_id_.fetch_add(1, std::memory_order_relaxed);
         if (sid == 0)
@@ -588,18 +749,48 @@ namespace urpc {
         auto call = std::make_shared<PendingCall>();
         call->event = std::make_shared<sync::AsyncEvent>(
             sync::Reset::Manual, false);
+        call->sink = std::move(sink);
+
+        if (!co_await this->acquire_slot(call, timeout_ms)) {
+            result.ok = false;
+            result.error_code = 429;
+            result.error_message = "Client concurrency limit reached";
+#if URPC_LOGS
+            usub::ulog::warn(
+                "RpcClient::try_call: concurrency limit reached, mid={} "
+                "rejected",
+                method_id);
+#endif
+            co_return result;
+        }
 
+        this->track_call(*call, request_body.size());
         {
             auto guard = co_await this->pending_mutex_.lock();
             this->pending_calls_[sid] = call;
         }
 
+        // The key goes in front of the body before app encryption, so it
+        // is sealed with it and survives a decrypting proxy hop.
+        std::vector<uint8_t> keyed;
+        if (idempotency_key != 0) {
+            keyed.resize(kIdempotencyKeySize + request_body.size());
+            const uint64_t key_be = host_to_be(idempotency_key);
+            std::memcpy(keyed.data(), &key_be, kIdempotencyKeySize);
+            if (!request_body.empty())
+                std::memcpy(keyed.data() + kIdempotencyKeySize,
+                            request_body.data(), request_body.size());
+            request_body = std::span<const uint8_t>{keyed.data(), keyed.size()};
+        }
+
         RpcFrameHeader hdr{};
         hdr.magic = 0x55525043;
         hdr.version = 1;
         hdr.type = static_cast<uint8_t>(FrameType::Request);
         hdr.flags = FLAG_END_STREAM
                     | build_security_flags_client(this->stream_);
+        if (idempotency_key != 0)
+            hdr.flags |= FLAG_IDEMPOTENCY_KEY;
         hdr.stream_id = sid;
         hdr.method_id = method_id;
         hdr.length = static_cast<uint32_t>(request_body.size());
@@ -613,7 +804,8 @@ namespace urpc {
             if (!stream) {
                 {
                     auto g2 = co_await this->pending_mutex_.lock();
-                    this->pending_calls_.erase(sid);
+                    if (this->pending_calls_.erase(sid) != 0)
+                        fail_unsent(*call, "stream is null before send");
                 }
                 result.ok = false;
                 result.error_code = 0;
@@ -631,9 +823,12 @@ namespace urpc {
 
             std::span<const uint8_t> to_send = request_body;
 
-            if (cipher && !request_body.empty()) {
-                bool enc_ok = app_encrypt_gcm(
-                    *cipher, request_body, enc_buf);
+            if (cipher && this->should_encrypt(method_id, request_body.size())) {
+                bool enc_ok =
+                        this->offload_crypto(request_body.size())
+                            ? co_await this->config_.crypto_pool->seal(
+                                *cipher, request_body, enc_buf, hdr.flags)
+                            : app_encrypt(*cipher, request_body, enc_buf);
                 if (enc_ok) {
                     hdr.flags |= FLAG_ENCRYPTED;
                     hdr.length = static_cast<uint32_t>(enc_buf.size());
@@ -643,15 +838,16 @@ namespace urpc {
                 } else {
                     {
                         auto g2 = co_await this->pending_mutex_.lock();
-                        this->pending_calls_.erase(sid);
+                        if (this->pending_calls_.erase(sid) != 0)
+                            fail_unsent(*call, "app_encrypt failed (failing closed)");
                     }
                     result.ok = false;
                     result.error_code = 0;
                     result.error_message =
-                            "app_encrypt_gcm failed (failing closed)";
+                            "app_encrypt failed (failing closed)";
 #if URPC_LOGS
                     usub::ulog::error(
-                        "RpcClient::try_call: app_encrypt_gcm failed "
+                        "RpcClient::try_call: app_encrypt failed "
                         "for sid={} -- failing closed",
                         sid);
 #endif
@@ -663,7 +859,8 @@ namespace urpc {
             if (!sent) {
                 {
                     auto g2 = co_await this->pending_mutex_.lock();
-                    this->pending_calls_.erase(sid);
+                    if (this->pending_calls_.erase(sid) != 0)
+                        fail_unsent(*call, "send_frame failed");
                 }
                 result.ok = false;
                 result.error_code = 0;
@@ -721,6 +918,23 @@ namespace urpc {
             co_return result;
         }
 
+        if (call->sink) {
+            // Encrypted / offloaded responses arrive here buffered.
+            if (!call->response.empty() &&
+                !co_await call->sink->write(std::span<const uint8_t>{
+                    call->response.data(), call->response.size()
+                })) {
+                call->sink_aborted = true;
+            }
+            call->response.clear();
+            if (call->sink_aborted) {
+                result.ok = false;
+                result.error_code = 0;
+                result.error_message = "Response sink aborted";
+                co_return result;
+            }
+        }
+
         result.ok = true;
         result.response = std::move(call->response);
 #if URPC_LOGS
@@ -731,15 +945,14 @@ namespace urpc {
         co_return result;
     }
 
-    usub::uvent::task::Awaitable<bool> RpcClient::async_ping() {
-#if URPC_LOGS
-        usub::ulog::info("RpcClient::async_ping: start");
-#endif
-        const bool ok = co_await this->ensure_connected();
-        if (!ok) {
+    usub::uvent::task::Awaitable<bool> RpcClient::notify(
+        uint64_t method_id,
+        std::span<const uint8_t> request_body) {
+        const bool connected = co_await this->ensure_connected();
+        if (!connected) {
 #if URPC_LOGS
             usub::ulog::error(
-                "RpcClient::async_ping: ensure_connected() failed");
+                "RpcClient::notify: ensure_connected() failed");
 #endif
             co_return false;
         }
@@ -747,174 +960,847 @@ namespace urpc {
         uint32_t sid =
                 this->next_stream_id_.fetch_add(1, std::memory_order_relaxed);
         if (sid == 0)
-            sid = this->next_stream_id_.fetch_add(1, std::memory_order_relaxed);
-
-        auto evt = std::make_shared<sync::AsyncEvent>(
-            sync::Reset::Manual, false);
-
-        {
-            auto guard = co_await this->ping_mutex_.lock();
-#if URPC_LOGS
-            usub::ulog::debug(
-                "RpcClient::async_ping: register waiter sid={} ping_waiters={}",
-                sid,
-                this->ping_waiters_.size() + 1);
-#endif
-            this->ping_waiters_[sid] = evt;
-        }
+            sid = this->next_stream_id_.fetch_add(
+                1, std::memory_order_relaxed);
 
         RpcFrameHeader hdr{};
         hdr.magic = 0x55525043;
         hdr.version = 1;
-        hdr.type = static_cast<uint8_t>(FrameType::Ping);
+        hdr.type = static_cast<uint8_t>(FrameType::Request);
+        hdr.flags = FLAG_END_STREAM | FLAG_ONEWAY
+                    | build_security_flags_client(this->stream_);
+        hdr.stream_id = sid;
+        hdr.method_id = method_id;
+        hdr.length = static_cast<uint32_t>(request_body.size());
 
-        uint16_t flags = FLAG_END_STREAM |
-                         build_security_flags_client(this->stream_);
+        std::vector<uint8_t> enc_buf;
 
-        hdr.flags = flags;
-        hdr.stream_id = sid;
-        hdr.method_id = 0;
-        hdr.length = 0;
+        auto guard = co_await this->write_mutex_.lock();
 
-        {
-            auto guard = co_await this->write_mutex_.lock();
+        auto stream = this->stream_;
+        if (!stream)
+            co_return false;
 
-            auto stream = this->stream_;
-            if (!stream) {
-#if URPC_LOGS
-                usub::ulog::error(
-                    "RpcClient::async_ping: stream_ is null before send_frame "
-                    "sid={} – removing waiter",
-                    sid);
-#endif
-                auto g2 = co_await this->ping_mutex_.lock();
-                this->ping_waiters_.erase(sid);
-                co_return false;
-            }
+        const AppCipherContext *cipher = get_cipher_for_stream(stream);
+        std::span<const uint8_t> to_send = request_body;
 
-#if URPC_LOGS
-            usub::ulog::debug(
-                "RpcClient::async_ping: BEFORE send_frame sid={} flags=0x{:x}",
-                sid, hdr.flags);
-#endif
-            const bool sent =
-                    co_await send_frame(*stream, hdr, {});
-            if (!sent) {
+        if (cipher && this->should_encrypt(method_id, request_body.size())) {
+            const bool enc_ok =
+                    this->offload_crypto(request_body.size())
+                        ? co_await this->config_.crypto_pool->seal(
+                            *cipher, request_body, enc_buf, hdr.flags)
+                        : app_encrypt(*cipher, request_body, enc_buf);
+            if (!enc_ok) {
 #if URPC_LOGS
                 usub::ulog::error(
-                    "RpcClient::async_ping: send_frame failed sid={} – "
-                    "removing waiter",
+                    "RpcClient::notify: app_encrypt failed for sid={} "
+                    "-- failing closed",
                     sid);
 #endif
-                auto g2 = co_await this->ping_mutex_.lock();
-                this->ping_waiters_.erase(sid);
                 co_return false;
             }
+            hdr.flags |= FLAG_ENCRYPTED;
+            hdr.length = static_cast<uint32_t>(enc_buf.size());
+            to_send = std::span<const uint8_t>{enc_buf.data(), enc_buf.size()};
         }
 
 #if URPC_LOGS
         usub::ulog::debug(
-            "RpcClient::async_ping: BEFORE wait sid={}", sid);
-#endif
-        co_await evt->wait();
-#if URPC_LOGS
-        usub::ulog::debug(
-            "RpcClient::async_ping: AFTER wait sid={}", sid);
+            "RpcClient::notify: sid={} mid={} len={}",
+            sid, method_id, hdr.length);
 #endif
+        co_return co_await send_frame(*stream, hdr, to_send);
+    }
 
-        bool result = false;
-        {
-            auto guard = co_await this->ping_mutex_.lock();
+    usub::uvent::task::Awaitable<bool> RpcClient::start_request(
+        const std::shared_ptr<PendingCall> &call,
+        uint32_t &out_sid,
+        uint64_t method_id,
+        uint16_t flags,
+        std::span<const uint8_t> payload,
+        uint32_t timeout_ms) {
+        auto fail = [&call](std::string msg) {
+            call->error = true;
+            call->error_code = 0;
+            call->error_message = std::move(msg);
+            call->signal();
+        };
 
-            auto it = this->ping_waiters_.find(sid);
-            if (it != this->ping_waiters_.end()) {
-                result = true;
-                this->ping_waiters_.erase(it);
-            }
+        const bool connected = co_await this->ensure_connected();
+        if (!connected) {
+            fail("ensure_connected() failed");
+            co_return false;
         }
 
-#if URPC_LOGS
-        usub::ulog::info(
-            "RpcClient::async_ping: finished sid={} result={}",
-            sid, result);
-#endif
-        co_return result;
-    }
-
-    void RpcClient::close() {
-#if URPC_LOGS
-        usub::ulog::info("RpcClient::close()");
-#endif
-        this->running_.store(false, std::memory_order_relaxed);
-
-        std::shared_ptr<IRpcStream> stream;
-        stream.swap(this->stream_);
+        // A forwarded keyed request needs the key agreed on this hop too.
+        if ((flags & FLAG_IDEMPOTENCY_KEY) &&
+            !co_await this->agree_idempotency_keys(timeout_ms)) {
+            fail("upstream does not accept idempotency keys");
+            co_return false;
+        }
 
-        if (stream)
-            stream->shutdown();
-    }
+        if (!co_await this->acquire_slot(call, timeout_ms)) {
+            call->error_code = 429;
+            call->error = true;
+            call->error_message = "Client concurrency limit reached";
+            call->signal();
+            co_return false;
+        }
 
-    usub::uvent::task::Awaitable<bool> RpcClient::ensure_connected() {
-        using namespace usub::uvent;
+        uint32_t sid =
+                this->next_stream_id_.fetch_add(1, std::memory_order_relaxed);
+        if (sid == 0)
+            sid = this->next_stream_id_.fetch_add(
+                1, std::memory_order_relaxed);
 
-        if (this->stream_ &&
-            this->running_.load(std::memory_order_relaxed)) {
-#if URPC_LOGS
-            usub::ulog::debug(
-                "RpcClient::ensure_connected: already connected");
-#endif
-            co_return true;
+        this->track_call(*call, payload.size());
+        {
+            auto guard = co_await this->pending_mutex_.lock();
+            this->pending_calls_[sid] = call;
         }
 
-        auto guard = co_await this->connect_mutex_.lock();
+        RpcFrameHeader hdr{};
+        hdr.magic = 0x55525043;
+        hdr.version = 1;
+        hdr.type = static_cast<uint8_t>(FrameType::Request);
+        hdr.flags = static_cast<uint16_t>(
+            (flags & ~(FLAG_TLS | FLAG_MTLS | FLAG_ENCRYPTED | FLAG_CHUNKED |
+                       FLAG_LOAD_REPORT)) |
+            FLAG_END_STREAM |
+            build_security_flags_client(this->stream_));
+        hdr.stream_id = sid;
+        hdr.method_id = method_id;
+        hdr.length = static_cast<uint32_t>(payload.size());
 
-        if (this->stream_ &&
-            this->running_.load(std::memory_order_relaxed)) {
-#if URPC_LOGS
-            usub::ulog::debug(
-                "RpcClient::ensure_connected: already connected (after lock)");
-#endif
-            co_return true;
-        }
+        std::vector<uint8_t> enc_buf;
+        const char *error = nullptr;
+        {
+            auto guard = co_await this->write_mutex_.lock();
 
-        this->stream_.reset();
+            auto stream = this->stream_;
+            const AppCipherContext *cipher =
+                    stream ? get_cipher_for_stream(stream) : nullptr;
 
-#if URPC_LOGS
-        usub::ulog::info(
-            "RpcClient::ensure_connected: connecting to {}:{}",
-            this->config_.host, this->config_.port);
-#endif
+            std::span<const uint8_t> to_send = payload;
+            if (!stream) {
+                error = "stream is null before send";
+            } else if (cipher && this->should_encrypt(method_id, payload.size())) {
+                const bool enc_ok =
+                        this->offload_crypto(payload.size())
+                            ? co_await this->config_.crypto_pool->seal(
+                                *cipher, payload, enc_buf, hdr.flags)
+                            : app_encrypt(*cipher, payload, enc_buf);
+                if (enc_ok) {
+                    hdr.flags |= FLAG_ENCRYPTED;
+                    hdr.length = static_cast<uint32_t>(enc_buf.size());
+                    to_send = std::span<const uint8_t>{
+                        enc_buf.data(), enc_buf.size()
+                    };
+                } else {
+                    error = "app_encrypt failed (failing closed)";
+                }
+            }
 
-        if (!this->config_.stream_factory) {
-            this->config_.stream_factory =
-                    std::make_shared<TcpRpcStreamFactory>(
-                        this->config_.socket_timeout_ms);
+            if (!error && !(co_await send_frame(*stream, hdr, to_send)))
+                error = "send_frame failed";
         }
 
-        auto stream =
-                co_await this->config_.stream_factory->create_client_stream(
-                    this->config_.host,
-                    this->config_.port);
-        if (!stream) {
+        if (error) {
 #if URPC_LOGS
             usub::ulog::error(
-                "RpcClient::ensure_connected: stream_factory returned nullptr");
+                "RpcClient::start_request: sid={} mid={}: {}",
+                sid, method_id, error);
 #endif
+            {
+                auto guard = co_await this->pending_mutex_.lock();
+                this->pending_calls_.erase(sid);
+            }
+            fail(error);
             co_return false;
         }
 
-        this->stream_ = std::move(stream);
-        this->running_.store(true, std::memory_order_relaxed);
-
-#if URPC_LOGS
-        usub::ulog::info(
-            "RpcClient::ensure_connected: connected, spawning reader_loop");
-#endif
+        if (timeout_ms > 0) {
+            usub::uvent::system::co_spawn(
+                RpcClient::timeout_watchdog(
+                    this->shared_from_this(),
+                    call,
+                    sid,
+                    method_id,
+                    timeout_ms));
+        }
+
+        out_sid = sid;
+        co_return true;
+    }
+
+    usub::uvent::task::Awaitable<RpcCallHandle> RpcClient::start_call(
+        uint64_t method_id,
+        std::span<const uint8_t> request_body,
+        uint32_t timeout_ms) {
+        RpcCallHandle h;
+        h.method_id = method_id;
+        h.call = std::make_shared<PendingCall>();
+        h.call->event = std::make_shared<sync::AsyncEvent>(
+            sync::Reset::Manual, false);
+        h.result_state = std::make_shared<RpcCallResultState>();
+
+        co_await this->start_request(
+            h.call, h.stream_id, method_id, 0, request_body, timeout_ms);
+        co_return h;
+    }
+
+    usub::uvent::task::Awaitable<RpcCallHandle> RpcClient::start_forward(
+        uint64_t method_id,
+        uint16_t flags,
+        std::span<const uint8_t> payload,
+        uint32_t timeout_ms) {
+        RpcCallHandle h;
+
+        auto call = std::make_shared<PendingCall>();
+        call->event = std::make_shared<sync::AsyncEvent>(
+            sync::Reset::Manual, false);
+        call->raw = true;
+
+        if (!(co_await this->start_request(
+            call, h.stream_id, method_id, flags, payload, timeout_ms)))
+            co_return h;
+
+        h.method_id = method_id;
+        h.call = std::move(call);
+        co_return h;
+    }
+
+    RpcCallResult RpcClient::take_result(const RpcCallHandle &h) {
+        RpcCallResult result;
+        if (!h) {
+            result.error_message = "empty call handle";
+            return result;
+        }
+
+        if (h.result_state && !h.result_state->try_consume()) {
+            result.error_message = "call result already consumed";
+            return result;
+        }
+
+        PendingCall &call = *h.call;
+        if (call.timed_out.load(std::memory_order_acquire)) {
+            result.timed_out = true;
+            result.error_code = 408;
+            result.error_message = "RPC call timed out";
+        } else if (call.error) {
+            result.error_code = call.error_code;
+            result.error_message = std::move(call.error_message);
+        } else {
+            result.ok = true;
+            result.response = std::move(call.response);
+        }
+        return result;
+    }
+
+    usub::uvent::task::Awaitable<RpcCallResult> RpcClient::await_call(
+        const RpcCallHandle &h) {
+        if (!h)
+            co_return take_result(h);
+
+        co_await h.call->event->wait();
+        co_return take_result(h);
+    }
+
+    usub::uvent::task::Awaitable<std::vector<RpcCallResult> >
+    RpcClient::when_all(std::span<const RpcCallHandle> handles) {
+        // Every call is already on the wire, so waiting one after another
+        // costs max(latency), not the sum, and needs no extra coroutines.
+        for (const auto &h: handles) {
+            if (h)
+                co_await h.call->event->wait();
+        }
+
+        std::vector<RpcCallResult> results;
+        results.reserve(handles.size());
+        for (const auto &h: handles)
+            results.push_back(take_result(h));
+        co_return results;
+    }
+
+    usub::uvent::task::Awaitable<std::size_t>
+    RpcClient::when_any(std::span<const RpcCallHandle> handles) {
+        auto group = std::make_shared<sync::AsyncEvent>(
+            sync::Reset::Manual, false);
+
+        bool any = false;
+        for (const auto &h: handles) {
+            if (h) {
+                h.call->add_waiter(group);
+                any = true;
+            }
+        }
+        if (!any)
+            co_return handles.size();
+
+        // The waiter is registered before done is checked, so a completion
+        // in between still sets the event.
+        std::size_t winner = handles.size();
+        for (;;) {
+            for (std::size_t i = 0; i < handles.size(); ++i) {
+                if (handles[i] && handles[i].call->done.load()) {
+                    winner = i;
+                    break;
+                }
+            }
+            if (winner != handles.size())
+                break;
+
+            co_await group->wait();
+            group->reset();
+        }
+
+        for (const auto &h: handles) {
+            if (h)
+                h.call->remove_waiter(group);
+        }
+
+        co_return winner;
+    }
+
+    usub::uvent::task::Awaitable<void> RpcClient::wait_forward(
+        const RpcCallHandle &h) {
+        if (!h)
+            co_return;
+
+        co_await h.call->event->wait();
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void> RpcClient::cancel_call(
+        const RpcCallHandle &h) {
+        if (!h)
+            co_return;
+
+        bool removed = false;
+        {
+            auto guard = co_await this->pending_mutex_.lock();
+            auto it = this->pending_calls_.find(h.stream_id);
+            if (it != this->pending_calls_.end() && it->second == h.call) {
+                this->pending_calls_.erase(it);
+                removed = true;
+            }
+        }
+
+        if (!removed)
+            co_return;
+
+        h.call->error = true;
+        h.call->error_code = 499;
+        h.call->error_message = "Cancelled";
+        h.call->signal();
+
+        co_await this->send_cancel_frame(h.stream_id, h.method_id);
+        co_return;
+    }
+
+    static std::vector<uint8_t> build_error_body(uint32_t code,
+                                                 std::string_view message) {
+        const uint32_t code_be = host_to_be<uint32_t>(code);
+        const uint32_t len_be =
+                host_to_be<uint32_t>(static_cast<uint32_t>(message.size()));
+
+        std::vector<uint8_t> buf(8 + message.size());
+        std::memcpy(buf.data(), &code_be, 4);
+        std::memcpy(buf.data() + 4, &len_be, 4);
+        if (!message.empty())
+            std::memcpy(buf.data() + 8, message.data(), message.size());
+        return buf;
+    }
+
+    void RpcClient::register_method(uint64_t method_id, RpcHandlerPtr fn) {
+        this->registry_.register_method(method_id, fn);
+    }
+
+    void RpcClient::register_method(std::string_view name, RpcHandlerPtr fn) {
+        this->registry_.register_method(name, fn);
+    }
+
+    usub::uvent::task::Awaitable<void> RpcClient::handle_push_detached(
+        std::shared_ptr<RpcClient> self,
+        std::shared_ptr<IRpcStream> stream,
+        RpcFrame frame,
+        std::shared_ptr<sync::CancellationSource> src,
+        uint64_t oneway_key) {
+        const uint32_t sid = frame.header.stream_id;
+        co_await self->handle_push(
+            std::move(stream), std::move(frame), src, oneway_key);
+        co_await self->untrack_push(sid, src, oneway_key);
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void> RpcClient::untrack_push(
+        uint32_t stream_id,
+        const std::shared_ptr<sync::CancellationSource> &src,
+        uint64_t oneway_key) {
+        auto guard = co_await this->push_cancel_mutex_.lock();
+        if (oneway_key != 0) {
+            this->oneway_push_cancels_.erase(oneway_key);
+            co_return;
+        }
+        // A Cancel already removed it; the id may belong to a newer push.
+        auto it = this->push_cancels_.find(stream_id);
+        if (it != this->push_cancels_.end() && it->second == src)
+            this->push_cancels_.erase(it);
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void> RpcClient::handle_push(
+        std::shared_ptr<IRpcStream> stream,
+        RpcFrame frame,
+        std::shared_ptr<sync::CancellationSource> src,
+        uint64_t oneway_key) {
+        const uint32_t sid = frame.header.stream_id;
+        const uint64_t mid = frame.header.method_id;
+        const bool oneway = (frame.header.flags & FLAG_ONEWAY) != 0;
+        const bool topic = oneway && (frame.header.flags & FLAG_TOPIC) != 0;
+
+        RpcHandlerEntry fn;
+        if (!topic)
+            fn = this->registry_.find(mid);
+        if (!fn && oneway) {
+            // Servers that predate FLAG_TOPIC send topic messages as plain
+            // one-way calls; a method registered under that id still wins.
+            auto guard = co_await this->topic_mutex_.lock();
+            auto it = this->topic_handlers_.find(mid);
+            if (it != this->topic_handlers_.end())
+                fn = RpcHandlerEntry{.fn = it->second};
+        }
+        if (!fn) {
+#if URPC_LOGS
+            usub::ulog::warn(
+                "RpcClient::handle_push: unknown method mid={} sid={}",
+                mid, sid);
+#endif
+            if (oneway)
+                co_return;
+            auto err = build_error_body(404, "Unknown method");
+            co_await this->send_push_reply(stream, sid, mid, true, err);
+            co_return;
+        }
+
+        std::span<const uint8_t> body{
+            reinterpret_cast<const uint8_t *>(frame.payload.data()),
+            frame.payload.size()
+        };
+
+        std::vector<uint8_t> decrypted;
+        if (frame.header.flags & FLAG_ENCRYPTED) {
+            const AppCipherContext *cipher = get_cipher_for_stream(stream);
+            if (!cipher ||
+                !RpcCryptoPool::open_inline(*cipher, body, frame.header.flags,
+                                            decrypted)) {
+#if URPC_LOGS
+                usub::ulog::warn(
+                    "RpcClient::handle_push: failed to decrypt push sid={}",
+                    sid);
+#endif
+                if (oneway)
+                    co_return;
+                auto err = build_error_body(400, "Failed to decrypt request");
+                co_await this->send_push_reply(stream, sid, mid, true, err);
+                co_return;
+            }
+            body = std::span<const uint8_t>{decrypted.data(), decrypted.size()};
+        }
+
+        RpcContext ctx{
+            .stream = *stream,
+            .stream_id = sid,
+            .method_id = mid,
+            .flags = frame.header.flags,
+            .cancel_token = src->token(),
+            .peer = stream->peer_identity(),
+        };
+
+        // Cancelled (or the connection closed) before the handler started.
+        if (ctx.cancel_token.stop_requested())
+            co_return;
+
+        std::vector<uint8_t> resp = co_await fn(ctx, body);
+        if (oneway || ctx.cancel_token.stop_requested())
+            co_return;
+        co_await this->send_push_reply(stream, sid, mid, false, resp);
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void> RpcClient::handle_push_cancel(
+        uint32_t stream_id) {
+        std::shared_ptr<sync::CancellationSource> src;
+        {
+            auto guard = co_await this->push_cancel_mutex_.lock();
+            auto it = this->push_cancels_.find(stream_id);
+            if (it != this->push_cancels_.end()) {
+                src = it->second;
+                this->push_cancels_.erase(it);
+            }
+        }
+#if URPC_LOGS
+        usub::ulog::debug(
+            "RpcClient::handle_push_cancel: sid={} found={}",
+            stream_id, src != nullptr);
+#endif
+        if (src)
+            src->request_cancel();
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<bool> RpcClient::subscribe(
+        std::string_view topic,
+        RpcHandlerPtr handler,
+        uint32_t timeout_ms) {
+        if (topic.empty() || !handler)
+            co_return false;
+
+        const uint64_t topic_id = fnv1a64_rt(topic);
+        {
+            auto guard = co_await this->topic_mutex_.lock();
+            this->topic_handlers_[topic_id] = handler;
+        }
+
+        std::span<const uint8_t> body{
+            reinterpret_cast<const uint8_t *>(topic.data()),
+            topic.size()
+        };
+        auto res = co_await this->try_call(
+            fnv1a64_rt(kSubscribeMethod), body, timeout_ms);
+#if URPC_LOGS
+        usub::ulog::info(
+            "RpcClient::subscribe: topic={} ok={} code={}",
+            topic, res.ok, res.error_code);
+#endif
+        const bool subscribed =
+            res.ok && !res.response.empty() && res.response[0] == 1;
+        if (!subscribed) {
+            auto guard = co_await this->topic_mutex_.lock();
+            auto it = this->topic_handlers_.find(topic_id);
+            if (it != this->topic_handlers_.end() && it->second == handler)
+                this->topic_handlers_.erase(it);
+        }
+        co_return subscribed;
+    }
+
+    usub::uvent::task::Awaitable<bool> RpcClient::unsubscribe(
+        std::string_view topic,
+        uint32_t timeout_ms) {
+        if (topic.empty())
+            co_return false;
+
+        // Dropped first: messages already on the wire are not delivered.
+        {
+            auto guard = co_await this->topic_mutex_.lock();
+            this->topic_handlers_.erase(fnv1a64_rt(topic));
+        }
+
+        std::span<const uint8_t> body{
+            reinterpret_cast<const uint8_t *>(topic.data()),
+            topic.size()
+        };
+        auto res = co_await this->try_call(
+            fnv1a64_rt(kUnsubscribeMethod), body, timeout_ms);
+        co_return res.ok && !res.response.empty() && res.response[0] == 1;
+    }
+
+    usub::uvent::task::Awaitable<void> RpcClient::send_push_reply(
+        const std::shared_ptr<IRpcStream> &stream,
+        uint32_t stream_id,
+        uint64_t method_id,
+        bool is_error,
+        std::span<const uint8_t> body) {
+        RpcFrameHeader hdr{};
+        hdr.magic = 0x55525043;
+        hdr.version = 1;
+        hdr.type = static_cast<uint8_t>(FrameType::Response);
+        hdr.flags = FLAG_END_STREAM | build_security_flags_client(stream);
+        if (is_error)
+            hdr.flags |= FLAG_ERROR;
+        hdr.stream_id = stream_id;
+        hdr.method_id = method_id;
+        hdr.length = static_cast<uint32_t>(body.size());
+
+        std::vector<uint8_t> enc_buf;
+        std::span<const uint8_t> to_send = body;
+
+        const AppCipherContext *cipher = get_cipher_for_stream(stream);
+        if (cipher && this->should_encrypt(method_id, body.size())) {
+            if (!app_encrypt(*cipher, body, enc_buf)) {
+#if URPC_LOGS
+                usub::ulog::error(
+                    "RpcClient::send_push_reply: app_encrypt failed "
+                    "sid={}; failing closed",
+                    stream_id);
+#endif
+                co_return;
+            }
+            hdr.flags |= FLAG_ENCRYPTED;
+            hdr.length = static_cast<uint32_t>(enc_buf.size());
+            to_send = std::span<const uint8_t>{enc_buf.data(), enc_buf.size()};
+        }
+
+        auto guard = co_await this->write_mutex_.lock();
+        if (this->stream_ != stream) {
+#if URPC_LOGS
+            usub::ulog::warn(
+                "RpcClient::send_push_reply: stream changed, dropping reply "
+                "sid={}",
+                stream_id);
+#endif
+            co_return;
+        }
+
+        co_await send_frame(*stream, hdr, to_send);
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<bool> RpcClient::async_ping() {
+        co_return co_await this->ping_with_flags(0, 0);
+    }
+
+    usub::uvent::task::Awaitable<bool> RpcClient::ping_with_flags(
+        uint16_t extra_flags,
+        uint32_t timeout_ms) {
+#if URPC_LOGS
+        usub::ulog::info("RpcClient::async_ping: start");
+#endif
+        const bool ok = co_await this->ensure_connected();
+        if (!ok) {
+#if URPC_LOGS
+            usub::ulog::error(
+                "RpcClient::async_ping: ensure_connected() failed");
+#endif
+            co_return false;
+        }
+
+        uint32_t sid =
+                this->next_stream_id_.fetch_add(1, std::memory_order_relaxed);
+        if (sid == 0)
+            sid = this->next_stream_id_.fetch_add(1, std::memory_order_relaxed);
+
+        auto evt = std::make_shared<sync::AsyncEvent>(
+            sync::Reset::Manual, false);
+
+        {
+            auto guard = co_await this->ping_mutex_.lock();
+#if URPC_LOGS
+            usub::ulog::debug(
+                "RpcClient::async_ping: register waiter sid={} ping_waiters={}",
+                sid,
+                this->ping_waiters_.size() + 1);
+#endif
+            this->ping_waiters_[sid] = evt;
+        }
+
+        RpcFrameHeader hdr{};
+        hdr.magic = 0x55525043;
+        hdr.version = 1;
+        hdr.type = static_cast<uint8_t>(FrameType::Ping);
+
+        uint16_t flags = FLAG_END_STREAM | extra_flags |
+                         build_security_flags_client(this->stream_);
+
+        hdr.flags = flags;
+        hdr.stream_id = sid;
+        hdr.method_id = 0;
+        hdr.length = 0;
+
+        {
+            auto guard = co_await this->write_mutex_.lock();
+
+            auto stream = this->stream_;
+            if (!stream) {
+#if URPC_LOGS
+                usub::ulog::error(
+                    "RpcClient::async_ping: stream_ is null before send_frame "
+                    "sid={} – removing waiter",
+                    sid);
+#endif
+                auto g2 = co_await this->ping_mutex_.lock();
+                this->ping_waiters_.erase(sid);
+                co_return false;
+            }
+
+#if URPC_LOGS
+            usub::ulog::debug(
+                "RpcClient::async_ping: BEFORE send_frame sid={} flags=0x{:x}",
+                sid, hdr.flags);
+#endif
+            const bool sent =
+                    co_await send_frame(*stream, hdr, {});
+            if (!sent) {
+#if URPC_LOGS
+                usub::ulog::error(
+                    "RpcClient::async_ping: send_frame failed sid={} – "
+                    "removing waiter",
+                    sid);
+#endif
+                auto g2 = co_await this->ping_mutex_.lock();
+                this->ping_waiters_.erase(sid);
+                co_return false;
+            }
+        }
+
+        if (timeout_ms > 0)
+            usub::uvent::system::co_spawn(RpcClient::ping_timeout_detached(
+                this->shared_from_this(), sid, timeout_ms));
+
+#if URPC_LOGS
+        usub::ulog::debug(
+            "RpcClient::async_ping: BEFORE wait sid={}", sid);
+#endif
+        co_await evt->wait();
+#if URPC_LOGS
+        usub::ulog::debug(
+            "RpcClient::async_ping: AFTER wait sid={}", sid);
+#endif
+
+        bool result = false;
+        {
+            auto guard = co_await this->ping_mutex_.lock();
+
+            auto it = this->ping_waiters_.find(sid);
+            if (it != this->ping_waiters_.end()) {
+                result = true;
+                this->ping_waiters_.erase(it);
+            }
+        }
+
+#if URPC_LOGS
+        usub::ulog::info(
+            "RpcClient::async_ping: finished sid={} result={}",
+            sid, result);
+#endif
+        co_return result;
+    }
+
+    usub::uvent::task::Awaitable<void> RpcClient::ping_timeout_detached(
+        std::shared_ptr<RpcClient> self,
+        uint32_t sid,
+        uint32_t timeout_ms) {
+        co_await usub::uvent::system::this_coroutine::sleep_for(
+            std::chrono::milliseconds{timeout_ms});
+
+        // Dropping the waiter is what tells the pinger it timed out.
+        std::shared_ptr<sync::AsyncEvent> evt;
+        {
+            auto guard = co_await self->ping_mutex_.lock();
+            auto it = self->ping_waiters_.find(sid);
+            if (it == self->ping_waiters_.end())
+                co_return;
+            evt = std::move(it->second);
+            self->ping_waiters_.erase(it);
+        }
+        evt->set();
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<bool> RpcClient::agree_idempotency_keys(
+        uint32_t timeout_ms) {
+        auto stream = this->stream_;
+        if (stream && stream->idempotency_keys())
+            co_return true;
+
+        // The reader switches the flag on when the Pong echoes the offer,
+        // before it wakes us; Pongs on one link arrive in order.
+        if (!co_await this->ping_with_flags(FLAG_IDEMPOTENCY_KEY,
+                                            timeout_ms > 0 ? timeout_ms : 5000))
+            co_return false;
+        stream = this->stream_;
+        co_return stream && stream->idempotency_keys();
+    }
+
+    void RpcClient::close() {
+#if URPC_LOGS
+        usub::ulog::info("RpcClient::close()");
+#endif
+        this->running_.store(false, std::memory_order_relaxed);
+
+        std::shared_ptr<IRpcStream> stream;
+        stream.swap(this->stream_);
+
+        if (stream)
+            stream->shutdown();
+    }
+
+    usub::uvent::task::Awaitable<bool> RpcClient::ensure_connected() {
+        using namespace usub::uvent;
+
+        if (this->stream_ &&
+            this->running_.load(std::memory_order_relaxed)) {
+#if URPC_LOGS
+            usub::ulog::debug(
+                "RpcClient::ensure_connected: already connected");
+#endif
+            co_return true;
+        }
+
+        auto guard = co_await this->connect_mutex_.lock();
+
+        if (this->stream_ &&
+            this->running_.load(std::memory_order_relaxed)) {
+#if URPC_LOGS
+            usub::ulog::debug(
+                "RpcClient::ensure_connected: already connected (after lock)");
+#endif
+            co_return true;
+        }
+
+        this->stream_.reset();
+
+#if URPC_LOGS
+        usub::ulog::info(
+            "RpcClient::ensure_connected: connecting to {}:{}",
+            this->config_.host, this->config_.port);
+#endif
+
+        if (!this->config_.stream_factory) {
+            this->config_.stream_factory =
+                    std::make_shared<TcpRpcStreamFactory>(
+                        this->config_.socket_timeout_ms);
+        }
+
+        auto stream =
+                co_await this->config_.stream_factory->create_client_stream(
+                    this->config_.host,
+                    this->config_.port);
+        if (!stream) {
+#if URPC_LOGS
+            usub::ulog::error(
+                "RpcClient::ensure_connected: stream_factory returned nullptr");
+#endif
+            co_return false;
+        }
+
+        this->stream_ = std::move(stream);
+        this->running_.store(true, std::memory_order_relaxed);
+
+#if URPC_LOGS
+        usub::ulog::info(
+            "RpcClient::ensure_connected: connected, spawning reader_loop");
+#endif
 
         auto self = this->shared_from_this();
         usub::uvent::system::co_spawn(
             RpcClient::run_reader_detached(std::move(self)));
 
+        this->crypto_policy_.store(nullptr, std::memory_order_release);
+        if (this->config_.negotiate_crypto_policy &&
+            get_cipher_for_stream(this->stream_)) {
+            usub::uvent::system::co_spawn(
+                RpcClient::fetch_crypto_policy_detached(
+                    this->shared_from_this()));
+        }
+
+        if ((this->config_.frame_crc32c || this->config_.compression) &&
+            !std::dynamic_pointer_cast<TlsRpcStream>(this->stream_)) {
+            usub::uvent::system::co_spawn(
+                RpcClient::offer_link_options_detached(
+                    this->shared_from_this()));
+        }
+
         if (this->config_.ping_interval_ms > 0) {
             auto self2 = this->shared_from_this();
             usub::uvent::system::co_spawn(
@@ -924,6 +1810,298 @@ namespace urpc {
         co_return true;
     }
 
+    usub::uvent::task::Awaitable<void> RpcClient::deliver_offloaded_detached(
+        std::shared_ptr<RpcClient> self,
+        std::shared_ptr<IRpcStream> stream,
+        std::shared_ptr<PendingCall> call,
+        RpcFrame frame) {
+        const AppCipherContext *cipher = get_cipher_for_stream(stream);
+
+        std::vector<uint8_t> decrypted;
+        const bool ok = cipher &&
+                        co_await self->config_.crypto_pool->open(
+                            *cipher,
+                            std::span<const uint8_t>{
+                                reinterpret_cast<const uint8_t *>(
+                                    frame.payload.data()),
+                                frame.payload.size()
+                            },
+                            frame.header.flags,
+                            decrypted);
+        if (!ok) {
+#if URPC_LOGS
+            usub::ulog::warn(
+                "RpcClient::deliver_offloaded_detached: decrypt failed sid={}",
+                frame.header.stream_id);
+#endif
+            call->error = true;
+            call->error_code = 0;
+            call->error_message = cipher
+                                      ? "Failed to decrypt response"
+                                      : "Encrypted response but cipher not available";
+            if (call->event)
+                call->signal();
+            co_return;
+        }
+
+        self->deliver_response(
+            call, frame,
+            std::span<const uint8_t>{decrypted.data(), decrypted.size()},
+            true);
+        co_return;
+    }
+
+    void RpcClient::note_load_report(const RpcFrameHeader &hdr) {
+        if (!(hdr.flags & FLAG_LOAD_REPORT))
+            return;
+        this->load_report_.store(hdr.reserved, std::memory_order_relaxed);
+        this->load_report_at_ns_.store(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count(),
+            std::memory_order_release);
+    }
+
+    usub::uvent::task::Awaitable<bool> RpcClient::stream_response_body(
+        IRpcStream &stream,
+        const RpcFrameHeader &hdr,
+        const uint8_t *head,
+        const std::shared_ptr<PendingCall> &call,
+        bool &crc_seen) {
+        constexpr std::size_t kChunk = 64 * 1024;
+
+        const bool has_crc = frame_has_crc(hdr);
+        uint32_t crc = has_crc
+                           ? crc32c_update(kCrc32cInit, head, RpcFrameHeaderSize)
+                           : 0;
+
+        utils::DynamicBuffer chunk;
+        std::size_t left = hdr.length;
+        while (left > 0) {
+            chunk.clear();
+            const std::size_t want = std::min(left, kChunk);
+            chunk.reserve(want);
+            while (chunk.size() < want) {
+                const ssize_t r = co_await stream.async_read(
+                    chunk, want - chunk.size());
+                if (r <= 0)
+                    co_return false;
+            }
+            if (has_crc)
+                crc = crc32c_update(crc, chunk.data(), chunk.size());
+            left -= chunk.size();
+
+            // A call that timed out keeps its sink untouched from then on.
+            if (!call->sink_aborted && !call->done.load(std::memory_order_acquire) &&
+                !co_await call->sink->write(std::span<const uint8_t>{
+                    chunk.data(), chunk.size()
+                }))
+                call->sink_aborted = true;
+        }
+
+        if (has_crc) {
+            crc_seen = true;
+            uint32_t wire = 0;
+            if (!co_await read_crc_trailer(stream, wire) ||
+                wire != crc32c_finish(crc))
+                co_return false;
+        } else if (crc_seen) {
+            co_return false;
+        }
+
+        {
+            auto guard = co_await this->pending_mutex_.lock();
+            auto it = this->pending_calls_.find(hdr.stream_id);
+            if (it != this->pending_calls_.end() && it->second == call)
+                this->pending_calls_.erase(it);
+        }
+
+        if (call->done.load(std::memory_order_acquire))
+            co_return true;
+
+        call->error = false;
+        if (call->event)
+            call->signal();
+#if URPC_LOGS
+        usub::ulog::debug(
+            "RpcClient::stream_response_body: sid={} len={} aborted={}",
+            hdr.stream_id, hdr.length, call->sink_aborted);
+#endif
+        co_return true;
+    }
+
+    void RpcClient::deliver_response(const std::shared_ptr<PendingCall> &call,
+                                     RpcFrame &frame,
+                                     std::span<const uint8_t> payload_view,
+                                     bool encrypted) {
+        const bool is_error = (frame.header.flags & FLAG_ERROR) != 0;
+
+        if (call->raw) {
+            if (encrypted) {
+                call->raw_payload.clear();
+                if (!payload_view.empty())
+                    call->raw_payload.append(payload_view.data(),
+                                             payload_view.size());
+            } else {
+                call->raw_payload = std::move(frame.payload);
+            }
+            call->raw_flags = static_cast<uint16_t>(
+                frame.header.flags &
+                ~(FLAG_TLS | FLAG_MTLS | FLAG_ENCRYPTED | FLAG_CHUNKED |
+                  FLAG_LOAD_REPORT));
+            if (call->event)
+                call->signal();
+            return;
+        }
+
+        if (is_error) {
+            usub::uvent::utils::DynamicBuffer tmp;
+            if (!payload_view.empty()) {
+                tmp.append(payload_view.data(),
+                           payload_view.size());
+            }
+
+            uint32_t code = 0;
+            std::string msg;
+            if (this->parse_error_payload(tmp, code, msg)) {
+                call->error = true;
+                call->error_code = code;
+                call->error_message = std::move(msg);
+#if URPC_LOGS
+                usub::ulog::warn(
+                    "RpcClient::deliver_response: error Response "
+                    "sid={} code={} msg='{}'",
+                    frame.header.stream_id,
+                    code,
+                    call->error_message);
+#endif
+            } else {
+                call->error = true;
+                call->error_code = 0;
+                call->error_message =
+                        "Malformed error payload";
+#if URPC_LOGS
+                usub::ulog::warn(
+                    "RpcClient::deliver_response: malformed error "
+                    "payload sid={}",
+                    frame.header.stream_id);
+#endif
+            }
+
+            if (call->event)
+                call->signal();
+        } else {
+            auto sz = payload_view.size();
+            call->response.resize(sz);
+            if (sz > 0) {
+                std::memcpy(call->response.data(),
+                            payload_view.data(),
+                            sz);
+            }
+            call->error = false;
+            if (call->event)
+                call->signal();
+#if URPC_LOGS
+            usub::ulog::debug(
+                "RpcClient::deliver_response: Response delivered "
+                "sid={} body_size={}",
+                frame.header.stream_id,
+                sz);
+#endif
+        }
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcClient::offer_link_options_detached(std::shared_ptr<RpcClient> self) {
+        // Ping on stream 0 carrying FLAG_CRC32C and/or FLAG_COMPRESSED;
+        // nobody waits for the Pong, the reader switches each option on
+        // when it arrives with the flag echoed. Servers that predate a flag
+        // answer without it and nothing changes.
+        RpcFrameHeader hdr{};
+        hdr.magic = 0x55525043;
+        hdr.version = 1;
+        hdr.type = static_cast<uint8_t>(FrameType::Ping);
+        hdr.flags = FLAG_END_STREAM;
+        hdr.stream_id = 0;
+        hdr.method_id = 0;
+        hdr.length = 0;
+
+        auto guard = co_await self->write_mutex_.lock();
+        auto stream = self->stream_;
+        if (!stream)
+            co_return;
+
+        if (self->config_.frame_crc32c)
+            hdr.flags |= FLAG_CRC32C;
+        // The server may compress right after its Pong, so the receive
+        // side has to exist before the offer leaves.
+        if (self->config_.compression && stream->prepare_inflate())
+            hdr.flags |= FLAG_COMPRESSED;
+        if (hdr.flags == FLAG_END_STREAM)
+            co_return;
+
+        if (!co_await send_frame(*stream, hdr, {})) {
+#if URPC_LOGS
+            usub::ulog::warn(
+                "RpcClient::offer_link_options_detached: send_frame failed");
+#endif
+        }
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcClient::fetch_crypto_policy_detached(std::shared_ptr<RpcClient> self) {
+        // Everything stays encrypted until the table arrives, which the
+        // server always accepts, so there is no window of disagreement.
+        RpcCallResult r = co_await self->try_call(
+            fnv1a64_rt(kCryptoPolicyMethod), {}, 5000);
+        if (!r.ok) {
+#if URPC_LOGS
+            usub::ulog::info(
+                "RpcClient: no crypto policy from server (code={} msg={}); "
+                "encrypting every body",
+                r.error_code, r.error_message);
+#endif
+            co_return;
+        }
+
+        auto policy = std::make_shared<RpcCryptoPolicy>();
+        if (!RpcCryptoPolicy::parse(r.response, *policy)) {
+#if URPC_LOGS
+            usub::ulog::warn(
+                "RpcClient: malformed crypto policy ({} bytes) ignored",
+                r.response.size());
+#endif
+            co_return;
+        }
+
+        self->crypto_policy_.store(std::move(policy),
+                                   std::memory_order_release);
+        co_return;
+    }
+
+    bool RpcClient::should_encrypt(uint64_t method_id,
+                                   std::size_t size) const {
+        if (size == 0)
+            return false;
+        if (!this->config_.negotiate_crypto_policy)
+            return true;
+        auto policy = this->crypto_policy_.load(std::memory_order_acquire);
+        return !policy || policy->should_encrypt(method_id, size);
+    }
+
+    bool RpcClient::offload_crypto(std::size_t size) const {
+        return this->config_.crypto_pool &&
+               this->config_.crypto_pool->should_offload(size);
+    }
+
+    bool RpcClient::requires_encryption(uint64_t method_id,
+                                        std::size_t size) const {
+        if (!this->config_.negotiate_crypto_policy)
+            return false;
+        auto policy = this->crypto_policy_.load(std::memory_order_acquire);
+        return policy && policy->should_encrypt(method_id, size);
+    }
+
     usub::uvent::task::Awaitable<void>
     RpcClient::run_ping_detached(std::shared_ptr<RpcClient> self) {
 #if URPC_LOGS
@@ -1047,6 +2225,8 @@ namespace urpc {
 #if URPC_LOGS
         usub::ulog::info("RpcClient::reader_loop: started");
 #endif
+        bool crc_seen = false;
+
         while (this->running_.load(std::memory_order_relaxed)) {
             auto stream = this->stream_;
             if (!stream) {
@@ -1119,6 +2299,38 @@ namespace urpc {
                 break;
             }
 
+            // Plaintext success bodies for try_call_into go straight to the
+            // caller's sink; everything else is buffered below.
+            if (static_cast<FrameType>(hdr.type) == FrameType::Response &&
+                hdr.length > 0 &&
+                (hdr.flags & (FLAG_ENCRYPTED | FLAG_ERROR | FLAG_COMPRESSED)) == 0 &&
+                !(get_cipher_for_stream(stream) &&
+                  this->requires_encryption(hdr.method_id, hdr.length))) {
+                std::shared_ptr<PendingCall> call;
+                {
+                    auto guard = co_await this->pending_mutex_.lock();
+                    auto it = this->pending_calls_.find(hdr.stream_id);
+                    if (it != this->pending_calls_.end() && it->second->sink)
+                        call = it->second;
+                }
+                if (call) {
+                    this->note_load_report(hdr);
+                    if (!co_await this->stream_response_body(
+                        *stream, hdr,
+                        reinterpret_cast<const uint8_t *>(head.data()),
+                        call, crc_seen)) {
+#if URPC_LOGS
+                        usub::ulog::warn(
+                            "RpcClient::reader_loop: streamed Response body "
+                            "failed sid={} len={}",
+                            hdr.stream_id, hdr.length);
+#endif
+                        break;
+                    }
+                    continue;
+                }
+            }
+
             RpcFrame frame;
             frame.header = hdr;
 
@@ -1147,6 +2359,33 @@ namespace urpc {
 #endif
             }
 
+            if (!co_await read_frame_crc(
+                *stream, hdr,
+                reinterpret_cast<const uint8_t *>(head.data()),
+                std::span<const uint8_t>{
+                    reinterpret_cast<const uint8_t *>(frame.payload.data()),
+                    frame.payload.size()
+                },
+                crc_seen)) {
+#if URPC_LOGS
+                usub::ulog::warn(
+                    "RpcClient::reader_loop: CRC32C mismatch sid={} len={}, "
+                    "dropping connection",
+                    hdr.stream_id, hdr.length);
+#endif
+                break;
+            }
+
+            if (!inflate_frame(*stream, frame.header, frame.payload)) {
+#if URPC_LOGS
+                usub::ulog::warn(
+                    "RpcClient::reader_loop: undecodable compressed frame "
+                    "sid={}, dropping connection",
+                    hdr.stream_id);
+#endif
+                break;
+            }
+
             auto ft = static_cast<FrameType>(frame.header.type);
 #if URPC_LOGS
             usub::ulog::debug(
@@ -1166,6 +2405,8 @@ namespace urpc {
                         frame.header.length,
                         frame.header.flags);
 #endif
+                    this->note_load_report(frame.header);
+
                     std::shared_ptr<PendingCall> call;
                     {
                         auto guard = co_await this->pending_mutex_.lock();
@@ -1173,7 +2414,8 @@ namespace urpc {
                         auto it =
                                 this->pending_calls_.find(frame.header.stream_id);
                         if (it != this->pending_calls_.end()) {
-                            call = it->second;
+                            call = std::move(it->second);
+                            this->pending_calls_.erase(it);
 #if URPC_LOGS
                             usub::ulog::debug(
                                 "RpcClient::reader_loop: found PendingCall "
@@ -1203,11 +2445,23 @@ namespace urpc {
                         break;
                     }
 
-                    const bool is_error =
-                            (frame.header.flags & FLAG_ERROR) != 0;
                     const bool encrypted =
                             (frame.header.flags & FLAG_ENCRYPTED) != 0;
 
+                    if (encrypted && this->config_.crypto_pool &&
+                        this->config_.crypto_pool->should_offload(
+                            frame.payload.size())) {
+                        // Decrypt on the crypto pool and complete the call
+                        // from there; the reader moves on to the next frame.
+                        usub::uvent::system::co_spawn(
+                            RpcClient::deliver_offloaded_detached(
+                                this->shared_from_this(),
+                                stream,
+                                std::move(call),
+                                std::move(frame)));
+                        break;
+                    }
+
                     std::span<const uint8_t> payload_view{
                         reinterpret_cast<const uint8_t *>(frame.payload.data()),
                         frame.payload.size()
@@ -1230,18 +2484,19 @@ namespace urpc {
                             call->error_message =
                                     "Encrypted response but cipher not available";
                             if (call->event)
-                                call->event->set();
+                                call->signal();
                             break;
                         }
 
-                        bool ok_dec = app_decrypt_gcm(
+                        bool ok_dec = RpcCryptoPool::open_inline(
                             *cipher,
                             payload_view,
+                            frame.header.flags,
                             decrypted);
                         if (!ok_dec) {
 #if URPC_LOGS
                             usub::ulog::warn(
-                                "RpcClient::reader_loop: app_decrypt_gcm failed "
+                                "RpcClient::reader_loop: app_decrypt failed "
                                 "sid={}",
                                 frame.header.stream_id);
 #endif
@@ -1250,7 +2505,7 @@ namespace urpc {
                             call->error_message =
                                     "Failed to decrypt response";
                             if (call->event)
-                                call->event->set();
+                                call->signal();
                             break;
                         }
 
@@ -1267,64 +2522,28 @@ namespace urpc {
                             frame.payload.size(),
                             decrypted.size());
 #endif
-                    }
-
-                    if (is_error) {
-                        usub::uvent::utils::DynamicBuffer tmp;
-                        if (!payload_view.empty()) {
-                            tmp.append(payload_view.data(),
-                                       payload_view.size());
-                        }
-
-                        uint32_t code = 0;
-                        std::string msg;
-                        if (this->parse_error_payload(tmp, code, msg)) {
-                            call->error = true;
-                            call->error_code = code;
-                            call->error_message = std::move(msg);
-#if URPC_LOGS
-                            usub::ulog::warn(
-                                "RpcClient::reader_loop: error Response "
-                                "sid={} code={} msg='{}'",
-                                frame.header.stream_id,
-                                code,
-                                call->error_message);
-#endif
-                        } else {
-                            call->error = true;
-                            call->error_code = 0;
-                            call->error_message =
-                                    "Malformed error payload";
-#if URPC_LOGS
-                            usub::ulog::warn(
-                                "RpcClient::reader_loop: malformed error "
-                                "payload sid={}",
-                                frame.header.stream_id);
-#endif
-                        }
-
-                        if (call->event)
-                            call->event->set();
-                    } else {
-                        auto sz = payload_view.size();
-                        call->response.resize(sz);
-                        if (sz > 0) {
-                            std::memcpy(call->response.data(),
-                                        payload_view.data(),
-                                        sz);
-                        }
-                        call->error = false;
-                        if (call->event)
-                            call->event->set();
+                    } else if (!payload_view.empty() &&
+                               get_cipher_for_stream(this->stream_) &&
+                               this->requires_encryption(
+                                   frame.header.method_id,
+                                   payload_view.size())) {
 #if URPC_LOGS
-                        usub::ulog::debug(
-                            "RpcClient::reader_loop: Response delivered "
-                            "sid={} body_size={}",
+                        usub::ulog::warn(
+                            "RpcClient::reader_loop: plaintext Response "
+                            "rejected by crypto policy sid={} mid={}",
                             frame.header.stream_id,
-                            sz);
+                            frame.header.method_id);
 #endif
+                        call->error = true;
+                        call->error_code = 0;
+                        call->error_message =
+                                "Plaintext response rejected by crypto policy";
+                        if (call->event)
+                            call->signal();
+                        break;
                     }
 
+                    this->deliver_response(call, frame, payload_view, encrypted);
                     break;
                 }
 
@@ -1380,14 +2599,68 @@ namespace urpc {
                         if (it != this->ping_waiters_.end())
                             evt = it->second;
                     }
+                    if ((frame.header.flags & FLAG_CRC32C) &&
+                        this->config_.frame_crc32c &&
+                        !std::dynamic_pointer_cast<TlsRpcStream>(stream)) {
+#if URPC_LOGS
+                        usub::ulog::info(
+                            "RpcClient::reader_loop: CRC32C trailers enabled");
+#endif
+                        stream->enable_frame_crc(true);
+                    }
+                    if (frame.header.flags & FLAG_IDEMPOTENCY_KEY)
+                        stream->enable_idempotency_keys(true);
+                    if ((frame.header.flags & FLAG_COMPRESSED) &&
+                        this->config_.compression &&
+                        !std::dynamic_pointer_cast<TlsRpcStream>(stream) &&
+                        stream->inflater()) {
+#if URPC_LOGS
+                        usub::ulog::info(
+                            "RpcClient::reader_loop: link compression enabled");
+#endif
+                        stream->enable_deflate(this->config_.compression_level);
+                    }
+
                     if (evt)
                         evt->set();
                     break;
                 }
 
-                case FrameType::Request:
-                case FrameType::Stream:
+                case FrameType::Request: {
+#if URPC_LOGS
+                    usub::ulog::debug(
+                        "RpcClient::reader_loop: push Request sid={} mid={} len={}",
+                        frame.header.stream_id,
+                        frame.header.method_id,
+                        frame.header.length);
+#endif
+                    // Registered here, not in the handler coroutine, so a
+                    // Cancel read after this frame always finds the push.
+                    auto src = std::make_shared<sync::CancellationSource>();
+                    uint64_t oneway_key = 0;
+                    {
+                        auto guard = co_await this->push_cancel_mutex_.lock();
+                        if (frame.header.flags & FLAG_ONEWAY) {
+                            oneway_key = ++this->oneway_push_seq_;
+                            this->oneway_push_cancels_[oneway_key] = src;
+                        } else {
+                            this->push_cancels_[frame.header.stream_id] = src;
+                        }
+                    }
+                    system::co_spawn(RpcClient::handle_push_detached(
+                        this->shared_from_this(),
+                        stream,
+                        std::move(frame),
+                        std::move(src),
+                        oneway_key));
+                    break;
+                }
+
                 case FrameType::Cancel:
+                    co_await this->handle_push_cancel(frame.header.stream_id);
+                    break;
+
+                case FrameType::Stream:
                 default:
 #if URPC_LOGS
                     usub::ulog::warn(
@@ -1420,7 +2693,7 @@ namespace urpc {
                     call->error_code = 0;
                     call->error_message =
                             "Connection closed by peer (timeout/idle)";
-                    call->event->set();
+                    call->signal();
                 }
             }
             this->pending_calls_.clear();
@@ -1440,6 +2713,24 @@ namespace urpc {
             this->ping_waiters_.clear();
         }
 
+        {
+            // close() and connection loss both end here: no push reply can
+            // be sent any more, so running push handlers are cancelled.
+            std::unordered_map<uint32_t,
+                               std::shared_ptr<sync::CancellationSource>> pushes;
+            std::unordered_map<uint64_t,
+                               std::shared_ptr<sync::CancellationSource>> oneway_pushes;
+            {
+                auto guard = co_await this->push_cancel_mutex_.lock();
+                pushes.swap(this->push_cancels_);
+                oneway_pushes.swap(this->oneway_push_cancels_);
+            }
+            for (auto &src: pushes | std::views::values)
+                src->request_cancel();
+            for (auto &src: oneway_pushes | std::views::values)
+                src->request_cancel();
+        }
+
         {
             auto guard = co_await this->connect_mutex_.lock();
 #if URPC_LOGS
@@ -1,6 +1,7 @@
 #include <urpc/client/RPCClientPool.h>
 #include <ulog/ulog.h>
 #include <cstdlib>
+#include <random>
 
 namespace urpc
 {
@@ -54,6 +55,8 @@ namespace urpc
             client_cfg.stream_factory = cfg_.stream_factory;
             client_cfg.socket_timeout_ms = cfg_.socket_timeout_ms;
             client_cfg.ping_interval_ms = cfg_.ping_interval_ms;
+            client_cfg.limiter = cfg_.limiter;
+            client_cfg.stats = stats_;
 
             try
             {
@@ -82,6 +85,22 @@ namespace urpc
         }
     }
 
+    double RpcClientPool::load_cost(const RpcClient& client) const
+    {
+        const auto report = client.load_report(
+            std::chrono::milliseconds{cfg_.load_report_max_age_ms});
+        if (!report)
+            return 0.0;
+
+        // Work waiting at the replica, stretched by how long requests sit in
+        // its queue; a saturated CPU doubles it.
+        double cost = (report->in_flight + 1.0) *
+            (1.0 + report->queue_delay_us / 1000.0);
+        if (report->cpu_percent >= 90)
+            cost *= 2.0;
+        return cost;
+    }
+
     RpcClientLease RpcClientPool::try_acquire()
     {
         {
@@ -128,6 +147,17 @@ namespace urpc
         else
             idx = ticket % sz;
 
+        if (cfg_.balance == RpcPoolBalance::PowerOfTwo && sz > 1)
+        {
+            thread_local std::minstd_rand rng{std::random_device{}()};
+            std::size_t other = rng() % (sz - 1);
+            if (other >= idx)
+                ++other;
+
+            if (load_cost(*clients_.at(other)) < load_cost(*clients_.at(idx)))
+                idx = other;
+        }
+
 #if URPC_LOGS
         usub::ulog::debug(
             "RpcClientPool::try_acquire: reuse multiplexed client idx={} "
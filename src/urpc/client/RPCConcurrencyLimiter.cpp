@@ -0,0 +1,227 @@
+#include <urpc/client/RPCConcurrencyLimiter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <uvent/system/SystemContext.h>
+#include <ulog/ulog.h>
+
+namespace urpc
+{
+    using namespace usub::uvent;
+
+    RpcConcurrencyLimiter::RpcConcurrencyLimiter(RpcConcurrencyLimiterConfig cfg)
+        : cfg_(cfg)
+    {
+        this->cfg_.min_limit = std::max<uint32_t>(this->cfg_.min_limit, 1);
+        this->cfg_.max_limit =
+            std::max(this->cfg_.max_limit, this->cfg_.min_limit);
+        this->cfg_.smoothing = std::clamp(this->cfg_.smoothing, 0.01, 1.0);
+        this->limit_ = std::clamp<double>(this->cfg_.initial_limit,
+                                          this->cfg_.min_limit,
+                                          this->cfg_.max_limit);
+    }
+
+    uint32_t RpcConcurrencyLimiter::current_limit() const
+    {
+        return static_cast<uint32_t>(this->limit_);
+    }
+
+    bool RpcConcurrencyLimiter::try_acquire()
+    {
+        std::lock_guard lk(this->mutex_);
+        if (!this->waiters_.empty() || this->in_flight_ >= this->current_limit())
+            return false;
+        ++this->in_flight_;
+        return true;
+    }
+
+    task::Awaitable<bool> RpcConcurrencyLimiter::acquire(uint32_t max_wait_ms)
+    {
+        std::shared_ptr<Waiter> waiter;
+        {
+            std::lock_guard lk(this->mutex_);
+            if (this->waiters_.empty() &&
+                this->in_flight_ < this->current_limit())
+            {
+                ++this->in_flight_;
+                co_return true;
+            }
+
+            if (this->waiters_.size() >= this->cfg_.max_queue)
+            {
+#if URPC_LOGS
+                usub::ulog::debug(
+                    "RpcConcurrencyLimiter: rejecting call, in_flight={} "
+                    "limit={} queued={}",
+                    this->in_flight_, this->current_limit(),
+                    this->waiters_.size());
+#endif
+                co_return false;
+            }
+
+            waiter = std::make_shared<Waiter>();
+            waiter->event = std::make_shared<sync::AsyncEvent>(
+                sync::Reset::Manual, false);
+            this->waiters_.push_back(waiter);
+        }
+
+        uint32_t wait_ms = this->cfg_.queue_timeout_ms;
+        if (max_wait_ms > 0 && (wait_ms == 0 || max_wait_ms < wait_ms))
+            wait_ms = max_wait_ms;
+        if (wait_ms > 0)
+        {
+            system::co_spawn(RpcConcurrencyLimiter::expire_waiter(
+                this->shared_from_this(), waiter, wait_ms));
+        }
+
+        co_await waiter->event->wait();
+
+        std::lock_guard lk(this->mutex_);
+        co_return waiter->granted;
+    }
+
+    task::Awaitable<void> RpcConcurrencyLimiter::expire_waiter(
+        std::shared_ptr<RpcConcurrencyLimiter> self,
+        std::shared_ptr<Waiter> waiter,
+        uint32_t timeout_ms)
+    {
+        co_await system::this_coroutine::sleep_for(
+            std::chrono::milliseconds{timeout_ms});
+
+        {
+            std::lock_guard lk(self->mutex_);
+            if (waiter->granted)
+                co_return;
+            waiter->abandoned = true;
+            std::erase(self->waiters_, waiter);
+        }
+        waiter->event->set();
+        co_return;
+    }
+
+    void RpcConcurrencyLimiter::release(RpcLimitOutcome outcome,
+                                        std::chrono::nanoseconds rtt)
+    {
+        std::vector<std::shared_ptr<Waiter>> wake;
+        {
+            std::lock_guard lk(this->mutex_);
+            this->update_limit(
+                outcome,
+                std::chrono::duration<double, std::micro>(rtt).count());
+
+            if (this->in_flight_ > 0)
+                --this->in_flight_;
+
+            const uint32_t lim = this->current_limit();
+            while (!this->waiters_.empty() && this->in_flight_ < lim)
+            {
+                auto w = std::move(this->waiters_.front());
+                this->waiters_.pop_front();
+                if (w->abandoned)
+                    continue;
+                w->granted = true;
+                ++this->in_flight_;
+                wake.push_back(std::move(w));
+            }
+        }
+
+        for (auto& w : wake)
+            w->event->set();
+    }
+
+    void RpcConcurrencyLimiter::update_limit(RpcLimitOutcome outcome,
+                                             double rtt_us)
+    {
+        const double lo = this->cfg_.min_limit;
+        const double hi = this->cfg_.max_limit;
+
+        if (outcome == RpcLimitOutcome::Ignored)
+            return;
+
+        if (outcome == RpcLimitOutcome::Dropped)
+        {
+            // One back-off per window: a burst of timeouts from a single
+            // stall must not collapse the limit to the floor.
+            if (!this->win_dropped_)
+            {
+                this->limit_ = std::clamp(
+                    this->limit_ * this->cfg_.backoff_ratio, lo, hi);
+                this->win_dropped_ = true;
+            }
+        }
+        else if (rtt_us > 0.0)
+        {
+            if (this->win_min_rtt_us_ <= 0.0 || rtt_us < this->win_min_rtt_us_)
+                this->win_min_rtt_us_ = rtt_us;
+            if (this->min_rtt_us_ <= 0.0 || rtt_us < this->min_rtt_us_)
+                this->min_rtt_us_ = rtt_us;
+            this->win_rtt_sum_us_ += rtt_us;
+            ++this->win_rtt_count_;
+            this->win_max_in_flight_ =
+                std::max(this->win_max_in_flight_, this->in_flight_);
+        }
+
+        // The limit moves once per window of about one limit's worth of
+        // completions, i.e. roughly once per round trip.
+        if (++this->win_samples_ < std::max<uint32_t>(this->current_limit(), 1))
+            return;
+
+        const bool dropped = this->win_dropped_;
+        const double avg_rtt_us = this->win_rtt_count_ > 0
+                                      ? this->win_rtt_sum_us_ / this->win_rtt_count_
+                                      : 0.0;
+        const double win_min_us = this->win_min_rtt_us_;
+        const uint32_t peak = this->win_max_in_flight_;
+
+        this->win_samples_ = 0;
+        this->win_min_rtt_us_ = 0.0;
+        this->win_rtt_count_ = 0;
+        this->win_rtt_sum_us_ = 0.0;
+        this->win_max_in_flight_ = 0;
+        this->win_dropped_ = false;
+
+        if (dropped || avg_rtt_us <= 0.0)
+            return;
+
+        // App-limited window: it says nothing about a larger limit, but the
+        // queueing it saw is not ours, so its minimum is a fair no-load RTT.
+        // This is the only way the baseline moves up (new route, slower
+        // host); while the limit is in use it can only move down.
+        if (peak < this->limit_ / 2.0)
+        {
+            this->min_rtt_us_ = win_min_us;
+            return;
+        }
+
+        const double gradient = std::clamp(
+            this->cfg_.rtt_tolerance * this->min_rtt_us_ / avg_rtt_us,
+            0.5, 1.0);
+        const double target =
+            this->limit_ * gradient + std::sqrt(this->limit_);
+
+        this->limit_ = std::clamp(
+            this->limit_ * (1.0 - this->cfg_.smoothing) +
+            target * this->cfg_.smoothing,
+            lo, hi);
+    }
+
+    uint32_t RpcConcurrencyLimiter::limit() const
+    {
+        std::lock_guard lk(this->mutex_);
+        return this->current_limit();
+    }
+
+    uint32_t RpcConcurrencyLimiter::in_flight() const
+    {
+        std::lock_guard lk(this->mutex_);
+        return this->in_flight_;
+    }
+
+    std::size_t RpcConcurrencyLimiter::queued() const
+    {
+        std::lock_guard lk(this->mutex_);
+        return this->waiters_.size();
+    }
+}
@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+#include <uvent/sync/AsyncEvent.h>
+#include <uvent/system/SystemContext.h>
+
+#include <urpc/client/RPCFanout.h>
+
+namespace urpc
+{
+    using namespace usub::uvent;
+
+    namespace
+    {
+        // Shared with the per-target starters, which may outlive the
+        // fanout when a start is still connecting at the deadline.
+        struct FanoutState
+        {
+            std::mutex mutex;
+            std::vector<RpcCallHandle> handles;
+            std::vector<uint8_t> started;
+            bool expired{false};
+            bool finished{false};
+            std::shared_ptr<sync::AsyncEvent> group;
+        };
+
+        task::Awaitable<void> start_target(std::shared_ptr<FanoutState> st,
+                                           std::size_t index,
+                                           std::shared_ptr<RpcClient> client,
+                                           uint64_t method_id,
+                                           std::vector<uint8_t> body,
+                                           uint32_t timeout_ms)
+        {
+            RpcCallHandle h = co_await client->start_call(
+                method_id,
+                std::span<const uint8_t>{body.data(), body.size()},
+                timeout_ms);
+            if (h)
+                h.call->add_waiter(st->group);
+
+            bool late = false;
+            {
+                std::lock_guard lk(st->mutex);
+                late = st->finished;
+                if (!late)
+                {
+                    st->handles[index] = h;
+                    st->started[index] = 1;
+                }
+            }
+
+            if (late)
+            {
+                // The fanout already reported this target as timed out.
+                if (h)
+                {
+                    h.call->remove_waiter(st->group);
+                    if (!h.call->done.load())
+                        co_await client->cancel_call(h);
+                }
+                co_return;
+            }
+            st->group->set();
+            co_return;
+        }
+
+        task::Awaitable<void> expire_fanout(std::shared_ptr<FanoutState> st,
+                                            uint32_t deadline_ms)
+        {
+            co_await system::this_coroutine::sleep_for(
+                std::chrono::milliseconds{deadline_ms});
+            {
+                std::lock_guard lk(st->mutex);
+                st->expired = true;
+            }
+            st->group->set();
+            co_return;
+        }
+    }
+
+    usub::uvent::task::Awaitable<RpcFanoutResult> rpc_fanout(
+        std::span<const RpcFanoutTarget> targets,
+        RpcFanoutOptions opts)
+    {
+        RpcFanoutResult out;
+        const std::size_t n = targets.size();
+        if (n == 0)
+        {
+            out.ok = true;
+            co_return out;
+        }
+
+        std::size_t need = n;
+        switch (opts.mode)
+        {
+        case RpcFanoutMode::All:
+            need = n;
+            break;
+        case RpcFanoutMode::FirstK:
+            need = std::clamp<std::size_t>(opts.k, 1, n);
+            break;
+        case RpcFanoutMode::Quorum:
+            need = n / 2 + 1;
+            break;
+        }
+
+        auto st = std::make_shared<FanoutState>();
+        st->handles.resize(n);
+        st->started.assign(n, 0);
+        st->group = std::make_shared<sync::AsyncEvent>(
+            sync::Reset::Manual, false);
+
+        // Every target starts at once, connect included, and the deadline
+        // runs from here: a target still connecting when it passes counts
+        // as timed out.
+        if (opts.deadline_ms > 0)
+            system::co_spawn(expire_fanout(st, opts.deadline_ms));
+
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const RpcFanoutTarget& t = targets[i];
+            if (!t.client)
+            {
+                st->started[i] = 1;
+                continue;
+            }
+            // The starter may outlive the caller's buffer and client
+            // pointer; it keeps its own copy and reference.
+            system::co_spawn(start_target(
+                st, i, t.client->shared_from_this(), t.method_id,
+                std::vector<uint8_t>(t.body.begin(), t.body.end()),
+                opts.deadline_ms));
+        }
+
+        std::size_t ok_count = 0;
+        for (;;)
+        {
+            ok_count = 0;
+            std::size_t failed = 0;
+            bool expired = false;
+            {
+                std::lock_guard lk(st->mutex);
+                expired = st->expired;
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    const RpcCallHandle& h = st->handles[i];
+                    if (!st->started[i])
+                        continue;
+                    if (!h)
+                    {
+                        ++failed;
+                    }
+                    else if (h.call->done.load())
+                    {
+                        if (h.call->error)
+                            ++failed;
+                        else
+                            ++ok_count;
+                    }
+                }
+                // For All the first failure decides; otherwise give up once
+                // the remaining calls can no longer reach need.
+                if (ok_count >= need || expired ||
+                    n - failed < need || ok_count + failed == n)
+                    st->finished = true;
+            }
+
+            if (st->finished)
+                break;
+
+            co_await st->group->wait();
+            st->group->reset();
+        }
+
+        out.ok = ok_count >= need;
+        out.succeeded = ok_count;
+        out.results.reserve(n);
+
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            if (!targets[i].client)
+            {
+                RpcCallResult r;
+                r.error_message = "no client";
+                out.results.push_back(std::move(r));
+                continue;
+            }
+            if (!st->started[i])
+            {
+                RpcCallResult r;
+                r.timed_out = true;
+                r.error_code = 408;
+                r.error_message = "RPC call timed out";
+                out.results.push_back(std::move(r));
+                continue;
+            }
+
+            auto& h = st->handles[i];
+            if (!h)
+            {
+                RpcCallResult r;
+                r.error_message = "call not started";
+                out.results.push_back(std::move(r));
+                continue;
+            }
+
+            h.call->remove_waiter(st->group);
+            if (!h.call->done.load())
+                co_await targets[i].client->cancel_call(h);
+
+            out.results.push_back(co_await targets[i].client->await_call(h));
+        }
+
+        co_return out;
+    }
+
+    usub::uvent::task::Awaitable<RpcFanoutResult> rpc_fanout(
+        std::span<RpcClient* const> clients,
+        uint64_t method_id,
+        std::span<const uint8_t> body,
+        RpcFanoutOptions opts)
+    {
+        std::vector<RpcFanoutTarget> targets;
+        targets.reserve(clients.size());
+        for (RpcClient* c : clients)
+            targets.push_back(RpcFanoutTarget{c, method_id, body});
+
+        co_return co_await rpc_fanout(
+            std::span<const RpcFanoutTarget>{targets.data(), targets.size()},
+            opts);
+    }
+}
@@ -0,0 +1,293 @@
+#include <chrono>
+
+#include <urpc/client/RPCSyncClient.h>
+
+#include <uvent/system/SystemContext.h>
+
+namespace urpc
+{
+    using namespace usub::uvent;
+
+    namespace
+    {
+        constexpr std::chrono::milliseconds kGracePeriod{1000};
+    }
+
+    RpcSyncClient::RpcSyncClient(RpcClientConfig cfg, int threads)
+        : state_(std::make_shared<State>())
+          , owned_uvent_(std::make_unique<usub::Uvent>(threads < 1 ? 1 : threads))
+          , uvent_(owned_uvent_.get())
+    {
+        this->state_->client = std::make_shared<RpcClient>(std::move(cfg));
+        this->state_->idle =
+            std::make_shared<sync::AsyncEvent>(sync::Reset::Manual, false);
+
+        auto st = this->state_;
+        this->uvent_->for_each_thread(
+            [st](int threadIndex, thread::ThreadLocalStorage*)
+            {
+                if (threadIndex == 0)
+                    system::co_spawn_static(drain_loop(st), threadIndex);
+            });
+
+        this->thread_ = std::thread([this] { this->uvent_->run(); });
+    }
+
+    RpcSyncClient::RpcSyncClient(RpcClientConfig cfg, usub::Uvent& uvent)
+        : state_(std::make_shared<State>())
+          , uvent_(&uvent)
+    {
+        this->state_->client = std::make_shared<RpcClient>(std::move(cfg));
+        this->state_->idle =
+            std::make_shared<sync::AsyncEvent>(sync::Reset::Manual, false);
+
+        auto st = this->state_;
+        this->uvent_->for_each_thread(
+            [st](int threadIndex, thread::ThreadLocalStorage*)
+            {
+                if (threadIndex == 0)
+                    system::co_spawn_static(drain_loop(st), threadIndex);
+            });
+    }
+
+    RpcSyncClient::~RpcSyncClient()
+    {
+        this->stop();
+    }
+
+    void RpcSyncClient::stop()
+    {
+        State& st = *this->state_;
+        if (st.stopping.exchange(true, std::memory_order_acq_rel))
+            return;
+
+        // The drain loop closes the connection, gives running calls a
+        // grace period to complete normally and fails the rest, all on its
+        // own thread, then fulfils `stopped`.
+        std::future<void> stopped = st.stopped.get_future();
+        st.wake.set();
+        if (stopped.wait_for(kGracePeriod + std::chrono::seconds(1)) !=
+            std::future_status::ready)
+        {
+            // The runtime is not running (a caller-owned one that was
+            // stopped, or this is its only thread). Whatever is left may
+            // never resume; its waiter must not hang.
+            st.fail_running();
+        }
+
+        // With a caller-owned runtime the drain loop is still the queue's
+        // consumer and fails the leftovers itself on exit; it and the jobs
+        // keep the state alive, so returning now is safe.
+        if (!this->owned_uvent_)
+            return;
+
+        this->uvent_->stop();
+        if (this->thread_.joinable())
+            this->thread_.join();
+
+        std::lock_guard lk(st.mutex);
+        st.drained = true;
+        st.fail_queued();
+    }
+
+    void RpcSyncClient::State::fail_queued()
+    {
+        while (!this->queue.empty())
+        {
+            if (auto* job = static_cast<Job*>(this->queue.pop()))
+            {
+                RpcCallResult r;
+                r.error_message = "RpcSyncClient stopped";
+                complete(job, std::move(r));
+            }
+        }
+    }
+
+    void RpcSyncClient::State::fail_running()
+    {
+        std::unordered_set<Job*> left;
+        {
+            std::lock_guard lk(this->mutex);
+            left.swap(this->running);
+        }
+        for (Job* job : left)
+        {
+            RpcCallResult r;
+            r.error_message = "RpcSyncClient stopped";
+            complete(job, std::move(r));
+        }
+    }
+
+    RpcCallResult RpcSyncClient::call(uint64_t method_id,
+                                      std::span<const uint8_t> body,
+                                      uint32_t timeout_ms)
+    {
+        return this->call_async(method_id, body, timeout_ms).get();
+    }
+
+    std::future<RpcCallResult> RpcSyncClient::call_async(
+        uint64_t method_id,
+        std::span<const uint8_t> body,
+        uint32_t timeout_ms)
+    {
+        auto* job = new Job;
+        job->method_id = method_id;
+        job->body.assign(body.begin(), body.end());
+        job->timeout_ms = timeout_ms;
+        auto fut = job->promise.get_future();
+        this->submit(job);
+        return fut;
+    }
+
+    void RpcSyncClient::call_async(uint64_t method_id,
+                                   std::span<const uint8_t> body,
+                                   uint32_t timeout_ms,
+                                   RpcSyncCallback cb)
+    {
+        auto* job = new Job;
+        job->method_id = method_id;
+        job->body.assign(body.begin(), body.end());
+        job->timeout_ms = timeout_ms;
+        job->callback = std::move(cb);
+        this->submit(job);
+    }
+
+    void RpcSyncClient::submit(Job* job)
+    {
+        State& st = *this->state_;
+        if (st.stopping.load(std::memory_order_acquire))
+        {
+            RpcCallResult r;
+            r.error_message = "RpcSyncClient stopped";
+            complete(job, std::move(r));
+            return;
+        }
+
+        st.queue.push(job);
+
+        // Only the producer that catches the loop parked pays for the
+        // wake-up; everyone else just enqueues.
+        if (st.parked.exchange(false, std::memory_order_acq_rel))
+            st.wake.set();
+
+        // Raced with stop(): if the drain loop is already gone nobody else
+        // will pop this job.
+        if (st.stopping.load(std::memory_order_acquire))
+        {
+            std::lock_guard lk(st.mutex);
+            if (st.drained)
+                st.fail_queued();
+        }
+    }
+
+    void RpcSyncClient::complete(Job* job, RpcCallResult result)
+    {
+        if (job->callback)
+            job->callback(std::move(result));
+        else
+            job->promise.set_value(std::move(result));
+        delete job;
+    }
+
+    usub::uvent::task::Awaitable<void> RpcSyncClient::drain_loop(
+        std::shared_ptr<State> st)
+    {
+        while (!st->stopping.load(std::memory_order_acquire))
+        {
+            while (auto* node = st->queue.pop())
+            {
+                auto* job = static_cast<Job*>(node);
+                {
+                    // Checked under the lock so a job cannot slip in after
+                    // stop() has failed the running ones.
+                    std::lock_guard lk(st->mutex);
+                    if (!st->stopping.load(std::memory_order_acquire))
+                    {
+                        st->running.insert(job);
+                        job = nullptr;
+                    }
+                }
+                if (job)
+                {
+                    RpcCallResult r;
+                    r.error_message = "RpcSyncClient stopped";
+                    complete(job, std::move(r));
+                    continue;
+                }
+                system::co_spawn(run_job(st, static_cast<Job*>(node)));
+            }
+
+            st->parked.store(true, std::memory_order_release);
+            if (!st->queue.empty() &&
+                st->parked.exchange(false, std::memory_order_acq_rel))
+            {
+                continue;
+            }
+
+            co_await st->wake.wait();
+            st->wake.reset();
+        }
+
+        st->client->close();
+
+        // Running calls observe the closed connection and complete
+        // normally; whatever is left after the grace period (e.g. a call
+        // with a long timeout that reconnected) is failed.
+        bool idle = false;
+        {
+            std::lock_guard lk(st->mutex);
+            idle = st->running.empty();
+        }
+        if (!idle)
+        {
+            system::co_spawn(expire_grace(st->idle));
+            co_await st->idle->wait();
+        }
+        st->fail_running();
+
+        {
+            std::lock_guard lk(st->mutex);
+            if (!st->drained)
+            {
+                st->drained = true;
+                st->fail_queued();
+            }
+        }
+        st->stopped.set_value();
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void> RpcSyncClient::expire_grace(
+        std::shared_ptr<sync::AsyncEvent> idle)
+    {
+        co_await system::this_coroutine::sleep_for(kGracePeriod);
+        idle->set();
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void> RpcSyncClient::run_job(
+        std::shared_ptr<State> st, Job* job)
+    {
+        // The job may be failed and freed by stop() while the call is
+        // suspended; only the pointer is used after the await.
+        const std::vector<uint8_t> body = std::move(job->body);
+        auto result = co_await st->client->try_call(
+            job->method_id,
+            std::span<const uint8_t>{body.data(), body.size()},
+            job->timeout_ms);
+
+        bool mine = false;
+        bool last = false;
+        {
+            std::lock_guard lk(st->mutex);
+            mine = st->running.erase(job) != 0;
+            last = st->running.empty() &&
+                   st->stopping.load(std::memory_order_acquire);
+        }
+        if (mine)
+            complete(job, std::move(result));
+        if (last)
+            st->idle->set();
+        co_return;
+    }
+}
@@ -1,61 +1,29 @@
 #include <urpc/connection/RPCConnection.h>
+#include <urpc/connection/RPCWireHelpers.h>
 #include <urpc/crypto/AppCrypto.h>
+#include <urpc/crypto/CryptoPolicy.h>
+#include <urpc/crypto/CryptoPool.h>
+#include <urpc/server/RPCIdempotency.h>
+#include <urpc/server/RPCLoadTracker.h>
+#include <urpc/server/RPCMethodStats.h>
+#include <urpc/server/RPCMirror.h>
+#include <urpc/server/RPCResponseCache.h>
+#include <urpc/server/RPCServerStats.h>
 #include <urpc/transport/TlsRpcStream.h>
 
+#include <algorithm>
+
 namespace urpc
 {
     using namespace usub::uvent;
 
-    static const AppCipherContext* get_cipher_for_stream(IRpcStream* s)
-    {
-        auto* tls = dynamic_cast<TlsRpcStream*>(s);
-        if (!tls)
-            return nullptr;
-        return tls->app_cipher();
-    }
-
-    static bool stream_is_tls(IRpcStream* s)
-    {
-        return dynamic_cast<TlsRpcStream*>(s) != nullptr;
-    }
-
-    static uint16_t build_security_flags(IRpcStream* stream,
-                                         const RpcPeerIdentity* peer)
-    {
-        uint16_t flags = 0;
-        if (stream_is_tls(stream))
-            flags |= FLAG_TLS;
-        if (peer && peer->authenticated)
-            flags |= FLAG_MTLS;
-        return flags;
-    }
-
-    static task::Awaitable<bool> read_exact(
-        IRpcStream& stream,
-        utils::DynamicBuffer& buf,
-        std::size_t expected)
-    {
-        buf.clear();
-        buf.reserve(expected);
+    // Fastest deflate level: link compression targets repetitive small
+    // messages, where level 1 already finds most of the matches.
+    static constexpr int kServerCompressionLevel = 1;
 
-#if URPC_LOGS
-        usub::ulog::debug(
-            "RpcConnection::read_exact: cur={} expected={}",
-            buf.size(), expected);
-#endif
-
-        while (buf.size() < expected) {
-            const std::size_t want = expected - buf.size();
-            const ssize_t r = co_await stream.async_read(buf, want);
-            if (r <= 0) co_return false;
-        }
-        co_return true;
-#if URPC_LOGS
-        usub::ulog::debug(
-            "RpcConnection::read_exact: size={}",
-            buf.size());
-#endif
-    }
+    // Frames up to this size (control frames, error responses) are never
+    // refused by the outbound byte cap.
+    static constexpr std::size_t kAlwaysAdmitBytes = 1024;
 
     RpcConnection::RpcConnection(std::shared_ptr<IRpcStream> stream,
                                  RpcMethodRegistry& registry)
@@ -72,10 +40,32 @@ namespace urpc
 
     RpcConnection::RpcConnection(std::shared_ptr<IRpcStream> stream,
                                  RpcMethodRegistry& registry,
-                                 RpcCancelCallback on_cancel)
+                                 RpcCancelCallback on_cancel,
+                                 RpcTopicRegistry* topics,
+                                 RpcMirror* mirror,
+                                 const RpcCryptoPolicy* crypto_policy,
+                                 RpcCryptoPool* crypto_pool,
+                                 RpcLoadTracker* load,
+                                 RpcConnectionLimits limits,
+                                 RpcMemoryBudget* budget,
+                                 RpcResponseCache* cache,
+                                 RpcIdempotencyTable* idempotency,
+                                 RpcMethodStats* stats,
+                                 RpcServerStats* server_stats)
         : stream_(std::move(stream))
           , registry_(registry)
           , on_cancel_(std::move(on_cancel))
+          , topics_(topics)
+          , mirror_(mirror)
+          , crypto_policy_(crypto_policy)
+          , crypto_pool_(crypto_pool)
+          , load_(load)
+          , limits_(limits)
+          , budget_(budget)
+          , cache_(cache)
+          , idempotency_(idempotency)
+          , stats_(stats)
+          , server_stats_(server_stats)
     {
 #if URPC_LOGS
         usub::ulog::info(
@@ -85,6 +75,14 @@ namespace urpc
 #endif
     }
 
+    bool RpcConnection::should_encrypt(uint64_t method_id,
+                                       std::size_t size) const
+    {
+        if (!this->crypto_policy_)
+            return size != 0;
+        return this->crypto_policy_->should_encrypt(method_id, size);
+    }
+
     usub::uvent::task::Awaitable<void>
     RpcConnection::run_detached(std::shared_ptr<RpcConnection> self)
     {
@@ -95,7 +93,17 @@ namespace urpc
             "RpcConnection::run_detached: self={}",
             static_cast<void*>(self.get()));
 #endif
+        if (self->server_stats_)
+        {
+            self->server_stats_->connections_accepted.add();
+            self->server_stats_->connections_active.add();
+        }
+        if (self->limits_.write_stall_timeout_ms > 0)
+            usub::uvent::system::co_spawn(
+                RpcConnection::stall_watchdog(self));
         co_await self->loop();
+        if (self->server_stats_)
+            self->server_stats_->connections_active.add(-1);
 #if URPC_LOGS
         usub::ulog::warn(
             "RpcConnection::run_detached: finished self={}",
@@ -121,6 +129,8 @@ namespace urpc
             static_cast<void*>(this->stream_.get()));
 #endif
 
+        bool crc_seen = false;
+
         for (;;)
         {
             if (!this->stream_)
@@ -198,6 +208,73 @@ namespace urpc
                 break;
             }
 
+            // Streaming handlers read plain bodies straight off the socket;
+            // app-encrypted or compressed ones must be decoded as a whole
+            // and take the buffered path below, as do keyed retries, which
+            // are looked up before any handler runs. So do bodies on a
+            // CRC32C link: the trailer follows the body, and a handler must
+            // not see bytes before they are verified.
+            if (static_cast<FrameType>(hdr.type) == FrameType::Request &&
+                (hdr.flags & (FLAG_ENCRYPTED | FLAG_COMPRESSED |
+                              FLAG_IDEMPOTENCY_KEY)) == 0 &&
+                !frame_has_crc(hdr) && !crc_seen)
+            {
+                if (RpcStreamHandlerEntry sfn =
+                        this->registry_.find_streaming(hdr.method_id))
+                {
+                    if (!co_await this->stream_request_body(hdr, sfn))
+                    {
+#if URPC_LOGS
+                        usub::ulog::warn(
+                            "RpcConnection::loop: streamed body read failed "
+                            "sid={} len={}",
+                            hdr.stream_id, hdr.length);
+#endif
+                        this->stream_->shutdown();
+                        break;
+                    }
+                    continue;
+                }
+            }
+
+            RpcMemoryCharge charge;
+            if (this->budget_ && hdr.length > 0)
+            {
+                const bool is_request =
+                    static_cast<FrameType>(hdr.type) == FrameType::Request;
+                if (is_request && !this->budget_->admit(hdr.length))
+                {
+                    this->budget_->count_rejected();
+#if URPC_LOGS
+                    usub::ulog::warn(
+                        "RpcConnection::loop: memory budget exceeded "
+                        "(used={}), rejecting sid={} len={}",
+                        this->budget_->used(), hdr.stream_id, hdr.length);
+#endif
+                    if (!co_await discard_frame_body(
+                        *this->stream_, hdr,
+                        reinterpret_cast<const uint8_t*>(head.data()),
+                        crc_seen))
+                    {
+                        this->stream_->shutdown();
+                        break;
+                    }
+                    if ((hdr.flags & FLAG_ONEWAY) == 0)
+                        usub::uvent::system::co_spawn(
+                            RpcConnection::reject_request_detached(
+                                this->shared_from_this(), hdr));
+                    continue;
+                }
+
+                // Over the soft limit the heaviest readers wait here, with
+                // the body still in the socket buffer, so TCP pushes back
+                // on their senders. Only new requests wait: responses to
+                // our pushes, cancels and pings are what frees memory.
+                if (is_request)
+                    co_await this->budget_->wait_for_room(this, hdr.length);
+                charge = this->budget_->charge(this, hdr.length);
+            }
+
             RpcFrame frame;
             frame.header = hdr;
 
@@ -231,6 +308,60 @@ namespace urpc
 #endif
             }
 
+            if (!co_await read_frame_crc(
+                *this->stream_, hdr,
+                reinterpret_cast<const uint8_t*>(head.data()),
+                std::span<const uint8_t>(
+                    reinterpret_cast<const uint8_t*>(frame.payload.data()),
+                    frame.payload.size()),
+                crc_seen))
+            {
+#if URPC_LOGS
+                usub::ulog::warn(
+                    "RpcConnection::loop: CRC32C mismatch sid={} len={}, "
+                    "dropping connection",
+                    hdr.stream_id, hdr.length);
+#endif
+                this->stream_->shutdown();
+                break;
+            }
+
+            if (!inflate_frame(*this->stream_, frame.header, frame.payload))
+            {
+#if URPC_LOGS
+                usub::ulog::warn(
+                    "RpcConnection::loop: undecodable compressed frame sid={}, "
+                    "dropping connection",
+                    hdr.stream_id);
+#endif
+                this->stream_->shutdown();
+                break;
+            }
+
+            // The budget saw the compressed length; a deflated body may
+            // have grown up to kMaxFrameBodyLength since.
+            if (this->budget_ && frame.payload.size() > hdr.length)
+            {
+                const std::size_t inflated = frame.payload.size();
+                if (static_cast<FrameType>(hdr.type) == FrameType::Request &&
+                    !this->budget_->admit(inflated))
+                {
+                    this->budget_->count_rejected();
+#if URPC_LOGS
+                    usub::ulog::warn(
+                        "RpcConnection::loop: memory budget exceeded "
+                        "(used={}), rejecting inflated sid={} len={}",
+                        this->budget_->used(), hdr.stream_id, inflated);
+#endif
+                    if ((hdr.flags & FLAG_ONEWAY) == 0)
+                        usub::uvent::system::co_spawn(
+                            RpcConnection::reject_request_detached(
+                                this->shared_from_this(), hdr));
+                    continue;
+                }
+                charge.merge(this->budget_->charge(this, inflated - hdr.length));
+            }
+
             FrameType ft = static_cast<FrameType>(frame.header.type);
 #if URPC_LOGS
             usub::ulog::debug(
@@ -259,7 +390,9 @@ namespace urpc
                 usub::uvent::system::co_spawn(
                     RpcConnection::handle_request_detached(
                         this->shared_from_this(),
-                        std::move(frame)));
+                        std::move(frame),
+                        std::chrono::steady_clock::now(),
+                        std::move(charge)));
                 break;
 
             case FrameType::Cancel:
@@ -271,6 +404,9 @@ namespace urpc
                 break;
 
             case FrameType::Response:
+                co_await this->handle_response(std::move(frame));
+                break;
+
             case FrameType::Stream:
             case FrameType::Pong:
 #if URPC_LOGS
@@ -281,6 +417,7 @@ namespace urpc
                     frame.header.stream_id);
 #endif
                 this->stream_->shutdown();
+                co_await this->fail_pending_calls();
                 co_return;
 
             default:
@@ -292,6 +429,7 @@ namespace urpc
                     frame.header.stream_id);
 #endif
                 this->stream_->shutdown();
+                co_await this->fail_pending_calls();
                 co_return;
             }
         }
@@ -299,15 +437,145 @@ namespace urpc
 #if URPC_LOGS
         usub::ulog::warn("RpcConnection::loop: exiting");
 #endif
+        co_await this->fail_pending_calls();
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void> RpcConnection::fail_pending_calls()
+    {
+        this->open_.store(false, std::memory_order_release);
+
+        auto guard = co_await this->pending_mutex_.lock();
+#if URPC_LOGS
+        usub::ulog::warn(
+            "RpcConnection[{}]: failing {} pending push calls",
+            static_cast<void*>(this),
+            this->pending_calls_.size());
+#endif
+        for (auto& [sid, call] : this->pending_calls_)
+        {
+            if (call && call->event)
+            {
+                call->error = true;
+                call->error_code = 0;
+                call->error_message = "Connection closed";
+                call->signal();
+            }
+        }
+        this->pending_calls_.clear();
+        co_return;
+    }
+
+    bool RpcConnection::write_stalled(int64_t now_ns) const
+    {
+        const uint32_t timeout_ms = this->limits_.write_stall_timeout_ms;
+        if (timeout_ms == 0)
+            return false;
+        const int64_t since = this->write_since_ns_.load(std::memory_order_acquire);
+        if (since == 0)
+            return false;
+        const int64_t progress =
+            std::max(since, this->stream_->last_write_progress_ns());
+        return now_ns - progress > static_cast<int64_t>(timeout_ms) * 1'000'000;
+    }
+
+    void RpcConnection::evict(const char* reason)
+    {
+        if (this->evicted_.exchange(true, std::memory_order_acq_rel))
+            return;
+#if URPC_LOGS
+        usub::ulog::warn(
+            "RpcConnection[{}]: evicting slow consumer ({}), queued_bytes={}",
+            static_cast<void*>(this),
+            reason,
+            this->out_bytes_.load(std::memory_order_relaxed));
+#else
+        (void)reason;
+#endif
+        if (this->server_stats_)
+            this->server_stats_->connections_evicted.add();
+        this->stream_->shutdown();
+        usub::uvent::system::co_spawn(
+            RpcConnection::cancel_handlers_detached(this->shared_from_this()));
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcConnection::cancel_handlers_detached(std::shared_ptr<RpcConnection> self)
+    {
+        auto guard = co_await self->cancel_map_mutex_.lock();
+        for (auto& [sid, src] : self->cancel_map_)
+            if (src)
+                src->request_cancel();
         co_return;
     }
 
     usub::uvent::task::Awaitable<void>
+    RpcConnection::stall_watchdog(std::shared_ptr<RpcConnection> self)
+    {
+        const auto period = std::chrono::milliseconds{
+            std::max<uint32_t>(self->limits_.write_stall_timeout_ms / 4, 50)};
+
+        while (self->open_.load(std::memory_order_acquire) &&
+               !self->evicted_.load(std::memory_order_acquire))
+        {
+            co_await usub::uvent::system::this_coroutine::sleep_for(period);
+            if (self->write_stalled(steady_now_ns()))
+                self->evict("write stalled");
+        }
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<bool>
     RpcConnection::locked_send(const RpcFrameHeader& hdr,
-                               std::span<const uint8_t> body)
+                               std::span<const uint8_t> body,
+                               bool* over_cap)
     {
+        if (this->evicted_.load(std::memory_order_acquire))
+            co_return false;
+
+        // A writer stuck on a peer that stopped reading holds the lock; do
+        // not queue behind it.
+        if (this->write_stalled(steady_now_ns()))
+        {
+            this->evict("write stalled");
+            co_return false;
+        }
+
+        // A single frame is always admitted, however large, so an idle
+        // connection can still send a big response. Going over the cap only
+        // fails this send: a burst of large responses to a peer that reads
+        // fine must not cost it the connection; stalled peers are evicted
+        // by write_stalled().
+        const std::size_t n = RpcFrameHeaderSize + body.size();
+        const std::size_t queued =
+            this->out_bytes_.fetch_add(n, std::memory_order_acq_rel) + n;
+        if (this->limits_.max_outbound_bytes > 0 && queued != n &&
+            n > kAlwaysAdmitBytes &&
+            queued > this->limits_.max_outbound_bytes)
+        {
+            this->out_bytes_.fetch_sub(n, std::memory_order_acq_rel);
+#if URPC_LOGS
+            usub::ulog::warn(
+                "RpcConnection[{}]: outbound queue full, refusing sid={} "
+                "len={} queued={}",
+                static_cast<void*>(this),
+                hdr.stream_id,
+                body.size(),
+                queued - n);
+#endif
+            if (over_cap)
+                *over_cap = true;
+            co_return false;
+        }
+
         auto guard = co_await this->write_mutex_.lock();
 
+        if (this->evicted_.load(std::memory_order_acquire))
+        {
+            this->out_bytes_.fetch_sub(n, std::memory_order_acq_rel);
+            co_return false;
+        }
+
 #if URPC_LOGS
         usub::ulog::info(
             "RpcConnection[{}]: locked_send type={} sid={} len={} flags=0x{:x}",
@@ -318,7 +586,10 @@ namespace urpc
             hdr.flags);
 #endif
 
+        this->write_since_ns_.store(steady_now_ns(), std::memory_order_release);
         const bool ok = co_await send_frame(*this->stream_, hdr, body);
+        this->write_since_ns_.store(0, std::memory_order_release);
+        this->out_bytes_.fetch_sub(n, std::memory_order_acq_rel);
         if (!ok)
             this->stream_->shutdown();
 
@@ -331,7 +602,7 @@ namespace urpc
             body.size());
 #endif
 
-        co_return;
+        co_return ok;
     }
 
     usub::uvent::task::Awaitable<void>
@@ -348,14 +619,25 @@ namespace urpc
         hdr.length = static_cast<uint32_t>(body.size());
 
         std::vector<uint8_t> enc_buf;
+        RpcMemoryCharge enc_charge;
         std::span<const uint8_t> to_send = body;
 
         const AppCipherContext* cipher =
             get_cipher_for_stream(&ctx.stream);
 
-        if (cipher && !body.empty())
+        if (cipher && this->should_encrypt(ctx.method_id, body.size()))
         {
-            bool ok = app_encrypt_gcm(*cipher, body, enc_buf);
+            bool ok = false;
+            if (this->crypto_pool_ &&
+                this->crypto_pool_->should_offload(body.size()))
+            {
+                ok = co_await this->crypto_pool_->seal(
+                    *cipher, body, enc_buf, hdr.flags);
+            }
+            else
+            {
+                ok = app_encrypt(*cipher, body, enc_buf);
+            }
             if (ok)
             {
                 hdr.flags |= FLAG_ENCRYPTED;
@@ -364,6 +646,7 @@ namespace urpc
                     enc_buf.data(),
                     enc_buf.size()
                 };
+                enc_charge = this->charge_memory(enc_buf.size());
 #if URPC_LOGS
                 usub::ulog::info(
                     "RpcConnection[{}]: encrypting Response mid={} sid={} "
@@ -379,7 +662,7 @@ namespace urpc
             {
 #if URPC_LOGS
                 usub::ulog::error(
-                    "RpcConnection[{}]: app_encrypt_gcm failed for Response "
+                    "RpcConnection[{}]: app_encrypt failed for Response "
                     "mid={} sid={}; failing closed (no plaintext fallback)",
                     static_cast<void*>(this),
                     hdr.method_id,
@@ -400,7 +683,22 @@ namespace urpc
             hdr.flags);
 #endif
 
-        co_await this->locked_send(hdr, to_send);
+        this->stamp_load_report(hdr);
+        bool over_cap = false;
+        if (co_await this->locked_send(hdr, to_send, &over_cap))
+        {
+            if (this->server_stats_)
+            {
+                this->server_stats_->responses.add();
+                this->server_stats_->response_bytes.add(hdr.length);
+            }
+        }
+        else if (over_cap)
+        {
+            // The client still gets an answer it can retry on.
+            co_await this->send_simple_error(
+                ctx, 503, "Server outbound queue full");
+        }
         co_return;
     }
 
@@ -412,32 +710,15 @@ namespace urpc
     {
         using urpc::host_to_be;
 
-        const uint32_t code_be = host_to_be<uint32_t>(error_code);
-        const uint32_t msg_len = static_cast<uint32_t>(message.size());
-        const uint32_t msg_len_be = host_to_be<uint32_t>(msg_len);
-
-        std::vector<uint8_t> buf;
-        buf.reserve(8 + message.size() + details.size());
-
-        buf.insert(buf.end(),
-                   reinterpret_cast<const uint8_t*>(&code_be),
-                   reinterpret_cast<const uint8_t*>(&code_be)
-                   + sizeof(code_be));
-
-        buf.insert(buf.end(),
-                   reinterpret_cast<const uint8_t*>(&msg_len_be),
-                   reinterpret_cast<const uint8_t*>(&msg_len_be)
-                   + sizeof(msg_len_be));
+        // One-way requests never get a reply, not even an error.
+        if (ctx.flags & FLAG_ONEWAY)
+            co_return;
 
-        buf.insert(buf.end(),
-                   reinterpret_cast<const uint8_t*>(message.data()),
-                   reinterpret_cast<const uint8_t*>(message.data())
-                   + message.size());
+        if (this->server_stats_)
+            this->server_stats_->errors.add();
 
-        if (!details.empty())
-        {
-            buf.insert(buf.end(), details.begin(), details.end());
-        }
+        std::vector<uint8_t> buf =
+            build_error_body(error_code, message, details);
 
         RpcFrameHeader hdr{};
         hdr.magic = 0x55525043;
@@ -454,9 +735,9 @@ namespace urpc
         const AppCipherContext* cipher =
             get_cipher_for_stream(&ctx.stream);
 
-        if (cipher && !buf.empty())
+        if (cipher && this->should_encrypt(ctx.method_id, buf.size()))
         {
-            bool ok = app_encrypt_gcm(*cipher,
+            bool ok = app_encrypt(*cipher,
                                       std::span<const uint8_t>{
                                           buf.data(),
                                           buf.size()
@@ -486,7 +767,7 @@ namespace urpc
             {
 #if URPC_LOGS
                 usub::ulog::error(
-                    "RpcConnection[{}]: app_encrypt_gcm failed for ERROR "
+                    "RpcConnection[{}]: app_encrypt failed for ERROR "
                     "mid={} sid={} code={}; failing closed (no plaintext "
                     "fallback)",
                     static_cast<void*>(this),
@@ -510,6 +791,12 @@ namespace urpc
             hdr.flags);
 #endif
 
+        this->stamp_load_report(hdr);
+        if (this->server_stats_)
+        {
+            this->server_stats_->responses.add();
+            this->server_stats_->response_bytes.add(hdr.length);
+        }
         co_await this->locked_send(hdr, to_send);
         co_return;
     }
@@ -517,14 +804,231 @@ namespace urpc
     usub::uvent::task::Awaitable<void>
     RpcConnection::handle_request_detached(
         std::shared_ptr<RpcConnection> self,
-        RpcFrame frame)
+        RpcFrame frame,
+        std::chrono::steady_clock::time_point read_at,
+        // Never read: owning it keeps the request body charged to the
+        // memory budget until the handler is done.
+        [[maybe_unused]] RpcMemoryCharge charge)
     {
         if (!self)
             co_return;
+        // Nothing a handler produces could reach an evicted peer.
+        if (self->evicted_.load(std::memory_order_acquire))
+            co_return;
+        RpcLoadTracker* load = self->load_;
+        if (load)
+            load->on_request_start(std::chrono::steady_clock::now() - read_at);
+        RpcServerStats* stats = self->server_stats_;
+        if (stats)
+        {
+            stats->requests.add();
+            stats->request_bytes.add(frame.header.length);
+        }
         co_await self->handle_request(std::move(frame));
+        if (load)
+            load->on_request_end();
+        if (stats)
+            stats->request_latency_us.observe(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - read_at).count()));
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<bool>
+    RpcConnection::stream_request_body(const RpcFrameHeader& hdr,
+                                       RpcStreamHandlerEntry fn)
+    {
+        const std::size_t window = this->limits_.stream_body_window;
+        auto body = std::make_shared<RpcBodyReader>(hdr.length, window);
+
+        usub::uvent::system::co_spawn(
+            RpcConnection::handle_stream_request_detached(
+                this->shared_from_this(), hdr, fn, body,
+                std::chrono::steady_clock::now()));
+
+        const std::size_t chunk_size =
+            std::clamp<std::size_t>(window / 4, 4 * 1024, 64 * 1024);
+
+        std::size_t left = hdr.length;
+        while (left > 0)
+        {
+            utils::DynamicBuffer chunk;
+            const std::size_t want = std::min(left, chunk_size);
+            chunk.reserve(want);
+            while (chunk.size() < want)
+            {
+                const ssize_t r = co_await this->stream_->async_read(
+                    chunk, want - chunk.size());
+                if (r <= 0)
+                {
+                    body->fail();
+                    co_return false;
+                }
+            }
+            left -= chunk.size();
+            // After a stall the rest of the body is still read, and dropped.
+            if (!co_await body->push(std::move(chunk),
+                                     this->limits_.stream_body_stall_ms))
+            {
+#if URPC_LOGS
+                usub::ulog::warn(
+                    "RpcConnection::stream_request_body: handler stalled "
+                    "sid={} mid={}, dropping {} body bytes",
+                    hdr.stream_id, hdr.method_id, left);
+#endif
+            }
+        }
+
+        body->finish();
+        co_return true;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcConnection::handle_stream_request_detached(
+        std::shared_ptr<RpcConnection> self,
+        RpcFrameHeader hdr,
+        RpcStreamHandlerEntry fn,
+        std::shared_ptr<RpcBodyReader> body,
+        std::chrono::steady_clock::time_point read_at)
+    {
+        if (!self)
+            co_return;
+        if (!self->evicted_.load(std::memory_order_acquire))
+        {
+            RpcLoadTracker* load = self->load_;
+            if (load)
+                load->on_request_start(std::chrono::steady_clock::now() - read_at);
+            RpcServerStats* stats = self->server_stats_;
+            if (stats)
+            {
+                stats->requests.add();
+                stats->request_bytes.add(hdr.length);
+            }
+            co_await self->handle_stream_request(hdr, fn, *body);
+            if (load)
+                load->on_request_end();
+            if (stats)
+                stats->request_latency_us.observe(static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - read_at).count()));
+        }
+        // Whatever the handler left unread is dropped by the reader.
+        body->abandon();
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcConnection::handle_stream_request(const RpcFrameHeader& hdr,
+                                         RpcStreamHandlerEntry fn,
+                                         RpcBodyReader& body)
+    {
+        const bool oneway = (hdr.flags & FLAG_ONEWAY) != 0;
+
+        auto src = std::make_shared<sync::CancellationSource>();
+        if (!oneway)
+        {
+            auto guard = co_await this->cancel_map_mutex_.lock();
+            this->cancel_map_[hdr.stream_id] = src;
+        }
+
+        RpcContext ctx{
+            .stream = *this->stream_,
+            .stream_id = hdr.stream_id,
+            .method_id = hdr.method_id,
+            .flags = hdr.flags,
+            .cancel_token = src->token(),
+            .peer = this->stream_->peer_identity(),
+            .connection = this,
+        };
+
+        if (this->crypto_policy_ &&
+            get_cipher_for_stream(&ctx.stream) &&
+            this->crypto_policy_->should_encrypt(ctx.method_id, hdr.length))
+        {
+#if URPC_LOGS
+            usub::ulog::warn(
+                "handle_stream_request: plaintext body rejected by crypto "
+                "policy sid={} mid={} len={}",
+                ctx.stream_id,
+                ctx.method_id,
+                hdr.length);
+#endif
+            {
+                auto guard = co_await this->cancel_map_mutex_.lock();
+                this->cancel_map_.erase(ctx.stream_id);
+            }
+            co_await this->send_simple_error(
+                ctx,
+                400,
+                "Encryption required by policy");
+            co_return;
+        }
+
+#if URPC_LOGS
+        usub::ulog::info(
+            "handle_stream_request: invoking handler mid={} sid={} len={}",
+            ctx.method_id,
+            ctx.stream_id,
+            hdr.length);
+#endif
+
+        const int64_t started_ns = steady_now_ns();
+        RpcMethodStats::Attribution stats_call;
+        if (this->stats_)
+            stats_call = this->stats_->enter(ctx.method_id, hdr.length);
+        std::vector<uint8_t> resp = co_await fn(ctx, body);
+        if (this->stats_)
+            this->stats_->leave(stats_call,
+                                static_cast<uint64_t>(steady_now_ns() - started_ns),
+                                resp.size());
+        if (body.stalled())
+        {
+            {
+                auto guard = co_await this->cancel_map_mutex_.lock();
+                this->cancel_map_.erase(ctx.stream_id);
+            }
+            co_await this->send_simple_error(
+                ctx, 408, "Request body stalled");
+            co_return;
+        }
+        co_await this->finish_request(ctx, std::move(resp));
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcConnection::reject_request_detached(std::shared_ptr<RpcConnection> self,
+                                           RpcFrameHeader hdr)
+    {
+        if (!self)
+            co_return;
+        RpcContext tmp{
+            .stream = *self->stream_,
+            .stream_id = hdr.stream_id,
+            .method_id = hdr.method_id,
+            .flags = hdr.flags,
+            .cancel_token = usub::uvent::sync::CancellationToken{},
+            .peer = self->stream_->peer_identity(),
+            .connection = self.get(),
+        };
+        co_await self->send_simple_error(tmp, 503, "Server memory budget exceeded");
         co_return;
     }
 
+    RpcMemoryCharge RpcConnection::charge_memory(std::size_t bytes)
+    {
+        if (!this->budget_)
+            return {};
+        return this->budget_->charge(this, bytes);
+    }
+
+    void RpcConnection::stamp_load_report(RpcFrameHeader& hdr) const
+    {
+        if (!this->load_)
+            return;
+        hdr.flags |= FLAG_LOAD_REPORT;
+        hdr.reserved = encode_load_report(this->load_->snapshot());
+    }
+
     usub::uvent::task::Awaitable<void>
     RpcConnection::handle_request(RpcFrame frame)
     {
@@ -537,8 +1041,13 @@ namespace urpc
             frame.header.flags);
 #endif
 
-        RpcHandlerPtr fn = this->registry_.find(frame.header.method_id);
+        RpcHandlerEntry fn = this->registry_.find(frame.header.method_id);
+        // Streaming handlers get here for bodies that must be decoded or
+        // verified as a whole first (see loop).
+        RpcStreamHandlerEntry sfn;
         if (!fn)
+            sfn = this->registry_.find_streaming(frame.header.method_id);
+        if (!fn && !sfn)
         {
 #if URPC_LOGS
             usub::ulog::error(
@@ -554,13 +1063,19 @@ namespace urpc
                 .flags = frame.header.flags,
                 .cancel_token = usub::uvent::sync::CancellationToken{},
                 .peer = this->stream_->peer_identity(),
+                .connection = this,
             };
 
             co_await this->send_simple_error(tmp, 404, "Unknown method");
             co_return;
         }
 
+        const bool oneway = (frame.header.flags & FLAG_ONEWAY) != 0;
+
+        // One-way requests have no stream the client could cancel, so they
+        // skip the cancel map entirely.
         auto src = std::make_shared<sync::CancellationSource>();
+        if (!oneway)
         {
             auto guard = co_await this->cancel_map_mutex_.lock();
             this->cancel_map_[frame.header.stream_id] = src;
@@ -573,6 +1088,7 @@ namespace urpc
             .flags = frame.header.flags,
             .cancel_token = src->token(),
             .peer = this->stream_->peer_identity(),
+            .connection = this,
         };
 
         std::span<const uint8_t> body{
@@ -581,6 +1097,7 @@ namespace urpc
         };
 
         std::vector<uint8_t> decrypted;
+        RpcMemoryCharge dec_charge;
         const bool encrypted =
             (frame.header.flags & FLAG_ENCRYPTED) != 0;
 
@@ -604,15 +1121,25 @@ namespace urpc
                 co_return;
             }
 
-            bool ok = app_decrypt_gcm(
-                *cipher,
-                body,
-                decrypted);
+            // Large bodies are opened on the crypto pool so the I/O thread
+            // keeps serving other connections meanwhile.
+            bool ok = false;
+            if (this->crypto_pool_ &&
+                this->crypto_pool_->should_offload(body.size()))
+            {
+                ok = co_await this->crypto_pool_->open(
+                    *cipher, body, frame.header.flags, decrypted);
+            }
+            else
+            {
+                ok = RpcCryptoPool::open_inline(
+                    *cipher, body, frame.header.flags, decrypted);
+            }
             if (!ok)
             {
 #if URPC_LOGS
                 usub::ulog::warn(
-                    "handle_request: app_decrypt_gcm failed sid={} mid={}",
+                    "handle_request: app_decrypt failed sid={} mid={}",
                     ctx.stream_id,
                     ctx.method_id);
 #endif
@@ -627,6 +1154,7 @@ namespace urpc
                 decrypted.data(),
                 decrypted.size()
             };
+            dec_charge = this->charge_memory(decrypted.size());
 
 #if URPC_LOGS
             usub::ulog::info(
@@ -638,6 +1166,56 @@ namespace urpc
                 decrypted.size());
 #endif
         }
+        else if (this->crypto_policy_ &&
+                 get_cipher_for_stream(&ctx.stream) &&
+                 this->crypto_policy_->should_encrypt(ctx.method_id,
+                                                      body.size()))
+        {
+#if URPC_LOGS
+            usub::ulog::warn(
+                "handle_request: plaintext body rejected by crypto policy "
+                "sid={} mid={} len={}",
+                ctx.stream_id,
+                ctx.method_id,
+                body.size());
+#endif
+            {
+                auto guard = co_await this->cancel_map_mutex_.lock();
+                this->cancel_map_.erase(ctx.stream_id);
+            }
+            co_await this->send_simple_error(
+                ctx,
+                400,
+                "Encryption required by policy");
+            co_return;
+        }
+
+        // The key sits in front of the plaintext body, so app encryption
+        // covers it and a decrypting proxy forwards it unchanged.
+        uint64_t idem_key = 0;
+        std::size_t body_off = 0;
+        if (frame.header.flags & FLAG_IDEMPOTENCY_KEY)
+        {
+            // Only clients that were told we strip the key may send one;
+            // anything else would be a body we cannot interpret safely.
+            if (body.size() < kIdempotencyKeySize ||
+                !this->stream_->idempotency_keys())
+            {
+                {
+                    auto guard = co_await this->cancel_map_mutex_.lock();
+                    this->cancel_map_.erase(ctx.stream_id);
+                }
+                co_await this->send_simple_error(
+                    ctx,
+                    400,
+                    "Malformed or unnegotiated idempotency key");
+                co_return;
+            }
+            std::memcpy(&idem_key, body.data(), kIdempotencyKeySize);
+            idem_key = be_to_host(idem_key);
+            body_off = kIdempotencyKeySize;
+            body = body.subspan(body_off);
+        }
 
 #if URPC_LOGS
         usub::ulog::info(
@@ -676,7 +1254,156 @@ namespace urpc
             co_return;
         }
 
-        std::vector<uint8_t> resp = co_await (*fn)(ctx, body);
+        // Taken before the mirror may move the buffers away.
+        const std::size_t request_bytes =
+            frame.payload.size() + decrypted.size();
+
+        // Abandoned on every exit before complete(), including a throwing
+        // handler, so a waiting retry runs the handler itself.
+        RpcIdempotencyRun idem_run;
+        if (body_off != 0 && this->idempotency_)
+        {
+            const RpcIdempotencyKey key{
+                .scope = idempotency_scope(*this->stream_, this),
+                .method_id = ctx.method_id,
+                .key = idem_key,
+            };
+            RpcIdempotencyClaim claim =
+                co_await this->idempotency_->claim(key, body);
+            if (claim.outcome != RpcIdempotencyOutcome::Run)
+            {
+#if URPC_LOGS
+                usub::ulog::info(
+                    "handle_request: idempotency key {} mid={} sid={}: {}",
+                    idem_key,
+                    ctx.method_id,
+                    ctx.stream_id,
+                    claim.outcome == RpcIdempotencyOutcome::Replay
+                        ? "replaying stored response"
+                        : claim.outcome == RpcIdempotencyOutcome::Conflict
+                        ? "reused for a different request"
+                        : "first attempt still running");
+#endif
+                {
+                    auto guard = co_await this->cancel_map_mutex_.lock();
+                    this->cancel_map_.erase(ctx.stream_id);
+                }
+                if (claim.outcome == RpcIdempotencyOutcome::Conflict)
+                {
+                    co_await this->send_simple_error(
+                        ctx,
+                        422,
+                        "Idempotency key reused with a different request");
+                }
+                else if (claim.outcome == RpcIdempotencyOutcome::InProgress)
+                {
+                    co_await this->send_simple_error(
+                        ctx,
+                        409,
+                        "Request with this idempotency key still running");
+                }
+                else if (!oneway)
+                {
+                    co_await this->send_response(
+                        ctx,
+                        std::span<const uint8_t>{
+                            claim.response->data(),
+                            claim.response->size()
+                        });
+                }
+                co_return;
+            }
+            if (claim.tracked)
+                idem_run = RpcIdempotencyRun(this->idempotency_, key);
+        }
+
+        const bool cacheable = fn && !oneway && this->cache_ &&
+                               this->cache_->caches(ctx.method_id);
+        if (cacheable)
+        {
+            // Disk hits point into the cache's mapping; the pin keeps the
+            // region from being reused until the write is done. They are
+            // written from the mapping, not with sendfile(): frames go out
+            // through IRpcStream::async_write, which owns the socket and
+            // has no file-to-socket path. On plain TCP without a CRC
+            // trailer or compression the body is sent unchanged, so
+            // sendfile() would only save the one copy into the kernel;
+            // with TLS, app encryption, CRC or compression the body is
+            // transformed in user space anyway.
+            RpcCachedResponse hit = this->cache_->lookup(ctx.method_id, body);
+            if (hit)
+            {
+#if URPC_LOGS
+                usub::ulog::info(
+                    "handle_request: cache hit mid={} sid={} resp_size={}",
+                    ctx.method_id,
+                    ctx.stream_id,
+                    hit.body.size());
+#endif
+                idem_run.complete(hit.body);
+                {
+                    auto guard = co_await this->cancel_map_mutex_.lock();
+                    this->cancel_map_.erase(ctx.stream_id);
+                }
+                co_await this->send_response(ctx, hit.body);
+                co_return;
+            }
+        }
+
+        if (this->mirror_ && this->mirror_->should_mirror(ctx.method_id))
+        {
+            // Hand the body to the mirror by moving its buffer behind a
+            // shared owner; the handler keeps reading the same bytes.
+            std::shared_ptr<const void> owner;
+            if (encrypted)
+            {
+                auto sp = std::make_shared<std::vector<uint8_t>>(
+                    std::move(decrypted));
+                body = std::span<const uint8_t>{sp->data(), sp->size()}
+                    .subspan(body_off);
+                owner = std::move(sp);
+            }
+            else
+            {
+                auto sp = std::make_shared<utils::DynamicBuffer>(
+                    std::move(frame.payload));
+                body = std::span<const uint8_t>{
+                    reinterpret_cast<const uint8_t*>(sp->data()),
+                    sp->size(),
+                }.subspan(body_off);
+                owner = std::move(sp);
+            }
+            this->mirror_->offer(ctx.method_id, std::move(owner), body);
+        }
+
+        const int64_t started_ns = steady_now_ns();
+        RpcMethodStats::Attribution stats_call;
+        if (this->stats_)
+            stats_call = this->stats_->enter(ctx.method_id, request_bytes);
+
+        std::vector<uint8_t> resp;
+        if (fn)
+        {
+            resp = co_await fn(ctx, body);
+            if (cacheable && !ctx.cancel_token.stop_requested())
+                this->cache_->store(ctx.method_id, body,
+                                    {resp.data(), resp.size()});
+        }
+        else
+        {
+            RpcBodyReader reader(body.size(), body.size());
+            reader.set_buffered(body);
+            resp = co_await sfn(ctx, reader);
+        }
+
+        if (this->stats_)
+            this->stats_->leave(stats_call,
+                                static_cast<uint64_t>(steady_now_ns() - started_ns),
+                                resp.size());
+
+        // Stored even when the caller has cancelled meanwhile: the work is
+        // done, and its retry should not do it again.
+        idem_run.complete({resp.data(), resp.size()});
 
 #if URPC_LOGS
         usub::ulog::info(
@@ -686,16 +1413,28 @@ namespace urpc
             resp.size());
 #endif
 
+        co_await this->finish_request(ctx, std::move(resp));
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcConnection::finish_request(RpcContext& ctx, std::vector<uint8_t> resp)
+    {
+        if ((ctx.flags & FLAG_ONEWAY) != 0)
+            co_return;
+
+        RpcMemoryCharge resp_charge = this->charge_memory(resp.size());
+
         {
             auto guard = co_await this->cancel_map_mutex_.lock();
-            this->cancel_map_.erase(frame.header.stream_id);
+            this->cancel_map_.erase(ctx.stream_id);
         }
 
         if (ctx.cancel_token.stop_requested())
         {
 #if URPC_LOGS
             usub::ulog::info(
-                "handle_request: cancel was requested for sid={} mid={} "
+                "finish_request: cancel was requested for sid={} mid={} "
                 "while handler was running; dropping response "
                 "(resp_size={} bytes saved)",
                 ctx.stream_id,
@@ -719,7 +1458,7 @@ namespace urpc
 
 #if URPC_LOGS
         usub::ulog::info(
-            "handle_request: sending response mid={} sid={} len={}",
+            "finish_request: sending response mid={} sid={} len={}",
             ctx.method_id,
             ctx.stream_id,
             resp_span.size());
@@ -793,6 +1532,35 @@ namespace urpc
             build_security_flags(this->stream_.get(),
                                  this->stream_->peer_identity());
 
+        // CRC32C offer from the client. TLS already authenticates every
+        // record, so trailers are only agreed on plain links.
+        if ((frame.header.flags & FLAG_CRC32C) &&
+            !stream_is_tls(this->stream_.get()))
+        {
+            this->stream_->enable_frame_crc(true);
+            flags |= FLAG_CRC32C;
+        }
+
+        // Idempotency keys are stripped from the body by every server of
+        // this version, with or without a table; agree on any link.
+        if (frame.header.flags & FLAG_IDEMPOTENCY_KEY)
+        {
+            this->stream_->enable_idempotency_keys(true);
+            flags |= FLAG_IDEMPOTENCY_KEY;
+        }
+
+        // Compression offer. Both directions start at once: the client got
+        // its receive side ready before offering. Not agreed on TLS links,
+        // where compressing secrets next to attacker-chosen data leaks them
+        // through the ciphertext length (CRIME).
+        if ((frame.header.flags & FLAG_COMPRESSED) &&
+            !stream_is_tls(this->stream_.get()) &&
+            this->stream_->prepare_inflate() &&
+            this->stream_->enable_deflate(kServerCompressionLevel))
+        {
+            flags |= FLAG_COMPRESSED;
+        }
+
         hdr.flags = flags;
         hdr.stream_id = frame.header.stream_id;
         hdr.method_id = frame.header.method_id;
@@ -813,4 +1581,325 @@ namespace urpc
 #endif
         co_return;
     }
+    usub::uvent::task::Awaitable<RpcCallResult>
+    RpcConnection::call(uint64_t method_id,
+                        std::span<const uint8_t> body,
+                        uint32_t timeout_ms)
+    {
+        RpcCallResult result;
+
+        if (!this->stream_ || !this->open_.load(std::memory_order_acquire))
+        {
+            result.error_message = "connection is closed";
+            co_return result;
+        }
+
+        uint32_t sid = kServerStreamIdBit |
+            this->next_stream_id_.fetch_add(1, std::memory_order_relaxed);
+        if (sid == kServerStreamIdBit)
+            sid = kServerStreamIdBit |
+                this->next_stream_id_.fetch_add(1, std::memory_order_relaxed);
+
+        auto call = std::make_shared<PendingCall>();
+        call->event = std::make_shared<sync::AsyncEvent>(
+            sync::Reset::Manual, false);
+
+        {
+            auto guard = co_await this->pending_mutex_.lock();
+            if (!this->open_.load(std::memory_order_acquire))
+            {
+                result.error_message = "connection is closed";
+                co_return result;
+            }
+            this->pending_calls_[sid] = call;
+        }
+
+        RpcFrameHeader hdr{};
+        hdr.magic = 0x55525043;
+        hdr.version = 1;
+        hdr.type = static_cast<uint8_t>(FrameType::Request);
+        hdr.flags = FLAG_END_STREAM |
+            build_security_flags(this->stream_.get(),
+                                 this->stream_->peer_identity());
+        hdr.stream_id = sid;
+        hdr.method_id = method_id;
+        hdr.length = static_cast<uint32_t>(body.size());
+
+        std::vector<uint8_t> enc_buf;
+        std::span<const uint8_t> to_send = body;
+
+        const AppCipherContext* cipher =
+            get_cipher_for_stream(this->stream_.get());
+
+        if (cipher && this->should_encrypt(method_id, body.size()))
+        {
+            if (!app_encrypt(*cipher, body, enc_buf))
+            {
+#if URPC_LOGS
+                usub::ulog::error(
+                    "RpcConnection[{}]: app_encrypt failed for push "
+                    "mid={} sid={}; failing closed",
+                    static_cast<void*>(this),
+                    method_id,
+                    sid);
+#endif
+                {
+                    auto guard = co_await this->pending_mutex_.lock();
+                    this->pending_calls_.erase(sid);
+                }
+                result.error_message = "app_encrypt failed (failing closed)";
+                co_return result;
+            }
+
+            hdr.flags |= FLAG_ENCRYPTED;
+            hdr.length = static_cast<uint32_t>(enc_buf.size());
+            to_send = std::span<const uint8_t>{enc_buf.data(), enc_buf.size()};
+        }
+
+#if URPC_LOGS
+        usub::ulog::info(
+            "RpcConnection[{}]: sending push Request mid={} sid={} len={}",
+            static_cast<void*>(this),
+            method_id,
+            sid,
+            hdr.length);
+#endif
+
+        const bool sent = co_await this->locked_send(hdr, to_send);
+        if (!sent)
+        {
+            {
+                auto guard = co_await this->pending_mutex_.lock();
+                this->pending_calls_.erase(sid);
+            }
+            result.error_message = "send_frame failed";
+            co_return result;
+        }
+
+        if (timeout_ms > 0)
+        {
+            usub::uvent::system::co_spawn(
+                RpcConnection::call_timeout_watchdog(
+                    this->shared_from_this(),
+                    call,
+                    sid,
+                    method_id,
+                    timeout_ms));
+        }
+
+        co_await call->event->wait();
+
+        {
+            auto guard = co_await this->pending_mutex_.lock();
+            auto it = this->pending_calls_.find(sid);
+            if (it != this->pending_calls_.end() && it->second == call)
+                this->pending_calls_.erase(it);
+        }
+
+        if (call->timed_out.load(std::memory_order_acquire))
+        {
+            result.timed_out = true;
+            result.error_code = 408;
+            result.error_message = "RPC call timed out";
+            co_return result;
+        }
+
+        if (call->error)
+        {
+            result.error_code = call->error_code;
+            result.error_message = std::move(call->error_message);
+            co_return result;
+        }
+
+        result.ok = true;
+        result.response = std::move(call->response);
+        co_return result;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcConnection::call_timeout_watchdog(std::shared_ptr<RpcConnection> self,
+                                         std::shared_ptr<PendingCall> call,
+                                         uint32_t stream_id,
+                                         uint64_t method_id,
+                                         uint32_t timeout_ms)
+    {
+        if (!self || !call || timeout_ms == 0)
+            co_return;
+
+        co_await system::this_coroutine::sleep_for(
+            std::chrono::milliseconds{timeout_ms});
+
+        {
+            auto guard = co_await self->pending_mutex_.lock();
+            auto it = self->pending_calls_.find(stream_id);
+            if (it == self->pending_calls_.end() || it->second != call)
+                co_return;
+            self->pending_calls_.erase(it);
+        }
+
+#if URPC_LOGS
+        usub::ulog::warn(
+            "RpcConnection::call_timeout_watchdog: push sid={} mid={} "
+            "timed out after {}ms",
+            stream_id, method_id, timeout_ms);
+#endif
+
+        call->timed_out.store(true, std::memory_order_release);
+        call->error = true;
+        call->error_code = 408;
+        call->error_message = "RPC call timed out";
+        call->signal();
+
+        // Tell the client to stop the handler; its reply would be dropped.
+        if (self->open_.load(std::memory_order_acquire))
+        {
+            RpcFrameHeader hdr{};
+            hdr.magic = 0x55525043;
+            hdr.version = 1;
+            hdr.type = static_cast<uint8_t>(FrameType::Cancel);
+            hdr.flags = FLAG_END_STREAM |
+                build_security_flags(self->stream_.get(),
+                                     self->stream_->peer_identity());
+            hdr.stream_id = stream_id;
+            hdr.method_id = method_id;
+            hdr.length = 0;
+            co_await self->locked_send(hdr, {});
+        }
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcConnection::handle_response(RpcFrame frame)
+    {
+        std::shared_ptr<PendingCall> call;
+        {
+            auto guard = co_await this->pending_mutex_.lock();
+            auto it = this->pending_calls_.find(frame.header.stream_id);
+            if (it != this->pending_calls_.end())
+            {
+                call = it->second;
+                this->pending_calls_.erase(it);
+            }
+        }
+
+        if (!call)
+        {
+#if URPC_LOGS
+            usub::ulog::warn(
+                "handle_response: late/orphan Response sid={}, dropping",
+                frame.header.stream_id);
+#endif
+            co_return;
+        }
+
+        std::span<const uint8_t> body{
+            reinterpret_cast<const uint8_t*>(frame.payload.data()),
+            frame.payload.size(),
+        };
+
+        std::vector<uint8_t> decrypted;
+        if (frame.header.flags & FLAG_ENCRYPTED)
+        {
+            const AppCipherContext* cipher =
+                get_cipher_for_stream(this->stream_.get());
+            if (!cipher ||
+                !RpcCryptoPool::open_inline(*cipher, body, frame.header.flags,
+                                            decrypted))
+            {
+                call->error = true;
+                call->error_code = 0;
+                call->error_message = "Failed to decrypt response";
+                call->signal();
+                co_return;
+            }
+            body = std::span<const uint8_t>{decrypted.data(), decrypted.size()};
+        }
+
+        if (frame.header.flags & FLAG_ERROR)
+        {
+            call->error = true;
+            if (!parse_error_body(body, call->error_code, call->error_message))
+            {
+                call->error_code = 0;
+                call->error_message = "Malformed error payload";
+            }
+        }
+        else
+        {
+            call->response.assign(body.begin(), body.end());
+        }
+
+#if URPC_LOGS
+        usub::ulog::debug(
+            "handle_response: push sid={} delivered error={} size={}",
+            frame.header.stream_id,
+            call->error,
+            body.size());
+#endif
+        call->signal();
+        co_return;
+    }
+    usub::uvent::task::Awaitable<bool>
+    RpcConnection::notify(uint64_t method_id,
+                          std::span<const uint8_t> body,
+                          uint16_t extra_flags)
+    {
+        if (!this->stream_ || !this->is_open())
+            co_return false;
+
+        RpcFrameHeader hdr{};
+        hdr.magic = 0x55525043;
+        hdr.version = 1;
+        hdr.type = static_cast<uint8_t>(FrameType::Request);
+        hdr.flags = FLAG_END_STREAM | FLAG_ONEWAY | extra_flags |
+            build_security_flags(this->stream_.get(),
+                                 this->stream_->peer_identity());
+        hdr.stream_id = kServerStreamIdBit;
+        hdr.method_id = method_id;
+        hdr.length = static_cast<uint32_t>(body.size());
+
+        std::vector<uint8_t> enc_buf;
+        std::span<const uint8_t> to_send = body;
+
+        const AppCipherContext* cipher =
+            get_cipher_for_stream(this->stream_.get());
+
+        if (cipher && this->should_encrypt(method_id, body.size()))
+        {
+            if (!app_encrypt(*cipher, body, enc_buf))
+            {
+#if URPC_LOGS
+                usub::ulog::error(
+                    "RpcConnection[{}]: app_encrypt failed for one-way "
+                    "mid={}; failing closed",
+                    static_cast<void*>(this),
+                    method_id);
+#endif
+                this->stream_->shutdown();
+                co_return false;
+            }
+
+            hdr.flags |= FLAG_ENCRYPTED;
+            hdr.length = static_cast<uint32_t>(enc_buf.size());
+            to_send = std::span<const uint8_t>{enc_buf.data(), enc_buf.size()};
+        }
+
+        co_return co_await this->locked_send(hdr, to_send);
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcConnection::send_oneway_detached(
+        std::shared_ptr<RpcConnection> self,
+        uint64_t method_id,
+        std::shared_ptr<const std::vector<uint8_t>> body)
+    {
+        if (!self || !body)
+            co_return;
+
+        co_await self->notify(
+            method_id,
+            std::span<const uint8_t>{body->data(), body->size()},
+            FLAG_TOPIC);
+        co_return;
+    }
 }
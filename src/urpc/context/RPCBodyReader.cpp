@@ -0,0 +1,189 @@
+#include <urpc/context/RPCBodyReader.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <uvent/system/SystemContext.h>
+
+namespace urpc
+{
+    using namespace usub::uvent;
+
+    static task::Awaitable<void> expire_stall(
+        std::shared_ptr<sync::AsyncEvent> room,
+        uint32_t stall_ms)
+    {
+        co_await system::this_coroutine::sleep_for(
+            std::chrono::milliseconds(stall_ms));
+        room->set();
+        co_return;
+    }
+
+    RpcBodyReader::RpcBodyReader(std::size_t length, std::size_t window)
+        : length_(length)
+          , window_(std::max<std::size_t>(window, 1))
+          , data_ev_(std::make_shared<sync::AsyncEvent>(sync::Reset::Manual, false))
+          , room_ev_(std::make_shared<sync::AsyncEvent>(sync::Reset::Manual, false))
+    {
+    }
+
+    task::Awaitable<bool> RpcBodyReader::next(std::span<const uint8_t>& chunk)
+    {
+        for (;;)
+        {
+            chunk = {};
+            {
+                std::lock_guard lk(this->mutex_);
+                if (!this->buffered_body_.empty())
+                {
+                    chunk = this->buffered_body_;
+                    this->consumed_ += chunk.size();
+                    this->buffered_body_ = {};
+                    co_return true;
+                }
+                if (!this->queue_.empty())
+                {
+                    this->current_ = std::move(this->queue_.front());
+                    this->queue_.pop_front();
+                    this->queued_bytes_ -= this->current_.size();
+                    this->consumed_ += this->current_.size();
+                    chunk = std::span<const uint8_t>{
+                        this->current_.data(), this->current_.size()};
+                }
+                else if (this->done_ || this->failed_)
+                {
+                    co_return false;
+                }
+                else
+                {
+                    this->data_ev_->reset();
+                }
+            }
+
+            if (!chunk.empty())
+            {
+                this->room_ev_->set();
+                co_return true;
+            }
+            co_await this->data_ev_->wait();
+        }
+    }
+
+    task::Awaitable<std::vector<uint8_t>> RpcBodyReader::read_all()
+    {
+        std::vector<uint8_t> out;
+        out.reserve(this->length_ - std::min(this->length_, this->consumed()));
+
+        std::span<const uint8_t> chunk;
+        while (co_await this->next(chunk))
+            out.insert(out.end(), chunk.begin(), chunk.end());
+
+        if (this->failed())
+            out.clear();
+        co_return out;
+    }
+
+    std::size_t RpcBodyReader::consumed() const
+    {
+        std::lock_guard lk(this->mutex_);
+        return this->consumed_;
+    }
+
+    bool RpcBodyReader::failed() const
+    {
+        std::lock_guard lk(this->mutex_);
+        return this->failed_;
+    }
+
+    bool RpcBodyReader::stalled() const
+    {
+        std::lock_guard lk(this->mutex_);
+        return this->stalled_;
+    }
+
+    task::Awaitable<bool> RpcBodyReader::push(utils::DynamicBuffer chunk,
+                                              uint32_t stall_ms)
+    {
+        {
+            std::lock_guard lk(this->mutex_);
+            if (this->abandoned_)
+                co_return !this->stalled_;
+            if (chunk.size() == 0)
+                co_return true;
+            this->queued_bytes_ += chunk.size();
+            this->queue_.push_back(std::move(chunk));
+        }
+        this->data_ev_->set();
+
+        // The timer may fire after this push returned; a spurious room
+        // wakeup only costs the next push one extra check.
+        const auto deadline = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(stall_ms);
+        bool armed = false;
+        for (;;)
+        {
+            {
+                std::lock_guard lk(this->mutex_);
+                if (this->abandoned_ || this->queued_bytes_ < this->window_)
+                    co_return !this->stalled_;
+                if (armed && std::chrono::steady_clock::now() >= deadline)
+                {
+                    this->stalled_ = true;
+                    this->failed_ = true;
+                    this->abandoned_ = true;
+                    this->queue_.clear();
+                    this->queued_bytes_ = 0;
+                    break;
+                }
+                this->room_ev_->reset();
+            }
+            if (stall_ms > 0 && !armed)
+            {
+                armed = true;
+                system::co_spawn(expire_stall(this->room_ev_, stall_ms));
+            }
+            co_await this->room_ev_->wait();
+        }
+        this->data_ev_->set();
+        co_return false;
+    }
+
+    void RpcBodyReader::set_buffered(std::span<const uint8_t> body)
+    {
+        {
+            std::lock_guard lk(this->mutex_);
+            this->buffered_body_ = body;
+            this->done_ = true;
+        }
+        this->data_ev_->set();
+    }
+
+    void RpcBodyReader::finish()
+    {
+        {
+            std::lock_guard lk(this->mutex_);
+            this->done_ = true;
+        }
+        this->data_ev_->set();
+    }
+
+    void RpcBodyReader::fail()
+    {
+        {
+            std::lock_guard lk(this->mutex_);
+            this->failed_ = true;
+        }
+        this->data_ev_->set();
+    }
+
+    void RpcBodyReader::abandon()
+    {
+        {
+            std::lock_guard lk(this->mutex_);
+            this->abandoned_ = true;
+            this->queue_.clear();
+            this->queued_bytes_ = 0;
+        }
+        this->room_ev_->set();
+    }
+}
@@ -0,0 +1,123 @@
+#include <urpc/crypto/CryptoPolicy.h>
+
+#include <cstring>
+#include <utility>
+
+#include <urpc/utils/Endianness.h>
+#include <urpc/utils/Hash.h>
+
+namespace urpc
+{
+    namespace
+    {
+        constexpr std::size_t kHeaderSize = 1 + 4 + 4;
+        constexpr std::size_t kEntrySize = 8 + 1 + 4;
+
+        template <typename T>
+        void put_be(std::vector<uint8_t>& out, T v)
+        {
+            const T be = host_to_be<T>(v);
+            const auto* p = reinterpret_cast<const uint8_t*>(&be);
+            out.insert(out.end(), p, p + sizeof(T));
+        }
+
+        template <typename T>
+        T get_be(const uint8_t* p)
+        {
+            T be{};
+            std::memcpy(&be, p, sizeof(T));
+            return be_to_host<T>(be);
+        }
+
+        bool valid_mode(uint8_t m)
+        {
+            return m <= static_cast<uint8_t>(RpcCryptoMode::BelowSize);
+        }
+    }
+
+    void RpcCryptoPolicy::set(uint64_t method_id, RpcCryptoRule rule)
+    {
+        this->rules_[method_id] = rule;
+    }
+
+    void RpcCryptoPolicy::set(std::string_view method_name, RpcCryptoRule rule)
+    {
+        this->set(fnv1a64_rt(method_name), rule);
+    }
+
+    RpcCryptoRule RpcCryptoPolicy::rule_for(uint64_t method_id) const
+    {
+        const auto it = this->rules_.find(method_id);
+        return it == this->rules_.end() ? this->default_ : it->second;
+    }
+
+    bool RpcCryptoPolicy::should_encrypt(uint64_t method_id,
+                                         std::size_t body_size) const
+    {
+        if (body_size == 0)
+            return false;
+
+        const RpcCryptoRule rule = this->rule_for(method_id);
+        switch (rule.mode)
+        {
+        case RpcCryptoMode::Never:
+            return false;
+        case RpcCryptoMode::AboveSize:
+            return body_size > rule.threshold;
+        case RpcCryptoMode::BelowSize:
+            return body_size <= rule.threshold;
+        case RpcCryptoMode::Always:
+        default:
+            return true;
+        }
+    }
+
+    std::vector<uint8_t> RpcCryptoPolicy::serialize() const
+    {
+        std::vector<uint8_t> out;
+        out.reserve(kHeaderSize + this->rules_.size() * kEntrySize);
+
+        out.push_back(static_cast<uint8_t>(this->default_.mode));
+        put_be<uint32_t>(out, this->default_.threshold);
+        put_be<uint32_t>(out, static_cast<uint32_t>(this->rules_.size()));
+
+        for (const auto& [mid, rule] : this->rules_)
+        {
+            put_be<uint64_t>(out, mid);
+            out.push_back(static_cast<uint8_t>(rule.mode));
+            put_be<uint32_t>(out, rule.threshold);
+        }
+        return out;
+    }
+
+    bool RpcCryptoPolicy::parse(std::span<const uint8_t> in,
+                                RpcCryptoPolicy& out)
+    {
+        if (in.size() < kHeaderSize || !valid_mode(in[0]))
+            return false;
+
+        const uint32_t count = get_be<uint32_t>(in.data() + 5);
+        if (in.size() - kHeaderSize != std::size_t{count} * kEntrySize)
+            return false;
+
+        RpcCryptoPolicy policy;
+        policy.default_ = RpcCryptoRule{
+            static_cast<RpcCryptoMode>(in[0]),
+            get_be<uint32_t>(in.data() + 1),
+        };
+
+        const uint8_t* p = in.data() + kHeaderSize;
+        for (uint32_t i = 0; i < count; ++i, p += kEntrySize)
+        {
+            if (!valid_mode(p[8]))
+                return false;
+            policy.rules_[get_be<uint64_t>(p)] = RpcCryptoRule{
+                static_cast<RpcCryptoMode>(p[8]),
+                get_be<uint32_t>(p + 9),
+            };
+        }
+
+        out = std::move(policy);
+        return true;
+    }
+}
@@ -0,0 +1,273 @@
+#include <urpc/crypto/CryptoPool.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include <urpc/datatypes/Frame.h>
+#include <urpc/utils/Endianness.h>
+
+namespace urpc
+{
+    using namespace usub::uvent;
+
+    namespace
+    {
+        constexpr std::size_t kChunkPrefix = 4;
+
+        uint32_t load_u32_be(const uint8_t* p)
+        {
+            uint32_t be = 0;
+            std::memcpy(&be, p, 4);
+            return be_to_host<uint32_t>(be);
+        }
+
+        void store_u32_be(uint8_t* p, uint32_t v)
+        {
+            const uint32_t be = host_to_be<uint32_t>(v);
+            std::memcpy(p, &be, 4);
+        }
+
+        std::array<uint8_t, 8> chunk_aad(uint32_t index, uint32_t count)
+        {
+            std::array<uint8_t, 8> aad{};
+            store_u32_be(aad.data(), index);
+            store_u32_be(aad.data() + 4, count);
+            return aad;
+        }
+
+        // Chunk layout of an encrypted body; false if it is malformed.
+        bool chunk_layout(std::span<const uint8_t> in,
+                          std::size_t& chunk_size,
+                          uint32_t& count,
+                          std::size_t& plain_size)
+        {
+            if (in.size() < kChunkPrefix + kAppSealOverhead)
+                return false;
+
+            chunk_size = load_u32_be(in.data());
+            if (chunk_size < RpcCryptoPool::kMinChunkSize)
+                return false;
+
+            const std::size_t sealed = in.size() - kChunkPrefix;
+            const std::size_t full = chunk_size + kAppSealOverhead;
+            const std::size_t n = (sealed + full - 1) / full;
+            const std::size_t last = sealed - (n - 1) * full;
+            if (last <= kAppSealOverhead || n > UINT32_MAX)
+                return false;
+
+            count = static_cast<uint32_t>(n);
+            plain_size = sealed - n * kAppSealOverhead;
+            return true;
+        }
+    }
+
+    RpcCryptoPool::RpcCryptoPool(RpcCryptoPoolConfig cfg)
+        : cfg_(cfg)
+    {
+        const int n = this->cfg_.threads > 0 ? this->cfg_.threads : 1;
+        this->workers_.reserve(static_cast<std::size_t>(n));
+        for (int i = 0; i < n; ++i)
+            this->workers_.emplace_back([this] { this->worker_loop(); });
+    }
+
+    RpcCryptoPool::~RpcCryptoPool()
+    {
+        {
+            std::lock_guard lk(this->mutex_);
+            this->stopping_ = true;
+        }
+        this->cv_.notify_all();
+        for (auto& t : this->workers_)
+            if (t.joinable())
+                t.join();
+    }
+
+    void RpcCryptoPool::worker_loop()
+    {
+        for (;;)
+        {
+            Task task;
+            {
+                std::unique_lock lk(this->mutex_);
+                this->cv_.wait(lk, [this]
+                {
+                    return this->stopping_ || !this->tasks_.empty();
+                });
+                if (this->tasks_.empty())
+                    return;
+                task = std::move(this->tasks_.front());
+                this->tasks_.pop_front();
+            }
+
+            execute(task);
+
+            Batch& b = *task.batch;
+            if (b.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                b.done.set();
+        }
+    }
+
+    void RpcCryptoPool::execute(Task& t)
+    {
+        Batch& b = *t.batch;
+        if (b.failed.load(std::memory_order_relaxed))
+            return;
+
+        std::array<uint8_t, 8> aad{};
+        std::span<const uint8_t> aad_view;
+        if (t.count != 0)
+        {
+            aad = chunk_aad(t.index, t.count);
+            aad_view = aad;
+        }
+
+        const bool ok = t.seal
+                            ? app_seal_into(b.cipher, t.in, t.out, aad_view)
+                            : app_open_into(b.cipher, t.in, t.out, aad_view);
+        if (!ok)
+            b.failed.store(true, std::memory_order_relaxed);
+    }
+
+    task::Awaitable<bool> RpcCryptoPool::run(
+        const std::shared_ptr<Batch>& batch,
+        std::vector<Task> tasks)
+    {
+        batch->remaining.store(tasks.size(), std::memory_order_relaxed);
+        {
+            std::lock_guard lk(this->mutex_);
+            for (auto& t : tasks)
+                this->tasks_.push_back(std::move(t));
+        }
+        if (tasks.size() == 1)
+            this->cv_.notify_one();
+        else
+            this->cv_.notify_all();
+
+        co_await batch->done.wait();
+        co_return !batch->failed.load(std::memory_order_acquire);
+    }
+
+    task::Awaitable<bool> RpcCryptoPool::seal(
+        const AppCipherContext& cipher,
+        std::span<const uint8_t> in,
+        std::vector<uint8_t>& out,
+        uint16_t& flags)
+    {
+        auto batch = std::make_shared<Batch>();
+        batch->cipher = cipher;
+
+        std::vector<Task> tasks;
+        const std::size_t cs =
+            this->cfg_.chunk_size == 0
+                ? 0
+                : std::max(this->cfg_.chunk_size, kMinChunkSize);
+
+        if (cs == 0 || in.size() <= cs || cs > UINT32_MAX)
+        {
+            out.resize(in.size() + kAppSealOverhead);
+            tasks.push_back(Task{batch, true, in, out.data(), 0, 0});
+            co_return co_await this->run(batch, std::move(tasks));
+        }
+
+        const std::size_t n = (in.size() + cs - 1) / cs;
+        out.resize(kChunkPrefix + in.size() + n * kAppSealOverhead);
+        store_u32_be(out.data(), static_cast<uint32_t>(cs));
+
+        tasks.reserve(n);
+        uint8_t* dst = out.data() + kChunkPrefix;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const std::size_t off = i * cs;
+            const std::size_t len = std::min(cs, in.size() - off);
+            tasks.push_back(Task{
+                batch, true, in.subspan(off, len), dst,
+                static_cast<uint32_t>(i), static_cast<uint32_t>(n)
+            });
+            dst += len + kAppSealOverhead;
+        }
+
+        const bool ok = co_await this->run(batch, std::move(tasks));
+        if (ok)
+            flags |= FLAG_CHUNKED;
+        co_return ok;
+    }
+
+    task::Awaitable<bool> RpcCryptoPool::open(
+        const AppCipherContext& cipher,
+        std::span<const uint8_t> in,
+        uint16_t flags,
+        std::vector<uint8_t>& out)
+    {
+        auto batch = std::make_shared<Batch>();
+        batch->cipher = cipher;
+
+        std::vector<Task> tasks;
+
+        if (!(flags & FLAG_CHUNKED))
+        {
+            if (in.size() < kAppSealOverhead)
+                co_return false;
+            out.resize(in.size() - kAppSealOverhead);
+            tasks.push_back(Task{batch, false, in, out.data(), 0, 0});
+            co_return co_await this->run(batch, std::move(tasks));
+        }
+
+        std::size_t cs = 0;
+        uint32_t n = 0;
+        std::size_t plain = 0;
+        if (!chunk_layout(in, cs, n, plain))
+            co_return false;
+
+        out.resize(plain);
+        tasks.reserve(n);
+
+        const uint8_t* src = in.data() + kChunkPrefix;
+        const uint8_t* end = in.data() + in.size();
+        uint8_t* dst = out.data();
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            const std::size_t len = std::min<std::size_t>(
+                cs + kAppSealOverhead, static_cast<std::size_t>(end - src));
+            tasks.push_back(Task{
+                batch, false, std::span<const uint8_t>{src, len}, dst, i, n
+            });
+            src += len;
+            dst += len - kAppSealOverhead;
+        }
+
+        co_return co_await this->run(batch, std::move(tasks));
+    }
+
+    bool RpcCryptoPool::open_inline(const AppCipherContext& cipher,
+                                    std::span<const uint8_t> in,
+                                    uint16_t flags,
+                                    std::vector<uint8_t>& out)
+    {
+        if (!(flags & FLAG_CHUNKED))
+            return app_decrypt(cipher, in, out);
+
+        std::size_t cs = 0;
+        uint32_t n = 0;
+        std::size_t plain = 0;
+        if (!chunk_layout(in, cs, n, plain))
+            return false;
+
+        out.resize(plain);
+
+        const uint8_t* src = in.data() + kChunkPrefix;
+        const uint8_t* end = in.data() + in.size();
+        uint8_t* dst = out.data();
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            const std::size_t len = std::min<std::size_t>(
+                cs + kAppSealOverhead, static_cast<std::size_t>(end - src));
+            const auto aad = chunk_aad(i, n);
+            if (!app_open_into(cipher, {src, len}, dst, aad))
+                return false;
+            src += len;
+            dst += len - kAppSealOverhead;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,75 @@
+#include <urpc/datatypes/PendingCall.h>
+
+#include <urpc/client/RPCClientStats.h>
+#include <urpc/client/RPCConcurrencyLimiter.h>
+
+namespace urpc
+{
+    void PendingCall::signal()
+    {
+        this->count_completion();
+        this->release_slot(this->limit_outcome());
+        this->done.store(true);
+        if (this->event)
+            this->event->set();
+        std::vector<std::shared_ptr<usub::uvent::sync::AsyncEvent>> wake;
+        {
+            std::lock_guard lk(this->waiters_mutex);
+            wake = this->waiters;
+        }
+        for (auto& g : wake)
+            g->set();
+    }
+
+    void PendingCall::release_slot(RpcLimitOutcome outcome)
+    {
+        if (!this->limiter || this->slot_released.exchange(true))
+            return;
+        this->limiter->release(
+            outcome, std::chrono::steady_clock::now() - this->started);
+    }
+
+    RpcLimitOutcome PendingCall::limit_outcome() const
+    {
+        if (this->timed_out.load(std::memory_order_acquire))
+            return RpcLimitOutcome::Dropped;
+        if (!this->error)
+            return RpcLimitOutcome::Success;
+        if (this->error_code == 429 || this->error_code == 503)
+            return RpcLimitOutcome::Dropped;
+        // Handler errors still measure a full round trip; cancellation
+        // and connection loss (code 0) say nothing about server load.
+        return (this->error_code == 0 || this->error_code == 499)
+                   ? RpcLimitOutcome::Ignored
+                   : RpcLimitOutcome::Success;
+    }
+
+    void PendingCall::count_completion()
+    {
+        if (!this->stats || this->counted.exchange(true))
+            return;
+        if (this->timed_out.load(std::memory_order_acquire))
+        {
+            this->stats->timed_out.add();
+            return;
+        }
+        if (this->error)
+        {
+            this->stats->failed.add();
+        }
+        else
+        {
+            this->stats->succeeded.add();
+            this->stats->response_bytes.add(static_cast<int64_t>(
+                this->raw ? this->raw_payload.size() : this->response.size()));
+        }
+        this->stats->latency_us.observe(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - this->registered_at).count()));
+    }
+
+    PendingCall::~PendingCall()
+    {
+        this->release_slot(RpcLimitOutcome::Ignored);
+    }
+}
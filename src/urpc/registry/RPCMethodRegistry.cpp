@@ -5,19 +5,28 @@ namespace urpc
     void RpcMethodRegistry::register_method(uint64_t method_id,
                                             RpcHandlerPtr fn)
     {
-        this->handlers_[method_id] = fn;
+        this->stream_handlers_.erase(method_id);
+        this->handlers_[method_id] = RpcHandlerEntry{.fn = fn};
+        this->states_.erase(method_id);
     }
 
     void RpcMethodRegistry::register_method(std::string_view name,
                                             RpcHandlerPtr fn)
     {
-        const uint64_t mid = fnv1a64_rt(name);
-        this->handlers_[mid] = fn;
+        this->register_method(fnv1a64_rt(name), fn);
     }
 
-    RpcHandlerPtr RpcMethodRegistry::find(uint64_t method_id) const
+    RpcHandlerEntry RpcMethodRegistry::find(uint64_t method_id) const
     {
         const auto it = this->handlers_.find(method_id);
-        return it == this->handlers_.end() ? nullptr : it->second;
+        return it == this->handlers_.end() ? RpcHandlerEntry{} : it->second;
     }
-}
\ No newline at end of file
+
+    RpcStreamHandlerEntry
+    RpcMethodRegistry::find_streaming(uint64_t method_id) const
+    {
+        const auto it = this->stream_handlers_.find(method_id);
+        return it == this->stream_handlers_.end() ? RpcStreamHandlerEntry{}
+                                                  : it->second;
+    }
+}
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <string_view>
+
+#include <ulog/ulog.h>
+
+#include <urpc/registry/RPCTopicRegistry.h>
+#include <urpc/connection/RPCConnection.h>
+#include <urpc/utils/Hash.h>
+
+namespace urpc
+{
+    usub::uvent::task::Awaitable<void> RpcTopicRegistry::subscribe(
+        uint64_t topic_id,
+        const std::shared_ptr<RpcConnection>& conn)
+    {
+        auto guard = co_await this->mutex_.lock();
+
+        auto& subs = this->topics_[topic_id];
+        for (const auto& w : subs)
+        {
+            if (w.lock() == conn)
+                co_return;
+        }
+        subs.emplace_back(conn);
+
+#if URPC_LOGS
+        usub::ulog::debug(
+            "RpcTopicRegistry::subscribe: topic={} conn={} subscribers={}",
+            topic_id,
+            static_cast<const void*>(conn.get()),
+            subs.size());
+#endif
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void> RpcTopicRegistry::unsubscribe(
+        uint64_t topic_id,
+        const RpcConnection* conn)
+    {
+        auto guard = co_await this->mutex_.lock();
+
+        auto it = this->topics_.find(topic_id);
+        if (it == this->topics_.end())
+            co_return;
+
+        std::erase_if(it->second, [conn](const std::weak_ptr<RpcConnection>& w)
+        {
+            auto sp = w.lock();
+            return !sp || sp.get() == conn;
+        });
+
+        if (it->second.empty())
+            this->topics_.erase(it);
+
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<std::vector<std::shared_ptr<RpcConnection>>>
+    RpcTopicRegistry::subscribers(uint64_t topic_id)
+    {
+        std::vector<std::shared_ptr<RpcConnection>> out;
+
+        auto guard = co_await this->mutex_.lock();
+
+        auto it = this->topics_.find(topic_id);
+        if (it == this->topics_.end())
+            co_return out;
+
+        auto& subs = it->second;
+        out.reserve(subs.size());
+
+        std::erase_if(subs, [&out](const std::weak_ptr<RpcConnection>& w)
+        {
+            auto sp = w.lock();
+            if (!sp || !sp->is_open())
+                return true;
+            out.emplace_back(std::move(sp));
+            return false;
+        });
+
+        if (subs.empty())
+            this->topics_.erase(it);
+
+        co_return out;
+    }
+
+    usub::uvent::task::Awaitable<std::vector<uint8_t>>
+    RpcTopicRegistry::handle_subscribe(RpcContext& ctx,
+                                       std::span<const uint8_t> body)
+    {
+        RpcTopicRegistry* topics =
+            ctx.connection ? ctx.connection->topics() : nullptr;
+        if (!topics || body.empty())
+            co_return std::vector<uint8_t>{0};
+
+        const uint64_t topic_id = fnv1a64_rt(std::string_view{
+            reinterpret_cast<const char*>(body.data()), body.size()
+        });
+
+        co_await topics->subscribe(topic_id,
+                                   ctx.connection->shared_from_this());
+        co_return std::vector<uint8_t>{1};
+    }
+
+    usub::uvent::task::Awaitable<std::vector<uint8_t>>
+    RpcTopicRegistry::handle_unsubscribe(RpcContext& ctx,
+                                         std::span<const uint8_t> body)
+    {
+        RpcTopicRegistry* topics =
+            ctx.connection ? ctx.connection->topics() : nullptr;
+        if (!topics || body.empty())
+            co_return std::vector<uint8_t>{0};
+
+        const uint64_t topic_id = fnv1a64_rt(std::string_view{
+            reinterpret_cast<const char*>(body.data()), body.size()
+        });
+
+        co_await topics->unsubscribe(topic_id, ctx.connection);
+        co_return std::vector<uint8_t>{1};
+    }
+}
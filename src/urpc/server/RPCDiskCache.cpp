@@ -0,0 +1,331 @@
+#include <urpc/server/RPCDiskCache.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <urpc/utils/Crc32c.h>
+
+#if URPC_LOGS
+#include <ulog/ulog.h>
+#endif
+
+namespace urpc
+{
+    namespace
+    {
+        constexpr uint64_t kIndexMagic = 0x3158444943505255ull; // "URPCIDX1"
+        constexpr uint32_t kEntryMagic = 0x45435255u;           // "URCE"
+        constexpr uint32_t kProbeLimit = 32;
+
+        constexpr std::size_t align8(std::size_t n)
+        {
+            return (n + 7) & ~std::size_t{7};
+        }
+
+        int open_sized(const std::string& path, std::size_t size, bool& reused)
+        {
+            const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd < 0)
+                return -1;
+
+            // Held until the fd is closed: two writers on one ring would
+            // overwrite each other's entries and index slots.
+            if (::flock(fd, LOCK_EX | LOCK_NB) != 0)
+            {
+#if URPC_LOGS
+                usub::ulog::error(
+                    "RpcDiskCache: {} is in use by another cache", path);
+#endif
+                ::close(fd);
+                return -1;
+            }
+
+            struct stat st{};
+            if (::fstat(fd, &st) != 0)
+            {
+                ::close(fd);
+                return -1;
+            }
+            reused = static_cast<std::size_t>(st.st_size) == size;
+            if (!reused && ::ftruncate(fd, static_cast<off_t>(size)) != 0)
+            {
+                ::close(fd);
+                return -1;
+            }
+            return fd;
+        }
+    }
+
+    struct RpcDiskCache::IndexHeader
+    {
+        uint64_t magic;
+        uint64_t capacity;
+        uint32_t slot_count;
+        uint32_t reserved;
+        // Bytes ever appended to the ring; entry positions are log offsets
+        // below this, stored at (pos % capacity).
+        uint64_t head;
+        uint64_t pad[4];
+    };
+
+    struct RpcDiskCache::Slot
+    {
+        uint64_t key;
+        uint64_t pos_plus_one; // 0: empty
+    };
+
+    struct RpcDiskCache::EntryHeader
+    {
+        uint32_t magic;
+        uint32_t crc;         // CRC32C of request + response
+        uint64_t key;
+        uint64_t method_id;
+        uint64_t expires_ms;  // 0: never
+        uint32_t request_len;
+        uint32_t response_len;
+    };
+
+    std::shared_ptr<RpcDiskCache> RpcDiskCache::open(RpcDiskCacheConfig cfg)
+    {
+        std::shared_ptr<RpcDiskCache> self(new RpcDiskCache());
+        if (!self->map_files(cfg))
+            return nullptr;
+        return self;
+    }
+
+    bool RpcDiskCache::map_files(const RpcDiskCacheConfig& cfg)
+    {
+        this->capacity_ = align8(std::max<std::size_t>(cfg.capacity_bytes, 1 << 20));
+        this->slot_count_ = cfg.index_slots
+                                ? cfg.index_slots
+                                : static_cast<uint32_t>(std::max<std::size_t>(
+                                    this->capacity_ / (16 * 1024), 1024));
+        this->index_bytes_ = sizeof(IndexHeader) + sizeof(Slot) * this->slot_count_;
+
+        bool data_reused = false;
+        bool index_reused = false;
+        this->data_fd_ = open_sized(cfg.path + ".dat", this->capacity_, data_reused);
+        this->index_fd_ = open_sized(cfg.path + ".idx", this->index_bytes_, index_reused);
+        if (this->data_fd_ < 0 || this->index_fd_ < 0)
+            return false;
+
+        void* d = ::mmap(nullptr, this->capacity_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, this->data_fd_, 0);
+        void* x = ::mmap(nullptr, this->index_bytes_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, this->index_fd_, 0);
+        if (d == MAP_FAILED || x == MAP_FAILED)
+        {
+            if (d != MAP_FAILED)
+                ::munmap(d, this->capacity_);
+            if (x != MAP_FAILED)
+                ::munmap(x, this->index_bytes_);
+            return false;
+        }
+        this->data_ = static_cast<uint8_t*>(d);
+        this->index_ = static_cast<uint8_t*>(x);
+
+        auto* ih = reinterpret_cast<IndexHeader*>(this->index_);
+        const bool warm = data_reused && index_reused &&
+                          ih->magic == kIndexMagic &&
+                          ih->capacity == this->capacity_ &&
+                          ih->slot_count == this->slot_count_;
+        if (!warm)
+        {
+            std::memset(this->index_, 0, this->index_bytes_);
+            ih->magic = kIndexMagic;
+            ih->capacity = this->capacity_;
+            ih->slot_count = this->slot_count_;
+        }
+
+#if URPC_LOGS
+        usub::ulog::info(
+            "RpcDiskCache: {} {} capacity={} slots={} head={}",
+            cfg.path, warm ? "reopened" : "created",
+            this->capacity_, this->slot_count_, ih->head);
+#endif
+        return true;
+    }
+
+    RpcDiskCache::~RpcDiskCache()
+    {
+        if (this->data_)
+        {
+            ::msync(this->data_, this->capacity_, MS_ASYNC);
+            ::munmap(this->data_, this->capacity_);
+        }
+        if (this->index_)
+        {
+            ::msync(this->index_, this->index_bytes_, MS_ASYNC);
+            ::munmap(this->index_, this->index_bytes_);
+        }
+        if (this->data_fd_ >= 0)
+            ::close(this->data_fd_);
+        if (this->index_fd_ >= 0)
+            ::close(this->index_fd_);
+    }
+
+    void RpcDiskCache::flush()
+    {
+        std::lock_guard lk(this->mutex_);
+        ::msync(this->data_, this->capacity_, MS_ASYNC);
+        ::msync(this->index_, this->index_bytes_, MS_ASYNC);
+    }
+
+    bool RpcDiskCache::live(uint64_t pos, std::size_t len) const
+    {
+        const uint64_t head = reinterpret_cast<const IndexHeader*>(this->index_)->head;
+        return pos + len <= head && pos + this->capacity_ >= head;
+    }
+
+    const RpcDiskCache::EntryHeader*
+    RpcDiskCache::entry_at(uint64_t pos, std::size_t& len) const
+    {
+        const std::size_t off = pos % this->capacity_;
+        if (off + sizeof(EntryHeader) > this->capacity_)
+            return nullptr;
+        const auto* e = reinterpret_cast<const EntryHeader*>(this->data_ + off);
+        if (e->magic != kEntryMagic)
+            return nullptr;
+        len = align8(sizeof(EntryHeader) + std::size_t{e->request_len} + e->response_len);
+        if (off + len > this->capacity_ || !this->live(pos, len))
+            return nullptr;
+        return e;
+    }
+
+    RpcDiskCache::Slot* RpcDiskCache::slot_for(uint64_t key, bool for_insert)
+    {
+        auto* slots = reinterpret_cast<Slot*>(this->index_ + sizeof(IndexHeader));
+        const uint32_t home = static_cast<uint32_t>(key % this->slot_count_);
+
+        Slot* reusable = nullptr;
+        for (uint32_t i = 0; i < kProbeLimit; ++i)
+        {
+            Slot& s = slots[(home + i) % this->slot_count_];
+            if (s.pos_plus_one == 0)
+                return for_insert ? (reusable ? reusable : &s) : nullptr;
+            if (s.key == key)
+                return &s;
+            if (for_insert && !reusable)
+            {
+                std::size_t len = 0;
+                if (!this->entry_at(s.pos_plus_one - 1, len))
+                    reusable = &s;
+            }
+        }
+        if (!for_insert)
+            return nullptr;
+        // Table crowded here: take a dead slot, else evict the home slot.
+        return reusable ? reusable : &slots[home];
+    }
+
+    RpcCachedResponse RpcDiskCache::get(uint64_t key,
+                                        uint64_t method_id,
+                                        std::span<const uint8_t> request,
+                                        uint64_t now_ms)
+    {
+        std::lock_guard lk(this->mutex_);
+
+        Slot* s = this->slot_for(key, false);
+        if (!s)
+            return {};
+
+        const uint64_t pos = s->pos_plus_one - 1;
+        std::size_t len = 0;
+        const EntryHeader* e = this->entry_at(pos, len);
+        if (!e || e->key != key || e->method_id != method_id ||
+            e->request_len != request.size())
+            return {};
+        if (e->expires_ms != 0 && e->expires_ms <= now_ms)
+            return {};
+
+        const uint8_t* req = reinterpret_cast<const uint8_t*>(e + 1);
+        const uint8_t* resp = req + e->request_len;
+        if (!request.empty() &&
+            std::memcmp(req, request.data(), request.size()) != 0)
+            return {};
+        if (crc32c_finish(crc32c_update(kCrc32cInit, req,
+                                        std::size_t{e->request_len} + e->response_len)) != e->crc)
+        {
+            // Torn write or bit rot: forget the entry.
+            s->pos_plus_one = 0;
+            return {};
+        }
+
+        this->pins_.insert(pos);
+        auto self = this->shared_from_this();
+        std::shared_ptr<const void> pin(
+            static_cast<const void*>(resp),
+            [self, pos](const void*) { self->unpin(pos); });
+
+        return RpcCachedResponse{
+            .body = std::span<const uint8_t>{resp, e->response_len},
+            .pin = std::move(pin),
+            .expires_ms = e->expires_ms,
+        };
+    }
+
+    void RpcDiskCache::unpin(uint64_t pos)
+    {
+        std::lock_guard lk(this->mutex_);
+        if (auto it = this->pins_.find(pos); it != this->pins_.end())
+            this->pins_.erase(it);
+    }
+
+    bool RpcDiskCache::put(uint64_t key,
+                           uint64_t method_id,
+                           std::span<const uint8_t> request,
+                           std::span<const uint8_t> response,
+                           uint64_t expires_ms)
+    {
+        const std::size_t len =
+            align8(sizeof(EntryHeader) + request.size() + response.size());
+        // Bigger entries would churn most of the ring on every store.
+        if (len > this->capacity_ / 4 ||
+            request.size() > UINT32_MAX || response.size() > UINT32_MAX)
+            return false;
+
+        std::lock_guard lk(this->mutex_);
+        auto* ih = reinterpret_cast<IndexHeader*>(this->index_);
+
+        uint64_t pos = ih->head;
+        const std::size_t off = pos % this->capacity_;
+        if (off + len > this->capacity_)
+            pos += this->capacity_ - off; // skip the tail, restart at 0
+
+        // Everything below new_head - capacity gets overwritten; refuse if
+        // some of it is still being sent.
+        const uint64_t new_head = pos + len;
+        if (!this->pins_.empty() && new_head > this->capacity_ &&
+            *this->pins_.begin() < new_head - this->capacity_)
+            return false;
+
+        // Retire the slot first so a crash mid-copy cannot leave it
+        // pointing at a half-written entry that happens to verify.
+        Slot* s = this->slot_for(key, true);
+        s->pos_plus_one = 0;
+
+        auto* e = reinterpret_cast<EntryHeader*>(this->data_ + pos % this->capacity_);
+        uint8_t* req = reinterpret_cast<uint8_t*>(e + 1);
+        uint32_t crc = crc32c_copy(kCrc32cInit, req, request.data(), request.size());
+        crc = crc32c_copy(crc, req + request.size(), response.data(), response.size());
+
+        e->crc = crc32c_finish(crc);
+        e->key = key;
+        e->method_id = method_id;
+        e->expires_ms = expires_ms;
+        e->request_len = static_cast<uint32_t>(request.size());
+        e->response_len = static_cast<uint32_t>(response.size());
+        e->magic = kEntryMagic;
+
+        ih->head = new_head;
+        s->key = key;
+        s->pos_plus_one = pos + 1;
+        return true;
+    }
+}
@@ -0,0 +1,270 @@
+#include <urpc/server/RPCIdempotency.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <uvent/system/SystemContext.h>
+
+#include <urpc/transport/IRPCStream.h>
+#include <urpc/utils/Hash.h>
+
+namespace urpc
+{
+    using namespace usub::uvent;
+
+    namespace
+    {
+        int64_t now_ns() noexcept
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // Ends one retry's wait at its deadline; harmless if the entry
+        // finished first.
+        task::Awaitable<void> wake_after(
+            std::shared_ptr<sync::AsyncEvent> ev, uint64_t ms)
+        {
+            co_await system::this_coroutine::sleep_for(
+                std::chrono::milliseconds{ms});
+            ev->set();
+        }
+    }
+
+    uint64_t idempotency_scope(const IRpcStream& stream, const void* connection)
+    {
+        if (const RpcPeerIdentity* peer = stream.peer_identity();
+            peer && peer->authenticated)
+            return fnv1a64_rt("id:" + peer->subject + "\n" + peer->issuer);
+        if (std::string addr = stream.peer_address(); !addr.empty())
+            return fnv1a64_rt("ip:" + addr);
+        return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(connection));
+    }
+
+    uint64_t scoped_idempotency_key(uint64_t scope, uint64_t key) noexcept
+    {
+        uint64_t h = FNV_OFFSET;
+        for (uint64_t v : {scope, key})
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                h ^= static_cast<uint8_t>(v >> (i * 8));
+                h *= FNV_PRIME;
+            }
+        }
+        return h != 0 ? h : 1;
+    }
+
+    RpcIdempotencyTable::RpcIdempotencyTable(RpcIdempotencyConfig cfg)
+        : cfg_(cfg)
+    {
+    }
+
+    uint64_t RpcIdempotencyTable::fingerprint(std::span<const uint8_t> body) noexcept
+    {
+        uint64_t h = FNV_OFFSET ^ body.size();
+        for (uint8_t c : body)
+        {
+            h ^= c;
+            h *= FNV_PRIME;
+        }
+        return h;
+    }
+
+    task::Awaitable<RpcIdempotencyClaim> RpcIdempotencyTable::claim(
+        const RpcIdempotencyKey& k,
+        std::span<const uint8_t> body)
+    {
+        const uint64_t fp = fingerprint(body);
+        const int64_t deadline =
+            now_ns() + static_cast<int64_t>(this->cfg_.wait_timeout_ms) * 1'000'000;
+
+        for (std::shared_ptr<sync::AsyncEvent> waiting;;)
+        {
+            {
+                std::lock_guard lk(this->mutex_);
+                const int64_t now = now_ns();
+
+                auto it = this->entries_.find(k);
+                if (it != this->entries_.end() && it->second.done &&
+                    it->second.expires_ns <= now)
+                {
+                    this->erase_locked(it);
+                    it = this->entries_.end();
+                }
+
+                if (it == this->entries_.end())
+                {
+                    this->evict_locked(now);
+                    // As many calls in flight as the table remembers: run
+                    // this one without dedup rather than grow further.
+                    if (this->entries_.size() - this->done_count_ >=
+                        this->cfg_.max_entries)
+                        co_return RpcIdempotencyClaim{};
+
+                    Entry e;
+                    e.fingerprint = fp;
+                    this->entries_.emplace(k, std::move(e));
+                    co_return RpcIdempotencyClaim{
+                        .outcome = RpcIdempotencyOutcome::Run,
+                        .response = nullptr,
+                        .tracked = true,
+                    };
+                }
+
+                Entry& e = it->second;
+                if (waiting)
+                    std::erase(e.waiters, waiting);
+                if (e.fingerprint != fp)
+                {
+                    this->conflicts_.fetch_add(1, std::memory_order_relaxed);
+                    co_return RpcIdempotencyClaim{
+                        .outcome = RpcIdempotencyOutcome::Conflict,
+                        .response = nullptr,
+                        .tracked = false,
+                    };
+                }
+                if (e.done)
+                {
+                    this->replays_.fetch_add(1, std::memory_order_relaxed);
+                    co_return RpcIdempotencyClaim{
+                        .outcome = RpcIdempotencyOutcome::Replay,
+                        .response = e.response,
+                        .tracked = false,
+                    };
+                }
+                if (now >= deadline)
+                {
+                    co_return RpcIdempotencyClaim{
+                        .outcome = RpcIdempotencyOutcome::InProgress,
+                        .response = nullptr,
+                        .tracked = false,
+                    };
+                }
+
+                waiting = std::make_shared<sync::AsyncEvent>(
+                    sync::Reset::Manual, false);
+                e.waiters.push_back(waiting);
+                system::co_spawn(wake_after(
+                    waiting,
+                    static_cast<uint64_t>(deadline - now) / 1'000'000 + 1));
+            }
+
+            // The first attempt is still running; look again once it has
+            // completed or been abandoned, or the wait timed out.
+            co_await waiting->wait();
+        }
+    }
+
+    void RpcIdempotencyTable::complete(const RpcIdempotencyKey& k,
+                                       std::span<const uint8_t> response)
+    {
+        auto stored = std::make_shared<const std::vector<uint8_t>>(
+            response.begin(), response.end());
+
+        std::vector<std::shared_ptr<sync::AsyncEvent>> waiters;
+        {
+            std::lock_guard lk(this->mutex_);
+            auto it = this->entries_.find(k);
+            if (it == this->entries_.end() || it->second.done)
+                return;
+
+            Entry& e = it->second;
+            e.done = true;
+            e.expires_ns = now_ns() +
+                           static_cast<int64_t>(this->cfg_.ttl_ms) * 1'000'000;
+            e.response = std::move(stored);
+            e.order = this->order_.insert(this->order_.end(), it->first);
+            ++this->done_count_;
+            this->done_bytes_ += e.response->size();
+            waiters.swap(e.waiters);
+
+            this->evict_locked(now_ns());
+        }
+        wake(std::move(waiters));
+    }
+
+    void RpcIdempotencyTable::abandon(const RpcIdempotencyKey& k)
+    {
+        std::vector<std::shared_ptr<sync::AsyncEvent>> waiters;
+        {
+            std::lock_guard lk(this->mutex_);
+            auto it = this->entries_.find(k);
+            if (it == this->entries_.end() || it->second.done)
+                return;
+            waiters.swap(it->second.waiters);
+            this->erase_locked(it);
+        }
+        wake(std::move(waiters));
+    }
+
+    void RpcIdempotencyTable::wake(
+        std::vector<std::shared_ptr<sync::AsyncEvent>> waiters)
+    {
+        for (auto& ev : waiters)
+            ev->set();
+    }
+
+    void RpcIdempotencyTable::erase_locked(std::map<Key, Entry>::iterator it)
+    {
+        if (it->second.done)
+        {
+            --this->done_count_;
+            this->done_bytes_ -= it->second.response->size();
+            this->order_.erase(it->second.order);
+        }
+        this->entries_.erase(it);
+    }
+
+    void RpcIdempotencyTable::evict_locked(int64_t now_ns)
+    {
+        // order_ holds completed entries by completion time; with one TTL
+        // for all of them the front is always the first to expire.
+        while (!this->order_.empty())
+        {
+            auto it = this->entries_.find(this->order_.front());
+            const bool over = this->done_count_ > this->cfg_.max_entries ||
+                              this->done_bytes_ > this->cfg_.max_bytes;
+            if (!over && it->second.expires_ns > now_ns)
+                break;
+            this->erase_locked(it);
+        }
+    }
+
+    std::size_t RpcIdempotencyTable::size() const
+    {
+        std::lock_guard lk(this->mutex_);
+        return this->entries_.size();
+    }
+
+    RpcIdempotencyRun::RpcIdempotencyRun(RpcIdempotencyRun&& o) noexcept
+        : table_(std::exchange(o.table_, nullptr))
+          , key_(o.key_)
+    {
+    }
+
+    RpcIdempotencyRun& RpcIdempotencyRun::operator=(
+        RpcIdempotencyRun&& o) noexcept
+    {
+        if (this != &o)
+        {
+            if (this->table_)
+                this->table_->abandon(this->key_);
+            this->table_ = std::exchange(o.table_, nullptr);
+            this->key_ = o.key_;
+        }
+        return *this;
+    }
+
+    RpcIdempotencyRun::~RpcIdempotencyRun()
+    {
+        if (this->table_)
+            this->table_->abandon(this->key_);
+    }
+
+    void RpcIdempotencyRun::complete(std::span<const uint8_t> response)
+    {
+        if (auto* table = std::exchange(this->table_, nullptr))
+            table->complete(this->key_, response);
+    }
+}
@@ -0,0 +1,91 @@
+#include <urpc/server/RPCLoadTracker.h>
+
+#include <algorithm>
+#include <thread>
+#include <time.h>
+
+namespace urpc
+{
+    namespace
+    {
+        constexpr int64_t kCpuSampleIntervalNs = 100'000'000;
+
+        int64_t wall_now_ns()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        int64_t process_cpu_ns()
+        {
+            timespec ts{};
+            if (::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0)
+                return 0;
+            return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+        }
+    }
+
+    RpcLoadTracker::RpcLoadTracker()
+        : last_wall_ns_(wall_now_ns())
+          , last_cpu_ns_(process_cpu_ns())
+          , cores_(std::max(1u, std::thread::hardware_concurrency()))
+    {
+    }
+
+    void RpcLoadTracker::on_request_start(std::chrono::nanoseconds queue_delay)
+    {
+        this->in_flight_.fetch_add(1, std::memory_order_relaxed);
+
+        const auto us = static_cast<int64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                queue_delay).count());
+        const int64_t old = this->queue_delay_us_.load(std::memory_order_relaxed);
+        const int64_t next = old + (std::max<int64_t>(us, 0) - old) / 8;
+        this->queue_delay_us_.store(
+            static_cast<uint32_t>(std::clamp<int64_t>(next, 0, UINT32_MAX)),
+            std::memory_order_relaxed);
+    }
+
+    void RpcLoadTracker::on_request_end()
+    {
+        this->in_flight_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void RpcLoadTracker::sample_cpu()
+    {
+        const int64_t now = wall_now_ns();
+        if (now < this->next_cpu_sample_ns_.load(std::memory_order_relaxed))
+            return;
+
+        std::unique_lock lk(this->cpu_mutex_, std::try_to_lock);
+        if (!lk.owns_lock())
+            return;
+
+        const int64_t cpu = process_cpu_ns();
+        const int64_t dwall = now - this->last_wall_ns_;
+        const int64_t dcpu = cpu - this->last_cpu_ns_;
+        if (dwall > 0)
+        {
+            const double pct = 100.0 * static_cast<double>(dcpu) /
+                (static_cast<double>(dwall) * this->cores_);
+            this->cpu_percent_.store(
+                static_cast<uint8_t>(std::clamp(pct, 0.0, 100.0)),
+                std::memory_order_relaxed);
+        }
+        this->last_wall_ns_ = now;
+        this->last_cpu_ns_ = cpu;
+        this->next_cpu_sample_ns_.store(now + kCpuSampleIntervalNs,
+                                        std::memory_order_relaxed);
+    }
+
+    RpcLoadReport RpcLoadTracker::snapshot()
+    {
+        this->sample_cpu();
+
+        RpcLoadReport r;
+        r.in_flight = this->in_flight_.load(std::memory_order_relaxed);
+        r.queue_delay_us = this->queue_delay_us_.load(std::memory_order_relaxed);
+        r.cpu_percent = this->cpu_percent_.load(std::memory_order_relaxed);
+        return r;
+    }
+}
@@ -0,0 +1,146 @@
+#include <urpc/server/RPCMemoryBudget.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <uvent/system/SystemContext.h>
+
+namespace urpc
+{
+    RpcMemoryCharge::RpcMemoryCharge(RpcMemoryCharge&& o) noexcept
+        : budget_(o.budget_), owner_(o.owner_), bytes_(o.bytes_)
+    {
+        o.budget_ = nullptr;
+        o.bytes_ = 0;
+    }
+
+    RpcMemoryCharge& RpcMemoryCharge::operator=(RpcMemoryCharge&& o) noexcept
+    {
+        if (this != &o)
+        {
+            this->reset();
+            this->budget_ = o.budget_;
+            this->owner_ = o.owner_;
+            this->bytes_ = o.bytes_;
+            o.budget_ = nullptr;
+            o.bytes_ = 0;
+        }
+        return *this;
+    }
+
+    RpcMemoryCharge::~RpcMemoryCharge()
+    {
+        this->reset();
+    }
+
+    void RpcMemoryCharge::reset()
+    {
+        if (this->budget_ && this->bytes_ > 0)
+            this->budget_->release(this->owner_, this->bytes_);
+        this->budget_ = nullptr;
+        this->bytes_ = 0;
+    }
+
+    void RpcMemoryCharge::merge(RpcMemoryCharge&& o) noexcept
+    {
+        if (!this->budget_)
+        {
+            *this = std::move(o);
+            return;
+        }
+        this->bytes_ += o.bytes_;
+        o.budget_ = nullptr;
+        o.bytes_ = 0;
+    }
+
+    RpcMemoryBudget::RpcMemoryBudget(RpcMemoryBudgetConfig cfg)
+        : cfg_(cfg)
+    {
+        if (this->cfg_.hard_limit_bytes > 0 && this->cfg_.soft_limit_bytes > 0)
+            this->cfg_.soft_limit_bytes =
+                std::min(this->cfg_.soft_limit_bytes, this->cfg_.hard_limit_bytes);
+        this->cfg_.pause_poll_ms = std::max<uint32_t>(this->cfg_.pause_poll_ms, 1);
+    }
+
+    RpcMemoryCharge RpcMemoryBudget::charge(const void* owner, std::size_t bytes)
+    {
+        if (bytes == 0)
+            return {};
+
+        {
+            std::lock_guard lk(this->mutex_);
+            this->by_owner_[owner] += bytes;
+        }
+
+        const std::size_t now =
+            this->used_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        std::size_t peak = this->peak_.load(std::memory_order_relaxed);
+        while (now > peak &&
+               !this->peak_.compare_exchange_weak(peak, now,
+                                                  std::memory_order_relaxed))
+        {
+        }
+
+        return RpcMemoryCharge{this, owner, bytes};
+    }
+
+    void RpcMemoryBudget::release(const void* owner, std::size_t bytes) noexcept
+    {
+        {
+            std::lock_guard lk(this->mutex_);
+            auto it = this->by_owner_.find(owner);
+            if (it != this->by_owner_.end())
+            {
+                it->second -= std::min(it->second, bytes);
+                if (it->second == 0)
+                    this->by_owner_.erase(it);
+            }
+        }
+        this->used_.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    bool RpcMemoryBudget::admit(std::size_t bytes) const noexcept
+    {
+        if (this->cfg_.hard_limit_bytes == 0 ||
+            bytes < this->cfg_.large_request_bytes)
+            return true;
+        return this->used() + bytes <= this->cfg_.hard_limit_bytes;
+    }
+
+    bool RpcMemoryBudget::should_pause(const void* owner,
+                                       std::size_t incoming) const
+    {
+        if (this->cfg_.soft_limit_bytes == 0)
+            return false;
+
+        const std::size_t used = this->used();
+        if (used == 0 || used + incoming <= this->cfg_.soft_limit_bytes)
+            return false;
+
+        std::lock_guard lk(this->mutex_);
+        std::size_t mine = 0;
+        if (auto it = this->by_owner_.find(owner); it != this->by_owner_.end())
+            mine = it->second;
+
+        const std::size_t owners =
+            this->by_owner_.size() + (mine == 0 ? 1 : 0);
+        // mine + incoming >= (used + incoming) / owners
+        return (mine + incoming) * owners >= used + incoming;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcMemoryBudget::wait_for_room(const void* owner, std::size_t incoming)
+    {
+        if (!this->should_pause(owner, incoming))
+            co_return;
+
+        this->pauses_.fetch_add(1, std::memory_order_relaxed);
+        const std::chrono::milliseconds poll{this->cfg_.pause_poll_ms};
+        do
+        {
+            co_await usub::uvent::system::this_coroutine::sleep_for(poll);
+        }
+        while (this->should_pause(owner, incoming));
+        co_return;
+    }
+}
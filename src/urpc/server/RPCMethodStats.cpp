@@ -0,0 +1,195 @@
+#include <urpc/server/RPCMethodStats.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <time.h>
+
+namespace urpc
+{
+    namespace
+    {
+        constexpr std::size_t kProbeLimit = 16;
+
+        std::atomic<uint64_t> g_next_stats_id{1};
+
+        // Call tokens: the high bits tell threads apart, so a handler that
+        // returns on another thread never matches a call started there.
+        std::atomic<uint64_t> g_next_thread{1};
+        thread_local uint64_t t_next_call =
+            g_next_thread.fetch_add(1, std::memory_order_relaxed) << 40;
+
+        int64_t thread_cpu_ns() noexcept
+        {
+            timespec ts{};
+            if (::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+                return 0;
+            return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+        }
+
+        // Single writer per shard: plain load + store, no RMW.
+        void bump(std::atomic<uint64_t>& c, uint64_t v) noexcept
+        {
+            c.store(c.load(std::memory_order_relaxed) + v,
+                    std::memory_order_relaxed);
+        }
+
+        // What this thread's CPU time is currently charged to.
+        struct ThreadAttribution
+        {
+            RpcMethodStats* stats{nullptr};
+            uint64_t method_id{0};
+            uint64_t call{0};
+            int64_t since_ns{0};
+        };
+
+        thread_local ThreadAttribution t_current;
+    }
+
+    RpcMethodStats::RpcMethodStats()
+        : id_(g_next_stats_id.fetch_add(1, std::memory_order_relaxed))
+    {
+    }
+
+    RpcMethodStats::~RpcMethodStats() = default;
+
+    RpcMethodStats::Shard& RpcMethodStats::local_shard()
+    {
+        // Keyed by id, not address: a stats object allocated where a dead
+        // one used to be must not pick up the old shard pointer.
+        thread_local std::unordered_map<uint64_t, Shard*> t_shards;
+
+        auto it = t_shards.find(this->id_);
+        if (it != t_shards.end())
+            return *it->second;
+
+        auto shard = std::make_unique<Shard>();
+        Shard* raw = shard.get();
+        {
+            std::lock_guard lk(this->shards_mutex_);
+            this->shards_.push_back(std::move(shard));
+        }
+        t_shards.emplace(this->id_, raw);
+        return *raw;
+    }
+
+    RpcMethodStats::Slot& RpcMethodStats::slot(uint64_t method_id)
+    {
+        Shard& sh = this->local_shard();
+        const std::size_t home = static_cast<std::size_t>(method_id % kSlots);
+        for (std::size_t i = 0; i < kProbeLimit; ++i)
+        {
+            Slot& s = sh.slots[(home + i) % kSlots];
+            const uint64_t cur = s.method_id.load(std::memory_order_relaxed);
+            if (cur == method_id)
+                return s;
+            if (cur == 0)
+            {
+                // Published last so a reader never sees a half-claimed slot
+                // under the wrong id.
+                s.method_id.store(method_id, std::memory_order_release);
+                return s;
+            }
+        }
+        return sh.overflow;
+    }
+
+    void RpcMethodStats::switch_to(const Attribution& to) noexcept
+    {
+        ThreadAttribution& cur = t_current;
+        if (!cur.stats && !to.stats)
+            return;
+
+        const int64_t now = thread_cpu_ns();
+        if (cur.stats && now > cur.since_ns)
+            bump(cur.stats->slot(cur.method_id).cpu_ns,
+                 static_cast<uint64_t>(now - cur.since_ns));
+
+        cur.stats = to.stats;
+        cur.method_id = to.method_id;
+        cur.call = to.call;
+        cur.since_ns = now;
+    }
+
+    RpcMethodStats::Attribution RpcMethodStats::enter(uint64_t method_id,
+                                                      std::size_t request_bytes)
+    {
+        const Attribution a{this, method_id, t_next_call++};
+        switch_to(a);
+        bump(this->slot(method_id).alloc_bytes, request_bytes);
+        return a;
+    }
+
+    void RpcMethodStats::leave(const Attribution& call,
+                               uint64_t wall_ns,
+                               std::size_t response_bytes)
+    {
+        const ThreadAttribution& cur = t_current;
+        if (cur.stats == this && cur.call == call.call &&
+            cur.method_id == call.method_id)
+            switch_to(Attribution{});
+
+        Slot& s = this->slot(call.method_id);
+        bump(s.calls, 1);
+        bump(s.wall_ns, wall_ns);
+        bump(s.alloc_bytes, response_bytes);
+    }
+
+    RpcMethodStats::Attribution RpcMethodStats::suspend() noexcept
+    {
+        const Attribution a{t_current.stats, t_current.method_id, t_current.call};
+        switch_to(Attribution{});
+        return a;
+    }
+
+    void RpcMethodStats::resume(Attribution a) noexcept
+    {
+        switch_to(a);
+    }
+
+    void RpcMethodStats::note_alloc(std::size_t bytes) noexcept
+    {
+        ThreadAttribution& cur = t_current;
+        if (cur.stats)
+            bump(cur.stats->slot(cur.method_id).alloc_bytes, bytes);
+    }
+
+    RpcMethodStatsSnapshot RpcMethodStats::snapshot() const
+    {
+        std::unordered_map<uint64_t, RpcMethodStatsEntry> by_method;
+
+        auto add = [&by_method](uint64_t mid, const Slot& s) {
+            RpcMethodStatsEntry& e = by_method[mid];
+            e.method_id = mid;
+            e.calls += s.calls.load(std::memory_order_relaxed);
+            e.wall_ns += s.wall_ns.load(std::memory_order_relaxed);
+            e.cpu_ns += s.cpu_ns.load(std::memory_order_relaxed);
+            e.alloc_bytes += s.alloc_bytes.load(std::memory_order_relaxed);
+        };
+
+        {
+            std::lock_guard lk(this->shards_mutex_);
+            for (const auto& sh : this->shards_)
+            {
+                for (const Slot& s : sh->slots)
+                {
+                    const uint64_t mid = s.method_id.load(std::memory_order_acquire);
+                    if (mid != 0)
+                        add(mid, s);
+                }
+                if (sh->overflow.calls.load(std::memory_order_relaxed) != 0 ||
+                    sh->overflow.cpu_ns.load(std::memory_order_relaxed) != 0)
+                    add(0, sh->overflow);
+            }
+        }
+
+        RpcMethodStatsSnapshot snap;
+        snap.methods.reserve(by_method.size());
+        for (auto& [mid, e] : by_method)
+            snap.methods.push_back(e);
+        std::sort(snap.methods.begin(), snap.methods.end(),
+                  [](const RpcMethodStatsEntry& a, const RpcMethodStatsEntry& b) {
+                      return a.cpu_ns > b.cpu_ns;
+                  });
+        return snap;
+    }
+}
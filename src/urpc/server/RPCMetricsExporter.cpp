@@ -0,0 +1,584 @@
+#include <urpc/server/RPCMetricsExporter.h>
+
+#include <algorithm>
+#include <chrono>
+#include <charconv>
+#include <cstdio>
+#include <string_view>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <uvent/system/SystemContext.h>
+
+#include <urpc/client/RPCClient.h>
+#include <urpc/client/RPCClientPool.h>
+#include <urpc/client/RPCConcurrencyLimiter.h>
+#include <urpc/server/RPCIdempotency.h>
+#include <urpc/server/RPCLoadTracker.h>
+#include <urpc/server/RPCMemoryBudget.h>
+#include <urpc/server/RPCMethodStats.h>
+#include <urpc/server/RPCMirror.h>
+#include <urpc/server/RPCResponseCache.h>
+#include <urpc/server/RPCServer.h>
+
+#if URPC_LOGS
+#include <ulog/ulog.h>
+#endif
+
+namespace urpc
+{
+    using namespace usub::uvent;
+
+    namespace
+    {
+        constexpr std::size_t kMaxHttpRequest = 8 * 1024;
+        constexpr int kHttpTimeoutMs = 5000;
+
+        std::string num(uint64_t v)
+        {
+            return std::to_string(v);
+        }
+
+        std::string num(double v)
+        {
+            // Byte counts and the like stay integers instead of 1.2e+08.
+            if (v >= 0 && v < 9.0e15 && v == static_cast<double>(static_cast<uint64_t>(v)))
+                return num(static_cast<uint64_t>(v));
+
+            char buf[32];
+            const auto r = std::to_chars(buf, buf + sizeof(buf), v,
+                                         std::chars_format::general);
+            return std::string{buf, r.ptr};
+        }
+
+        std::string label(std::string_view key, std::string_view value)
+        {
+            std::string out{key};
+            out += "=\"";
+            for (const char c : value)
+            {
+                if (c == '\\' || c == '"')
+                {
+                    out += '\\';
+                    out += c;
+                }
+                else if (c == '\n')
+                    out += "\\n";
+                else
+                    out += c;
+            }
+            out += '"';
+            return out;
+        }
+
+        // Samples grouped by metric family, families in first-use order,
+        // so several sources can add to the same family.
+        class MetricsText
+        {
+        public:
+            void counter(std::string_view name, std::string_view help,
+                         const std::string& labels, uint64_t v)
+            {
+                this->sample(this->family(name, "counter", help), name,
+                             "_total", labels, num(v));
+            }
+
+            void counter_seconds(std::string_view name, std::string_view help,
+                                 const std::string& labels, uint64_t ns)
+            {
+                this->sample(this->family(name, "counter", help), name,
+                             "_total", labels, num(ns / 1e9));
+            }
+
+            void gauge(std::string_view name, std::string_view help,
+                       const std::string& labels, double v)
+            {
+                this->sample(this->family(name, "gauge", help), name, "",
+                             labels, num(v));
+            }
+
+            // h is in microseconds; exported in seconds.
+            void histogram_us(std::string_view name, std::string_view help,
+                              const std::string& labels,
+                              const HistogramSnapshot& h)
+            {
+                Family& f = this->family(name, "histogram", help);
+                uint64_t cumulative = 0;
+                for (std::size_t i = 0; i < h.counts.size(); ++i)
+                {
+                    cumulative += h.counts[i];
+                    const std::string le = i < h.bounds.size()
+                                               ? num(h.bounds[i] / 1e6)
+                                               : std::string{"+Inf"};
+                    this->sample(f, name, "_bucket",
+                                 labels + "," + label("le", le), num(cumulative));
+                }
+                this->sample(f, name, "_count", labels, num(h.count));
+                this->sample(f, name, "_sum", labels, num(h.sum / 1e6));
+            }
+
+            std::string finish() const
+            {
+                std::string out;
+                for (const Family& f : this->families_)
+                {
+                    out += "# TYPE ";
+                    out += f.name;
+                    out += ' ';
+                    out += f.type;
+                    out += "\n# HELP ";
+                    out += f.name;
+                    out += ' ';
+                    out += f.help;
+                    out += '\n';
+                    out += f.samples;
+                }
+                out += "# EOF\n";
+                return out;
+            }
+
+        private:
+            struct Family
+            {
+                std::string name;
+                std::string_view type;
+                std::string_view help;
+                std::string samples;
+            };
+
+            Family& family(std::string_view name, std::string_view type,
+                           std::string_view help)
+            {
+                for (Family& f : this->families_)
+                    if (f.name == name)
+                        return f;
+                return this->families_.emplace_back(
+                    Family{std::string{name}, type, help, {}});
+            }
+
+            static void sample(Family& f, std::string_view name,
+                               std::string_view suffix,
+                               const std::string& labels,
+                               const std::string& value)
+            {
+                f.samples += name;
+                f.samples += suffix;
+                f.samples += '{';
+                f.samples += labels;
+                f.samples += "} ";
+                f.samples += value;
+                f.samples += '\n';
+            }
+
+            std::vector<Family> families_;
+        };
+
+        std::string method_label(uint64_t method_id)
+        {
+            char buf[19] = "0x0000000000000000";
+            char hex[16];
+            const auto r = std::to_chars(hex, hex + sizeof(hex), method_id, 16);
+            const std::size_t n = static_cast<std::size_t>(r.ptr - hex);
+            std::copy(hex, r.ptr, buf + 18 - n);
+            return label("method", std::string_view{buf, 18});
+        }
+
+        uint64_t count(const ShardedCounter& c)
+        {
+            const int64_t v = c.value();
+            return v > 0 ? static_cast<uint64_t>(v) : 0;
+        }
+
+        void add_server_metrics(MetricsText& m, const std::string& name,
+                                const RpcServer& server)
+        {
+            const std::string l = label("server", name);
+            const RpcServerStats& s = server.stats();
+            const RpcServerConfig& cfg = server.config();
+
+            m.counter("urpc_server_connections_accepted",
+                      "Connections accepted.", l, count(s.connections_accepted));
+            m.gauge("urpc_server_connections_active",
+                    "Connections open.", l,
+                    static_cast<double>(count(s.connections_active)));
+            m.counter("urpc_server_connections_evicted",
+                      "Connections closed because writes to them stalled.", l,
+                      count(s.connections_evicted));
+            m.counter("urpc_server_requests", "Requests received.", l,
+                      count(s.requests));
+            m.counter("urpc_server_request_bytes",
+                      "Request body bytes received.", l, count(s.request_bytes));
+            m.counter("urpc_server_responses",
+                      "Responses sent, errors included.", l, count(s.responses));
+            m.counter("urpc_server_response_bytes",
+                      "Response body bytes sent.", l, count(s.response_bytes));
+            m.counter("urpc_server_errors", "Error responses sent.", l,
+                      count(s.errors));
+            m.histogram_us("urpc_server_request_duration_seconds",
+                           "Time from reading a request to queueing its response.",
+                           l, s.request_latency_us.snapshot());
+
+            if (cfg.load_tracker)
+            {
+                m.gauge("urpc_server_in_flight", "Requests being handled.", l,
+                        cfg.load_tracker->in_flight());
+                m.gauge("urpc_server_queue_delay_seconds",
+                        "Smoothed time requests wait before their handler.", l,
+                        cfg.load_tracker->queue_delay_us() / 1e6);
+            }
+
+            if (cfg.memory_budget)
+            {
+                const RpcMemoryBudget& b = *cfg.memory_budget;
+                m.gauge("urpc_server_memory_used_bytes",
+                        "Bytes charged to the memory budget.", l,
+                        static_cast<double>(b.used()));
+                m.gauge("urpc_server_memory_peak_bytes",
+                        "Highest memory budget usage seen.", l,
+                        static_cast<double>(b.peak()));
+                m.counter("urpc_server_memory_rejected",
+                          "Requests rejected by the memory budget.", l,
+                          b.rejected());
+                m.counter("urpc_server_memory_pauses",
+                          "Times a connection stopped reading for the memory budget.",
+                          l, b.pauses());
+            }
+
+            if (cfg.response_cache)
+            {
+                const RpcResponseCache& c = *cfg.response_cache;
+                m.counter("urpc_server_cache_hits", "Response cache hits.",
+                          l + "," + label("tier", "memory"), c.memory_hits());
+                if (c.has_disk())
+                    m.counter("urpc_server_cache_hits", "Response cache hits.",
+                              l + "," + label("tier", "disk"), c.disk_hits());
+                m.counter("urpc_server_cache_misses", "Response cache misses.",
+                          l, c.misses());
+                m.counter("urpc_server_cache_stores",
+                          "Responses stored in the cache.", l, c.stores());
+                m.gauge("urpc_server_cache_memory_bytes",
+                        "Bytes held by the in-memory cache tier.", l,
+                        static_cast<double>(c.memory_used()));
+            }
+
+            if (cfg.idempotency)
+            {
+                const RpcIdempotencyTable& t = *cfg.idempotency;
+                m.gauge("urpc_server_idempotency_entries",
+                        "Idempotency keys remembered.", l,
+                        static_cast<double>(t.size()));
+                m.counter("urpc_server_idempotency_replays",
+                          "Retries answered with a stored response.", l,
+                          t.replays());
+                m.counter("urpc_server_idempotency_conflicts",
+                          "Keys reused with a different request.", l,
+                          t.conflicts());
+            }
+
+            if (cfg.mirror)
+            {
+                m.counter("urpc_server_mirrored",
+                          "Requests copied to the mirror target.", l,
+                          cfg.mirror->mirrored());
+                m.counter("urpc_server_mirror_dropped",
+                          "Mirror copies dropped.", l, cfg.mirror->dropped());
+            }
+
+            if (cfg.method_stats)
+            {
+                for (const RpcMethodStatsEntry& e :
+                     cfg.method_stats->snapshot().methods)
+                {
+                    const std::string ml = l + "," + method_label(e.method_id);
+                    m.counter("urpc_server_method_calls",
+                              "Handler calls per method.", ml, e.calls);
+                    m.counter_seconds("urpc_server_method_wall_seconds",
+                                      "Handler wall time per method.", ml,
+                                      e.wall_ns);
+                    m.counter_seconds("urpc_server_method_cpu_seconds",
+                                      "Handler CPU time per method.", ml,
+                                      e.cpu_ns);
+                    m.counter("urpc_server_method_alloc_bytes",
+                              "Bytes allocated for calls per method.", ml,
+                              e.alloc_bytes);
+                }
+            }
+        }
+
+        // prefix is urpc_client or urpc_pool.
+        void add_call_metrics(MetricsText& m, std::string_view prefix,
+                              const std::string& l, const RpcClientStats& s,
+                              const RpcConcurrencyLimiter* limiter)
+        {
+            const std::string p{prefix};
+            m.counter(p + "_calls", "Calls started.", l, count(s.calls));
+            m.counter(p + "_calls_succeeded", "Calls answered with a response.",
+                      l, count(s.succeeded));
+            m.counter(p + "_calls_failed",
+                      "Calls that failed, other than by timeout.", l,
+                      count(s.failed));
+            m.counter(p + "_calls_timed_out", "Calls that timed out.", l,
+                      count(s.timed_out));
+            m.counter(p + "_request_bytes", "Request body bytes sent.", l,
+                      count(s.request_bytes));
+            m.counter(p + "_response_bytes", "Response body bytes received.",
+                      l, count(s.response_bytes));
+            m.histogram_us(p + "_call_duration_seconds",
+                           "Call latency, timeouts excluded.", l,
+                           s.latency_us.snapshot());
+
+            if (limiter)
+            {
+                m.gauge(p + "_limit", "Adaptive in-flight limit.", l,
+                        limiter->limit());
+                m.gauge(p + "_in_flight", "Calls holding a limiter slot.", l,
+                        limiter->in_flight());
+                m.gauge(p + "_queued", "Calls waiting for a limiter slot.", l,
+                        static_cast<double>(limiter->queued()));
+            }
+        }
+
+        bool write_all_fd(int fd, const std::string& data)
+        {
+            std::size_t off = 0;
+            while (off < data.size())
+            {
+                const ssize_t r = ::write(fd, data.data() + off, data.size() - off);
+                if (r < 0)
+                    return false;
+                off += static_cast<std::size_t>(r);
+            }
+            return true;
+        }
+    }
+
+    RpcMetricsExporter::RpcMetricsExporter(RpcMetricsExporterConfig cfg)
+        : cfg_(std::move(cfg))
+    {
+    }
+
+    RpcMetricsExporter::~RpcMetricsExporter()
+    {
+        {
+            std::lock_guard lk(this->writer_mutex_);
+            this->writer_stop_ = true;
+        }
+        this->writer_cv_.notify_all();
+        if (this->writer_.joinable())
+            this->writer_.join();
+    }
+
+    void RpcMetricsExporter::add_server(std::string name, const RpcServer& server)
+    {
+        std::lock_guard lk(this->mutex_);
+        this->servers_.push_back({std::move(name), &server});
+    }
+
+    void RpcMetricsExporter::add_client(std::string name, const RpcClient& client)
+    {
+        std::lock_guard lk(this->mutex_);
+        this->clients_.push_back({std::move(name), &client});
+    }
+
+    void RpcMetricsExporter::add_pool(std::string name, const RpcClientPool& pool)
+    {
+        std::lock_guard lk(this->mutex_);
+        this->pools_.push_back({std::move(name), &pool});
+    }
+
+    std::string RpcMetricsExporter::render() const
+    {
+        MetricsText m;
+        std::lock_guard lk(this->mutex_);
+
+        for (const auto& s : this->servers_)
+            add_server_metrics(m, s.name, *s.object);
+
+        for (const auto& c : this->clients_)
+            add_call_metrics(m, "urpc_client", label("client", c.name),
+                             c.object->stats(), c.object->config().limiter.get());
+
+        for (const auto& p : this->pools_)
+        {
+            const std::string l = label("pool", p.name);
+            m.gauge("urpc_pool_clients", "Clients created by the pool.", l,
+                    static_cast<double>(p.object->size()));
+            m.gauge("urpc_pool_capacity", "Most clients the pool creates.", l,
+                    static_cast<double>(p.object->capacity()));
+            add_call_metrics(m, "urpc_pool", l, p.object->stats(),
+                             p.object->config().limiter.get());
+        }
+
+        return m.finish();
+    }
+
+    bool RpcMetricsExporter::write_file() const
+    {
+        if (this->cfg_.file_path.empty())
+            return false;
+
+        const std::string text = this->render();
+        const std::string tmp = this->cfg_.file_path + ".tmp";
+
+        const int fd = ::open(tmp.c_str(),
+                              O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;
+
+        // Synced before the rename so a crash never leaves an empty file
+        // under the final name; this runs on the writer thread, so the
+        // event loop does not wait for the disk.
+        const bool ok = write_all_fd(fd, text) && ::fsync(fd) == 0;
+        ::close(fd);
+
+        // rename() replaces the file in one step: readers see either the
+        // previous snapshot or this one, never a partial write.
+        if (!ok || std::rename(tmp.c_str(), this->cfg_.file_path.c_str()) != 0)
+        {
+#if URPC_LOGS
+            usub::ulog::warn("RpcMetricsExporter: writing {} failed",
+                             this->cfg_.file_path);
+#endif
+            ::unlink(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    task::Awaitable<void> RpcMetricsExporter::run_async()
+    {
+        if (!this->cfg_.file_path.empty())
+            this->start_file_writer();
+
+        if (this->cfg_.http_port != 0)
+            co_await this->http_loop();
+        co_return;
+    }
+
+    void RpcMetricsExporter::attach(usub::Uvent& uvent)
+    {
+        // One listener is enough; a scrape is cheap next to the traffic it
+        // describes.
+        uvent.for_each_thread([this](int threadIndex, thread::ThreadLocalStorage*)
+        {
+            if (threadIndex == 0)
+                system::co_spawn_static(this->run_async(), threadIndex);
+        });
+    }
+
+    void RpcMetricsExporter::start_file_writer()
+    {
+        std::call_once(this->writer_once_, [this]
+        {
+            this->writer_ = std::thread([this] { this->file_writer_loop(); });
+        });
+    }
+
+    void RpcMetricsExporter::file_writer_loop()
+    {
+        const auto interval = std::chrono::milliseconds{
+            std::max<uint32_t>(this->cfg_.file_interval_ms, 1)};
+        std::unique_lock lk(this->writer_mutex_);
+        while (!this->writer_stop_)
+        {
+            lk.unlock();
+            this->write_file();
+            lk.lock();
+            this->writer_cv_.wait_for(lk, interval,
+                                      [this] { return this->writer_stop_; });
+        }
+    }
+
+    task::Awaitable<void> RpcMetricsExporter::http_loop()
+    {
+        using namespace std::chrono_literals;
+
+        net::TCPServerSocket acceptor{
+            this->cfg_.http_host.c_str(), this->cfg_.http_port
+        };
+
+#if URPC_LOGS
+        usub::ulog::info("RpcMetricsExporter: serving /metrics on {}:{}",
+                         this->cfg_.http_host, this->cfg_.http_port);
+#endif
+
+        for (;;)
+        {
+            auto soc = co_await acceptor.async_accept();
+            if (!soc)
+            {
+                co_await system::this_coroutine::sleep_for(50ms);
+                continue;
+            }
+            system::co_spawn(this->serve(std::move(soc.value())));
+        }
+    }
+
+    // Minimal HTTP/1.x: one request per connection, GET /metrics only.
+    task::Awaitable<void> RpcMetricsExporter::serve(net::TCPClientSocket socket)
+    {
+        socket.set_timeout_ms(kHttpTimeoutMs);
+
+        utils::DynamicBuffer buf;
+        std::string_view req;
+        for (;;)
+        {
+            if (buf.size() >= kMaxHttpRequest)
+            {
+                socket.shutdown();
+                co_return;
+            }
+            const ssize_t r = co_await socket.async_read(
+                buf, kMaxHttpRequest - buf.size());
+            if (r <= 0)
+            {
+                socket.shutdown();
+                co_return;
+            }
+            req = std::string_view{
+                reinterpret_cast<const char*>(buf.data()), buf.size()};
+            if (req.find("\r\n\r\n") != std::string_view::npos)
+                break;
+        }
+
+        const std::string_view line = req.substr(0, req.find("\r\n"));
+        const bool metrics = line.starts_with("GET /metrics ") ||
+            line.starts_with("GET /metrics?");
+
+        std::string body;
+        std::string_view status = "404 Not Found";
+        std::string_view type = "text/plain; charset=utf-8";
+        if (metrics)
+        {
+            body = this->render();
+            status = "200 OK";
+            type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+        }
+        else
+        {
+            body = "not found\n";
+        }
+
+        std::string out = "HTTP/1.1 ";
+        out += status;
+        out += "\r\nContent-Type: ";
+        out += type;
+        out += "\r\nContent-Length: ";
+        out += std::to_string(body.size());
+        out += "\r\nConnection: close\r\n\r\n";
+        out += body;
+
+        std::size_t off = 0;
+        while (off < out.size())
+        {
+            const ssize_t w = co_await socket.async_write(
+                reinterpret_cast<uint8_t*>(out.data() + off), out.size() - off);
+            if (w <= 0)
+                break;
+            off += static_cast<std::size_t>(w);
+        }
+        socket.shutdown();
+        co_return;
+    }
+}
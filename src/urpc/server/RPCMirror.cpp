@@ -0,0 +1,130 @@
+#include <urpc/server/RPCMirror.h>
+
+#include <uvent/system/SystemContext.h>
+
+namespace urpc
+{
+    using namespace usub::uvent;
+
+    static uint64_t next_random() noexcept
+    {
+        thread_local uint64_t state =
+            0x9E3779B97F4A7C15ull ^
+            reinterpret_cast<uintptr_t>(&state);
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    RpcMirror::RpcMirror(RpcMirrorConfig cfg)
+        : cfg_(std::move(cfg))
+          , queue_(cfg_.queue_capacity)
+          , wake_(std::make_shared<sync::AsyncEvent>(sync::Reset::Manual, false))
+    {
+        RpcClientConfig client_cfg;
+        client_cfg.host = this->cfg_.host;
+        client_cfg.port = this->cfg_.port;
+        client_cfg.stream_factory = this->cfg_.stream_factory;
+        this->client_ = std::make_shared<RpcClient>(std::move(client_cfg));
+
+#if URPC_LOGS
+        usub::ulog::info(
+            "RpcMirror: target={}:{} sample_percent={} queue_capacity={}",
+            this->cfg_.host,
+            this->cfg_.port,
+            this->cfg_.sample_percent,
+            this->queue_.capacity());
+#endif
+    }
+
+    bool RpcMirror::should_mirror(uint64_t method_id) const noexcept
+    {
+        if (this->cfg_.sample_percent == 0)
+            return false;
+
+        if (!this->cfg_.methods.empty() &&
+            !this->cfg_.methods.contains(method_id))
+            return false;
+
+        if (this->cfg_.sample_percent >= 100)
+            return true;
+
+        return next_random() % 100 < this->cfg_.sample_percent;
+    }
+
+    bool RpcMirror::offer(uint64_t method_id,
+                          std::shared_ptr<const void> owner,
+                          std::span<const uint8_t> body)
+    {
+        if (!this->queue_.try_push(Item{method_id, std::move(owner), body}))
+        {
+            this->dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        if (!this->started_.exchange(true, std::memory_order_acq_rel))
+        {
+            system::co_spawn(RpcMirror::drain_loop(this->shared_from_this()));
+        }
+        else if (this->parked_.exchange(false, std::memory_order_acq_rel))
+        {
+            this->wake_->set();
+        }
+
+        return true;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcMirror::drain_loop(std::shared_ptr<RpcMirror> self)
+    {
+        for (;;)
+        {
+            Item item;
+            while (self->queue_.try_pop(item))
+            {
+                if (self->inflight_.load(std::memory_order_relaxed) >=
+                    self->cfg_.max_inflight)
+                {
+                    self->dropped_.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                self->inflight_.fetch_add(1, std::memory_order_relaxed);
+                system::co_spawn(RpcMirror::send_one(self, std::move(item)));
+            }
+
+            self->parked_.store(true, std::memory_order_release);
+            if (!self->queue_.empty_approx() &&
+                self->parked_.exchange(false, std::memory_order_acq_rel))
+            {
+                continue;
+            }
+
+            co_await self->wake_->wait();
+            self->wake_->reset();
+        }
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcMirror::send_one(std::shared_ptr<RpcMirror> self, Item item)
+    {
+        auto res = co_await self->client_->try_call(
+            item.method_id, item.body, self->cfg_.timeout_ms);
+
+        self->inflight_.fetch_sub(1, std::memory_order_relaxed);
+        self->mirrored_.fetch_add(1, std::memory_order_relaxed);
+
+#if URPC_LOGS
+        if (!res.ok)
+        {
+            usub::ulog::debug(
+                "RpcMirror::send_one: mid={} failed code={} msg='{}'",
+                item.method_id,
+                res.error_code,
+                res.error_message);
+        }
+#endif
+        co_return;
+    }
+}
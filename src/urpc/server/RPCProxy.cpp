@@ -0,0 +1,600 @@
+#include <chrono>
+#include <cstring>
+#include <ranges>
+
+#include <urpc/server/RPCProxy.h>
+#include <urpc/connection/RPCWireHelpers.h>
+#include <urpc/crypto/AppCrypto.h>
+#include <urpc/crypto/CryptoPolicy.h>
+#include <urpc/crypto/CryptoPool.h>
+#include <urpc/server/RPCIdempotency.h>
+#include <urpc/transport/IOOps.h>
+#include <urpc/transport/TCPStreamFactory.h>
+#include <urpc/transport/TlsRpcStream.h>
+#include <urpc/utils/Endianness.h>
+#include <urpc/utils/Hash.h>
+
+namespace urpc
+{
+    using namespace usub::uvent;
+
+    void RpcRouteTable::add(uint64_t method_id, RpcClientPool* pool)
+    {
+        this->exact_[method_id] = pool;
+    }
+
+    void RpcRouteTable::add_range(uint64_t lo, uint64_t hi, RpcClientPool* pool)
+    {
+        if (lo > hi)
+            std::swap(lo, hi);
+        this->ranges_.push_back(Range{lo, hi, pool});
+    }
+
+    void RpcRouteTable::set_default(RpcClientPool* pool)
+    {
+        this->default_ = pool;
+    }
+
+    RpcClientPool* RpcRouteTable::find(uint64_t method_id) const
+    {
+        if (auto it = this->exact_.find(method_id); it != this->exact_.end())
+            return it->second;
+
+        for (const auto& r : this->ranges_)
+        {
+            if (method_id >= r.lo && method_id <= r.hi)
+                return r.pool;
+        }
+
+        return this->default_;
+    }
+
+    RpcProxyConnection::RpcProxyConnection(std::shared_ptr<IRpcStream> stream,
+                                           const RpcRouteTable& routes,
+                                           uint32_t upstream_timeout_ms,
+                                           std::shared_ptr<const RpcCryptoPolicy> crypto_policy)
+        : stream_(std::move(stream))
+          , routes_(routes)
+          , upstream_timeout_ms_(upstream_timeout_ms)
+          , crypto_policy_(std::move(crypto_policy))
+    {
+    }
+
+    bool RpcProxyConnection::should_encrypt(uint64_t method_id,
+                                            std::size_t size) const
+    {
+        if (!this->crypto_policy_)
+            return size != 0;
+        return this->crypto_policy_->should_encrypt(method_id, size);
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcProxyConnection::run_detached(std::shared_ptr<RpcProxyConnection> self)
+    {
+        if (!self)
+            co_return;
+        co_await self->loop();
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void> RpcProxyConnection::loop()
+    {
+        if (!this->stream_)
+            co_return;
+
+#if URPC_LOGS
+        usub::ulog::info(
+            "RpcProxyConnection::loop: started, this={}",
+            static_cast<void*>(this));
+#endif
+
+        bool crc_seen = false;
+
+        for (;;)
+        {
+            utils::DynamicBuffer head;
+            const bool ok_hdr = co_await read_exact(
+                *this->stream_, head, RpcFrameHeaderSize);
+            if (!ok_hdr || head.size() != RpcFrameHeaderSize)
+                break;
+
+            RpcFrameHeader hdr = parse_header(
+                reinterpret_cast<const uint8_t*>(head.data()));
+
+            if (hdr.magic != 0x55525043 || hdr.version != 1 ||
+                hdr.length > kMaxFrameBodyLength)
+            {
+#if URPC_LOGS
+                usub::ulog::warn(
+                    "RpcProxyConnection::loop: invalid header "
+                    "(magic={} ver={} len={}), dropping connection",
+                    static_cast<unsigned>(hdr.magic),
+                    static_cast<unsigned>(hdr.version),
+                    hdr.length);
+#endif
+                break;
+            }
+
+            RpcFrame frame;
+            frame.header = hdr;
+
+            if (hdr.length > 0)
+            {
+                const bool ok_body = co_await read_exact(
+                    *this->stream_, frame.payload, hdr.length);
+                if (!ok_body || frame.payload.size() != hdr.length)
+                    break;
+            }
+
+            if (!co_await read_frame_crc(
+                *this->stream_, hdr,
+                reinterpret_cast<const uint8_t*>(head.data()),
+                std::span<const uint8_t>(
+                    reinterpret_cast<const uint8_t*>(frame.payload.data()),
+                    frame.payload.size()),
+                crc_seen))
+            {
+#if URPC_LOGS
+                usub::ulog::warn(
+                    "RpcProxyConnection::loop: CRC32C mismatch sid={}, "
+                    "dropping connection",
+                    hdr.stream_id);
+#endif
+                break;
+            }
+
+            // The proxy never agrees to compression with its clients, so a
+            // compressed frame here is a protocol error.
+            if (!inflate_frame(*this->stream_, frame.header, frame.payload))
+                break;
+
+            switch (static_cast<FrameType>(hdr.type))
+            {
+            case FrameType::Request:
+                system::co_spawn(RpcProxyConnection::forward_detached(
+                    this->shared_from_this(), std::move(frame)));
+                break;
+
+            case FrameType::Cancel:
+                co_await this->relay_cancel(frame);
+                break;
+
+            case FrameType::Ping:
+                co_await this->reply_pong(frame);
+                break;
+
+            default:
+#if URPC_LOGS
+                usub::ulog::warn(
+                    "RpcProxyConnection::loop: unexpected frame type={} sid={}, "
+                    "dropping connection",
+                    static_cast<int>(hdr.type),
+                    hdr.stream_id);
+#endif
+                this->stream_->shutdown();
+                co_return;
+            }
+        }
+
+        this->stream_->shutdown();
+
+        // Downstream is gone: cancel everything still in flight upstream.
+        std::unordered_map<uint32_t, InFlight> orphaned;
+        {
+            auto guard = co_await this->inflight_mutex_.lock();
+            orphaned.swap(this->inflight_);
+        }
+        for (auto& entry : orphaned | std::views::values)
+            co_await entry.client->cancel_call(entry.handle);
+
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcProxyConnection::forward_detached(
+        std::shared_ptr<RpcProxyConnection> self,
+        RpcFrame frame)
+    {
+        co_await self->forward(std::move(frame));
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcProxyConnection::forward(RpcFrame frame)
+    {
+        const uint32_t sid = frame.header.stream_id;
+        const uint64_t mid = frame.header.method_id;
+
+        // The downstream hop follows the proxy's own policy, so the proxy
+        // answers the policy request instead of routing it upstream.
+        if (this->crypto_policy_ && mid == fnv1a64_rt(kCryptoPolicyMethod) &&
+            (frame.header.flags & FLAG_ONEWAY) == 0)
+        {
+            RpcFrameHeader hdr{};
+            hdr.magic = 0x55525043;
+            hdr.version = 1;
+            hdr.type = static_cast<uint8_t>(FrameType::Response);
+            hdr.flags = FLAG_END_STREAM;
+            hdr.stream_id = sid;
+            hdr.method_id = mid;
+            const std::vector<uint8_t> table = this->crypto_policy_->serialize();
+            co_await this->send_downstream(hdr, table);
+            co_return;
+        }
+
+        // Same gate as RpcConnection::handle_request, checked before routing
+        // so a policy-violating request never reaches an upstream.
+        if ((frame.header.flags & FLAG_ENCRYPTED) == 0 &&
+            this->crypto_policy_ &&
+            get_cipher_for_stream(this->stream_.get()) &&
+            this->crypto_policy_->should_encrypt(mid, frame.payload.size()))
+        {
+            co_await this->send_error(
+                frame.header, 400, "Encryption required by policy");
+            co_return;
+        }
+
+        RpcClientPool* pool = this->routes_.find(mid);
+        if (!pool)
+        {
+            co_await this->send_error(frame.header, 404, "No route for method");
+            co_return;
+        }
+
+        std::span<const uint8_t> body{
+            reinterpret_cast<const uint8_t*>(frame.payload.data()),
+            frame.payload.size(),
+        };
+
+        // Each hop has its own app key, so encrypted bodies must be opened
+        // here and resealed by the upstream client. Plain bodies are passed
+        // through from the read buffer as-is.
+        std::vector<uint8_t> decrypted;
+        if (frame.header.flags & FLAG_ENCRYPTED)
+        {
+            const AppCipherContext* cipher =
+                get_cipher_for_stream(this->stream_.get());
+            if (!cipher ||
+                !RpcCryptoPool::open_inline(*cipher, body, frame.header.flags,
+                                            decrypted))
+            {
+                co_await this->send_error(
+                    frame.header, 400, "Failed to decrypt request");
+                co_return;
+            }
+            body = std::span<const uint8_t>{decrypted.data(), decrypted.size()};
+        }
+
+        // Upstream sees every downstream caller as this proxy, so the key
+        // is replaced by one that also names the caller. body points into
+        // a buffer this frame owns either way.
+        if (frame.header.flags & FLAG_IDEMPOTENCY_KEY)
+        {
+            if (body.size() < kIdempotencyKeySize ||
+                !this->stream_->idempotency_keys())
+            {
+                co_await this->send_error(
+                    frame.header, 400, "Malformed or unnegotiated idempotency key");
+                co_return;
+            }
+            uint8_t* key_at = const_cast<uint8_t*>(body.data());
+            uint64_t key = 0;
+            std::memcpy(&key, key_at, kIdempotencyKeySize);
+            key = host_to_be(scoped_idempotency_key(
+                idempotency_scope(*this->stream_, this), be_to_host(key)));
+            std::memcpy(key_at, &key, kIdempotencyKeySize);
+        }
+
+        auto lease = pool->try_acquire();
+        RpcClient& client = lease.get();
+
+        if (frame.header.flags & FLAG_ONEWAY)
+        {
+            // notify() sends no flags, so the key cannot travel with it.
+            if (frame.header.flags & FLAG_IDEMPOTENCY_KEY)
+                body = body.subspan(kIdempotencyKeySize);
+            co_await client.notify(mid, body);
+            co_return;
+        }
+
+        // Placeholder (no client yet): a Cancel that arrives while the
+        // upstream call is being started removes it, and is acted on below.
+        {
+            auto guard = co_await this->inflight_mutex_.lock();
+            this->inflight_[sid] = InFlight{};
+        }
+
+        RpcCallHandle h = co_await client.start_forward(
+            mid, frame.header.flags, body, this->upstream_timeout_ms_);
+
+        bool cancelled = false;
+        {
+            auto guard = co_await this->inflight_mutex_.lock();
+            auto it = this->inflight_.find(sid);
+            if (it == this->inflight_.end() || it->second.client != nullptr)
+                cancelled = true;
+            else if (!h)
+                this->inflight_.erase(it);
+            else
+                it->second = InFlight{&client, h};
+        }
+
+        if (cancelled)
+        {
+            if (h)
+                co_await client.cancel_call(h);
+            co_return;
+        }
+
+        if (!h)
+        {
+            co_await this->send_error(frame.header, 503, "Upstream unavailable");
+            co_return;
+        }
+
+        co_await client.wait_forward(h);
+
+        {
+            auto guard = co_await this->inflight_mutex_.lock();
+            auto it = this->inflight_.find(sid);
+            if (it == this->inflight_.end() || it->second.handle.call != h.call)
+            {
+                // Cancelled by the downstream peer; nothing to send.
+                co_return;
+            }
+            this->inflight_.erase(it);
+        }
+
+        PendingCall& call = *h.call;
+
+        if (call.timed_out.load(std::memory_order_acquire))
+        {
+            co_await this->send_error(frame.header, 504, "Upstream timed out");
+            co_return;
+        }
+
+        if (call.error)
+        {
+            co_await this->send_error(frame.header, 502, call.error_message);
+            co_return;
+        }
+
+        RpcFrameHeader hdr{};
+        hdr.magic = 0x55525043;
+        hdr.version = 1;
+        hdr.type = static_cast<uint8_t>(FrameType::Response);
+        hdr.flags = call.raw_flags;
+        hdr.stream_id = sid;
+        hdr.method_id = mid;
+
+        co_await this->send_downstream(
+            hdr,
+            std::span<const uint8_t>{
+                reinterpret_cast<const uint8_t*>(call.raw_payload.data()),
+                call.raw_payload.size(),
+            });
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcProxyConnection::relay_cancel(const RpcFrame& frame)
+    {
+        InFlight entry;
+        {
+            auto guard = co_await this->inflight_mutex_.lock();
+            auto it = this->inflight_.find(frame.header.stream_id);
+            if (it == this->inflight_.end())
+                co_return;
+            entry = std::move(it->second);
+            this->inflight_.erase(it);
+        }
+
+        // Upstream call not started yet; forward() sees the missing entry.
+        if (!entry.client)
+            co_return;
+
+#if URPC_LOGS
+        usub::ulog::debug(
+            "RpcProxyConnection::relay_cancel: downstream sid={} -> "
+            "upstream sid={}",
+            frame.header.stream_id,
+            entry.handle.stream_id);
+#endif
+        co_await entry.client->cancel_call(entry.handle);
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcProxyConnection::reply_pong(const RpcFrame& frame)
+    {
+        RpcFrameHeader hdr{};
+        hdr.magic = 0x55525043;
+        hdr.version = 1;
+        hdr.type = static_cast<uint8_t>(FrameType::Pong);
+        hdr.flags = FLAG_END_STREAM;
+        hdr.stream_id = frame.header.stream_id;
+        hdr.method_id = frame.header.method_id;
+
+        if ((frame.header.flags & FLAG_CRC32C) &&
+            dynamic_cast<TlsRpcStream*>(this->stream_.get()) == nullptr)
+        {
+            this->stream_->enable_frame_crc(true);
+            hdr.flags |= FLAG_CRC32C;
+        }
+
+        // Keys are re-scoped here (see forward) and agreed per upstream
+        // link when a keyed request is first sent there.
+        if (frame.header.flags & FLAG_IDEMPOTENCY_KEY)
+        {
+            this->stream_->enable_idempotency_keys(true);
+            hdr.flags |= FLAG_IDEMPOTENCY_KEY;
+        }
+
+        co_await this->send_downstream(hdr, {});
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcProxyConnection::send_downstream(RpcFrameHeader hdr,
+                                        std::span<const uint8_t> body)
+    {
+        hdr.flags = static_cast<uint16_t>(
+            (hdr.flags & ~(FLAG_TLS | FLAG_MTLS | FLAG_ENCRYPTED | FLAG_CHUNKED)) |
+            build_security_flags(this->stream_.get(),
+                                 this->stream_->peer_identity()));
+        hdr.length = static_cast<uint32_t>(body.size());
+
+        std::vector<uint8_t> enc_buf;
+        const AppCipherContext* cipher =
+            get_cipher_for_stream(this->stream_.get());
+
+        if (cipher && this->should_encrypt(hdr.method_id, body.size()))
+        {
+            if (!app_encrypt(*cipher, body, enc_buf))
+            {
+#if URPC_LOGS
+                usub::ulog::error(
+                    "RpcProxyConnection: app_encrypt failed sid={}; "
+                    "failing closed",
+                    hdr.stream_id);
+#endif
+                this->stream_->shutdown();
+                co_return;
+            }
+            hdr.flags |= FLAG_ENCRYPTED;
+            hdr.length = static_cast<uint32_t>(enc_buf.size());
+            body = std::span<const uint8_t>{enc_buf.data(), enc_buf.size()};
+        }
+
+        auto guard = co_await this->write_mutex_.lock();
+        if (!(co_await send_frame(*this->stream_, hdr, body)))
+            this->stream_->shutdown();
+        co_return;
+    }
+
+    usub::uvent::task::Awaitable<void>
+    RpcProxyConnection::send_error(const RpcFrameHeader& request,
+                                   uint32_t code,
+                                   std::string_view message)
+    {
+        // One-way requests never get a reply, not even an error.
+        if (request.flags & FLAG_ONEWAY)
+            co_return;
+
+        const std::vector<uint8_t> buf = build_error_body(code, message);
+
+        RpcFrameHeader hdr{};
+        hdr.magic = 0x55525043;
+        hdr.version = 1;
+        hdr.type = static_cast<uint8_t>(FrameType::Response);
+        hdr.flags = FLAG_END_STREAM | FLAG_ERROR;
+        hdr.stream_id = request.stream_id;
+        hdr.method_id = request.method_id;
+
+#if URPC_LOGS
+        usub::ulog::warn(
+            "RpcProxyConnection::send_error: sid={} mid={} code={} msg='{}'",
+            request.stream_id, request.method_id, code, message);
+#endif
+        co_await this->send_downstream(hdr, buf);
+        co_return;
+    }
+
+    RpcProxy::RpcProxy(RpcProxyConfig cfg)
+        : config_(std::move(cfg))
+    {
+        if (!this->config_.stream_factory)
+        {
+            if (this->config_.timeout_ms > 0)
+            {
+                this->config_.stream_factory =
+                    std::make_shared<TcpRpcStreamFactory>(
+                        this->config_.timeout_ms);
+            }
+            else
+            {
+                this->config_.stream_factory =
+                    std::make_shared<TcpRpcStreamFactory>();
+            }
+        }
+    }
+
+    void RpcProxy::route(uint64_t method_id, RpcClientPool* pool)
+    {
+        this->routes_.add(method_id, pool);
+    }
+
+    void RpcProxy::route(std::string_view name, RpcClientPool* pool)
+    {
+        this->routes_.add(fnv1a64_rt(name), pool);
+    }
+
+    void RpcProxy::route_range(uint64_t lo, uint64_t hi, RpcClientPool* pool)
+    {
+        this->routes_.add_range(lo, hi, pool);
+    }
+
+    void RpcProxy::set_default_route(RpcClientPool* pool)
+    {
+        this->routes_.set_default(pool);
+    }
+
+    usub::uvent::task::Awaitable<void> RpcProxy::run_async()
+    {
+        co_await this->accept_loop();
+        co_return;
+    }
+
+    void RpcProxy::attach(usub::Uvent& uvent)
+    {
+        uvent.for_each_thread([this](int threadIndex, thread::ThreadLocalStorage*)
+        {
+            system::co_spawn_static(this->run_async(), threadIndex);
+        });
+    }
+
+    void RpcProxy::run()
+    {
+        usub::Uvent uvent(this->config_.threads);
+        this->attach(uvent);
+        uvent.run();
+    }
+
+    usub::uvent::task::Awaitable<void> RpcProxy::accept_loop()
+    {
+        using namespace std::chrono_literals;
+
+        net::TCPServerSocket acceptor{
+            this->config_.host.c_str(), this->config_.port
+        };
+
+#if URPC_LOGS
+        usub::ulog::info(
+            "RpcProxy: accept_loop started on {}:{}",
+            this->config_.host,
+            this->config_.port);
+#endif
+
+        for (;;)
+        {
+            auto soc = co_await acceptor.async_accept();
+            if (!soc)
+            {
+                co_await system::this_coroutine::sleep_for(50ms);
+                continue;
+            }
+
+            auto stream =
+                co_await this->config_.stream_factory->create_server_stream(
+                    std::move(soc.value()));
+            if (!stream)
+                continue;
+
+            auto conn = std::make_shared<RpcProxyConnection>(
+                stream, this->routes_, this->config_.upstream_timeout_ms,
+                this->config_.crypto_policy);
+
+            system::co_spawn(RpcProxyConnection::run_detached(conn));
+        }
+    }
+}
@@ -0,0 +1,225 @@
+#include <urpc/server/RPCResponseCache.h>
+
+#include <chrono>
+#include <cstring>
+
+#include <urpc/utils/Hash.h>
+
+#if URPC_LOGS
+#include <ulog/ulog.h>
+#endif
+
+namespace urpc
+{
+    namespace
+    {
+        // Bookkeeping charged per memory entry on top of its bytes.
+        constexpr std::size_t kEntryOverhead = 128;
+
+        std::size_t entry_cost(std::size_t req, std::size_t resp)
+        {
+            return req + resp + kEntryOverhead;
+        }
+    }
+
+    RpcResponseCache::RpcResponseCache(RpcResponseCacheConfig cfg)
+        : cfg_(std::move(cfg))
+    {
+        if (!this->cfg_.disk.path.empty())
+            this->disk_ = RpcDiskCache::open(this->cfg_.disk);
+#if URPC_LOGS
+        if (!this->cfg_.disk.path.empty() && !this->disk_)
+            usub::ulog::error(
+                "RpcResponseCache: cannot open disk tier at {}; "
+                "continuing with memory only",
+                this->cfg_.disk.path);
+#endif
+    }
+
+    void RpcResponseCache::cache_method(uint64_t method_id, uint32_t ttl_ms)
+    {
+        this->methods_[method_id] = ttl_ms;
+    }
+
+    bool RpcResponseCache::caches(uint64_t method_id) const noexcept
+    {
+        return this->methods_.contains(method_id);
+    }
+
+    uint64_t RpcResponseCache::make_key(uint64_t method_id,
+                                        std::span<const uint8_t> request) noexcept
+    {
+        uint64_t h = FNV_OFFSET ^ method_id;
+        for (uint8_t c : request)
+        {
+            h ^= c;
+            h *= FNV_PRIME;
+        }
+        return h;
+    }
+
+    uint64_t RpcResponseCache::now_ms() noexcept
+    {
+        // Wall clock, since disk entries outlive the process.
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    uint64_t RpcResponseCache::expiry_for(uint64_t method_id, uint64_t now) const
+    {
+        auto it = this->methods_.find(method_id);
+        if (it == this->methods_.end() || it->second == 0)
+            return 0;
+        return now + it->second;
+    }
+
+    RpcCachedResponse RpcResponseCache::lookup(uint64_t method_id,
+                                               std::span<const uint8_t> request)
+    {
+        const uint64_t key = make_key(method_id, request);
+        const uint64_t now = now_ms();
+
+        if (auto hit = this->memory_get(key, method_id, request, now))
+        {
+            this->memory_hits_.fetch_add(1, std::memory_order_relaxed);
+            return hit;
+        }
+
+        if (this->disk_)
+        {
+            if (auto hit = this->disk_->get(key, method_id, request, now))
+            {
+                this->disk_hits_.fetch_add(1, std::memory_order_relaxed);
+                if (this->cfg_.memory_bytes > 0 &&
+                    hit.body.size() <= this->cfg_.memory_max_entry_bytes)
+                {
+                    auto e = std::make_shared<Entry>();
+                    e->key = key;
+                    e->method_id = method_id;
+                    // Keeps the disk entry's expiry: promotion is not a
+                    // fresh store.
+                    e->expires_ms = hit.expires_ms;
+                    e->request.assign(request.begin(), request.end());
+                    e->response.assign(hit.body.begin(), hit.body.end());
+                    this->memory_put(std::move(e));
+                }
+                return hit;
+            }
+        }
+
+        this->misses_.fetch_add(1, std::memory_order_relaxed);
+        return {};
+    }
+
+    void RpcResponseCache::store(uint64_t method_id,
+                                 std::span<const uint8_t> request,
+                                 std::span<const uint8_t> response)
+    {
+        const uint64_t key = make_key(method_id, request);
+        const uint64_t expires = this->expiry_for(method_id, now_ms());
+        bool stored = false;
+
+        if (this->cfg_.memory_bytes > 0 &&
+            response.size() <= this->cfg_.memory_max_entry_bytes)
+        {
+            auto e = std::make_shared<Entry>();
+            e->key = key;
+            e->method_id = method_id;
+            e->expires_ms = expires;
+            e->request.assign(request.begin(), request.end());
+            e->response.assign(response.begin(), response.end());
+            this->memory_put(std::move(e));
+            stored = true;
+        }
+
+        if (this->disk_ &&
+            this->disk_->put(key, method_id, request, response, expires))
+            stored = true;
+
+        if (stored)
+            this->stores_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    RpcCachedResponse RpcResponseCache::memory_get(uint64_t key,
+                                                   uint64_t method_id,
+                                                   std::span<const uint8_t> request,
+                                                   uint64_t now)
+    {
+        std::lock_guard lk(this->mutex_);
+        auto it = this->index_.find(key);
+        if (it == this->index_.end())
+            return {};
+
+        std::shared_ptr<const Entry> e = *it->second;
+        if (e->expires_ms != 0 && e->expires_ms <= now)
+        {
+            this->memory_used_ -= entry_cost(e->request.size(), e->response.size());
+            this->lru_.erase(it->second);
+            this->index_.erase(it);
+            return {};
+        }
+        if (e->method_id != method_id ||
+            e->request.size() != request.size() ||
+            (!request.empty() &&
+             std::memcmp(e->request.data(), request.data(), request.size()) != 0))
+            return {};
+
+        this->lru_.splice(this->lru_.begin(), this->lru_, it->second);
+
+        std::span<const uint8_t> body{e->response.data(), e->response.size()};
+        const uint64_t expires = e->expires_ms;
+        return RpcCachedResponse{.body = body, .pin = std::move(e), .expires_ms = expires};
+    }
+
+    void RpcResponseCache::memory_put(std::shared_ptr<const Entry> e)
+    {
+        const std::size_t cost = entry_cost(e->request.size(), e->response.size());
+        if (cost > this->cfg_.memory_bytes)
+            return;
+
+        std::lock_guard lk(this->mutex_);
+        if (auto it = this->index_.find(e->key); it != this->index_.end())
+        {
+            const auto& old = *it->second;
+            this->memory_used_ -= entry_cost(old->request.size(), old->response.size());
+            this->lru_.erase(it->second);
+            this->index_.erase(it);
+        }
+
+        while (!this->lru_.empty() &&
+               this->memory_used_ + cost > this->cfg_.memory_bytes)
+        {
+            const auto& victim = this->lru_.back();
+            this->memory_used_ -= entry_cost(victim->request.size(),
+                                             victim->response.size());
+            this->index_.erase(victim->key);
+            this->lru_.pop_back();
+        }
+
+        const uint64_t key = e->key;
+        this->lru_.push_front(std::move(e));
+        this->index_[key] = this->lru_.begin();
+        this->memory_used_ += cost;
+    }
+
+    void RpcResponseCache::clear_memory()
+    {
+        std::lock_guard lk(this->mutex_);
+        this->lru_.clear();
+        this->index_.clear();
+        this->memory_used_ = 0;
+    }
+
+    void RpcResponseCache::flush()
+    {
+        if (this->disk_)
+            this->disk_->flush();
+    }
+
+    std::size_t RpcResponseCache::memory_used() const
+    {
+        std::lock_guard lk(this->mutex_);
+        return this->memory_used_;
+    }
+}
@@ -1,6 +1,7 @@
 #include <chrono>
 
 #include <urpc/server/RPCServer.h>
+#include <urpc/crypto/CryptoPolicy.h>
 #include <urpc/transport/TCPStreamFactory.h>
 
 namespace urpc
@@ -30,6 +31,23 @@ namespace urpc
             this->config_.threads,
             this->config_.timeout_ms);
 #endif
+        this->registry_.register_method(
+            kSubscribeMethod, &RpcTopicRegistry::handle_subscribe);
+        this->registry_.register_method(
+            kUnsubscribeMethod, &RpcTopicRegistry::handle_unsubscribe);
+
+        if (this->config_.crypto_policy)
+        {
+            this->registry_.register_method(
+                kCryptoPolicyMethod,
+                [table = this->config_.crypto_policy->serialize()](
+                    RpcContext&, std::span<const uint8_t>)
+                    -> usub::uvent::task::Awaitable<std::vector<uint8_t>>
+                {
+                    co_return table;
+                });
+        }
+
         if (!this->config_.stream_factory)
         {
             if (this->config_.timeout_ms > 0)
@@ -77,6 +95,41 @@ namespace urpc
         this->registry_.register_method(name, fn);
     }
 
+    usub::uvent::task::Awaitable<std::size_t> RpcServer::publish(
+        std::string_view topic,
+        std::span<const uint8_t> body)
+    {
+        auto shared = std::make_shared<const std::vector<uint8_t>>(
+            body.begin(), body.end());
+        co_return co_await this->publish(topic, std::move(shared));
+    }
+
+    usub::uvent::task::Awaitable<std::size_t> RpcServer::publish(
+        std::string_view topic,
+        std::shared_ptr<const std::vector<uint8_t>> body)
+    {
+        if (!body)
+            co_return 0;
+
+        const uint64_t topic_id = fnv1a64_rt(topic);
+        auto subs = co_await this->topics_.subscribers(topic_id);
+
+#if URPC_LOGS
+        usub::ulog::debug(
+            "RpcServer::publish: topic={} id={} subscribers={} size={}",
+            topic, topic_id, subs.size(), body->size());
+#endif
+
+        for (auto& conn : subs)
+        {
+            usub::uvent::system::co_spawn(
+                RpcConnection::send_oneway_detached(
+                    std::move(conn), topic_id, body));
+        }
+
+        co_return subs.size();
+    }
+
     usub::uvent::task::Awaitable<void> RpcServer::run_async()
     {
 #if URPC_LOGS
@@ -96,6 +149,18 @@ namespace urpc
         co_return;
     }
 
+    void RpcServer::attach(usub::Uvent& uvent)
+    {
+#if URPC_LOGS
+        usub::ulog::debug(
+            "RpcServer::attach: spawning run_async on every uvent thread");
+#endif
+        uvent.for_each_thread([this](int threadIndex, thread::ThreadLocalStorage*)
+        {
+            system::co_spawn_static(this->run_async(), threadIndex);
+        });
+    }
+
     void RpcServer::run()
     {
 #if URPC_LOGS
@@ -106,16 +171,7 @@ namespace urpc
 #endif
 
         usub::Uvent uvent(this->config_.threads);
-
-#if URPC_LOGS
-        usub::ulog::debug(
-            "RpcServer::run: spawning run_async coroutine");
-#endif
-        uvent.for_each_thread([&](int threadIndex, thread::ThreadLocalStorage* tls)
-        {
-            system::co_spawn_static(this->run_async(), threadIndex);
-        });
-
+        this->attach(uvent);
         uvent.run();
 #if URPC_LOGS
         usub::ulog::warn("RpcServer::run finished");
@@ -207,7 +263,20 @@ namespace urpc
             }
 
             auto conn = std::make_shared<RpcConnection>(
-                stream, this->registry_, this->config_.on_request_cancelled);
+                stream,
+                this->registry_,
+                this->config_.on_request_cancelled,
+                &this->topics_,
+                this->config_.mirror.get(),
+                this->config_.crypto_policy.get(),
+                this->config_.crypto_pool.get(),
+                this->config_.load_tracker.get(),
+                this->config_.limits,
+                this->config_.memory_budget.get(),
+                this->config_.response_cache.get(),
+                this->config_.idempotency.get(),
+                this->config_.method_stats.get(),
+                this->stats_.get());
 
 #if URPC_LOGS
             usub::ulog::info(
@@ -63,6 +63,11 @@ namespace urpc
         return nullptr;
     }
 
+    std::string TcpRpcStream::peer_address() const
+    {
+        return socket_peer_ip(this->socket_.get_raw_header()->fd);
+    }
+
     void TcpRpcStream::shutdown()
     {
 #if URPC_LOGS
@@ -9,6 +9,10 @@
 #include <openssl/evp.h>
 #include <openssl/rand.h>
 
+#include <cstring>
+#include <string>
+#include <string_view>
+
 namespace urpc
 {
     using namespace usub::uvent;
@@ -115,6 +119,100 @@ namespace urpc
         return pem;
     }
 
+    // App ciphers are agreed through ALPN: the client offers the ones it
+    // accepts, the server picks one or fails the handshake. Peers that do
+    // not offer or answer these ids fall back to the configured / Auto
+    // choice, as before.
+    static std::string_view app_cipher_alpn(AppCipherSuite suite)
+    {
+        return suite == AppCipherSuite::ChaCha20Poly1305
+                   ? std::string_view{"urpc/chacha20-poly1305"}
+                   : std::string_view{"urpc/aes-256-gcm"};
+    }
+
+    static bool parse_app_cipher_alpn(std::string_view id, AppCipherSuite& out)
+    {
+        for (AppCipherSuite s : {AppCipherSuite::Aes256Gcm,
+                                 AppCipherSuite::ChaCha20Poly1305})
+        {
+            if (id == app_cipher_alpn(s))
+            {
+                out = s;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Indexed by AppCipherSuite; handed to the select callback as its arg.
+    static const AppCipherSuite kServerAppCiphers[] = {
+        AppCipherSuite::Auto,
+        AppCipherSuite::Aes256Gcm,
+        AppCipherSuite::ChaCha20Poly1305,
+    };
+
+    static int select_app_cipher(SSL* ssl,
+                                 const unsigned char** out,
+                                 unsigned char* outlen,
+                                 const unsigned char* in,
+                                 unsigned int inlen,
+                                 void* arg)
+    {
+        const AppCipherSuite want = *static_cast<const AppCipherSuite*>(arg);
+
+        const unsigned char* offered[3] = {};
+        unsigned char offered_len[3] = {};
+        std::string offers;
+        for (unsigned int i = 0; i < inlen;)
+        {
+            const unsigned char len = in[i];
+            if (len == 0 || i + 1 + len > inlen)
+                break;
+            const std::string_view id{
+                reinterpret_cast<const char*>(in + i + 1), len};
+            AppCipherSuite s{};
+            if (parse_app_cipher_alpn(id, s))
+            {
+                offered[static_cast<std::size_t>(s)] = in + i + 1;
+                offered_len[static_cast<std::size_t>(s)] = len;
+                if (!offers.empty())
+                    offers += ", ";
+                offers += app_cipher_name(s);
+            }
+            i += 1u + len;
+        }
+        if (offers.empty())
+            return SSL_TLSEXT_ERR_NOACK;
+
+        AppCipherSuite pick = want;
+        if (pick == AppCipherSuite::Auto)
+        {
+            const SSL_CIPHER* tls_cipher = SSL_get_pending_cipher(ssl);
+            const char* name = tls_cipher ? SSL_CIPHER_get_name(tls_cipher)
+                                          : nullptr;
+            const bool chacha = name && std::strstr(name, "CHACHA20");
+            const auto aes_i = static_cast<std::size_t>(AppCipherSuite::Aes256Gcm);
+            const auto chacha_i =
+                static_cast<std::size_t>(AppCipherSuite::ChaCha20Poly1305);
+            pick = (chacha && offered[chacha_i]) || !offered[aes_i]
+                       ? AppCipherSuite::ChaCha20Poly1305
+                       : AppCipherSuite::Aes256Gcm;
+        }
+
+        const auto idx = static_cast<std::size_t>(pick);
+        if (!offered[idx])
+        {
+            usub::ulog::error(
+                "TlsRpcStream: app cipher mismatch: server requires {}, "
+                "client offers {}; failing the handshake",
+                app_cipher_name(pick), offers);
+            return SSL_TLSEXT_ERR_ALERT_FATAL;
+        }
+        *out = offered[idx];
+        *outlen = offered_len[idx];
+        return SSL_TLSEXT_ERR_OK;
+    }
+
     static std::shared_ptr<SSL_CTX> make_client_ctx(const TlsClientConfig& cfg)
     {
         const SSL_METHOD* method = TLS_client_method();
@@ -175,6 +273,39 @@ namespace urpc
         else
             SSL_CTX_set_verify(ctx.get(), SSL_VERIFY_NONE, nullptr);
 
+        if (cfg.app_cipher == AppCipherSuite::ChaCha20Poly1305)
+        {
+            if (SSL_CTX_set_ciphersuites(
+                ctx.get(),
+                "TLS_CHACHA20_POLY1305_SHA256:"
+                "TLS_AES_256_GCM_SHA384:"
+                "TLS_AES_128_GCM_SHA256") != 1)
+            {
+                log_last_ssl_error("SSL_CTX_set_ciphersuites(client)");
+            }
+        }
+
+        if (cfg.app_encryption)
+        {
+            std::string protos;
+            auto offer = [&protos](AppCipherSuite s) {
+                const std::string_view id = app_cipher_alpn(s);
+                protos.push_back(static_cast<char>(id.size()));
+                protos.append(id);
+            };
+            if (cfg.app_cipher != AppCipherSuite::ChaCha20Poly1305)
+                offer(AppCipherSuite::Aes256Gcm);
+            if (cfg.app_cipher != AppCipherSuite::Aes256Gcm)
+                offer(AppCipherSuite::ChaCha20Poly1305);
+            if (SSL_CTX_set_alpn_protos(
+                ctx.get(),
+                reinterpret_cast<const unsigned char*>(protos.data()),
+                static_cast<unsigned int>(protos.size())) != 0)
+            {
+                log_last_ssl_error("SSL_CTX_set_alpn_protos(client)");
+            }
+        }
+
         return ctx;
     }
 
@@ -235,6 +366,18 @@ namespace urpc
             SSL_CTX_set_verify(ctx.get(), SSL_VERIFY_NONE, nullptr);
         }
 
+        if (cfg.app_cipher == AppCipherSuite::Auto)
+            SSL_CTX_set_options(ctx.get(), SSL_OP_PRIORITIZE_CHACHA);
+
+        if (cfg.app_encryption)
+        {
+            SSL_CTX_set_alpn_select_cb(
+                ctx.get(),
+                &select_app_cipher,
+                const_cast<AppCipherSuite*>(
+                    &kServerAppCiphers[static_cast<std::size_t>(cfg.app_cipher)]));
+        }
+
         return ctx;
     }
 
@@ -374,7 +517,62 @@ namespace urpc
 
     bool TlsRpcStream::derive_app_key()
     {
-        return false;
+        AppCipherSuite suite = this->mode_ == Mode::Client
+                                   ? this->client_cfg_.app_cipher
+                                   : this->server_cfg_.app_cipher;
+
+        // A cipher agreed through ALPN wins over both the configured one
+        // and Auto.
+        const unsigned char* alpn = nullptr;
+        unsigned int alpn_len = 0;
+        SSL_get0_alpn_selected(this->ssl_, &alpn, &alpn_len);
+        if (alpn_len > 0)
+        {
+            parse_app_cipher_alpn(
+                std::string_view{reinterpret_cast<const char*>(alpn), alpn_len},
+                suite);
+        }
+
+        if (suite == AppCipherSuite::Auto)
+        {
+            const SSL_CIPHER* tls_cipher = SSL_get_current_cipher(this->ssl_);
+            const char* name = tls_cipher ? SSL_CIPHER_get_name(tls_cipher)
+                                          : nullptr;
+            suite = (name && std::strstr(name, "CHACHA20"))
+                        ? AppCipherSuite::ChaCha20Poly1305
+                        : AppCipherSuite::Aes256Gcm;
+        }
+
+        // AES-256-GCM keeps the original context-free derivation so it
+        // interoperates with older peers. Other suites mix their name into
+        // the exporter context: peers that disagree on the suite end up
+        // with different keys and fail authentication instead of decoding
+        // with the wrong algorithm.
+        static const char kLabel[] = "urpc_app_key_v1";
+        const char* context = app_cipher_name(suite);
+        const bool use_context = suite != AppCipherSuite::Aes256Gcm;
+
+        std::array<uint8_t, 32> key{};
+        const int ok = SSL_export_keying_material(
+            this->ssl_,
+            key.data(),
+            key.size(),
+            kLabel,
+            sizeof(kLabel) - 1,
+            use_context ? reinterpret_cast<const unsigned char*>(context)
+                        : nullptr,
+            use_context ? std::strlen(context) : 0,
+            use_context ? 1 : 0);
+        if (ok != 1)
+        {
+            this->app_cipher_.valid = false;
+            return false;
+        }
+
+        this->app_cipher_.key = key;
+        this->app_cipher_.suite = suite;
+        this->app_cipher_.valid = true;
+        return true;
     }
 
     usub::uvent::task::Awaitable<bool> TlsRpcStream::flush_wbio()
@@ -475,24 +673,12 @@ namespace urpc
 #endif
                 this->fill_peer_identity();
 
-                static const char kLabel[] = "urpc_app_key_v1";
-                std::array<uint8_t, 32> key{};
-                int ok = SSL_export_keying_material(
-                    this->ssl_,
-                    key.data(),
-                    static_cast<size_t>(key.size()),
-                    kLabel,
-                    sizeof(kLabel) - 1,
-                    nullptr,
-                    0,
-                    0);
-                if (ok == 1)
+                if (this->derive_app_key())
                 {
-                    this->app_cipher_.key = key;
-                    this->app_cipher_.valid = true;
 #if URPC_LOGS
                     usub::ulog::info(
-                        "TlsRpcStream::do_handshake: app key derived (AES-256-GCM)");
+                        "TlsRpcStream::do_handshake: app key derived ({})",
+                        app_cipher_name(this->app_cipher_.suite));
 #endif
                 }
                 else
@@ -502,7 +688,6 @@ namespace urpc
                         "TlsRpcStream::do_handshake: SSL_export_keying_material failed, "
                         "app-level encryption disabled");
 #endif
-                    this->app_cipher_.valid = false;
                 }
 
                 co_return true;
@@ -516,6 +701,15 @@ namespace urpc
                 continue;
             }
 
+            if (this->mode_ == Mode::Client &&
+                ERR_GET_REASON(ERR_peek_error()) ==
+                SSL_R_TLSV1_ALERT_NO_APPLICATION_PROTOCOL)
+            {
+                usub::ulog::error(
+                    "TlsRpcStream: server rejected app cipher {}; "
+                    "app_cipher must match on both ends",
+                    app_cipher_name(this->client_cfg_.app_cipher));
+            }
             log_last_ssl_error("SSL_do_handshake");
             co_return false;
         }
@@ -0,0 +1,222 @@
+#include <urpc/utils/Crc32c.h>
+
+#include <array>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h>
+#define URPC_CRC32C_X86 1
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#define URPC_CRC32C_ARM 1
+#endif
+
+namespace urpc
+{
+    namespace
+    {
+        constexpr uint32_t kPoly = 0x82F63B78u; // reflected Castagnoli
+
+        using Table = std::array<std::array<uint32_t, 256>, 8>;
+
+        constexpr Table make_table()
+        {
+            Table t{};
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = (c >> 1) ^ ((c & 1u) ? kPoly : 0u);
+                t[0][i] = c;
+            }
+            for (uint32_t i = 0; i < 256; ++i)
+                for (std::size_t s = 1; s < 8; ++s)
+                    t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFFu];
+            return t;
+        }
+
+        constexpr Table kTable = make_table();
+
+        uint64_t load_le64(const uint8_t* p)
+        {
+            uint64_t v;
+            std::memcpy(&v, p, 8);
+            if constexpr (std::endian::native == std::endian::big)
+                v = std::byteswap(v);
+            return v;
+        }
+
+        uint32_t sw_update(uint32_t crc, const uint8_t* p, std::size_t n)
+        {
+            while (n >= 8)
+            {
+                const uint64_t v = load_le64(p) ^ crc;
+                crc = kTable[7][v & 0xFF] ^
+                    kTable[6][(v >> 8) & 0xFF] ^
+                    kTable[5][(v >> 16) & 0xFF] ^
+                    kTable[4][(v >> 24) & 0xFF] ^
+                    kTable[3][(v >> 32) & 0xFF] ^
+                    kTable[2][(v >> 40) & 0xFF] ^
+                    kTable[1][(v >> 48) & 0xFF] ^
+                    kTable[0][v >> 56];
+                p += 8;
+                n -= 8;
+            }
+            while (n--)
+                crc = (crc >> 8) ^ kTable[0][(crc ^ *p++) & 0xFF];
+            return crc;
+        }
+
+        uint32_t sw_copy(uint32_t crc, uint8_t* dst, const uint8_t* src,
+                         std::size_t n)
+        {
+            std::memcpy(dst, src, n);
+            return sw_update(crc, dst, n);
+        }
+
+#if URPC_CRC32C_X86
+        __attribute__((target("sse4.2")))
+        uint32_t hw_update(uint32_t crc, const uint8_t* p, std::size_t n)
+        {
+            uint64_t c = crc;
+            while (n >= 8)
+            {
+                uint64_t v;
+                std::memcpy(&v, p, 8);
+                c = _mm_crc32_u64(c, v);
+                p += 8;
+                n -= 8;
+            }
+            uint32_t c32 = static_cast<uint32_t>(c);
+            while (n--)
+                c32 = _mm_crc32_u8(c32, *p++);
+            return c32;
+        }
+
+        __attribute__((target("sse4.2")))
+        uint32_t hw_copy(uint32_t crc, uint8_t* dst, const uint8_t* src,
+                         std::size_t n)
+        {
+            uint64_t c = crc;
+            while (n >= 8)
+            {
+                uint64_t v;
+                std::memcpy(&v, src, 8);
+                std::memcpy(dst, &v, 8);
+                c = _mm_crc32_u64(c, v);
+                src += 8;
+                dst += 8;
+                n -= 8;
+            }
+            uint32_t c32 = static_cast<uint32_t>(c);
+            while (n--)
+            {
+                *dst++ = *src;
+                c32 = _mm_crc32_u8(c32, *src++);
+            }
+            return c32;
+        }
+
+        bool detect_hw()
+        {
+            return __builtin_cpu_supports("sse4.2");
+        }
+#elif URPC_CRC32C_ARM
+        __attribute__((target("+crc")))
+        uint32_t hw_update(uint32_t crc, const uint8_t* p, std::size_t n)
+        {
+            while (n >= 8)
+            {
+                uint64_t v;
+                std::memcpy(&v, p, 8);
+                crc = __crc32cd(crc, v);
+                p += 8;
+                n -= 8;
+            }
+            while (n--)
+                crc = __crc32cb(crc, *p++);
+            return crc;
+        }
+
+        __attribute__((target("+crc")))
+        uint32_t hw_copy(uint32_t crc, uint8_t* dst, const uint8_t* src,
+                         std::size_t n)
+        {
+            while (n >= 8)
+            {
+                uint64_t v;
+                std::memcpy(&v, src, 8);
+                std::memcpy(dst, &v, 8);
+                crc = __crc32cd(crc, v);
+                src += 8;
+                dst += 8;
+                n -= 8;
+            }
+            while (n--)
+            {
+                *dst++ = *src;
+                crc = __crc32cb(crc, *src++);
+            }
+            return crc;
+        }
+
+        bool detect_hw()
+        {
+#if defined(__ARM_FEATURE_CRC32)
+            return true;
+#elif defined(__linux__) && defined(HWCAP_CRC32)
+            return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+            return false;
+#endif
+        }
+#endif
+
+        struct Impl
+        {
+            uint32_t (*update)(uint32_t, const uint8_t*, std::size_t);
+            uint32_t (*copy)(uint32_t, uint8_t*, const uint8_t*, std::size_t);
+            bool hw;
+        };
+
+        Impl select_impl()
+        {
+#if URPC_CRC32C_X86 || URPC_CRC32C_ARM
+            if (detect_hw())
+                return Impl{&hw_update, &hw_copy, true};
+#endif
+            return Impl{&sw_update, &sw_copy, false};
+        }
+
+        const Impl& impl()
+        {
+            static const Impl i = select_impl();
+            return i;
+        }
+    }
+
+    uint32_t crc32c_update(uint32_t state,
+                           const uint8_t* data,
+                           std::size_t n) noexcept
+    {
+        return impl().update(state, data, n);
+    }
+
+    uint32_t crc32c_copy(uint32_t state,
+                         uint8_t* dst,
+                         const uint8_t* src,
+                         std::size_t n) noexcept
+    {
+        return impl().copy(state, dst, src, n);
+    }
+
+    bool crc32c_hw() noexcept
+    {
+        return impl().hw;
+    }
+}
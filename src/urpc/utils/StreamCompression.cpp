@@ -0,0 +1,205 @@
+#include <urpc/utils/StreamCompression.h>
+
+#include <algorithm>
+#include <array>
+
+#if URPC_ZLIB
+#include <zlib.h>
+#endif
+
+namespace urpc
+{
+    namespace
+    {
+        constexpr std::array<uint8_t, 4> kSyncTail{0x00, 0x00, 0xFF, 0xFF};
+        constexpr std::size_t kOutBlock = 16 * 1024;
+    }
+
+#if URPC_ZLIB
+    struct DeflateStream::Impl
+    {
+        z_stream zs{};
+        bool ok{false};
+    };
+
+    struct InflateStream::Impl
+    {
+        z_stream zs{};
+        bool ok{false};
+    };
+
+    DeflateStream::DeflateStream(int level, int window_bits)
+        : impl_(std::make_unique<Impl>())
+    {
+        // Negative window bits: raw deflate, no zlib header or checksum;
+        // the frame CRC / TLS already cover integrity.
+        this->impl_->ok =
+            deflateInit2(&this->impl_->zs, level, Z_DEFLATED,
+                         -std::clamp(window_bits, 9, 15), 8,
+                         Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+
+    DeflateStream::~DeflateStream()
+    {
+        if (this->impl_->ok)
+            deflateEnd(&this->impl_->zs);
+    }
+
+    bool DeflateStream::available() noexcept
+    {
+        return true;
+    }
+
+    bool DeflateStream::compress(std::span<const uint8_t> in,
+                                 std::vector<uint8_t>& out)
+    {
+        if (!this->impl_->ok)
+            return false;
+
+        z_stream& zs = this->impl_->zs;
+        out.resize(deflateBound(&zs, static_cast<uLong>(in.size())) + 16);
+
+        zs.next_in = const_cast<Bytef*>(in.data());
+        zs.avail_in = static_cast<uInt>(in.size());
+
+        std::size_t produced = 0;
+        for (;;)
+        {
+            zs.next_out = out.data() + produced;
+            zs.avail_out = static_cast<uInt>(out.size() - produced);
+
+            const int rc = deflate(&zs, Z_SYNC_FLUSH);
+            if (rc != Z_OK && rc != Z_BUF_ERROR)
+            {
+                this->impl_->ok = false;
+                return false;
+            }
+            produced = out.size() - zs.avail_out;
+
+            // Done once all input is consumed and the flush fitted.
+            if (zs.avail_in == 0 && zs.avail_out != 0)
+                break;
+            out.resize(out.size() + kOutBlock);
+        }
+
+        out.resize(produced);
+        if (out.size() >= kSyncTail.size() &&
+            std::equal(kSyncTail.begin(), kSyncTail.end(),
+                       out.end() - kSyncTail.size()))
+            out.resize(out.size() - kSyncTail.size());
+        return true;
+    }
+
+    InflateStream::InflateStream(int window_bits)
+        : impl_(std::make_unique<Impl>())
+    {
+        this->impl_->ok =
+            inflateInit2(&this->impl_->zs, -std::clamp(window_bits, 9, 15)) == Z_OK;
+    }
+
+    InflateStream::~InflateStream()
+    {
+        if (this->impl_->ok)
+            inflateEnd(&this->impl_->zs);
+    }
+
+    bool InflateStream::feed(const uint8_t* data, std::size_t n, const Sink& out)
+    {
+        if (!this->impl_->ok)
+            return false;
+
+        z_stream& zs = this->impl_->zs;
+        zs.next_in = const_cast<Bytef*>(data);
+        zs.avail_in = static_cast<uInt>(n);
+
+        std::array<uint8_t, kOutBlock> block;
+        do
+        {
+            zs.next_out = block.data();
+            zs.avail_out = static_cast<uInt>(block.size());
+
+            const int rc = inflate(&zs, Z_SYNC_FLUSH);
+            if (rc != Z_OK && rc != Z_BUF_ERROR)
+            {
+                this->impl_->ok = false;
+                return false;
+            }
+
+            const std::size_t got = block.size() - zs.avail_out;
+            this->message_bytes_ += got;
+            if (this->message_bytes_ > this->max_message_)
+            {
+                this->impl_->ok = false;
+                return false;
+            }
+            if (got > 0)
+                out(std::span<const uint8_t>{block.data(), got});
+            if (rc == Z_BUF_ERROR && got == 0)
+                break;
+        }
+        while (zs.avail_in > 0 || zs.avail_out == 0);
+
+        return true;
+    }
+#else
+    struct DeflateStream::Impl
+    {
+    };
+
+    struct InflateStream::Impl
+    {
+    };
+
+    DeflateStream::DeflateStream(int, int)
+        : impl_(std::make_unique<Impl>())
+    {
+    }
+
+    DeflateStream::~DeflateStream() = default;
+
+    bool DeflateStream::available() noexcept
+    {
+        return false;
+    }
+
+    bool DeflateStream::compress(std::span<const uint8_t>, std::vector<uint8_t>&)
+    {
+        return false;
+    }
+
+    InflateStream::InflateStream(int)
+        : impl_(std::make_unique<Impl>())
+    {
+    }
+
+    InflateStream::~InflateStream() = default;
+
+    bool InflateStream::feed(const uint8_t*, std::size_t, const Sink&)
+    {
+        return false;
+    }
+#endif
+
+    bool InflateStream::write(std::span<const uint8_t> in, const Sink& out)
+    {
+        return in.empty() || this->feed(in.data(), in.size(), out);
+    }
+
+    bool InflateStream::end_message(const Sink& out)
+    {
+        const bool ok = this->feed(kSyncTail.data(), kSyncTail.size(), out);
+        this->message_bytes_ = 0;
+        return ok;
+    }
+
+    bool InflateStream::decompress(std::span<const uint8_t> in,
+                                   std::vector<uint8_t>& out)
+    {
+        out.clear();
+        const Sink sink = [&out](std::span<const uint8_t> b)
+        {
+            out.insert(out.end(), b.begin(), b.end());
+        };
+        return this->write(in, sink) && this->end_message(sink);
+    }
+}
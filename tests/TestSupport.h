@@ -0,0 +1,123 @@
+#ifndef URPC_TESTS_TESTSUPPORT_H
+#define URPC_TESTS_TESTSUPPORT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <uvent/Uvent.h>
+#include <uvent/system/SystemContext.h>
+#include <uvent/tasks/Awaitable.h>
+
+#include <urpc/transport/IRPCStream.h>
+
+namespace urpc::test
+{
+    // Loopback stream: whatever is written is read back, in order. Frames
+    // sent with send_frame() can be read and checked by the frame readers.
+    class MemoryRpcStream final : public IRpcStream
+    {
+    public:
+        usub::uvent::task::Awaitable<ssize_t> async_read(
+            usub::uvent::utils::DynamicBuffer& buf, size_t max_read) override
+        {
+            const std::size_t n =
+                std::min(max_read, this->bytes_.size() - this->read_pos_);
+            if (n == 0)
+                co_return 0;
+            buf.append(this->bytes_.data() + this->read_pos_, n);
+            this->read_pos_ += n;
+            co_return static_cast<ssize_t>(n);
+        }
+
+        usub::uvent::task::Awaitable<ssize_t> async_write(
+            uint8_t* data, size_t len) override
+        {
+            this->bytes_.insert(this->bytes_.end(), data, data + len);
+            co_return static_cast<ssize_t>(len);
+        }
+
+        [[nodiscard]] const RpcPeerIdentity* peer_identity() const noexcept override
+        {
+            return nullptr;
+        }
+
+        [[nodiscard]] bool get_app_secret_key(
+            std::array<uint8_t, 32>&) const noexcept override
+        {
+            return false;
+        }
+
+        void shutdown() override {}
+
+        // Written and not yet read bytes, for corrupting frames in place.
+        std::vector<uint8_t>& bytes() noexcept { return this->bytes_; }
+
+    private:
+        std::vector<uint8_t> bytes_;
+        std::size_t read_pos_{0};
+    };
+
+    // Runs body on a one-thread runtime and returns once it has finished.
+    // gtest's ASSERT_* return from the enclosing function, which a
+    // coroutine cannot do: record results inside, assert on them after.
+    inline usub::uvent::task::Awaitable<void> run_and_stop(
+        usub::Uvent* uvent,
+        std::function<usub::uvent::task::Awaitable<void>()> body)
+    {
+        co_await body();
+        uvent->stop();
+        co_return;
+    }
+
+    inline void run_async(std::function<usub::uvent::task::Awaitable<void>()> body)
+    {
+        usub::Uvent uvent(1);
+        usub::uvent::system::co_spawn(run_and_stop(&uvent, std::move(body)));
+        uvent.run();
+    }
+
+    // Fresh directory under $TMPDIR (or /tmp), removed by the destructor.
+    class TempDir
+    {
+    public:
+        TempDir()
+        {
+            const char* base = std::getenv("TMPDIR");
+            std::string tmpl = std::string(base ? base : "/tmp") + "/urpc_test_XXXXXX";
+            if (::mkdtemp(tmpl.data()))
+                this->path_ = tmpl;
+        }
+
+        ~TempDir()
+        {
+            std::error_code ec;
+            if (!this->path_.empty())
+                std::filesystem::remove_all(this->path_, ec);
+        }
+
+        TempDir(const TempDir&) = delete;
+        TempDir& operator=(const TempDir&) = delete;
+
+        [[nodiscard]] const std::string& path() const noexcept { return this->path_; }
+
+    private:
+        std::string path_;
+    };
+
+    inline std::vector<uint8_t> pattern_bytes(std::size_t n, uint8_t seed = 0)
+    {
+        std::vector<uint8_t> v(n);
+        for (std::size_t i = 0; i < n; ++i)
+            v[i] = static_cast<uint8_t>((i * 31u + seed) ^ (i >> 8));
+        return v;
+    }
+}
+
+#endif // URPC_TESTS_TESTSUPPORT_H
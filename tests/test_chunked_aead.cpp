@@ -0,0 +1,207 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <utility>
+
+#include <urpc/crypto/AppCrypto.h>
+#include <urpc/crypto/CryptoPool.h>
+#include <urpc/datatypes/Frame.h>
+#include <urpc/utils/Endianness.h>
+
+#include "TestSupport.h"
+
+using namespace urpc;
+
+namespace
+{
+    constexpr uint16_t kChunkedFlags = FLAG_ENCRYPTED | FLAG_CHUNKED;
+
+    AppCipherContext make_cipher(AppCipherSuite suite)
+    {
+        AppCipherContext c;
+        for (std::size_t i = 0; i < c.key.size(); ++i)
+            c.key[i] = static_cast<uint8_t>(0xA5 ^ i);
+        c.suite = suite;
+        c.valid = true;
+        return c;
+    }
+
+    void put_u32_be(uint8_t* p, uint32_t v)
+    {
+        const uint32_t be = host_to_be<uint32_t>(v);
+        std::memcpy(p, &be, 4);
+    }
+
+    // Builds a FLAG_CHUNKED body the way RpcCryptoPool::seal lays it out:
+    // [u32 chunk_size BE] then IV | CT | TAG per chunk, AAD = [u32 i][u32 n].
+    std::vector<uint8_t> seal_chunked(const AppCipherContext& cipher,
+                                      std::span<const uint8_t> plain,
+                                      std::size_t chunk_size)
+    {
+        const std::size_t n = (plain.size() + chunk_size - 1) / chunk_size;
+        std::vector<uint8_t> out(4 + plain.size() + n * kAppSealOverhead);
+        put_u32_be(out.data(), static_cast<uint32_t>(chunk_size));
+
+        uint8_t* dst = out.data() + 4;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const std::size_t off = i * chunk_size;
+            const std::size_t len = std::min(chunk_size, plain.size() - off);
+            std::array<uint8_t, 8> aad{};
+            put_u32_be(aad.data(), static_cast<uint32_t>(i));
+            put_u32_be(aad.data() + 4, static_cast<uint32_t>(n));
+            EXPECT_TRUE(app_seal_into(cipher, plain.subspan(off, len), dst, aad));
+            dst += len + kAppSealOverhead;
+        }
+        return out;
+    }
+
+    class ChunkedAead : public ::testing::TestWithParam<AppCipherSuite>
+    {
+    };
+}
+
+TEST_P(ChunkedAead, RoundTrip)
+{
+    const auto cipher = make_cipher(GetParam());
+    const std::size_t cs = RpcCryptoPool::kMinChunkSize;
+    const auto plain = test::pattern_bytes(3 * cs + 100);
+
+    const auto sealed = seal_chunked(cipher, plain, cs);
+    std::vector<uint8_t> opened;
+    ASSERT_TRUE(RpcCryptoPool::open_inline(cipher, sealed, kChunkedFlags, opened));
+    EXPECT_EQ(opened, plain);
+}
+
+TEST_P(ChunkedAead, ExactMultipleOfChunkSize)
+{
+    const auto cipher = make_cipher(GetParam());
+    const std::size_t cs = RpcCryptoPool::kMinChunkSize;
+    const auto plain = test::pattern_bytes(2 * cs);
+
+    const auto sealed = seal_chunked(cipher, plain, cs);
+    std::vector<uint8_t> opened;
+    ASSERT_TRUE(RpcCryptoPool::open_inline(cipher, sealed, kChunkedFlags, opened));
+    EXPECT_EQ(opened, plain);
+}
+
+TEST_P(ChunkedAead, ReorderedChunksAreRejected)
+{
+    const auto cipher = make_cipher(GetParam());
+    const std::size_t cs = RpcCryptoPool::kMinChunkSize;
+    const auto plain = test::pattern_bytes(3 * cs);
+
+    auto sealed = seal_chunked(cipher, plain, cs);
+    const std::size_t full = cs + kAppSealOverhead;
+    std::swap_ranges(sealed.begin() + 4, sealed.begin() + 4 + full,
+                     sealed.begin() + 4 + full);
+
+    std::vector<uint8_t> opened;
+    EXPECT_FALSE(RpcCryptoPool::open_inline(cipher, sealed, kChunkedFlags, opened));
+}
+
+TEST_P(ChunkedAead, DroppedChunkIsRejected)
+{
+    const auto cipher = make_cipher(GetParam());
+    const std::size_t cs = RpcCryptoPool::kMinChunkSize;
+    const auto plain = test::pattern_bytes(3 * cs);
+
+    auto sealed = seal_chunked(cipher, plain, cs);
+    // The remaining chunks were sealed for n = 3, not 2.
+    sealed.resize(sealed.size() - (cs + kAppSealOverhead));
+
+    std::vector<uint8_t> opened;
+    EXPECT_FALSE(RpcCryptoPool::open_inline(cipher, sealed, kChunkedFlags, opened));
+}
+
+TEST_P(ChunkedAead, TamperedCiphertextIsRejected)
+{
+    const auto cipher = make_cipher(GetParam());
+    const std::size_t cs = RpcCryptoPool::kMinChunkSize;
+    const auto plain = test::pattern_bytes(2 * cs + 7);
+
+    auto sealed = seal_chunked(cipher, plain, cs);
+    sealed[4 + cs + kAppSealOverhead + kAppIvSize + 3] ^= 0x01;
+
+    std::vector<uint8_t> opened;
+    EXPECT_FALSE(RpcCryptoPool::open_inline(cipher, sealed, kChunkedFlags, opened));
+}
+
+TEST_P(ChunkedAead, ChunkSizeBelowMinimumIsRejected)
+{
+    const auto cipher = make_cipher(GetParam());
+    const std::size_t cs = RpcCryptoPool::kMinChunkSize / 2;
+    const auto plain = test::pattern_bytes(4 * cs);
+
+    // Correctly sealed, but a peer announcing tiny chunks is refused
+    // before any work is done.
+    const auto sealed = seal_chunked(cipher, plain, cs);
+    std::vector<uint8_t> opened;
+    EXPECT_FALSE(RpcCryptoPool::open_inline(cipher, sealed, kChunkedFlags, opened));
+}
+
+TEST_P(ChunkedAead, PoolSealOpensInlineAndOnPool)
+{
+    const auto cipher = make_cipher(GetParam());
+    const auto plain = test::pattern_bytes(5 * RpcCryptoPool::kMinChunkSize + 11);
+
+    RpcCryptoPool pool{RpcCryptoPoolConfig{
+        .threads = 2,
+        .offload_threshold = 0,
+        .chunk_size = RpcCryptoPool::kMinChunkSize,
+    }};
+
+    bool sealed_ok = false;
+    bool opened_ok = false;
+    uint16_t flags = FLAG_ENCRYPTED;
+    std::vector<uint8_t> sealed;
+    std::vector<uint8_t> opened;
+    test::run_async([&]() -> usub::uvent::task::Awaitable<void>
+    {
+        sealed_ok = co_await pool.seal(cipher, plain, sealed, flags);
+        if (sealed_ok)
+            opened_ok = co_await pool.open(cipher, sealed, flags, opened);
+        co_return;
+    });
+
+    ASSERT_TRUE(sealed_ok);
+    EXPECT_TRUE(flags & FLAG_CHUNKED);
+    ASSERT_TRUE(opened_ok);
+    EXPECT_EQ(opened, plain);
+
+    std::vector<uint8_t> inline_opened;
+    ASSERT_TRUE(RpcCryptoPool::open_inline(cipher, sealed, flags, inline_opened));
+    EXPECT_EQ(inline_opened, plain);
+}
+
+TEST(ChunkedAeadConfig, SmallConfiguredChunkSizeIsRaised)
+{
+    const auto cipher = make_cipher(AppCipherSuite::Aes256Gcm);
+    const auto plain = test::pattern_bytes(3 * RpcCryptoPool::kMinChunkSize);
+
+    RpcCryptoPool pool{RpcCryptoPoolConfig{
+        .threads = 1,
+        .offload_threshold = 0,
+        .chunk_size = 1,
+    }};
+
+    bool ok = false;
+    uint16_t flags = FLAG_ENCRYPTED;
+    std::vector<uint8_t> sealed;
+    test::run_async([&]() -> usub::uvent::task::Awaitable<void>
+    {
+        ok = co_await pool.seal(cipher, plain, sealed, flags);
+        co_return;
+    });
+
+    ASSERT_TRUE(ok);
+    ASSERT_TRUE(flags & FLAG_CHUNKED);
+    uint32_t be = 0;
+    std::memcpy(&be, sealed.data(), 4);
+    EXPECT_EQ(be_to_host<uint32_t>(be), RpcCryptoPool::kMinChunkSize);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Suites, ChunkedAead,
+    ::testing::Values(AppCipherSuite::Aes256Gcm,
+                      AppCipherSuite::ChaCha20Poly1305));
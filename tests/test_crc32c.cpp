@@ -0,0 +1,240 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string_view>
+
+#include <urpc/connection/RPCWireHelpers.h>
+#include <urpc/datatypes/Frame.h>
+#include <urpc/transport/IOOps.h>
+#include <urpc/utils/Crc32c.h>
+
+#include "TestSupport.h"
+
+using namespace urpc;
+
+namespace
+{
+    uint32_t crc_of(std::string_view s)
+    {
+        return crc32c(reinterpret_cast<const uint8_t*>(s.data()), s.size());
+    }
+
+    RpcFrameHeader request_header(uint32_t sid, std::size_t len)
+    {
+        RpcFrameHeader h{};
+        h.magic = 0x55525043;
+        h.version = 1;
+        h.type = static_cast<uint8_t>(FrameType::Request);
+        h.flags = FLAG_END_STREAM;
+        h.stream_id = sid;
+        h.method_id = 42;
+        h.length = static_cast<uint32_t>(len);
+        return h;
+    }
+
+    // Reads one frame off the stream and checks its trailer the way the
+    // connection readers do.
+    usub::uvent::task::Awaitable<bool> read_checked_frame(
+        IRpcStream& stream, bool& crc_seen, RpcFrameHeader& hdr)
+    {
+        usub::uvent::utils::DynamicBuffer head;
+        if (!co_await read_exact(stream, head, RpcFrameHeaderSize))
+            co_return false;
+        hdr = parse_header(head.data());
+
+        usub::uvent::utils::DynamicBuffer payload;
+        if (hdr.length > 0 && !co_await read_exact(stream, payload, hdr.length))
+            co_return false;
+
+        co_return co_await read_frame_crc(
+            stream, hdr, head.data(),
+            std::span<const uint8_t>{payload.data(), payload.size()},
+            crc_seen);
+    }
+}
+
+TEST(Crc32c, KnownVectors)
+{
+    // RFC 3720 appendix B.4 and the common check value.
+    EXPECT_EQ(crc_of("123456789"), 0xE3069283u);
+    EXPECT_EQ(crc_of(""), 0x00000000u);
+
+    std::vector<uint8_t> zeros(32, 0x00);
+    EXPECT_EQ(crc32c(zeros.data(), zeros.size()), 0x8A9136AAu);
+
+    std::vector<uint8_t> ones(32, 0xFF);
+    EXPECT_EQ(crc32c(ones.data(), ones.size()), 0x62A8AB43u);
+
+    std::vector<uint8_t> inc(32);
+    for (std::size_t i = 0; i < inc.size(); ++i)
+        inc[i] = static_cast<uint8_t>(i);
+    EXPECT_EQ(crc32c(inc.data(), inc.size()), 0x46DD794Eu);
+}
+
+TEST(Crc32c, IncrementalMatchesOneShot)
+{
+    const auto data = test::pattern_bytes(4099);
+    const uint32_t whole = crc32c(data.data(), data.size());
+
+    for (std::size_t split : {0u, 1u, 7u, 8u, 9u, 64u, 4098u, 4099u})
+    {
+        uint32_t st = crc32c_update(kCrc32cInit, data.data(), split);
+        st = crc32c_update(st, data.data() + split, data.size() - split);
+        EXPECT_EQ(crc32c_finish(st), whole) << "split=" << split;
+    }
+}
+
+TEST(Crc32c, CopyFoldsWhileCopying)
+{
+    const auto data = test::pattern_bytes(1000, 3);
+    std::vector<uint8_t> dst(data.size());
+
+    const uint32_t st = crc32c_copy(kCrc32cInit, dst.data(), data.data(), data.size());
+    EXPECT_EQ(dst, data);
+    EXPECT_EQ(crc32c_finish(st), crc32c(data.data(), data.size()));
+}
+
+TEST(Crc32cFraming, PingPongCarryTheOfferNotATrailer)
+{
+    RpcFrameHeader h = request_header(1, 0);
+    h.flags |= FLAG_CRC32C;
+    EXPECT_TRUE(frame_has_crc(h));
+
+    h.type = static_cast<uint8_t>(FrameType::Ping);
+    EXPECT_FALSE(frame_has_crc(h));
+    h.type = static_cast<uint8_t>(FrameType::Pong);
+    EXPECT_FALSE(frame_has_crc(h));
+}
+
+TEST(Crc32cFraming, SendFrameFollowsNegotiation)
+{
+    test::MemoryRpcStream stream;
+    const auto body = test::pattern_bytes(300);
+
+    bool sent_plain = false;
+    bool sent_crc = false;
+    test::run_async([&]() -> usub::uvent::task::Awaitable<void>
+    {
+        // Not agreed yet: the flag is cleared, no trailer is written.
+        RpcFrameHeader h = request_header(1, body.size());
+        h.flags |= FLAG_CRC32C;
+        sent_plain = co_await send_frame(stream, h, body);
+
+        stream.enable_frame_crc(true);
+        sent_crc = co_await send_frame(stream, request_header(3, body.size()), body);
+        co_return;
+    });
+
+    ASSERT_TRUE(sent_plain);
+    ASSERT_TRUE(sent_crc);
+    const std::size_t frame = RpcFrameHeaderSize + body.size();
+    ASSERT_EQ(stream.bytes().size(), 2 * frame + kFrameCrcSize);
+
+    const RpcFrameHeader first = parse_header(stream.bytes().data());
+    EXPECT_FALSE(first.flags & FLAG_CRC32C);
+    const RpcFrameHeader second = parse_header(stream.bytes().data() + frame);
+    EXPECT_TRUE(second.flags & FLAG_CRC32C);
+}
+
+TEST(Crc32cFraming, TrailerIsVerified)
+{
+    for (std::size_t size : {std::size_t{0}, std::size_t{100},
+                             kFrameCrcCoalesceLimit + 1})
+    {
+        test::MemoryRpcStream stream;
+        stream.enable_frame_crc(true);
+        const auto body = test::pattern_bytes(size);
+
+        bool ok = false;
+        bool crc_seen = false;
+        RpcFrameHeader hdr{};
+        test::run_async([&]() -> usub::uvent::task::Awaitable<void>
+        {
+            if (co_await send_frame(stream, request_header(1, size), body))
+                ok = co_await read_checked_frame(stream, crc_seen, hdr);
+            co_return;
+        });
+
+        EXPECT_TRUE(ok) << "size=" << size;
+        EXPECT_TRUE(crc_seen);
+        EXPECT_EQ(hdr.length, size);
+    }
+}
+
+TEST(Crc32cFraming, CorruptedPayloadIsRejected)
+{
+    test::MemoryRpcStream stream;
+    stream.enable_frame_crc(true);
+    const auto body = test::pattern_bytes(200);
+
+    bool ok = true;
+    bool crc_seen = false;
+    test::run_async([&]() -> usub::uvent::task::Awaitable<void>
+    {
+        co_await send_frame(stream, request_header(1, body.size()), body);
+        stream.bytes()[RpcFrameHeaderSize + 17] ^= 0x40;
+        RpcFrameHeader hdr{};
+        ok = co_await read_checked_frame(stream, crc_seen, hdr);
+        co_return;
+    });
+
+    EXPECT_FALSE(ok);
+}
+
+TEST(Crc32cFraming, MissingFlagAfterCrcSeenIsRejected)
+{
+    test::MemoryRpcStream stream;
+    const auto body = test::pattern_bytes(64);
+
+    bool first = false;
+    bool second = true;
+    test::run_async([&]() -> usub::uvent::task::Awaitable<void>
+    {
+        stream.enable_frame_crc(true);
+        co_await send_frame(stream, request_header(1, body.size()), body);
+        // A flipped flag bit must not switch the check off.
+        stream.enable_frame_crc(false);
+        co_await send_frame(stream, request_header(3, body.size()), body);
+
+        bool crc_seen = false;
+        RpcFrameHeader hdr{};
+        first = co_await read_checked_frame(stream, crc_seen, hdr);
+        second = co_await read_checked_frame(stream, crc_seen, hdr);
+        co_return;
+    });
+
+    EXPECT_TRUE(first);
+    EXPECT_FALSE(second);
+}
+
+TEST(Crc32cFraming, DiscardedBodyIsStillChecked)
+{
+    test::MemoryRpcStream stream;
+    stream.enable_frame_crc(true);
+    const auto body = test::pattern_bytes(70000);
+
+    bool intact = false;
+    bool corrupted = true;
+    test::run_async([&]() -> usub::uvent::task::Awaitable<void>
+    {
+        co_await send_frame(stream, request_header(1, body.size()), body);
+        co_await send_frame(stream, request_header(3, body.size()), body);
+        const std::size_t second =
+            RpcFrameHeaderSize + body.size() + kFrameCrcSize;
+        stream.bytes()[second + RpcFrameHeaderSize + 5] ^= 0x01;
+
+        bool crc_seen = false;
+        for (bool* out : {&intact, &corrupted})
+        {
+            usub::uvent::utils::DynamicBuffer head;
+            if (!co_await read_exact(stream, head, RpcFrameHeaderSize))
+                co_return;
+            const RpcFrameHeader hdr = parse_header(head.data());
+            *out = co_await discard_frame_body(stream, hdr, head.data(), crc_seen);
+        }
+        co_return;
+    });
+
+    EXPECT_TRUE(intact);
+    EXPECT_FALSE(corrupted);
+}
@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <urpc/connection/RPCWireHelpers.h>
+#include <urpc/datatypes/Frame.h>
+#include <urpc/transport/IOOps.h>
+#include <urpc/utils/StreamCompression.h>
+
+#include "TestSupport.h"
+
+using namespace urpc;
+
+namespace
+{
+    std::vector<uint8_t> message(int i)
+    {
+        const std::string s =
+            R"({"user":"alice","action":"update","item":)" + std::to_string(i) +
+            R"(,"tags":["red","green","blue"],"ok":true})";
+        return {s.begin(), s.end()};
+    }
+
+    RpcFrameHeader request_header(uint32_t sid, std::size_t len, uint16_t flags = 0)
+    {
+        RpcFrameHeader h{};
+        h.magic = 0x55525043;
+        h.version = 1;
+        h.type = static_cast<uint8_t>(FrameType::Request);
+        h.flags = static_cast<uint16_t>(FLAG_END_STREAM | flags);
+        h.stream_id = sid;
+        h.method_id = 7;
+        h.length = static_cast<uint32_t>(len);
+        return h;
+    }
+}
+
+TEST(DeflateStream, MessagesRoundTripInOrder)
+{
+    if (!DeflateStream::available())
+        GTEST_SKIP() << "built without zlib (URPC_WITH_ZLIB=OFF)";
+
+    DeflateStream z;
+    InflateStream u;
+    std::vector<std::size_t> sizes;
+    for (int i = 0; i < 8; ++i)
+    {
+        const auto in = message(i);
+        std::vector<uint8_t> wire;
+        ASSERT_TRUE(z.compress(in, wire));
+        sizes.push_back(wire.size());
+
+        // The sync-flush marker is stripped on the wire.
+        ASSERT_GE(wire.size(), 4u);
+        EXPECT_FALSE(wire[wire.size() - 4] == 0x00 && wire[wire.size() - 3] == 0x00 &&
+                     wire[wire.size() - 2] == 0xFF && wire[wire.size() - 1] == 0xFF);
+
+        std::vector<uint8_t> out;
+        ASSERT_TRUE(u.decompress(wire, out));
+        EXPECT_EQ(out, in);
+    }
+    // Later messages back-reference earlier ones on the same stream.
+    EXPECT_LT(sizes.back(), sizes.front());
+}
+
+TEST(DeflateStream, MessageMayBeFedInPieces)
+{
+    if (!DeflateStream::available())
+        GTEST_SKIP() << "built without zlib (URPC_WITH_ZLIB=OFF)";
+
+    DeflateStream z;
+    InflateStream u;
+    const auto in = test::pattern_bytes(10000);
+    std::vector<uint8_t> wire;
+    ASSERT_TRUE(z.compress(in, wire));
+
+    std::vector<uint8_t> out;
+    const InflateStream::Sink sink = [&out](std::span<const uint8_t> b) {
+        out.insert(out.end(), b.begin(), b.end());
+    };
+    for (std::size_t off = 0; off < wire.size(); off += 7)
+    {
+        const std::size_t n = std::min<std::size_t>(7, wire.size() - off);
+        ASSERT_TRUE(u.write({wire.data() + off, n}, sink));
+    }
+    ASSERT_TRUE(u.end_message(sink));
+    EXPECT_EQ(out, in);
+}
+
+TEST(DeflateStream, OversizedMessageIsRejected)
+{
+    if (!DeflateStream::available())
+        GTEST_SKIP() << "built without zlib (URPC_WITH_ZLIB=OFF)";
+
+    DeflateStream z;
+    InflateStream u;
+    const std::vector<uint8_t> in(64 * 1024, 'a');
+    std::vector<uint8_t> wire;
+    ASSERT_TRUE(z.compress(in, wire));
+
+    u.set_max_message(1024);
+    std::vector<uint8_t> out;
+    EXPECT_FALSE(u.decompress(wire, out));
+}
+
+TEST(DeflateFraming, SendFrameCompressesAndInflateFrameRestores)
+{
+    if (!DeflateStream::available())
+        GTEST_SKIP() << "built without zlib (URPC_WITH_ZLIB=OFF)";
+
+    test::MemoryRpcStream stream;
+    ASSERT_TRUE(stream.prepare_inflate());
+    ASSERT_TRUE(stream.enable_deflate(1));
+
+    const auto body = message(1);
+    bool sent = false;
+    bool inflated = false;
+    RpcFrameHeader hdr{};
+    std::vector<uint8_t> restored;
+    test::run_async([&]() -> usub::uvent::task::Awaitable<void>
+    {
+        sent = co_await send_frame(stream, request_header(1, body.size()), body);
+
+        usub::uvent::utils::DynamicBuffer head;
+        usub::uvent::utils::DynamicBuffer payload;
+        if (!co_await read_exact(stream, head, RpcFrameHeaderSize))
+            co_return;
+        hdr = parse_header(head.data());
+        if (!(hdr.flags & FLAG_COMPRESSED) ||
+            !co_await read_exact(stream, payload, hdr.length))
+            co_return;
+        inflated = inflate_frame(stream, hdr, payload);
+        restored.assign(payload.data(), payload.data() + payload.size());
+        co_return;
+    });
+
+    ASSERT_TRUE(sent);
+    ASSERT_TRUE(inflated);
+    EXPECT_FALSE(hdr.flags & FLAG_COMPRESSED);
+    EXPECT_EQ(hdr.length, body.size());
+    EXPECT_EQ(restored, body);
+}
+
+TEST(DeflateFraming, EncryptedAndControlFramesAreNotCompressed)
+{
+    if (!DeflateStream::available())
+        GTEST_SKIP() << "built without zlib (URPC_WITH_ZLIB=OFF)";
+
+    test::MemoryRpcStream stream;
+    ASSERT_TRUE(stream.enable_deflate(1));
+    const auto body = message(2);
+
+    test::run_async([&]() -> usub::uvent::task::Awaitable<void>
+    {
+        co_await send_frame(
+            stream, request_header(1, body.size(), FLAG_ENCRYPTED), body);
+        RpcFrameHeader ping = request_header(3, 0);
+        ping.type = static_cast<uint8_t>(FrameType::Ping);
+        co_await send_frame(stream, ping, {});
+        co_return;
+    });
+
+    ASSERT_EQ(stream.bytes().size(), 2 * RpcFrameHeaderSize + body.size());
+    const RpcFrameHeader enc = parse_header(stream.bytes().data());
+    EXPECT_FALSE(enc.flags & FLAG_COMPRESSED);
+    EXPECT_EQ(enc.length, body.size());
+    const RpcFrameHeader ping =
+        parse_header(stream.bytes().data() + RpcFrameHeaderSize + body.size());
+    EXPECT_FALSE(ping.flags & FLAG_COMPRESSED);
+}
+
+TEST(DeflateFraming, CompressedFrameWithoutAgreementIsRejected)
+{
+    test::MemoryRpcStream stream; // no prepare_inflate()
+    RpcFrameHeader hdr = request_header(1, 4, FLAG_COMPRESSED);
+    usub::uvent::utils::DynamicBuffer payload;
+    const uint8_t junk[4] = {1, 2, 3, 4};
+    payload.append(junk, sizeof(junk));
+
+    EXPECT_FALSE(inflate_frame(stream, hdr, payload));
+}
@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <urpc/server/RPCDiskCache.h>
+#include <urpc/server/RPCResponseCache.h>
+
+#include "TestSupport.h"
+
+using namespace urpc;
+
+namespace
+{
+    std::vector<uint8_t> bytes(std::string_view s)
+    {
+        return {s.begin(), s.end()};
+    }
+
+    std::vector<uint8_t> body_of(const RpcCachedResponse& r)
+    {
+        return {r.body.begin(), r.body.end()};
+    }
+
+    RpcDiskCacheConfig disk_config(const test::TempDir& dir)
+    {
+        RpcDiskCacheConfig cfg;
+        cfg.path = dir.path() + "/cache";
+        cfg.capacity_bytes = 1 << 20;
+        return cfg;
+    }
+
+    // Flips one byte of the first occurrence of needle in file.
+    bool corrupt(const std::string& file, std::string_view needle)
+    {
+        std::fstream f(file, std::ios::in | std::ios::out | std::ios::binary);
+        std::string data{std::istreambuf_iterator<char>(f), {}};
+        const auto at = data.find(needle);
+        if (at == std::string::npos)
+            return false;
+        f.clear();
+        f.seekp(static_cast<std::streamoff>(at));
+        f.put(static_cast<char>(data[at] ^ 0x5A));
+        return static_cast<bool>(f);
+    }
+
+    constexpr uint64_t kMethod = 42;
+    constexpr uint64_t kFarFuture = ~0ull >> 1;
+}
+
+TEST(DiskCache, StoredResponseIsFound)
+{
+    test::TempDir dir;
+    auto cache = RpcDiskCache::open(disk_config(dir));
+    ASSERT_TRUE(cache);
+
+    const auto req = bytes("get user 1");
+    ASSERT_TRUE(cache->put(7, kMethod, req, bytes("alice"), 0));
+
+    const auto hit = cache->get(7, kMethod, req, 1000);
+    ASSERT_TRUE(hit);
+    EXPECT_EQ(body_of(hit), bytes("alice"));
+}
+
+TEST(DiskCache, KeyCollisionWithOtherRequestMisses)
+{
+    test::TempDir dir;
+    auto cache = RpcDiskCache::open(disk_config(dir));
+    ASSERT_TRUE(cache);
+
+    ASSERT_TRUE(cache->put(7, kMethod, bytes("get user 1"), bytes("alice"), 0));
+    EXPECT_FALSE(cache->get(7, kMethod, bytes("get user 2"), 1000));
+    EXPECT_FALSE(cache->get(7, kMethod + 1, bytes("get user 1"), 1000));
+}
+
+TEST(DiskCache, ExpiredEntryMisses)
+{
+    test::TempDir dir;
+    auto cache = RpcDiskCache::open(disk_config(dir));
+    ASSERT_TRUE(cache);
+
+    const auto req = bytes("r");
+    ASSERT_TRUE(cache->put(1, kMethod, req, bytes("v"), 5000));
+    EXPECT_TRUE(cache->get(1, kMethod, req, 4999));
+    EXPECT_FALSE(cache->get(1, kMethod, req, 5000));
+}
+
+TEST(DiskCache, EntriesSurviveReopen)
+{
+    test::TempDir dir;
+    const auto req = bytes("get user 1");
+    {
+        auto cache = RpcDiskCache::open(disk_config(dir));
+        ASSERT_TRUE(cache);
+        ASSERT_TRUE(cache->put(7, kMethod, req, bytes("alice"), kFarFuture));
+        cache->flush();
+    }
+
+    auto reopened = RpcDiskCache::open(disk_config(dir));
+    ASSERT_TRUE(reopened);
+    const auto hit = reopened->get(7, kMethod, req, 1000);
+    ASSERT_TRUE(hit);
+    EXPECT_EQ(body_of(hit), bytes("alice"));
+    EXPECT_EQ(hit.expires_ms, kFarFuture);
+}
+
+TEST(DiskCache, SecondOpenOfSamePathFails)
+{
+    test::TempDir dir;
+    auto first = RpcDiskCache::open(disk_config(dir));
+    ASSERT_TRUE(first);
+    EXPECT_FALSE(RpcDiskCache::open(disk_config(dir)));
+
+    first.reset();
+    EXPECT_TRUE(RpcDiskCache::open(disk_config(dir)));
+}
+
+TEST(DiskCache, CorruptedEntryReadsAsMiss)
+{
+    test::TempDir dir;
+    const auto cfg = disk_config(dir);
+    const auto req = bytes("get user 1");
+    {
+        auto cache = RpcDiskCache::open(cfg);
+        ASSERT_TRUE(cache);
+        ASSERT_TRUE(cache->put(7, kMethod, req,
+                               bytes("response-to-be-torn"), 0));
+    }
+    ASSERT_TRUE(corrupt(cfg.path + ".dat", "response-to-be-torn"));
+
+    auto reopened = RpcDiskCache::open(cfg);
+    ASSERT_TRUE(reopened);
+    EXPECT_FALSE(reopened->get(7, kMethod, req, 1000));
+}
+
+TEST(DiskCache, OversizedResponseIsNotStored)
+{
+    test::TempDir dir;
+    auto cache = RpcDiskCache::open(disk_config(dir));
+    ASSERT_TRUE(cache);
+
+    const std::vector<uint8_t> huge(2 << 20, 'x');
+    EXPECT_FALSE(cache->put(1, kMethod, bytes("r"), huge, 0));
+    EXPECT_FALSE(cache->get(1, kMethod, bytes("r"), 1000));
+}
+
+TEST(ResponseCache, DiskHitIsPromotedToMemory)
+{
+    test::TempDir dir;
+    RpcResponseCacheConfig cfg;
+    cfg.memory_bytes = 1 << 20;
+    cfg.disk = disk_config(dir);
+    RpcResponseCache cache{cfg};
+    ASSERT_TRUE(cache.has_disk());
+    cache.cache_method(kMethod, 60000);
+
+    const auto req = bytes("get user 1");
+    EXPECT_FALSE(cache.lookup(kMethod, req));
+    EXPECT_EQ(cache.misses(), 1u);
+
+    cache.store(kMethod, req, bytes("alice"));
+    EXPECT_EQ(cache.stores(), 1u);
+    const auto stored = cache.lookup(kMethod, req);
+    ASSERT_TRUE(stored);
+    EXPECT_EQ(cache.memory_hits(), 1u);
+
+    cache.clear_memory();
+    const auto from_disk = cache.lookup(kMethod, req);
+    ASSERT_TRUE(from_disk);
+    EXPECT_EQ(body_of(from_disk), bytes("alice"));
+    EXPECT_EQ(cache.disk_hits(), 1u);
+
+    // The promoted copy keeps the expiry of the disk entry.
+    const auto promoted = cache.lookup(kMethod, req);
+    ASSERT_TRUE(promoted);
+    EXPECT_EQ(cache.memory_hits(), 2u);
+    EXPECT_EQ(promoted.expires_ms, stored.expires_ms);
+}
+
+TEST(ResponseCache, UncachedMethodIsIgnored)
+{
+    RpcResponseCacheConfig cfg;
+    cfg.memory_bytes = 1 << 20;
+    RpcResponseCache cache{cfg};
+    cache.cache_method(kMethod);
+
+    cache.store(kMethod + 1, bytes("r"), bytes("v"));
+    EXPECT_FALSE(cache.lookup(kMethod + 1, bytes("r")));
+    EXPECT_FALSE(cache.caches(kMethod + 1));
+}
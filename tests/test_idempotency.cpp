@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+
+#include <urpc/server/RPCIdempotency.h>
+
+#include "TestSupport.h"
+
+using namespace urpc;
+
+namespace
+{
+    std::vector<uint8_t> bytes(std::string_view s)
+    {
+        return {s.begin(), s.end()};
+    }
+
+    RpcIdempotencyClaim claim_sync(RpcIdempotencyTable& table,
+                                   const RpcIdempotencyKey& key,
+                                   std::span<const uint8_t> body)
+    {
+        RpcIdempotencyClaim out;
+        test::run_async([&]() -> usub::uvent::task::Awaitable<void>
+        {
+            out = co_await table.claim(key, body);
+            co_return;
+        });
+        return out;
+    }
+}
+
+TEST(Idempotency, CompletedCallIsReplayed)
+{
+    RpcIdempotencyTable table;
+    const RpcIdempotencyKey key{.scope = 1, .method_id = 10, .key = 99};
+    const auto body = bytes("transfer 100");
+
+    const auto first = claim_sync(table, key, body);
+    ASSERT_EQ(first.outcome, RpcIdempotencyOutcome::Run);
+    ASSERT_TRUE(first.tracked);
+    table.complete(key, bytes("receipt-1"));
+
+    const auto retry = claim_sync(table, key, body);
+    ASSERT_EQ(retry.outcome, RpcIdempotencyOutcome::Replay);
+    ASSERT_TRUE(retry.response);
+    EXPECT_EQ(*retry.response, bytes("receipt-1"));
+    EXPECT_EQ(table.replays(), 1u);
+}
+
+TEST(Idempotency, ReusedKeyWithOtherBodyConflicts)
+{
+    RpcIdempotencyTable table;
+    const RpcIdempotencyKey key{.scope = 1, .method_id = 10, .key = 5};
+
+    ASSERT_EQ(claim_sync(table, key, bytes("a")).outcome, RpcIdempotencyOutcome::Run);
+    table.complete(key, bytes("ok"));
+
+    EXPECT_EQ(claim_sync(table, key, bytes("b")).outcome,
+              RpcIdempotencyOutcome::Conflict);
+    EXPECT_EQ(table.conflicts(), 1u);
+}
+
+TEST(Idempotency, KeysAreScopedByCallerAndMethod)
+{
+    RpcIdempotencyTable table;
+    const auto body = bytes("x");
+    const RpcIdempotencyKey key{.scope = 1, .method_id = 10, .key = 5};
+
+    ASSERT_EQ(claim_sync(table, key, body).outcome, RpcIdempotencyOutcome::Run);
+    table.complete(key, bytes("mine"));
+
+    RpcIdempotencyKey other_caller = key;
+    other_caller.scope = 2;
+    EXPECT_EQ(claim_sync(table, other_caller, body).outcome,
+              RpcIdempotencyOutcome::Run);
+
+    RpcIdempotencyKey other_method = key;
+    other_method.method_id = 11;
+    EXPECT_EQ(claim_sync(table, other_method, body).outcome,
+              RpcIdempotencyOutcome::Run);
+}
+
+TEST(Idempotency, AbandonedRunLetsTheRetryRun)
+{
+    RpcIdempotencyTable table;
+    const RpcIdempotencyKey key{.scope = 1, .method_id = 10, .key = 6};
+    const auto body = bytes("x");
+
+    ASSERT_EQ(claim_sync(table, key, body).outcome, RpcIdempotencyOutcome::Run);
+    table.abandon(key);
+    EXPECT_EQ(claim_sync(table, key, body).outcome, RpcIdempotencyOutcome::Run);
+}
+
+TEST(Idempotency, RunGuardAbandonsUnlessCompleted)
+{
+    RpcIdempotencyTable table;
+    const RpcIdempotencyKey key{.scope = 1, .method_id = 10, .key = 7};
+    const auto body = bytes("x");
+
+    ASSERT_TRUE(claim_sync(table, key, body).tracked);
+    {
+        RpcIdempotencyRun run{&table, key}; // handler "threw"
+    }
+    EXPECT_EQ(claim_sync(table, key, body).outcome, RpcIdempotencyOutcome::Run);
+
+    {
+        RpcIdempotencyRun run{&table, key};
+        run.complete(bytes("done"));
+    }
+    EXPECT_EQ(claim_sync(table, key, body).outcome, RpcIdempotencyOutcome::Replay);
+}
+
+TEST(Idempotency, RetryOfRunningCallTimesOut)
+{
+    RpcIdempotencyTable table{RpcIdempotencyConfig{
+        .max_entries = 16,
+        .max_bytes = 1 << 20,
+        .ttl_ms = 60000,
+        .wait_timeout_ms = 20,
+    }};
+    const RpcIdempotencyKey key{.scope = 1, .method_id = 10, .key = 8};
+    const auto body = bytes("x");
+
+    ASSERT_EQ(claim_sync(table, key, body).outcome, RpcIdempotencyOutcome::Run);
+    EXPECT_EQ(claim_sync(table, key, body).outcome,
+              RpcIdempotencyOutcome::InProgress);
+}
+
+TEST(Idempotency, RetryWaitsForRunningCall)
+{
+    RpcIdempotencyTable table;
+    const RpcIdempotencyKey key{.scope = 1, .method_id = 10, .key = 9};
+    const auto body = bytes("x");
+
+    RpcIdempotencyClaim first;
+    RpcIdempotencyClaim retry;
+    test::run_async([&]() -> usub::uvent::task::Awaitable<void>
+    {
+        first = co_await table.claim(key, body);
+        usub::uvent::system::co_spawn(
+            [](RpcIdempotencyTable* t, RpcIdempotencyKey k)
+                -> usub::uvent::task::Awaitable<void>
+            {
+                using namespace std::chrono_literals;
+                co_await usub::uvent::system::this_coroutine::sleep_for(10ms);
+                const std::vector<uint8_t> resp{'r'};
+                t->complete(k, resp);
+                co_return;
+            }(&table, key));
+        retry = co_await table.claim(key, body);
+        co_return;
+    });
+
+    EXPECT_EQ(first.outcome, RpcIdempotencyOutcome::Run);
+    ASSERT_EQ(retry.outcome, RpcIdempotencyOutcome::Replay);
+    EXPECT_EQ(*retry.response, std::vector<uint8_t>{'r'});
+}
+
+TEST(Idempotency, ProxyRekeyingIsStableAndScoped)
+{
+    EXPECT_EQ(scoped_idempotency_key(1, 42), scoped_idempotency_key(1, 42));
+    EXPECT_NE(scoped_idempotency_key(1, 42), scoped_idempotency_key(2, 42));
+    EXPECT_NE(scoped_idempotency_key(1, 42), scoped_idempotency_key(1, 43));
+    EXPECT_NE(scoped_idempotency_key(0, 0), 0u);
+}
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <urpc/server/RPCMemoryBudget.h>
+
+using namespace urpc;
+
+namespace
+{
+    RpcMemoryBudgetConfig limits(std::size_t soft, std::size_t hard)
+    {
+        RpcMemoryBudgetConfig cfg;
+        cfg.soft_limit_bytes = soft;
+        cfg.hard_limit_bytes = hard;
+        cfg.large_request_bytes = 1000;
+        return cfg;
+    }
+}
+
+TEST(MemoryBudget, ChargesAreReleasedOnDestruction)
+{
+    RpcMemoryBudget budget{limits(0, 0)};
+    int a = 0;
+    {
+        auto c1 = budget.charge(&a, 100);
+        auto c2 = budget.charge(&a, 50);
+        EXPECT_EQ(budget.used(), 150u);
+        c2.reset();
+        EXPECT_EQ(budget.used(), 100u);
+        EXPECT_EQ(c2.bytes(), 0u);
+    }
+    EXPECT_EQ(budget.used(), 0u);
+    EXPECT_EQ(budget.peak(), 150u);
+}
+
+TEST(MemoryBudget, MoveAndMergeKeepOneRelease)
+{
+    RpcMemoryBudget budget{limits(0, 0)};
+    int a = 0;
+    {
+        auto c1 = budget.charge(&a, 10);
+        RpcMemoryCharge moved = std::move(c1);
+        EXPECT_EQ(moved.bytes(), 10u);
+
+        auto c2 = budget.charge(&a, 5);
+        moved.merge(std::move(c2));
+        EXPECT_EQ(moved.bytes(), 15u);
+        EXPECT_EQ(c2.bytes(), 0u);
+        EXPECT_EQ(budget.used(), 15u);
+    }
+    EXPECT_EQ(budget.used(), 0u);
+}
+
+TEST(MemoryBudget, HardLimitRejectsOnlyLargeRequests)
+{
+    RpcMemoryBudget budget{limits(0, 4000)};
+    int a = 0;
+    EXPECT_TRUE(budget.admit(4000));
+    EXPECT_FALSE(budget.admit(4001));
+
+    auto held = budget.charge(&a, 3500);
+    EXPECT_TRUE(budget.admit(500));
+    EXPECT_FALSE(budget.admit(1000));
+    // Small requests are never turned away: they are what drains the budget.
+    EXPECT_TRUE(budget.admit(999));
+
+    RpcMemoryBudget unlimited{limits(0, 0)};
+    EXPECT_TRUE(unlimited.admit(1ull << 40));
+}
+
+TEST(MemoryBudget, SoftLimitPausesTheHeaviestOwner)
+{
+    RpcMemoryBudget budget{limits(1000, 10000)};
+    int heavy = 0;
+    int light = 0;
+    auto h = budget.charge(&heavy, 900);
+    auto l = budget.charge(&light, 50);
+
+    EXPECT_FALSE(budget.should_pause(&heavy, 50)); // still under soft
+    EXPECT_TRUE(budget.should_pause(&heavy, 100));
+    EXPECT_FALSE(budget.should_pause(&light, 100));
+
+    h.reset();
+    EXPECT_FALSE(budget.should_pause(&heavy, 100));
+}
+
+TEST(MemoryBudget, IdleOwnerIsNotPausedWhenNothingIsHeld)
+{
+    RpcMemoryBudget budget{limits(100, 1000)};
+    int a = 0;
+    EXPECT_FALSE(budget.should_pause(&a, 500));
+
+    RpcMemoryBudget off{limits(0, 1000)};
+    auto c = off.charge(&a, 900);
+    EXPECT_FALSE(off.should_pause(&a, 500));
+}
+
+TEST(MemoryBudget, SoftLimitIsClampedToHardLimit)
+{
+    RpcMemoryBudget budget{limits(5000, 1000)};
+    EXPECT_EQ(budget.config().soft_limit_bytes, 1000u);
+}